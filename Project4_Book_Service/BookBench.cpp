@@ -0,0 +1,2402 @@
+#include "BookServer.h"
+
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <iomanip>
+
+#ifdef _WIN32
+#include <malloc.h>
+#define getBlockSize _msize
+#elif defined(__linux__)
+#include <malloc.h>
+#define getBlockSize malloc_usable_size
+#endif
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// 프로그램 전체의 힙 할당 횟수. 대여/반납을 반복할 때 할당이 없는지 확인할 때 씀
+atomic<size_t> heapAllocationCount{ 0 };
+// 지금 살아 있는 힙 블록의 바이트 수(malloc이 실제로 잡은 크기). 색인의
+// 메모리 사용량을 잴 때 씀. 블록 크기를 알 수 없는 플랫폼에서는 0
+atomic<size_t> heapLiveBytes{ 0 };
+
+size_t getHeapAllocationCount() {
+    return heapAllocationCount.load(memory_order_relaxed);
+}
+
+size_t getHeapLiveBytes() {
+    return heapLiveBytes.load(memory_order_relaxed);
+}
+
+void* operator new(size_t size) {
+    heapAllocationCount.fetch_add(1, memory_order_relaxed);
+    if (void* block = malloc(size > 0 ? size : 1)) {
+#ifdef getBlockSize
+        heapLiveBytes.fetch_add(getBlockSize(block), memory_order_relaxed);
+#endif
+        return block;
+    }
+    throw bad_alloc();
+}
+
+// 표준 라이브러리의 임시 버퍼 등이 쓰는 나머지 형태도 같은 곳으로 보내
+// 할당과 해제의 짝을 맞춤
+void* operator new[](size_t size) {
+    return ::operator new(size);
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept {
+    try {
+        return ::operator new(size);
+    }
+    catch (const bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t size, const nothrow_t&) noexcept {
+    return ::operator new(size, nothrow);
+}
+
+void releaseBlock(void* block) {
+#ifdef getBlockSize
+    if (block) {
+        heapLiveBytes.fetch_sub(getBlockSize(block), memory_order_relaxed);
+    }
+#endif
+    free(block);
+}
+
+// 위의 operator new와 짝이지만 GCC는 인라인된 자리에서 new 식과 free를
+// 짝지어 경고하므로 여기서만 끔
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* block) noexcept {
+    releaseBlock(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+    releaseBlock(block);
+}
+
+void operator delete[](void* block) noexcept {
+    releaseBlock(block);
+}
+
+void operator delete[](void* block, size_t) noexcept {
+    releaseBlock(block);
+}
+
+void operator delete(void* block, const nothrow_t&) noexcept {
+    releaseBlock(block);
+}
+
+void operator delete[](void* block, const nothrow_t&) noexcept {
+    releaseBlock(block);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+// 여러 스레드가 적은 수의 책을 두고 동시에 대여/반납/조회/추가를 반복한 뒤
+// 한 책이 두 번 대여되거나 대여/반납이 사라진 경우가 없는지 확인.
+// 문제가 없으면 0을 돌려줌
+int runRentalStressTest(int threadCount, int iterations) {
+    constexpr int TITLE_COUNT = 8;
+    constexpr int COPY_COUNT = 4;
+    // 대여자 한 명을 여러 스레드가 같이 써서 한도 검사도 동시에 일어나게 함
+    constexpr int BORROWER_COUNT = 4;
+    constexpr uint32_t LOAN_LIMIT = 16;
+
+    // 작은 버퍼를 BLOCK으로 써서 여러 스레드가 버퍼가 찬 채로 이벤트를 넣게 함
+    constexpr size_t EVENT_CAPACITY = 256;
+
+    string eventPath = (filesystem::temp_directory_path()
+        / "book_service_stress.events").string();
+    filesystem::remove(eventPath);
+    auto eventLog = make_shared<EventLog>(eventPath, EventLevel::DEBUG,
+        OverflowPolicy::BLOCK, EVENT_CAPACITY);
+
+    auto stringPool = make_shared<StringPool>();
+    BookManager bookManager(stringPool);
+    RentalManager rentalManager(stringPool);
+    bookManager.attachEventLog(eventLog);
+    rentalManager.attachEventLog(eventLog);
+    rentalManager.setLoanLimit(LOAN_LIMIT);
+    for (int title = 0; title < TITLE_COUNT; title++) {
+        for (int copy = 0; copy < COPY_COUNT; copy++) {
+            bookManager.registerBook("책" + to_string(title), "작가");
+        }
+    }
+
+    // 대여/반납은 성공이든 실패든, 책 추가는 한 권마다 이벤트 하나
+    atomic<long long> eventCount{ TITLE_COUNT * COPY_COUNT };
+    atomic<long long> rentCount{ 0 };
+    atomic<long long> returnCount{ 0 };
+    atomic<int> addedCount{ 0 };
+    vector<thread> workers;
+    for (int t = 0; t < threadCount; t++) {
+        workers.emplace_back([&, t]() {
+            mt19937 random(t + 1);
+            string borrower = "대여자" + to_string(t % BORROWER_COUNT);
+            RentalDTO rentalDTO(borrower, "010", DateStruct(2025, 1, 1 + t % 28));
+            long long rents = 0;
+            long long returns = 0;
+            long long events = 0;
+
+            for (int i = 0; i < iterations; i++) {
+                int bookCount = TITLE_COUNT * COPY_COUNT + addedCount.load();
+                int bookId = static_cast<int>(random() % bookCount) + 1;
+                string title = "책" + to_string(random() % TITLE_COUNT);
+
+                switch (random() % 8) {
+                case 0:
+                case 1:
+                    rents += rentalManager.rentById(bookId, rentalDTO,
+                        bookManager) == RentalStatus::SUCCESS;
+                    events++;
+                    break;
+                case 2:
+                case 3:
+                    rents += rentalManager.rentByTitle(title, rentalDTO,
+                        bookManager) == RentalStatus::SUCCESS;
+                    events++;
+                    break;
+                case 4:
+                case 5:
+                    returns += rentalManager.returnById(bookId, bookManager)
+                        == RentalStatus::SUCCESS;
+                    events++;
+                    break;
+                case 6:
+                    bookManager.getBooksByTitle(title);
+                    rentalManager.getRentalsByBorrower(borrower);
+                    break;
+                case 7:
+                    if (random() % 64 == 0) {
+                        bookManager.registerBook(title, "작가");
+                        addedCount++;
+                        events++;
+                    }
+                    else {
+                        bookManager.forEachBook([](const BookView&) {});
+                    }
+                    break;
+                }
+            }
+            rentCount += rents;
+            returnCount += returns;
+            eventCount += events;
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    // 거절된 대여는 처음 보는 대여자를 대여자 표에 남기지 않아야 함
+    int checkedBookId = bookManager.registerBook("확인용 책", "작가");
+    RentalDTO ownerDTO("확인용 대여자", "010", DateStruct(2025, 1, 1));
+    rentCount += rentalManager.rentById(checkedBookId, ownerDTO, bookManager)
+        == RentalStatus::SUCCESS;
+    size_t borrowerCount = rentalManager.getBorrowerCount();
+    RentalDTO strangerDTO("처음 보는 대여자", "011", DateStruct(2025, 1, 1));
+    bool isRejectedCleanly =
+        rentalManager.rentById(checkedBookId, strangerDTO, bookManager)
+        == RentalStatus::ALREADY_RENTED &&
+        rentalManager.rentById(checkedBookId + 1000, strangerDTO, bookManager)
+        == RentalStatus::NO_SUCH_BOOK &&
+        rentalManager.rentByTitle("확인용 책", strangerDTO, bookManager)
+        == RentalStatus::NO_AVAILABLE_COPY &&
+        rentalManager.getBorrowerCount() == borrowerCount &&
+        !rentalManager.findBorrower("처음 보는 대여자", "011");
+    addedCount++;
+    eventCount += 5;
+    eventLog->flush();
+
+    // 저장소의 대여 칸, 대여 목록, 대여/반납 횟수가 서로 맞는지 확인
+    size_t rentedBooks = 0;
+    bookManager.forEachBook([&rentedBooks](const BookView& book) {
+        rentedBooks += book.returnDate ? 1 : 0;
+        });
+
+    // 대여자마다의 대여 수와 목록도 대여 목록과 맞고 한도를 넘지 않아야 함
+    size_t borrowerRentals = 0;
+    size_t mismatchedBorrowers = 0;
+    for (BorrowerId id = 0; id < rentalManager.getBorrowerCount(); id++) {
+        const Borrower& borrower = rentalManager.getBorrower(id);
+        borrowerRentals += borrower.rentals.size();
+        mismatchedBorrowers += borrower.rentals.size()
+            != borrower.activeRentalCount.load()
+            || borrower.rentals.size() > LOAN_LIMIT;
+    }
+
+    vector<bool> isSeen(bookManager.getAllBooks().size() + 1, false);
+    size_t mismatchedRentals = 0;
+    rentalManager.forEachRental([&](const RentalInfo& rental) {
+        bool isOwner = bookManager.getRentalInfo(rental.bookId).get() == &rental;
+        if (!isOwner || isSeen[rental.bookId]) {
+            mismatchedRentals++;
+        }
+        isSeen[rental.bookId] = true;
+        });
+
+    long long expectedRentals = rentCount - returnCount;
+    size_t rentalCount = rentalManager.getRentalCount();
+    bool isPassed = mismatchedRentals == 0 &&
+        expectedRentals == static_cast<long long>(rentalCount) &&
+        rentedBooks == rentalCount && borrowerRentals == rentalCount &&
+        mismatchedBorrowers == 0 && isRejectedCleanly &&
+        eventLog->getWrittenCount() == static_cast<size_t>(eventCount.load()) &&
+        eventLog->getDroppedCount() == 0;
+
+    cout << "----동시성 검사----" << endl;
+    cout << "스레드: " << threadCount << ", 스레드당 반복: " << iterations
+        << endl;
+    cout << "대여 성공: " << rentCount << ", 반납 성공: " << returnCount
+        << ", 추가된 책: " << addedCount << endl;
+    cout << "대여 목록: " << rentalCount << ", 대여중인 책: " << rentedBooks
+        << ", 어긋난 대여정보: " << mismatchedRentals << ", 어긋난 대여자: "
+        << mismatchedBorrowers << endl;
+    cout << "거절된 대여의 대여자 등록: "
+        << (isRejectedCleanly ? "없음" : "있음") << endl;
+    cout << "이벤트: " << eventCount << "건 중 기록 "
+        << eventLog->getWrittenCount() << "건, 버림 "
+        << eventLog->getDroppedCount() << "건" << endl;
+    cout << (isPassed ? "통과" : "실패") << endl;
+    bookManager.attachEventLog(nullptr);
+    rentalManager.attachEventLog(nullptr);
+    eventLog.reset();
+    filesystem::remove(eventPath);
+
+    return isPassed ? 0 : 1;
+}
+
+// 책 추가/대여/반납 이벤트 eventCount개로 로그를 만든 뒤 다시 적용하는 시간을 잼.
+// 앞의 1/10은 책 추가, 나머지는 대여와 반납을 번갈아 기록
+int runRecoveryBenchmark(size_t eventCount) {
+    string path = (filesystem::temp_directory_path() / "book_service_bench.wal")
+        .string();
+    filesystem::remove(path);
+
+    size_t bookCount = max<size_t>(eventCount / 10, 1);
+    size_t expectedRentals = 0;
+    // 되살린 대여가 기록된 대여일을 그대로 갖는지 봄
+    auto rentDateOf = [](int bookId) {
+        return DateStruct(2024, 12, 1 + bookId % 28);
+    };
+    auto writeStart = chrono::steady_clock::now();
+    {
+        MutationLog log(path, DurabilityMode::ASYNC);
+        if (!log.isOpen()) {
+            cout << "로그 파일을 열 수 없음: " << path << endl;
+            return 1;
+        }
+
+        mt19937 random(1);
+        vector<bool> isRented(bookCount + 1, false);
+        for (size_t i = 0; i < bookCount; i++) {
+            log.appendAddBook("책" + to_string(i % 100000),
+                "작가" + to_string(i % 5000));
+        }
+        for (size_t i = bookCount; i < eventCount; i++) {
+            int bookId = static_cast<int>(random() % bookCount) + 1;
+            if (isRented[bookId]) {
+                log.appendReturn(bookId);
+                expectedRentals--;
+            }
+            else {
+                log.appendRent(bookId, "대여자" + to_string(bookId % 1000),
+                    "01012345678", rentDateOf(bookId),
+                    DateStruct(2025, 1, 1 + bookId % 28));
+                expectedRentals++;
+            }
+            isRented[bookId] = !isRented[bookId];
+        }
+    }
+    chrono::duration<double> writeSeconds =
+        chrono::steady_clock::now() - writeStart;
+
+    auto stringPool = make_shared<StringPool>();
+    BookManager bookManager(stringPool);
+    RentalManager rentalManager(stringPool);
+    ReplayReport report = MutationLog::replay(path, bookManager, rentalManager);
+
+    bool isPassed = report.events == eventCount
+        && rentalManager.getRentalCount() == expectedRentals
+        && ranges::all_of(rentalManager.getAllRentals(),
+            [&](const shared_ptr<RentalInfo>& rental) {
+                return rental->getRentDate() == rentDateOf(rental->bookId);
+            });
+
+    cout << "----복구 성능----" << endl;
+    cout << "로그 크기: " << filesystem::file_size(path) << "바이트, 기록: "
+        << writeSeconds.count() << "초" << endl;
+    cout << "적용: " << report.events << "건, " << report.seconds << "초 ("
+        << static_cast<size_t>(report.getEventsPerSecond()) << " events/s)"
+        << endl;
+    cout << "책: " << bookCount << "권, 대여 목록: "
+        << rentalManager.getRentalCount() << endl;
+    cout << (isPassed ? "통과" : "실패") << endl;
+
+    filesystem::remove(path);
+    return isPassed ? 0 : 1;
+}
+
+// 책 bookCount권과 그중 1/10의 대여로 스냅샷을 만든 뒤, 다시 등록할 때와
+// 스냅샷을 불러올 때의 시간을 비교
+int runSnapshotBenchmark(size_t bookCount) {
+    string path = (filesystem::temp_directory_path() / "book_service_bench.snap")
+        .string();
+
+    auto buildStart = chrono::steady_clock::now();
+    auto stringPool = make_shared<StringPool>();
+    BookManager bookManager(stringPool);
+    RentalManager rentalManager(stringPool);
+    vector<pair<string, string>> rows;
+    for (size_t i = 0; i < bookCount; i++) {
+        rows.emplace_back("책" + to_string(i % (bookCount / 10 + 1)),
+            "작가" + to_string(i % 5000));
+    }
+    bookManager.addBooks(rows);
+    // 불러온 쪽의 오늘과 달라야 대여일이 저장되는지 보임
+    const DateStruct rentDate(2024, 12, 1);
+    rentalManager.setCurrentDate(rentDate);
+    for (size_t i = 0; i < bookCount; i += 10) {
+        string borrower = "대여자" + to_string(i % 1000);
+        rentalManager.rentById(static_cast<int>(i + 1),
+            RentalDTO(borrower, "01012345678", DateStruct(2025, 1, 1 + i % 28)),
+            bookManager);
+    }
+    chrono::duration<double> buildSeconds =
+        chrono::steady_clock::now() - buildStart;
+
+    auto writeStart = chrono::steady_clock::now();
+    if (!CatalogSnapshot::write(path, bookManager, rentalManager, 0)) {
+        cout << "스냅샷을 쓸 수 없음: " << path << endl;
+        return 1;
+    }
+    chrono::duration<double> writeSeconds =
+        chrono::steady_clock::now() - writeStart;
+
+    auto loadStart = chrono::steady_clock::now();
+    auto snapshot = CatalogSnapshot::open(path);
+    if (!snapshot) {
+        cout << "스냅샷을 읽을 수 없음: " << path << endl;
+        return 1;
+    }
+    chrono::duration<double> openSeconds =
+        chrono::steady_clock::now() - loadStart;
+    auto loadedPool = make_shared<StringPool>(snapshot);
+    BookManager loadedBooks(loadedPool);
+    RentalManager loadedRentals(loadedPool);
+    bool isLoaded = loadedBooks.loadSnapshot(snapshot)
+        && loadedRentals.loadSnapshot(*snapshot, loadedBooks);
+    chrono::duration<double> loadSeconds =
+        chrono::steady_clock::now() - loadStart;
+
+    // 스냅샷을 바로 조회한 결과와 불러온 BookManager의 결과가 같은지 확인
+    bool isPassed = isLoaded
+        && loadedBooks.getBookCount() == bookManager.getBookCount()
+        && loadedRentals.getRentalCount() == rentalManager.getRentalCount()
+        && snapshot->findBooksByTitle("책1").size()
+        == loadedBooks.getBookIdsByTitle("책1").size()
+        && snapshot->findRentalsByBorrower("대여자10").size()
+        == rentalManager.getRentalsByBorrower("대여자10").size()
+        && loadedBooks.searchBooks("책1", SearchMode::PREFIX, nullopt, 0, 10)
+        .totalCount == bookManager.searchBooks("책1", SearchMode::PREFIX,
+            nullopt, 0, 10).totalCount
+        && loadedRentals.getBorrowerCount() == rentalManager.getBorrowerCount()
+        && ranges::all_of(loadedRentals.getAllRentals(),
+            [&](const shared_ptr<RentalInfo>& rental) {
+                return rental->getRentDate() == rentDate;
+            });
+
+    // 망가진 스냅샷은 모두 open에서 거절해야 함. 체크섬을 다시 맞춘 경우는
+    // 쓴 쪽의 버그를 흉내 내어 범위 검사만으로 잡히는지 봄.
+    // 헤더 배치: magic 8, version 4, sectionCount 4, walOffset 8, checksum 4,
+    // reserved 4, 그 뒤 구간마다 (offset u64, size u64)
+    constexpr size_t CHECKSUM_POSITION = 24;
+    constexpr size_t SECTIONS_POSITION = 32;
+    constexpr size_t HEADER_SIZE = SECTIONS_POSITION + 13 * 16;
+    enum {
+        SORTED_STRINGS = 2, BOOK_TITLES = 3, RENTALS = 5, TITLE_KEYS = 6,
+        DUE_RENTALS = 12
+    };
+
+    string original;
+    {
+        ifstream file(path, ios::binary);
+        original.assign(istreambuf_iterator<char>(file),
+            istreambuf_iterator<char>());
+    }
+    auto sectionOffset = [&original](int section) {
+        uint64_t offset;
+        memcpy(&offset, original.data() + SECTIONS_POSITION + section * 16,
+            sizeof(offset));
+        return static_cast<size_t>(offset);
+    };
+    auto writeU32 = [](string& bytes, size_t position, uint32_t value) {
+        memcpy(bytes.data() + position, &value, sizeof(value));
+    };
+    // 구간의 처음 두 원소를 바꿔 정렬 순서만 깨뜨림
+    auto swapFirstTwo = [&](int section, size_t elementSize) {
+        return [=, &sectionOffset](string& bytes) {
+            char* first = bytes.data() + sectionOffset(section);
+            swap_ranges(first, first + elementSize, first + elementSize);
+        };
+    };
+    string badPath = path + ".bad";
+    size_t rejectedCount = 0;
+    auto isRejected = [&](auto corrupt, bool isResigned) {
+        string bytes = original;
+        corrupt(bytes);
+        if (isResigned) {
+            writeU32(bytes, CHECKSUM_POSITION, 0);
+            uint32_t checksum = crc32(0, string_view(bytes).substr(0,
+                HEADER_SIZE));
+            writeU32(bytes, CHECKSUM_POSITION, crc32(checksum,
+                string_view(bytes).substr(HEADER_SIZE)));
+        }
+        {
+            ofstream file(badPath, ios::binary | ios::trunc);
+            file.write(bytes.data(), bytes.size());
+        }
+        bool isNull = CatalogSnapshot::open(badPath) == nullptr;
+        rejectedCount += isNull;
+        return isNull;
+    };
+    auto setTitleId = [&](string& bytes) {
+        writeU32(bytes, sectionOffset(BOOK_TITLES), 0xFFFF);
+    };
+    bool isCorruptionRejected =
+        isRejected([](string& bytes) { bytes.pop_back(); }, false)
+        && isRejected(setTitleId, false)
+        && isRejected(setTitleId, true)
+        && isRejected([&](string& bytes) {
+            // 첫 대여의 책번호를 목록 밖으로
+            writeU32(bytes, sectionOffset(RENTALS),
+                static_cast<uint32_t>(bookCount + 1));
+        }, true)
+        && isRejected([&](string& bytes) {
+            // 첫 제목 묶음의 count
+            writeU32(bytes, sectionOffset(TITLE_KEYS) + 8, UINT32_MAX);
+        }, true)
+        && isRejected([&](string& bytes) {
+            writeU32(bytes, sectionOffset(DUE_RENTALS), UINT32_MAX);
+        }, true)
+        && isRejected(swapFirstTwo(SORTED_STRINGS, 4), true)
+        && isRejected(swapFirstTwo(TITLE_KEYS, 12), true)
+        && isRejected(swapFirstTwo(DUE_RENTALS, 4), true);
+    // 고치지 않고 다시 맞춘 체크섬은 통과해야 함
+    bool isResignedAccepted = !isRejected([](string&) {}, true);
+    isPassed = isPassed && isCorruptionRejected && isResignedAccepted;
+    filesystem::remove(badPath);
+
+    cout << "----스냅샷 성능----" << endl;
+    cout << "책: " << bookCount << "권, 대여: "
+        << rentalManager.getRentalCount() << "건, 파일: "
+        << filesystem::file_size(path) << "바이트" << endl;
+    cout << "다시 등록: " << buildSeconds.count() << "초, 저장: "
+        << writeSeconds.count() << "초" << endl;
+    cout << "열기: " << openSeconds.count() << "초, 불러오기까지: "
+        << loadSeconds.count() << "초" << endl;
+    cout << "망가진 스냅샷 거절: " << rejectedCount << "/9"
+        << (isResignedAccepted ? "" : ", 멀쩡한 파일도 거절") << endl;
+    cout << (isPassed ? "통과" : "실패") << endl;
+
+    snapshot.reset();
+    filesystem::remove(path);
+    return isPassed ? 0 : 1;
+}
+
+// 대여 rentalCount건의 반납일을 1년에 고루 나눈 뒤, 매일 밤 연체 수를
+// 세고 첫 페이지를 읽는 작업을 1년치 반복하는 시간을 잼.
+// 페이지 사이에 반납이 일어나도 빠지거나 겹치는 대여정보가 없는지도 확인
+int runDelayedRentalBenchmark(size_t rentalCount) {
+    constexpr int DAY_COUNT = 365;
+    constexpr size_t PAGE_SIZE = 100;
+
+    auto stringPool = make_shared<StringPool>();
+    BookManager bookManager(stringPool);
+    RentalManager rentalManager(stringPool);
+    vector<pair<string, string>> rows;
+    for (size_t i = 0; i < rentalCount; i++) {
+        rows.emplace_back("책" + to_string(i % 1000), "작가");
+    }
+    bookManager.addBooks(rows);
+
+    DateStruct firstDate(2025, 1, 1);
+    mt19937 random(1);
+    for (size_t i = 0; i < rentalCount; i++) {
+        auto returnDate = DateStruct::fromDayNumber(
+            firstDate.dayNumber + static_cast<int32_t>(random() % DAY_COUNT));
+        rentalManager.rentById(static_cast<int>(i + 1),
+            RentalDTO("대여자", "010", returnDate), bookManager);
+    }
+
+    auto sweepStart = chrono::steady_clock::now();
+    size_t pagedRentals = 0;
+    for (int day = 0; day < DAY_COUNT; day++) {
+        auto today = DateStruct::fromDayNumber(firstDate.dayNumber + day);
+        rentalManager.countDelayedRentals(today);
+        pagedRentals += rentalManager.getDelayedRentalPage(today, {}, PAGE_SIZE)
+            .rentals.size();
+    }
+    chrono::duration<double> sweepSeconds =
+        chrono::steady_clock::now() - sweepStart;
+
+    auto scanStart = chrono::steady_clock::now();
+    size_t scannedRentals = 0;
+    long long bookIdSum = 0;
+    auto midYear = DateStruct::fromDayNumber(firstDate.dayNumber + DAY_COUNT / 2);
+    rentalManager.forEachDelayedRental(midYear,
+        [&](const RentalInfo& rental) {
+            scannedRentals++;
+            bookIdSum += rental.bookId;
+        });
+    chrono::duration<double> scanSeconds =
+        chrono::steady_clock::now() - scanStart;
+    bool isPassed =
+        rentalManager.countDelayedRentals(midYear) == scannedRentals;
+
+    // 페이지를 읽는 사이에 짝수 책번호를 반납. 남은 대여정보는 한 번씩만 나와야 함
+    vector<int> seen(rentalCount + 1, 0);
+    DelayedRentalPage page{ {}, {}, true };
+    while (page.hasMore) {
+        page = rentalManager.getDelayedRentalPage(midYear, page.next,
+            PAGE_SIZE * 10);
+        for (const auto& rental : page.rentals) {
+            seen[rental->bookId]++;
+            int evenId = rental->bookId + 1 - rental->bookId % 2;
+            if (evenId <= static_cast<int>(rentalCount)) {
+                rentalManager.returnById(evenId, bookManager);
+            }
+        }
+    }
+    size_t remaining = rentalManager.countDelayedRentals(midYear);
+    size_t seenRentals = 0;
+    for (size_t id = 1; id <= rentalCount; id++) {
+        isPassed = isPassed && seen[id] <= 1;
+        bool isStillRented = bookManager.getRentalInfo(static_cast<int>(id))
+            != nullptr;
+        if (seen[id] == 1 && isStillRented) {
+            seenRentals++;
+        }
+    }
+    isPassed = isPassed && seenRentals == remaining;
+
+    // 반납일이 0001년과 9999년처럼 멀리 떨어진 대여. 창 밖 날짜는 map에
+    // 들어가므로 메모리와 조회 시간이 날짜 간격에 비례하지 않아야 함
+    constexpr size_t FAR_RENTAL_COUNT = 1000;
+    constexpr size_t FAR_QUERY_COUNT = 100'000;
+    BookManager farBookManager(stringPool);
+    RentalManager farRentalManager(stringPool);
+    vector<pair<string, string>> farRows(FAR_RENTAL_COUNT + 2, { "책", "작가" });
+    farBookManager.addBooks(farRows);
+    int32_t minDay = DateStruct(1, 1, 1).dayNumber;
+    int32_t maxDay = DateStruct(9999, 12, 31).dayNumber;
+    farRentalManager.rentById(1, RentalDTO("대여자", "010",
+        DateStruct::fromDayNumber(minDay)), farBookManager);
+    farRentalManager.rentById(2, RentalDTO("대여자", "010",
+        DateStruct::fromDayNumber(maxDay)), farBookManager);
+    // 나머지는 오늘 근처와 먼 날짜를 반씩
+    vector<int32_t> farDays{ minDay, maxDay };
+    int32_t today = farRentalManager.getCurrentDate().dayNumber;
+    for (size_t i = 0; i < FAR_RENTAL_COUNT; i++) {
+        int32_t day = i % 2 == 0
+            ? today + static_cast<int32_t>(random() % DAY_COUNT)
+            : minDay + static_cast<int32_t>(random() % (maxDay - minDay + 1));
+        farDays.push_back(day);
+        farRentalManager.rentById(static_cast<int>(i + 3), RentalDTO("대여자",
+            "010", DateStruct::fromDayNumber(day)), farBookManager);
+    }
+    sort(farDays.begin(), farDays.end());
+
+    auto farStart = chrono::steady_clock::now();
+    bool isFarCountCorrect = true;
+    for (size_t i = 0; i < FAR_QUERY_COUNT; i++) {
+        int32_t day = i % 2 == 0 ? maxDay : minDay;
+        size_t expected = i % 2 == 0 ? farDays.size() : 1;
+        isFarCountCorrect = isFarCountCorrect && farRentalManager
+            .countDelayedRentals(DateStruct::fromDayNumber(day)) == expected;
+    }
+    chrono::duration<double> farCountSeconds =
+        chrono::steady_clock::now() - farStart;
+    for (int32_t day : { minDay, today, today + DAY_COUNT / 2, maxDay }) {
+        auto expected = static_cast<size_t>(upper_bound(farDays.begin(),
+            farDays.end(), day) - farDays.begin());
+        isFarCountCorrect = isFarCountCorrect && farRentalManager
+            .countDelayedRentals(DateStruct::fromDayNumber(day)) == expected;
+    }
+
+    // 반납일 순 페이지를 한 건씩 끝까지 읽음
+    farStart = chrono::steady_clock::now();
+    vector<int32_t> pagedDays;
+    RentalPage farPage{ {}, { RentalOrder::BY_RETURN_DATE, 0, INT32_MIN },
+        true };
+    while (farPage.hasMore) {
+        farPage = farRentalManager.getRentalPage(farPage.next, 1,
+            farBookManager);
+        for (const auto& rental : farPage.rentals) {
+            pagedDays.push_back(rental->getReturnDate().dayNumber);
+        }
+    }
+    chrono::duration<double> farPageSeconds =
+        chrono::steady_clock::now() - farStart;
+    bool isFarPageCorrect = pagedDays == farDays;
+    isPassed = isPassed && isFarCountCorrect && isFarPageCorrect;
+
+    auto getGauge = [](const RentalManager& manager, string_view name) {
+        vector<MetricGauge> gauges;
+        manager.appendGauges(gauges);
+        for (const auto& gauge : gauges) {
+            if (gauge.name == name) {
+                return gauge.value;
+            }
+        }
+        return 0.0;
+    };
+    double bucketCount = getGauge(farRentalManager,
+        "book_delayed_queue_buckets");
+    double overflowDays = getGauge(farRentalManager,
+        "book_delayed_queue_overflow_days");
+
+    // 오늘을 창 크기의 몇 배만큼 하루씩 옮기며 매일 대여/반납. 창이 따라
+    // 움직이면 오늘 근처 반납일은 창 밖으로 새지 않고, 창이 지나간 오래된
+    // 연체도 계속 셈에 들어가야 함
+    constexpr int SLIDE_DAYS = 12'000;
+    constexpr int SLIDE_BOOK_COUNT = 32;
+    BookManager slideBookManager(stringPool);
+    RentalManager slideRentalManager(stringPool);
+    vector<pair<string, string>> slideRows(SLIDE_BOOK_COUNT + 1,
+        { "책", "작가" });
+    slideBookManager.addBooks(slideRows);
+    int32_t slideStart = firstDate.dayNumber;
+    slideRentalManager.setCurrentDate(firstDate);
+    // 끝까지 반납하지 않는 연체 하나
+    slideRentalManager.rentById(SLIDE_BOOK_COUNT + 1,
+        RentalDTO("대여자", "010", firstDate), slideBookManager);
+    vector<int32_t> slideReturnDays(SLIDE_BOOK_COUNT + 1, INT32_MAX);
+    bool isSlideCorrect = true;
+    for (int day = 0; day < SLIDE_DAYS; day++) {
+        int32_t today = slideStart + day;
+        slideRentalManager.setCurrentDate(DateStruct::fromDayNumber(today));
+        int bookId = day % SLIDE_BOOK_COUNT + 1;
+        if (slideReturnDays[bookId] != INT32_MAX) {
+            slideRentalManager.returnById(bookId, slideBookManager);
+        }
+        slideReturnDays[bookId] = today + day % 30;
+        slideRentalManager.rentById(bookId, RentalDTO("대여자", "010",
+            DateStruct::fromDayNumber(slideReturnDays[bookId])),
+            slideBookManager);
+
+        auto expected = static_cast<size_t>(1 + count_if(
+            slideReturnDays.begin() + 1, slideReturnDays.end(),
+            [today](int32_t returnDay) { return returnDay <= today; }));
+        isSlideCorrect = isSlideCorrect && slideRentalManager
+            .countDelayedRentals(DateStruct::fromDayNumber(today)) == expected;
+    }
+    // 창 밖에는 창이 지나간 연체 하루만 남아야 함
+    double slideOverflowDays = getGauge(slideRentalManager,
+        "book_delayed_queue_overflow_days");
+    isSlideCorrect = isSlideCorrect && slideOverflowDays == 1;
+    isPassed = isPassed && isSlideCorrect;
+
+    cout << "----연체 조회 성능----" << endl;
+    cout << "대여: " << rentalCount << "건, " << DAY_COUNT << "일" << endl;
+    cout << "매일 연체 수 + 첫 페이지: " << sweepSeconds.count() << "초 (하루 "
+        << sweepSeconds.count() / DAY_COUNT * 1e6 << "us, " << pagedRentals
+        << "건)" << endl;
+    cout << "전체 순회 한 번: " << scanSeconds.count() << "초 ("
+        << scannedRentals << "건, 책번호 합 " << bookIdSum << ")" << endl;
+    cout << "먼 반납일 " << farDays.size() << "건 (창 " << bucketCount
+        << "칸, 창 밖 " << overflowDays << "일)" << endl;
+    cout << "  0001/9999년 번갈아 연체 수 " << FAR_QUERY_COUNT << "번: "
+        << farCountSeconds.count() << "초 ("
+        << static_cast<size_t>(FAR_QUERY_COUNT / farCountSeconds.count())
+        << " ops/s)" << (isFarCountCorrect ? "" : " 불일치") << endl;
+    cout << "  반납일 순 한 건씩 " << pagedDays.size() << "페이지: "
+        << farPageSeconds.count() << "초" << (isFarPageCorrect ? "" : " 불일치")
+        << endl;
+    cout << "오늘을 " << SLIDE_DAYS << "일 옮기며 대여/반납: 창 밖 "
+        << slideOverflowDays << "일" << (isSlideCorrect ? "" : " 불일치")
+        << endl;
+    cout << (isPassed ? "통과" : "실패") << endl;
+    return isPassed ? 0 : 1;
+}
+
+// 대여/반납을 반복할 때 힙 할당이 없는지 확인. 모든 대여자와 반납일로 한 번씩
+// 전부 빌렸다 돌려줘 인덱스의 용량을 채운 뒤, 섞인 대여/반납 opCount번 동안의
+// 할당 횟수를 셈. 로그도 붙여 레코드 기록까지 포함.
+// 대여 기록은 청크가 찰 때마다 새 청크 하나를 할당하므로 그만큼은 뺌
+int runAllocationBenchmark(size_t bookCount, size_t opCount) {
+    constexpr int BORROWER_COUNT = 16;
+    constexpr int DAY_COUNT = 28;
+
+    string path = (filesystem::temp_directory_path() / "book_service_alloc.wal")
+        .string();
+    filesystem::remove(path);
+
+    auto stringPool = make_shared<StringPool>();
+    BookManager bookManager(stringPool);
+    RentalManager rentalManager(stringPool);
+    vector<pair<string, string>> rows;
+    for (size_t i = 0; i < bookCount; i++) {
+        rows.emplace_back("책" + to_string(i % 100), "작가" + to_string(i % 10));
+    }
+    bookManager.addBooks(rows);
+    auto log = make_shared<MutationLog>(path, DurabilityMode::ASYNC);
+    if (!log->isOpen()) {
+        cout << "로그 파일을 열 수 없음: " << path << endl;
+        return 1;
+    }
+    rentalManager.attachLog(log);
+
+    vector<string> borrowers;
+    for (int i = 0; i < BORROWER_COUNT; i++) {
+        borrowers.push_back("대여자" + to_string(i));
+    }
+    vector<string> titles;
+    for (int i = 0; i < 100; i++) {
+        titles.push_back("책" + to_string(i));
+    }
+    DateStruct firstDate(2025, 1, 1);
+    auto getDate = [&](size_t i) {
+        return DateStruct::fromDayNumber(
+            firstDate.dayNumber + static_cast<int32_t>(i % DAY_COUNT));
+    };
+
+    auto bookIdCount = static_cast<int>(bookCount);
+    for (int round = 0; round < max(BORROWER_COUNT, DAY_COUNT); round++) {
+        RentalDTO rentalDTO(borrowers[round % BORROWER_COUNT], "010",
+            getDate(round));
+        for (int id = 1; id <= bookIdCount; id++) {
+            rentalManager.rentById(id, rentalDTO, bookManager);
+        }
+        for (int id = 1; id <= bookIdCount; id++) {
+            rentalManager.returnById(id, bookManager);
+        }
+    }
+    log->checkpoint();
+
+    mt19937 random(1);
+    size_t failedCount = 0;
+    size_t historyChunksBefore = rentalManager.getHistory().getChunkCount();
+    size_t allocationsBefore = getHeapAllocationCount();
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < opCount; i++) {
+        int bookId = static_cast<int>(random() % bookCount) + 1;
+        RentalDTO rentalDTO(borrowers[i % BORROWER_COUNT], "010", getDate(i));
+        RentalStatus status;
+        if (bookManager.getRentalInfo(bookId)) {
+            status = rentalManager.returnById(bookId, bookManager);
+        }
+        else if (i % 2 == 0) {
+            status = rentalManager.rentById(bookId, rentalDTO, bookManager);
+        }
+        else {
+            status = rentalManager.rentByTitle(titles[(bookId - 1) % 100],
+                rentalDTO, bookManager);
+        }
+        failedCount += status != RentalStatus::SUCCESS;
+    }
+    chrono::duration<double> seconds = chrono::steady_clock::now() - start;
+    size_t allocations = getHeapAllocationCount() - allocationsBefore;
+    size_t historyChunks =
+        rentalManager.getHistory().getChunkCount() - historyChunksBefore;
+    allocations -= min(allocations, historyChunks);
+
+    bool isPassed = allocations == 0 && failedCount == 0;
+    cout << "----대여/반납 할당----" << endl;
+    cout << "책: " << bookCount << "권, 대여/반납: " << opCount << "번, "
+        << seconds.count() << "초 (" << static_cast<size_t>(opCount / seconds.count())
+        << " ops/s)" << endl;
+    cout << "힙 할당: " << allocations << "번 (대여 기록 청크 " << historyChunks
+        << "개 제외), 실패: " << failedCount << "번" << endl;
+    cout << (isPassed ? "통과" : "실패") << endl;
+
+    rentalManager.attachLog(nullptr);
+    log.reset();
+    filesystem::remove(path);
+    return isPassed ? 0 : 1;
+}
+
+// 순위 r(0부터)가 1/(r+1)^exponent에 비례하는 확률로 뽑힘
+class ZipfGenerator {
+private:
+    vector<double> cdf;
+
+public:
+    ZipfGenerator(size_t count, double exponent) {
+        cdf.reserve(count);
+        double sum = 0;
+        for (size_t rank = 0; rank < count; rank++) {
+            sum += 1.0 / pow(static_cast<double>(rank + 1), exponent);
+            cdf.push_back(sum);
+        }
+        for (double& value : cdf) {
+            value /= sum;
+        }
+    }
+
+    size_t operator()(mt19937_64& random) const {
+        double target = uniform_real_distribution<double>(0, 1)(random);
+        auto it = lower_bound(cdf.begin(), cdf.end(), target);
+        return min(static_cast<size_t>(it - cdf.begin()), cdf.size() - 1);
+    }
+};
+
+// 작업 하나의 지연 시간(나노초)을 모아 처리량과 백분위를 계산
+class LatencyRecorder {
+private:
+    vector<uint32_t> samples;
+    double totalSeconds = 0;
+
+public:
+    template <typename Operation>
+    auto measure(Operation&& operation) {
+        auto start = chrono::steady_clock::now();
+        auto result = operation();
+        add(chrono::steady_clock::now() - start);
+        return result;
+    }
+
+    void add(chrono::duration<double> elapsed) {
+        totalSeconds += elapsed.count();
+        samples.push_back(static_cast<uint32_t>(
+            min(elapsed.count() * 1e9, 4e9)));
+    }
+
+    size_t getCount() const {
+        return samples.size();
+    }
+
+    double getOpsPerSecond() const {
+        return totalSeconds > 0 ? samples.size() / totalSeconds : 0;
+    }
+
+    // percentile은 0~100. 결과는 마이크로초
+    double getPercentile(double percentile) {
+        if (samples.empty()) {
+            return 0;
+        }
+        auto rank = static_cast<size_t>(percentile / 100 * (samples.size() - 1));
+        nth_element(samples.begin(), samples.begin() + rank, samples.end());
+        return samples[rank] / 1e3;
+    }
+};
+
+struct WorkloadOptions {
+    vector<size_t> bookCounts{ 1'000, 10'000, 100'000, 1'000'000 };
+    size_t opCount = 200'000;
+    // 섞인 작업 중 조회의 비율. 나머지는 대여/반납
+    double readRatio = 0.9;
+    double zipfExponent = 0.99;
+    // 전체를 훑는 조회의 반복 횟수
+    size_t scanCount = 3;
+    uint64_t seed = 1;
+};
+
+// 책 bookCount권(제목마다 약 10권)을 한 권씩 등록한 뒤, 인기도가 Zipf 분포인
+// 제목으로 조회와 대여/반납을 섞어 opCount번 실행하고, 끝으로 전체를 훑는
+// 조회를 scanCount번씩 실행. 작업마다 처리량과 p50/p99 지연 시간을 출력
+void runWorkload(size_t bookCount, const WorkloadOptions& options) {
+    constexpr int DAY_COUNT = 60;
+    constexpr size_t BORROWER_COUNT = 1000;
+    constexpr size_t PAGE_SIZE = 20;
+
+    size_t titleCount = max<size_t>(bookCount / 10, 1);
+    size_t authorCount = max<size_t>(titleCount / 10, 1);
+    vector<string> titles;
+    titles.reserve(titleCount);
+    for (size_t i = 0; i < titleCount; i++) {
+        titles.push_back("책" + to_string(i));
+    }
+    vector<string> authors;
+    authors.reserve(authorCount);
+    for (size_t i = 0; i < authorCount; i++) {
+        authors.push_back("작가" + to_string(i));
+    }
+    vector<string> borrowers;
+    for (size_t i = 0; i < BORROWER_COUNT; i++) {
+        borrowers.push_back("대여자" + to_string(i));
+    }
+    DateStruct firstDate(2025, 1, 1);
+
+    mt19937_64 random(options.seed);
+    ZipfGenerator titleRank(titleCount, options.zipfExponent);
+    auto randomIndex = [&](size_t count) {
+        return static_cast<size_t>(random() % count);
+    };
+    auto randomDate = [&]() {
+        return DateStruct::fromDayNumber(firstDate.dayNumber
+            + static_cast<int32_t>(randomIndex(DAY_COUNT)));
+    };
+    // 책번호 - 1을 titleCount로 나눈 나머지가 그 책의 제목
+    auto randomCopyOf = [&](size_t title) {
+        size_t copyCount = (bookCount - title + titleCount - 1) / titleCount;
+        return static_cast<int>(title + randomIndex(copyCount) * titleCount) + 1;
+    };
+
+    // 받아 둔 참조가 유지되도록 deque에 둠. 출력은 처음 쓴 순서대로
+    deque<pair<string, LatencyRecorder>> recorders;
+    auto getRecorder = [&](const string& name) -> LatencyRecorder& {
+        for (auto& [recorderName, recorder] : recorders) {
+            if (recorderName == name) {
+                return recorder;
+            }
+        }
+        return recorders.emplace_back(name, LatencyRecorder()).second;
+    };
+
+    auto stringPool = make_shared<StringPool>();
+    BookManager bookManager(stringPool);
+    RentalManager rentalManager(stringPool);
+    // 대여는 이름과 전화번호로 하므로 같은 대여자로 등록됨
+    vector<BorrowerId> borrowerIds;
+    for (const string& borrower : borrowers) {
+        borrowerIds.push_back(*rentalManager.registerBorrower(borrower, "010"));
+    }
+
+    LatencyRecorder& addRecorder = getRecorder("addBook");
+    for (size_t i = 0; i < bookCount; i++) {
+        size_t title = i % titleCount;
+        addRecorder.measure([&] {
+            return bookManager.registerBook(titles[title],
+                authors[title % authorCount]);
+        });
+    }
+
+    // 대여중인 책번호. 반납할 책을 고를 때 씀
+    vector<int> rentedIds;
+    vector<uint32_t> rentedPositions(bookCount + 1, UINT32_MAX);
+    auto onRented = [&](int bookId) {
+        rentedPositions[bookId] = static_cast<uint32_t>(rentedIds.size());
+        rentedIds.push_back(bookId);
+    };
+    auto onReturned = [&](int bookId) {
+        uint32_t pos = rentedPositions[bookId];
+        rentedIds[pos] = rentedIds.back();
+        rentedPositions[rentedIds[pos]] = pos;
+        rentedIds.pop_back();
+        rentedPositions[bookId] = UINT32_MAX;
+    };
+
+    // 대여 목록이 비어 있지 않도록 1/5을 미리 대여
+    for (size_t i = 0; i < bookCount / 5; i++) {
+        int bookId = static_cast<int>(randomIndex(bookCount)) + 1;
+        RentalDTO rentalDTO(borrowers[randomIndex(BORROWER_COUNT)], "010",
+            randomDate());
+        if (rentalManager.rentById(bookId, rentalDTO, bookManager)
+            == RentalStatus::SUCCESS) {
+            onRented(bookId);
+        }
+    }
+
+    using QueryFunction = function<size_t()>;
+    vector<pair<string, QueryFunction>> pointQueries{
+        { "getBookById", [&] {
+            return static_cast<size_t>(bookManager.getBookById(
+                static_cast<int>(randomIndex(bookCount)) + 1) != nullptr);
+        } },
+        { "getBooksByTitle", [&] {
+            return bookManager.getBooksByTitle(titles[titleRank(random)]).size();
+        } },
+        { "getBooksByAuthor", [&] {
+            return bookManager.getBooksByAuthor(
+                authors[titleRank(random) % authorCount]).size();
+        } },
+        { "getBookIdsByTitle", [&] {
+            return bookManager.getBookIdsByTitle(titles[titleRank(random)]).size();
+        } },
+        { "getBookIdsByAuthor", [&] {
+            return bookManager.getBookIdsByAuthor(
+                authors[titleRank(random) % authorCount]).size();
+        } },
+        { "forEachBookByTitle", [&] {
+            size_t count = 0;
+            bookManager.forEachBookByTitle(titles[titleRank(random)],
+                [&](const BookView&) { count++; });
+            return count;
+        } },
+        { "findAvailableBookByTitle", [&] {
+            return static_cast<size_t>(bookManager.findAvailableBookByTitle(
+                titles[titleRank(random)]));
+        } },
+        { "countAvailableBooksByTitle", [&] {
+            return bookManager.countAvailableBooksByTitle(
+                titles[titleRank(random)]);
+        } },
+        { "searchBooks(prefix)", [&] {
+            const string& title = titles[titleRank(random)];
+            return bookManager.searchBooks(
+                string_view(title).substr(0, title.size() - 1),
+                SearchMode::PREFIX, nullopt, 0, PAGE_SIZE).hits.size();
+        } },
+        { "searchBooks(substring)", [&] {
+            string digits = to_string(titleRank(random));
+            return bookManager.searchBooks(
+                string_view(digits).substr(0, max<size_t>(digits.size() / 2, 1)),
+                SearchMode::SUBSTRING, nullopt, 0, PAGE_SIZE).hits.size();
+        } },
+        { "getRentalsByBorrower", [&] {
+            return rentalManager.getRentalsByBorrower(
+                borrowers[randomIndex(BORROWER_COUNT)]).size();
+        } },
+        { "viewRentalsByBorrower(id)", [&] {
+            return rentalManager.viewRentalsByBorrower(
+                borrowerIds[randomIndex(BORROWER_COUNT)]).size();
+        } },
+        { "canBorrow", [&] {
+            return static_cast<size_t>(rentalManager.canBorrow(
+                borrowerIds[randomIndex(BORROWER_COUNT)]));
+        } },
+        { "countDelayedRentals", [&] {
+            return rentalManager.countDelayedRentals(randomDate());
+        } },
+        { "getDelayedRentalPage", [&] {
+            return rentalManager.getDelayedRentalPage(randomDate(), {},
+                PAGE_SIZE).rentals.size();
+        } },
+    };
+    for (auto& [name, query] : pointQueries) {
+        getRecorder(name);
+    }
+
+    LatencyRecorder& rentByIdRecorder = getRecorder("rentById");
+    LatencyRecorder& rentByTitleRecorder = getRecorder("rentByTitle");
+    LatencyRecorder& returnRecorder = getRecorder("returnById");
+    size_t checksum = 0;
+    auto mixStart = chrono::steady_clock::now();
+    for (size_t i = 0; i < options.opCount; i++) {
+        if (uniform_real_distribution<double>(0, 1)(random) < options.readRatio) {
+            auto& [name, query] = pointQueries[randomIndex(pointQueries.size())];
+            checksum += getRecorder(name).measure(query);
+            continue;
+        }
+
+        // 대여와 반납이 반씩이 되도록 고름. 대여는 책번호/제목 반씩
+        size_t kind = randomIndex(4);
+        if (kind >= 2 && !rentedIds.empty()) {
+            int bookId = rentedIds[randomIndex(rentedIds.size())];
+            RentalStatus status = returnRecorder.measure([&] {
+                return rentalManager.returnById(bookId, bookManager);
+            });
+            if (status == RentalStatus::SUCCESS) {
+                onReturned(bookId);
+            }
+            continue;
+        }
+
+        RentalDTO rentalDTO(borrowers[randomIndex(BORROWER_COUNT)], "010",
+            randomDate());
+        size_t title = titleRank(random);
+        if (kind == 0) {
+            int bookId = randomCopyOf(title);
+            RentalStatus status = rentByIdRecorder.measure([&] {
+                return rentalManager.rentById(bookId, rentalDTO, bookManager);
+            });
+            if (status == RentalStatus::SUCCESS) {
+                onRented(bookId);
+            }
+        }
+        else {
+            shared_ptr<RentalInfo> rentalInfo;
+            RentalStatus status = rentByTitleRecorder.measure([&] {
+                return rentalManager.rentByTitle(titles[title], rentalDTO,
+                    bookManager, &rentalInfo);
+            });
+            if (status == RentalStatus::SUCCESS) {
+                onRented(rentalInfo->bookId);
+            }
+        }
+    }
+    chrono::duration<double> mixSeconds = chrono::steady_clock::now() - mixStart;
+
+    vector<pair<string, QueryFunction>> scanQueries{
+        { "getAllBooks", [&] {
+            return bookManager.getAllBooks().size();
+        } },
+        { "forEachBook", [&] {
+            size_t count = 0;
+            bookManager.forEachBook([&](const BookView&) { count++; });
+            return count;
+        } },
+        { "getAllRentals", [&] {
+            return rentalManager.getAllRentals().size();
+        } },
+        { "viewAllRentals", [&] {
+            return rentalManager.viewAllRentals().size();
+        } },
+        { "getDelayedRentalsByReturnDate", [&] {
+            return rentalManager.getDelayedRentalsByReturnDate(
+                DateStruct::fromDayNumber(firstDate.dayNumber + DAY_COUNT / 2))
+                .size();
+        } },
+    };
+    for (auto& [name, query] : scanQueries) {
+        LatencyRecorder& recorder = getRecorder(name);
+        for (size_t i = 0; i < options.scanCount; i++) {
+            checksum += recorder.measure(query);
+        }
+    }
+
+    cout << "----작업량: 책 " << bookCount << "권, 제목 " << titleCount
+        << "개, 조회 비율 " << options.readRatio << ", zipf "
+        << options.zipfExponent << "----" << endl;
+    cout << "섞인 작업 " << options.opCount << "번: " << mixSeconds.count()
+        << "초 (" << static_cast<size_t>(options.opCount / mixSeconds.count())
+        << " ops/s), 대여중 " << rentalManager.getRentalCount() << "권, 검사값 "
+        << checksum << endl;
+    // 한글 두 글자는 6바이트지만 4칸을 차지하므로 폭을 2씩 늘림
+    cout << left << setw(34) << "작업" << right << setw(12) << "횟수"
+        << setw(14) << "ops/s" << setw(12) << "p50(us)" << setw(12)
+        << "p99(us)" << endl;
+    cout << fixed << setprecision(2);
+    for (auto& [name, recorder] : recorders) {
+        if (recorder.getCount() == 0) {
+            continue;
+        }
+        cout << left << setw(32) << name << right << setw(10)
+            << recorder.getCount() << setw(14)
+            << static_cast<size_t>(recorder.getOpsPerSecond()) << setw(12)
+            << recorder.getPercentile(50) << setw(12)
+            << recorder.getPercentile(99) << endl;
+    }
+    cout.unsetf(ios::floatfield);
+    cout << setprecision(6);
+}
+
+// 실행 인자: --workload [--books=1000,10000,...] [--ops=N] [--read=0.9]
+//           [--zipf=0.99] [--scans=N] [--seed=N]
+int runWorkloadBenchmark(int argc, char* argv[]) {
+    WorkloadOptions options;
+    for (int i = 2; i < argc; i++) {
+        string_view arg = argv[i];
+        if (arg.starts_with("--books=")) {
+            options.bookCounts.clear();
+            string_view list = arg.substr(8);
+            while (!list.empty()) {
+                size_t comma = min(list.find(','), list.size());
+                options.bookCounts.push_back(stoull(string(list.substr(0, comma))));
+                list.remove_prefix(min(comma + 1, list.size()));
+            }
+        }
+        else if (arg.starts_with("--ops=")) {
+            options.opCount = stoull(string(arg.substr(6)));
+        }
+        else if (arg.starts_with("--read=")) {
+            options.readRatio = stod(string(arg.substr(7)));
+        }
+        else if (arg.starts_with("--zipf=")) {
+            options.zipfExponent = stod(string(arg.substr(7)));
+        }
+        else if (arg.starts_with("--scans=")) {
+            options.scanCount = stoull(string(arg.substr(8)));
+        }
+        else if (arg.starts_with("--seed=")) {
+            options.seed = stoull(string(arg.substr(7)));
+        }
+        else {
+            cout << "알 수 없는 인자: " << arg << endl;
+            return 1;
+        }
+    }
+
+    for (size_t bookCount : options.bookCounts) {
+        if (bookCount == 0) {
+            cout << "책 수는 1 이상이어야 함" << endl;
+            return 1;
+        }
+        runWorkload(bookCount, options);
+    }
+    return 0;
+}
+
+struct LoadOptions {
+    size_t clientCount = 1000;
+    size_t requestsPerClient = 200;
+    // 한 연결에서 응답을 기다리지 않고 보내 두는 요청 수
+    size_t pipelineDepth = 4;
+    size_t bookCount = 100'000;
+    int serverThreads = 1;
+    bool isUnixSocket = false;
+};
+
+#ifdef __linux__
+
+// 부하 생성기의 연결 하나. 보낸 요청의 시각을 순서대로 들고 있다가 응답이
+// 오면 앞에서부터 꺼내 지연 시간을 잼
+struct LoadClient {
+    int fd = -1;
+    size_t sentRequests = 0;
+    size_t receivedResponses = 0;
+    deque<chrono::steady_clock::time_point> sendTimes;
+    string input;
+    string output;
+    size_t sentBytes = 0;
+};
+
+// 같은 프로세스에서 서버를 띄우고 loopback으로 clientCount개의 연결을 열어,
+// 연결마다 pipelineDepth개씩 요청을 보내 둔 채 requestsPerClient개를 주고받음.
+// 요청은 책번호 대여/반납과 제목별 대여 가능 권수 조회를 섞음
+int runServerLoad(const LoadOptions& options) {
+    constexpr size_t TITLE_COUNT = 1000;
+
+    auto stringPool = make_shared<StringPool>();
+    BookManager bookManager(stringPool);
+    RentalManager rentalManager(stringPool);
+    vector<pair<string, string>> rows;
+    for (size_t i = 0; i < options.bookCount; i++) {
+        rows.emplace_back("책" + to_string(i % TITLE_COUNT), "작가");
+    }
+    bookManager.addBooks(rows);
+
+    BookServer server(bookManager, rentalManager, nullptr);
+    string address = options.isUnixSocket
+        ? "unix:" + (filesystem::temp_directory_path() / "book_bench.sock").string()
+        : "127.0.0.1:0";
+    string error;
+    if (!server.listen(address, error)) {
+        cout << error << endl;
+        return 1;
+    }
+    thread serverThread([&] { server.run(options.serverThreads); });
+
+    auto connectClient = [&]() {
+        int fd;
+        if (options.isUnixSocket) {
+            sockaddr_un socketAddress{};
+            socketAddress.sun_family = AF_UNIX;
+            string path = address.substr(5);
+            memcpy(socketAddress.sun_path, path.c_str(), path.size() + 1);
+            fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (connect(fd, reinterpret_cast<sockaddr*>(&socketAddress),
+                sizeof(socketAddress)) != 0) {
+                ::close(fd);
+                return -1;
+            }
+        }
+        else {
+            sockaddr_in socketAddress{};
+            socketAddress.sin_family = AF_INET;
+            socketAddress.sin_port = htons(static_cast<uint16_t>(server.getPort()));
+            socketAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            fd = socket(AF_INET, SOCK_STREAM, 0);
+            if (connect(fd, reinterpret_cast<sockaddr*>(&socketAddress),
+                sizeof(socketAddress)) != 0) {
+                ::close(fd);
+                return -1;
+            }
+            int isNoDelay = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &isNoDelay,
+                sizeof(isNoDelay));
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        return fd;
+    };
+
+    mt19937_64 random(1);
+    auto appendRequest = [&](LoadClient& client) {
+        auto bookId = to_string(random() % options.bookCount + 1);
+        switch (random() % 3) {
+        case 0:
+            client.output += "rent\t" + bookId + "\t대여자\t010\t2025-01-07\n";
+            break;
+        case 1:
+            client.output += "return\t" + bookId + "\n";
+            break;
+        default:
+            client.output += "available\t책" + to_string(random() % TITLE_COUNT)
+                + "\n";
+            break;
+        }
+        client.sendTimes.push_back(chrono::steady_clock::now());
+        client.sentRequests++;
+    };
+
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    vector<LoadClient> clients(options.clientCount);
+    auto updateEvents = [&](LoadClient& client, int operation) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        if (client.sentBytes < client.output.size()) {
+            event.events |= EPOLLOUT;
+        }
+        event.data.ptr = &client;
+        epoll_ctl(epollFd, operation, client.fd, &event);
+    };
+    auto flushClient = [&](LoadClient& client) {
+        while (client.sentBytes < client.output.size()) {
+            ssize_t sent = send(client.fd, client.output.data() + client.sentBytes,
+                client.output.size() - client.sentBytes, MSG_NOSIGNAL);
+            if (sent <= 0) {
+                break;
+            }
+            client.sentBytes += static_cast<size_t>(sent);
+        }
+        if (client.sentBytes == client.output.size()) {
+            client.output.clear();
+            client.sentBytes = 0;
+        }
+    };
+
+    LatencyRecorder latency;
+    size_t okCount = 0;
+    size_t errorCount = 0;
+    size_t failedConnections = 0;
+    auto start = chrono::steady_clock::now();
+    for (auto& client : clients) {
+        client.fd = connectClient();
+        if (client.fd < 0) {
+            failedConnections++;
+            continue;
+        }
+        while (client.sentRequests < min(options.pipelineDepth,
+            options.requestsPerClient)) {
+            appendRequest(client);
+        }
+        flushClient(client);
+        updateEvents(client, EPOLL_CTL_ADD);
+    }
+
+    size_t activeClients = clients.size() - failedConnections;
+    epoll_event events[256];
+    char buffer[1 << 16];
+    while (activeClients > 0) {
+        int count = epoll_wait(epollFd, events, 256, 1000);
+        if (count <= 0) {
+            if (count == 0 || errno != EINTR) {
+                break;
+            }
+            continue;
+        }
+        for (int i = 0; i < count; i++) {
+            auto& client = *static_cast<LoadClient*>(events[i].data.ptr);
+            if (events[i].events & EPOLLIN) {
+                ssize_t received;
+                while ((received = recv(client.fd, buffer, sizeof(buffer), 0)) > 0) {
+                    client.input.append(buffer, static_cast<size_t>(received));
+                }
+                size_t pos = 0;
+                size_t newline;
+                auto now = chrono::steady_clock::now();
+                while ((newline = client.input.find('\n', pos)) != string::npos) {
+                    string_view line(client.input.data() + pos, newline - pos);
+                    pos = newline + 1;
+                    latency.add(now - client.sendTimes.front());
+                    client.sendTimes.pop_front();
+                    client.receivedResponses++;
+                    line.find("\tOK\t") != string_view::npos ? okCount++
+                        : errorCount++;
+                    if (client.sentRequests < options.requestsPerClient) {
+                        appendRequest(client);
+                    }
+                }
+                client.input.erase(0, pos);
+            }
+            flushClient(client);
+
+            if (client.receivedResponses == options.requestsPerClient) {
+                epoll_ctl(epollFd, EPOLL_CTL_DEL, client.fd, nullptr);
+                ::close(client.fd);
+                client.fd = -1;
+                activeClients--;
+            }
+            else {
+                updateEvents(client, EPOLL_CTL_MOD);
+            }
+        }
+    }
+    chrono::duration<double> seconds = chrono::steady_clock::now() - start;
+    ::close(epollFd);
+    for (auto& client : clients) {
+        if (client.fd >= 0) {
+            ::close(client.fd);
+        }
+    }
+    server.stop();
+    serverThread.join();
+
+    size_t expected = (clients.size() - failedConnections)
+        * options.requestsPerClient;
+    size_t responses = okCount + errorCount;
+    bool isPassed = failedConnections == 0 && responses == expected
+        && server.getStats().requests == expected;
+
+    cout << "----서버 부하 (" << (options.isUnixSocket ? "unix" : "tcp")
+        << ", 이벤트 루프 " << options.serverThreads << "개)----" << endl;
+    cout << "연결: " << clients.size() << "개 (실패 " << failedConnections
+        << "), 연결당 요청: " << options.requestsPerClient << "건, 파이프라인 깊이: "
+        << options.pipelineDepth << endl;
+    cout << "응답: " << responses << "건 (OK " << okCount << ", ERR "
+        << errorCount << "), " << seconds.count() << "초 ("
+        << static_cast<size_t>(responses / seconds.count()) << " requests/s)"
+        << endl;
+    cout << "지연 시간: p50 " << latency.getPercentile(50) << "us, p99 "
+        << latency.getPercentile(99) << "us, p99.9 "
+        << latency.getPercentile(99.9) << "us" << endl;
+    cout << (isPassed ? "통과" : "실패") << endl;
+    return isPassed ? 0 : 1;
+}
+
+#else
+
+int runServerLoad(const LoadOptions&) {
+    cout << "이 플랫폼에서는 서버를 지원하지 않음" << endl;
+    return 1;
+}
+
+#endif
+
+// 한 반이 batchSize권을 한꺼번에 빌리고 돌려주는 일을 roundCount번 반복하며
+// 한 권씩 부르는 방식과 rentBatch/returnBatch를 비교. 로그가 없을 때와 SYNC
+// 로그를 쓸 때를 모두 잼. 묶음마다 없는 책번호와 같은 책 두 번을 섞어 두고,
+// 두 방식의 항목별 결과와 끝난 뒤의 상태가 같으면 0을 돌려줌
+int runBatchBenchmark(size_t batchSize, size_t roundCount) {
+    constexpr int STUDENT_COUNT = 30;
+    constexpr int DAY_COUNT = 14;
+
+    size_t bookCount = batchSize * 4;
+    vector<string> students;
+    for (int i = 0; i < STUDENT_COUNT; i++) {
+        students.push_back("학생" + to_string(i));
+    }
+    DateStruct firstDate(2025, 3, 1);
+    vector<vector<RentalRequest>> rounds(roundCount);
+    for (size_t round = 0; round < roundCount; round++) {
+        for (size_t i = 0; i < batchSize; i++) {
+            auto bookId = static_cast<int>((round * batchSize + i) % bookCount) + 1;
+            rounds[round].push_back({ bookId, RentalDTO(students[i % STUDENT_COUNT],
+                "010", DateStruct::fromDayNumber(firstDate.dayNumber
+                    + static_cast<int32_t>(i % DAY_COUNT))) });
+        }
+        // 거절되는 항목의 처음 보는 대여자는 등록되지 않아야 함
+        rounds[round].push_back({ 0, RentalDTO("전학생", "011", firstDate) });
+        rounds[round].push_back(rounds[round].front());
+    }
+
+    struct Result {
+        vector<RentalStatus> statuses;
+        size_t rentedCount = 0;
+        size_t remainingCount = 0;
+        size_t borrowerCount = 0;
+        double rentSeconds = 0;
+        double returnSeconds = 0;
+    };
+    auto run = [&](bool isBatch, bool hasLog) {
+        string path = (filesystem::temp_directory_path()
+            / "book_service_batch.wal").string();
+        filesystem::remove(path);
+        auto stringPool = make_shared<StringPool>();
+        BookManager bookManager(stringPool);
+        RentalManager rentalManager(stringPool);
+        vector<pair<string, string>> rows;
+        for (size_t i = 0; i < bookCount; i++) {
+            rows.emplace_back("교재" + to_string(i % 50), "작가");
+        }
+        bookManager.addBooks(rows);
+        shared_ptr<MutationLog> log;
+        if (hasLog) {
+            log = make_shared<MutationLog>(path, DurabilityMode::SYNC);
+            rentalManager.attachLog(log);
+        }
+
+        Result result;
+        vector<int> bookIds;
+        for (const auto& requests : rounds) {
+            auto start = chrono::steady_clock::now();
+            if (isBatch) {
+                auto statuses = rentalManager.rentBatch(requests, bookManager);
+                result.statuses.insert(result.statuses.end(), statuses.begin(),
+                    statuses.end());
+            }
+            else {
+                for (const auto& request : requests) {
+                    result.statuses.push_back(rentalManager.rentById(
+                        request.bookId, request.rentalDTO, bookManager));
+                }
+            }
+            auto middle = chrono::steady_clock::now();
+            result.rentedCount += rentalManager.getRentalCount();
+
+            bookIds.clear();
+            for (const auto& request : requests) {
+                bookIds.push_back(request.bookId);
+            }
+            if (isBatch) {
+                auto statuses = rentalManager.returnBatch(bookIds, bookManager);
+                result.statuses.insert(result.statuses.end(), statuses.begin(),
+                    statuses.end());
+            }
+            else {
+                for (int bookId : bookIds) {
+                    result.statuses.push_back(
+                        rentalManager.returnById(bookId, bookManager));
+                }
+            }
+            auto end = chrono::steady_clock::now();
+            result.rentSeconds += chrono::duration<double>(middle - start).count();
+            result.returnSeconds += chrono::duration<double>(end - middle).count();
+        }
+        result.remainingCount = rentalManager.getRentalCount()
+            + rentalManager.countDelayedRentals(DateStruct(2100, 1, 1));
+        result.borrowerCount = rentalManager.getBorrowerCount();
+        log.reset();
+        filesystem::remove(path);
+        return result;
+    };
+
+    bool isPassed = true;
+    size_t itemCount = roundCount * (batchSize + 2);
+    size_t borrowerCount = min<size_t>(batchSize, STUDENT_COUNT);
+    cout << "----일괄 대여/반납 (" << batchSize << "권씩 " << roundCount
+        << "번)----" << endl;
+    for (bool hasLog : { false, true }) {
+        Result single = run(false, hasLog);
+        Result batch = run(true, hasLog);
+        isPassed = isPassed && single.statuses == batch.statuses
+            && single.rentedCount == batch.rentedCount
+            && single.remainingCount == 0 && batch.remainingCount == 0
+            && single.borrowerCount == borrowerCount
+            && batch.borrowerCount == borrowerCount;
+        cout << (hasLog ? "SYNC 로그" : "로그 없음") << endl;
+        for (auto [name, result] : { pair{ "  한 권씩", &single },
+            pair{ "  일괄", &batch } }) {
+            cout << name << ": 대여 "
+                << static_cast<size_t>(itemCount / result->rentSeconds)
+                << "건/s, 반납 "
+                << static_cast<size_t>(itemCount / result->returnSeconds)
+                << "건/s" << endl;
+        }
+    }
+    cout << (isPassed ? "통과" : "실패") << endl;
+    return isPassed ? 0 : 1;
+}
+
+// 예전 색인 구조(unordered_map + vector)와 StringKeyMap + SmallVector를 같은
+// 키로 만들고, 키당 메모리와 조회(있는 키/없는 키) 한 번의 평균 시간을 비교.
+// 제목마다 책이 1~4권. 두 색인의 조회 결과가 같으면 0을 돌려줌
+int runIndexBenchmark(size_t keyCount, size_t lookupCount) {
+    using OldIndex = unordered_map<string_view, vector<int>, StringHash,
+        equal_to<>>;
+
+    vector<string> keys;
+    vector<string> missingKeys;
+    keys.reserve(keyCount);
+    for (size_t i = 0; i < keyCount; i++) {
+        keys.push_back("제목" + to_string(i));
+        missingKeys.push_back("없는제목" + to_string(i));
+    }
+    mt19937_64 random(1);
+    vector<uint32_t> order(lookupCount);
+    for (auto& pos : order) {
+        pos = static_cast<uint32_t>(random() % keyCount);
+    }
+
+    auto build = [&](auto& index) {
+        size_t bytesBefore = getHeapLiveBytes();
+        int id = 1;
+        for (size_t i = 0; i < keyCount; i++) {
+            for (size_t copy = 0; copy <= i % 4; copy++) {
+                index[keys[i]].push_back(id++);
+            }
+        }
+        return getHeapLiveBytes() - bytesBefore;
+    };
+    // 결과를 더해 조회가 최적화로 사라지지 않게 함
+    auto lookup = [&](auto&& find, const vector<string>& source) {
+        auto start = chrono::steady_clock::now();
+        uint64_t checksum = 0;
+        for (uint32_t pos : order) {
+            span<const int> ids = find(source[pos]);
+            checksum += ids.empty() ? 0 : ids.size() + ids.back();
+        }
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        return pair{ checksum, elapsed.count() * 1e9 / lookupCount };
+    };
+
+    auto oldIndex = make_unique<OldIndex>();
+    size_t oldBytes = build(*oldIndex);
+    auto findOld = [&](string_view key) {
+        auto it = oldIndex->find(key);
+        return it == oldIndex->end() ? span<const int>() : span<const int>(it->second);
+    };
+    auto [oldChecksum, oldHitNanoseconds] = lookup(findOld, keys);
+    auto [oldMissChecksum, oldMissNanoseconds] = lookup(findOld, missingKeys);
+
+    auto newIndex = make_unique<StringKeyMap<BookIdList>>();
+    size_t newBytes = build(*newIndex);
+    auto findNew = [&](string_view key) {
+        const BookIdList* ids = newIndex->find(key);
+        return ids ? span<const int>(*ids) : span<const int>();
+    };
+    auto [newChecksum, newHitNanoseconds] = lookup(findNew, keys);
+    auto [newMissChecksum, newMissNanoseconds] = lookup(findNew, missingKeys);
+
+    bool isPassed = oldChecksum == newChecksum
+        && oldMissChecksum == 0 && newMissChecksum == 0;
+    cout << fixed << setprecision(1);
+    cout << "----문자열 색인 (키 " << keyCount << "개, 조회 " << lookupCount
+        << "번)----" << endl;
+    cout << "unordered_map + vector: 키당 " << static_cast<double>(oldBytes) / keyCount
+        << "바이트, 조회 " << oldHitNanoseconds << "ns, 없는 키 "
+        << oldMissNanoseconds << "ns" << endl;
+    cout << "StringKeyMap + SmallVector: 키당 " << static_cast<double>(newBytes) / keyCount
+        << "바이트, 조회 " << newHitNanoseconds << "ns, 없는 키 "
+        << newMissNanoseconds << "ns (부하율 " << newIndex->getLoadFactor()
+        << ")" << endl;
+    cout << defaultfloat << setprecision(6);
+    cout << (isPassed ? "통과" : "실패") << endl;
+    return isPassed ? 0 : 1;
+}
+
+// 여러 해의 대여 기록을 합성해 보고서 네 가지(많이 빌린 제목, 작가별 평균
+// 대여 일수, 여러 번 빌린 대여자, 날짜별 대여 수)의 시간을 재고, 행 단위
+// 기록(구조체 배열 + 해시 맵)으로 같은 값을 구해 비교. 실제 대여/반납이 기록에
+// 남는지도 확인. 결과가 모두 같으면 0을 돌려줌
+int runHistoryBenchmark(size_t recordCount, int yearCount) {
+    constexpr size_t BOOK_COUNT = 100'000;
+    constexpr size_t BORROWER_COUNT = 50'000;
+    constexpr size_t TOP_COUNT = 10;
+    constexpr uint64_t MIN_REPEAT_RENTALS = 2;
+
+    auto stringPool = make_shared<StringPool>();
+    BookManager bookManager(stringPool);
+    RentalManager rentalManager(stringPool);
+    vector<pair<string, string>> rows;
+    for (size_t i = 0; i < BOOK_COUNT; i++) {
+        rows.emplace_back("제목" + to_string(i % 20'000),
+            "작가" + to_string(i % 2'000));
+    }
+    bookManager.addBooks(rows);
+    vector<BorrowerId> borrowers;
+    for (size_t i = 0; i < BORROWER_COUNT; i++) {
+        borrowers.push_back(*rentalManager.registerBorrower(
+            "대여자" + to_string(i), "010-" + to_string(i)));
+    }
+
+    struct Record {
+        int bookId;
+        BorrowerId borrower;
+        int32_t rentDay;
+        int32_t returnDay;
+    };
+    DateStruct firstDate(2020, 1, 1);
+    auto dayCount = static_cast<int32_t>(365 * yearCount);
+    DateStruct lastDate = DateStruct::fromDayNumber(
+        firstDate.dayNumber + dayCount - 1);
+    mt19937_64 random(1);
+    vector<Record> records(recordCount);
+    RentalHistory& history = rentalManager.getHistory();
+    auto appendStart = chrono::steady_clock::now();
+    for (size_t i = 0; i < recordCount; i++) {
+        // 날짜 순으로 쌓이도록 대여일은 i에 따라 늘어남
+        int32_t rentDay = firstDate.dayNumber
+            + static_cast<int32_t>(i * dayCount / recordCount);
+        Record& record = records[i];
+        record = { static_cast<int>(random() % BOOK_COUNT) + 1,
+            borrowers[random() % BORROWER_COUNT], rentDay,
+            rentDay + 1 + static_cast<int32_t>(random() % 30) };
+        history.append(record.bookId, record.borrower,
+            DateStruct::fromDayNumber(record.rentDay),
+            DateStruct::fromDayNumber(record.returnDay));
+    }
+    chrono::duration<double> appendSeconds =
+        chrono::steady_clock::now() - appendStart;
+
+    // 실제 대여/반납: 기간 뒤의 하루에 빌려 5일 뒤에 반납
+    constexpr int LIVE_RENTALS = 1000;
+    DateStruct liveRentDate = DateStruct::fromDayNumber(lastDate.dayNumber + 10);
+    rentalManager.setCurrentDate(liveRentDate);
+    bool isPassed = true;
+    for (int id = 1; id <= LIVE_RENTALS; id++) {
+        isPassed &= rentalManager.rentById(id, borrowers[0], liveRentDate,
+            bookManager) == RentalStatus::SUCCESS;
+    }
+    rentalManager.setCurrentDate(
+        DateStruct::fromDayNumber(liveRentDate.dayNumber + 5));
+    for (int id = 1; id <= LIVE_RENTALS; id++) {
+        isPassed &= rentalManager.returnById(id, bookManager)
+            == RentalStatus::SUCCESS;
+    }
+    auto liveAuthors = rentalManager.getLoanDaysByAuthor(liveRentDate,
+        liveRentDate, bookManager);
+    uint64_t liveRentals = 0;
+    for (const auto& author : liveAuthors) {
+        liveRentals += author.rentals;
+        isPassed &= author.averageLoanDays == 5.0;
+    }
+    isPassed &= liveRentals == LIVE_RENTALS;
+
+    // 한 해 전체와 기록 전체 두 기간으로 잼
+    DateStruct yearEnd = DateStruct::fromDayNumber(
+        min(firstDate.dayNumber + 364, lastDate.dayNumber));
+    const array<pair<DateStruct, DateStruct>, 2> ranges = {
+        pair(firstDate, yearEnd), pair(firstDate, lastDate) };
+
+    // 행 단위 기록으로 같은 보고서를 만듦. 같은 정렬 규칙을 씀
+    vector<string_view> titleOfBook;
+    vector<string_view> authorOfBook;
+    bookManager.forEachBook([&](const BookView& book) {
+        titleOfBook.push_back(book.title);
+        authorOfBook.push_back(book.author);
+    });
+    auto rank = [](unordered_map<string_view, pair<uint64_t, int64_t>>& totals,
+        uint64_t minRentals, size_t count) {
+        vector<HistoryGroup> groups;
+        for (auto& [name, total] : totals) {
+            if (total.first >= minRentals) {
+                groups.push_back({ name, total.first,
+                    static_cast<double>(total.second) / total.first });
+            }
+        }
+        sort(groups.begin(), groups.end(),
+            [](const HistoryGroup& left, const HistoryGroup& right) {
+                return left.rentals != right.rentals
+                    ? left.rentals > right.rentals : left.name < right.name;
+            });
+        groups.resize(min(groups.size(), count));
+        return groups;
+    };
+    auto isSame = [](const vector<HistoryGroup>& left,
+        const vector<HistoryGroup>& right) {
+        return equal(left.begin(), left.end(), right.begin(), right.end(),
+            [](const HistoryGroup& a, const HistoryGroup& b) {
+                return a.name == b.name && a.rentals == b.rentals
+                    && a.averageLoanDays == b.averageLoanDays;
+            });
+    };
+    auto secondsSince = [](chrono::steady_clock::time_point start) {
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        return elapsed.count();
+    };
+
+    cout << fixed << setprecision(3);
+    cout << "----대여 기록 (" << recordCount << "건, " << yearCount
+        << "년)----" << endl;
+    cout << "기록 추가: " << appendSeconds.count() << "초 ("
+        << static_cast<size_t>(recordCount / appendSeconds.count())
+        << " records/s), 청크 " << history.getChunkCount() << "개" << endl;
+    for (auto [from, to] : ranges) {
+        auto start = chrono::steady_clock::now();
+        auto topTitles = rentalManager.getTopTitles(from, to, TOP_COUNT,
+            bookManager);
+        double topSeconds = secondsSince(start);
+        start = chrono::steady_clock::now();
+        auto authors = rentalManager.getLoanDaysByAuthor(from, to, bookManager);
+        double authorSeconds = secondsSince(start);
+        start = chrono::steady_clock::now();
+        auto repeatBorrowers = rentalManager.getRepeatBorrowers(from, to,
+            MIN_REPEAT_RENTALS);
+        double borrowerSeconds = secondsSince(start);
+        start = chrono::steady_clock::now();
+        auto perDay = rentalManager.getRentalsPerDay(from, to);
+        double daySeconds = secondsSince(start);
+
+        start = chrono::steady_clock::now();
+        unordered_map<string_view, pair<uint64_t, int64_t>> titleTotals;
+        unordered_map<string_view, pair<uint64_t, int64_t>> authorTotals;
+        unordered_map<string_view, pair<uint64_t, int64_t>> borrowerTotals;
+        vector<uint64_t> expectedPerDay(to.dayNumber - from.dayNumber + 1);
+        for (const Record& record : records) {
+            if (record.rentDay < from.dayNumber || record.rentDay > to.dayNumber) {
+                continue;
+            }
+            int32_t loanDays = record.returnDay - record.rentDay;
+            auto add = [loanDays](pair<uint64_t, int64_t>& total) {
+                total.first++;
+                total.second += loanDays;
+            };
+            add(titleTotals[titleOfBook[record.bookId - 1]]);
+            add(authorTotals[authorOfBook[record.bookId - 1]]);
+            add(borrowerTotals[rentalManager.getBorrower(record.borrower).name]);
+            expectedPerDay[record.rentDay - from.dayNumber]++;
+        }
+        double rowSeconds = secondsSince(start);
+
+        bool isRangePassed = isSame(topTitles, rank(titleTotals, 1, TOP_COUNT))
+            && isSame(authors, rank(authorTotals, 1, SIZE_MAX))
+            && isSame(repeatBorrowers,
+                rank(borrowerTotals, MIN_REPEAT_RENTALS, SIZE_MAX))
+            && perDay == expectedPerDay;
+        isPassed &= isRangePassed;
+
+        cout << from.getDateString() << " ~ " << to.getDateString() << ": 제목 상위 "
+            << topSeconds << "초, 작가별 평균 " << authorSeconds
+            << "초, 반복 대여자 " << borrowerSeconds << "초 ("
+            << repeatBorrowers.size() << "명), 날짜별 " << daySeconds
+            << "초 / 행 단위 한 번에 " << rowSeconds << "초"
+            << (isRangePassed ? "" : " (결과 다름)") << endl;
+        if (!topTitles.empty()) {
+            cout << "  가장 많이 빌린 제목: " << topTitles[0].name << " "
+                << topTitles[0].rentals << "번, 평균 "
+                << topTitles[0].averageLoanDays << "일" << endl;
+        }
+    }
+
+    // 저장했다 다른 풀로 불러도 같은 보고서가 나오는지 확인
+    string path = (filesystem::temp_directory_path() / "book_service.history")
+        .string();
+    auto saveStart = chrono::steady_clock::now();
+    bool isSaved = rentalManager.saveHistory(path);
+    double saveSeconds = secondsSince(saveStart);
+    RentalManager loadedManager(make_shared<StringPool>());
+    auto loadStart = chrono::steady_clock::now();
+    bool isLoaded = isSaved && loadedManager.loadHistory(path);
+    double loadSeconds = secondsSince(loadStart);
+    isPassed &= isLoaded
+        && loadedManager.getHistory().size() == history.size()
+        && isSame(loadedManager.getRepeatBorrowers(firstDate, lastDate,
+            MIN_REPEAT_RENTALS), rentalManager.getRepeatBorrowers(firstDate,
+            lastDate, MIN_REPEAT_RENTALS))
+        && isSame(loadedManager.getTopTitles(firstDate, lastDate, TOP_COUNT,
+            bookManager), rentalManager.getTopTitles(firstDate, lastDate,
+            TOP_COUNT, bookManager));
+    error_code error;
+    cout << "파일: " << filesystem::file_size(path, error) / (1 << 20)
+        << "MiB, 저장 " << saveSeconds << "초, 불러오기 " << loadSeconds
+        << "초" << endl;
+    filesystem::remove(path, error);
+    cout << defaultfloat << setprecision(6);
+    cout << (isPassed ? "통과" : "실패") << endl;
+    return isPassed ? 0 : 1;
+}
+
+// 전체 목록을 한 번에 꺼내는 것(getAllBooks/getAllRentals)과 커서로 페이지씩
+// 읽는 것의 첫 결과까지 걸리는 시간과 힙 최대 사용량을 비교. 페이지로 읽은
+// 결과가 순서대로 한 번씩 나오는지도 확인. 모두 맞으면 0을 돌려줌
+int runPageBenchmark(size_t bookCount) {
+    constexpr size_t PAGE_SIZE = 1000;
+    constexpr int DAY_COUNT = 365;
+
+    auto stringPool = make_shared<StringPool>();
+    BookManager bookManager(stringPool);
+    RentalManager rentalManager(stringPool);
+    mt19937 random(1);
+    {
+        vector<pair<string, string>> rows;
+        rows.reserve(bookCount);
+        size_t titleCount = max<size_t>(bookCount / 4, 1);
+        for (size_t i = 0; i < bookCount; i++) {
+            rows.emplace_back("제목" + to_string(random() % titleCount),
+                "작가" + to_string(i % 1000));
+        }
+        bookManager.addBooks(rows);
+    }
+    // 세 권에 한 권씩 대여
+    DateStruct firstDate(2025, 1, 1);
+    BorrowerId borrowerId = *rentalManager.registerBorrower("대여자", "010");
+    size_t rentalCount = 0;
+    for (size_t id = 1; id <= bookCount; id += 3) {
+        auto returnDate = DateStruct::fromDayNumber(
+            firstDate.dayNumber + static_cast<int32_t>(random() % DAY_COUNT));
+        rentalManager.rentById(static_cast<int>(id), borrowerId, returnDate,
+            bookManager);
+        rentalCount++;
+    }
+
+    using Clock = chrono::steady_clock;
+    auto toMilliseconds = [](Clock::duration elapsed) {
+        return chrono::duration<double, milli>(elapsed).count();
+    };
+    struct Result {
+        const char* name;
+        double firstMilliseconds;
+        double totalMilliseconds;
+        size_t peakBytes;
+        size_t count;
+    };
+    vector<Result> results;
+
+    auto measureAll = [&](const char* name, auto&& getAll) {
+        size_t bytesBefore = getHeapLiveBytes();
+        auto start = Clock::now();
+        auto all = getAll();
+        double elapsed = toMilliseconds(Clock::now() - start);
+        // 한 번에 꺼내면 전체가 만들어져야 첫 항목을 쓸 수 있음
+        results.push_back({ name, elapsed, elapsed,
+            getHeapLiveBytes() - bytesBefore, all.size() });
+    };
+    // visit(page)는 페이지의 항목 수를 돌려줌
+    auto measurePages = [&](const char* name, auto firstCursor, auto&& getPage,
+        auto&& visit) {
+        size_t bytesBefore = getHeapLiveBytes();
+        size_t peakBytes = 0;
+        size_t count = 0;
+        double firstMilliseconds = 0;
+        auto start = Clock::now();
+        auto page = getPage(firstCursor);
+        while (true) {
+            if (count == 0) {
+                firstMilliseconds = toMilliseconds(Clock::now() - start);
+            }
+            peakBytes = max(peakBytes, getHeapLiveBytes() - bytesBefore);
+            count += visit(page);
+            if (!page.hasMore) {
+                break;
+            }
+            auto next = page.next;
+            page = getPage(next);
+        }
+        results.push_back({ name, firstMilliseconds,
+            toMilliseconds(Clock::now() - start), peakBytes, count });
+    };
+
+    bool isPassed = true;
+    measureAll("getAllBooks", [&] { return bookManager.getAllBooks(); });
+
+    int lastId = 0;
+    measurePages("책번호 순 페이지", BookCursor{},
+        [&](const BookCursor& cursor) {
+            return bookManager.getBookPage(cursor, PAGE_SIZE);
+        },
+        [&](const BookPage& page) {
+            for (const BookView& book : page.books) {
+                isPassed = isPassed && book.id == lastId + 1;
+                lastId = book.id;
+            }
+            return page.books.size();
+        });
+    isPassed = isPassed && lastId == static_cast<int>(bookCount);
+
+    // 제목, 책번호 순으로 빠짐없이 한 번씩
+    pair<string, int> lastKey;
+    size_t titleOrderCount = 0;
+    measurePages("제목 순 페이지", BookCursor{ BookOrder::BY_TITLE, 0, {} },
+        [&](const BookCursor& cursor) {
+            return bookManager.getBookPage(cursor, PAGE_SIZE);
+        },
+        [&](const BookPage& page) {
+            for (const BookView& book : page.books) {
+                isPassed = isPassed && (titleOrderCount == 0 ||
+                    lastKey < pair<string, int>(book.title, book.id));
+                lastKey = { string(book.title), book.id };
+                titleOrderCount++;
+            }
+            return page.books.size();
+        });
+    isPassed = isPassed && titleOrderCount == bookCount;
+
+    measureAll("getAllRentals", [&] { return rentalManager.getAllRentals(); });
+
+    int lastRentalId = 0;
+    size_t rentalIdCount = 0;
+    measurePages("대여 책번호 순 페이지", RentalCursor{},
+        [&](const RentalCursor& cursor) {
+            return rentalManager.getRentalPage(cursor, PAGE_SIZE, bookManager);
+        },
+        [&](const RentalPage& page) {
+            for (const auto& rental : page.rentals) {
+                isPassed = isPassed && rental->bookId > lastRentalId;
+                lastRentalId = rental->bookId;
+                rentalIdCount++;
+            }
+            return page.rentals.size();
+        });
+    isPassed = isPassed && rentalIdCount == rentalCount;
+
+    pair<int32_t, int> lastDue{ INT32_MIN, 0 };
+    size_t rentalDateCount = 0;
+    measurePages("대여 반납일 순 페이지", RentalCursor{ RentalOrder::BY_RETURN_DATE },
+        [&](const RentalCursor& cursor) {
+            return rentalManager.getRentalPage(cursor, PAGE_SIZE, bookManager);
+        },
+        [&](const RentalPage& page) {
+            for (const auto& rental : page.rentals) {
+                pair<int32_t, int> due{ rental->getReturnDate().dayNumber,
+                    rental->bookId };
+                isPassed = isPassed && lastDue < due;
+                lastDue = due;
+                rentalDateCount++;
+            }
+            return page.rentals.size();
+        });
+    isPassed = isPassed && rentalDateCount == rentalCount;
+
+    // 토큰으로 바꿨다 되돌려도 같은 위치
+    BookPage titlePage = bookManager.getBookPage({ BookOrder::BY_TITLE, 0, {} }, 3);
+    optional<BookCursor> parsed = BookCursor::fromToken(titlePage.next.toToken());
+    isPassed = isPassed && parsed && parsed->order == BookOrder::BY_TITLE &&
+        parsed->bookId == titlePage.next.bookId &&
+        parsed->title == titlePage.next.title;
+    RentalPage datePage =
+        rentalManager.getRentalPage({ RentalOrder::BY_RETURN_DATE }, 3, bookManager);
+    optional<RentalCursor> parsedRental =
+        RentalCursor::fromToken(datePage.next.toToken());
+    isPassed = isPassed && parsedRental &&
+        parsedRental->returnDay == datePage.next.returnDay &&
+        parsedRental->bookId == datePage.next.bookId;
+
+    cout << fixed << setprecision(2);
+    cout << "----전체 목록 (책 " << bookCount << "권, 대여 " << rentalCount
+        << "건, 페이지 " << PAGE_SIZE << "개)----" << endl;
+    for (const Result& result : results) {
+        cout << result.name << ": 첫 결과 " << result.firstMilliseconds
+            << "ms, 전체 " << result.totalMilliseconds << "ms, 힙 최대 "
+            << result.peakBytes / 1024.0 << "KB, " << result.count << "건"
+            << endl;
+    }
+    cout << defaultfloat << setprecision(6);
+    cout << (isPassed ? "통과" : "실패") << endl;
+    return isPassed ? 0 : 1;
+}
+
+// 제목/작가/대여 상태를 섞은 조건을 비트맵 조건 검색으로 구하고, 전체 책을
+// 한 권씩 훑어 같은 조건을 확인한 결과와 비교. 작가 한 명의 책을 꺼내 손으로
+// 거르는 예전 방식의 시간도 같이 잼. 결과가 모두 같으면 0을 돌려줌
+int runQueryBenchmark(size_t bookCount) {
+    constexpr size_t AUTHOR_COUNT = 1000;
+    constexpr int DAY_COUNT = 365;
+
+    auto stringPool = make_shared<StringPool>();
+    BookManager bookManager(stringPool);
+    RentalManager rentalManager(stringPool);
+    mt19937 random(1);
+    {
+        vector<pair<string, string>> rows;
+        rows.reserve(bookCount);
+        size_t titleCount = max<size_t>(bookCount / 8, 1);
+        for (size_t i = 0; i < bookCount; i++) {
+            rows.emplace_back("제목" + to_string(random() % titleCount),
+                "작가" + to_string(random() % AUTHOR_COUNT));
+        }
+        bookManager.addBooks(rows);
+    }
+    // 세 권에 한 권꼴로 대여
+    DateStruct firstDate(2025, 1, 1);
+    BorrowerId borrowerId = *rentalManager.registerBorrower("대여자", "010");
+    for (size_t id = 1; id <= bookCount; id++) {
+        if (random() % 3 != 0) {
+            continue;
+        }
+        auto returnDate = DateStruct::fromDayNumber(
+            firstDate.dayNumber + static_cast<int32_t>(random() % DAY_COUNT));
+        rentalManager.rentById(static_cast<int>(id), borrowerId, returnDate,
+            bookManager);
+    }
+    auto midYear = DateStruct::fromDayNumber(firstDate.dayNumber + DAY_COUNT / 2);
+
+    using Clock = chrono::steady_clock;
+    auto toMilliseconds = [](Clock::duration elapsed) {
+        return chrono::duration<double, milli>(elapsed).count();
+    };
+    auto startsWith = [](string_view text, string_view prefix) {
+        return text.substr(0, prefix.size()) == prefix;
+    };
+    auto isDue = [&](const BookView& book) {
+        return book.returnDate && book.returnDate->dayNumber <= midYear.dayNumber;
+    };
+
+    struct Case {
+        const char* name;
+        BookQuery query;
+        function<bool(const BookView&)> matches;
+    };
+    vector<Case> cases;
+    cases.push_back({ "대여 가능 & 작가7 & 제목1*",
+        BookQuery::allOf({ BookQuery::available(), BookQuery::author("작가7"),
+            BookQuery::titlePrefix("제목1") }),
+        [&](const BookView& book) {
+            return !book.returnDate && book.author == "작가7" &&
+                startsWith(book.title, "제목1");
+        } });
+    cases.push_back({ "(작가1 | 작가2) & !대여중",
+        BookQuery::allOf({ BookQuery::anyOf({ BookQuery::author("작가1"),
+            BookQuery::author("작가2") }),
+            BookQuery::negate(BookQuery::rented()) }),
+        [&](const BookView& book) {
+            return (book.author == "작가1" || book.author == "작가2") &&
+                !book.returnDate;
+        } });
+    cases.push_back({ "반납일 지남 & 작가9*",
+        BookQuery::allOf({ BookQuery::dueBy(midYear),
+            BookQuery::authorPrefix("작가9") }),
+        [&](const BookView& book) {
+            return isDue(book) && startsWith(book.author, "작가9");
+        } });
+    cases.push_back({ "!제목1* & 대여중",
+        BookQuery::allOf({ BookQuery::negate(BookQuery::titlePrefix("제목1")),
+            BookQuery::rented() }),
+        [&](const BookView& book) {
+            return !startsWith(book.title, "제목1") && book.returnDate;
+        } });
+
+    bool isPassed = true;
+    cout << fixed << setprecision(3);
+    cout << "----조건 검색 (책 " << bookCount << "권)----" << endl;
+    for (const Case& testCase : cases) {
+        auto start = Clock::now();
+        BookQueryResult result = bookManager.queryBooks(testCase.query);
+        double queryMilliseconds = toMilliseconds(Clock::now() - start);
+
+        start = Clock::now();
+        size_t count = bookManager.countBooks(testCase.query);
+        double countMilliseconds = toMilliseconds(Clock::now() - start);
+
+        start = Clock::now();
+        vector<int> expected;
+        bookManager.forEachBook([&](const BookView& book) {
+            if (testCase.matches(book)) {
+                expected.push_back(book.id);
+            }
+        });
+        double scanMilliseconds = toMilliseconds(Clock::now() - start);
+
+        bool isSame = result.ids == expected &&
+            result.totalCount == expected.size() && count == expected.size();
+        isPassed = isPassed && isSame;
+        cout << testCase.name << ": " << result.totalCount << "권, 비트맵 "
+            << queryMilliseconds << "ms (권수만 " << countMilliseconds
+            << "ms), 전체 훑기 " << scanMilliseconds << "ms"
+            << (isSame ? "" : " 불일치") << endl;
+    }
+
+    // 예전 방식: 작가의 책을 전부 꺼내 제목과 대여 상태를 손으로 거름
+    auto start = Clock::now();
+    size_t manualCount = 0;
+    for (const auto& book : bookManager.getBooksByAuthor("작가7")) {
+        if (!book->rentalInfo && startsWith(book->getTitle(), "제목1")) {
+            manualCount++;
+        }
+    }
+    double manualMilliseconds = toMilliseconds(Clock::now() - start);
+    BookQueryResult limited = bookManager.queryBooks(cases[0].query, 10);
+    isPassed = isPassed && limited.totalCount == manualCount &&
+        limited.ids.size() == min<size_t>(10, manualCount);
+    cout << "getBooksByAuthor 후 거르기: " << manualCount << "권, "
+        << manualMilliseconds << "ms" << endl;
+    cout << defaultfloat << setprecision(6);
+    cout << (isPassed ? "통과" : "실패") << endl;
+    return isPassed ? 0 : 1;
+}
+
+// 대여와 반납을 opCount번 번갈아 하면서 결과를 남기는 방법별 처리량 비교.
+// 예전처럼 작업마다 출력하고 flush하는 것과 이벤트 로그(drop/block)를 씀.
+// 출력은 모두 임시 파일로 보냄
+int runEventBenchmark(size_t opCount) {
+    constexpr size_t BOOK_COUNT = 10'000;
+
+    string path = (filesystem::temp_directory_path() / "book_service_bench.events")
+        .string();
+    DateStruct returnDate(2025, 1, 7);
+
+    // 책 BOOK_COUNT권을 새로 만들고 한 권씩 빌렸다가 돌려줌.
+    // onResult는 작업마다 결과를 받음
+    auto run = [&](shared_ptr<EventLog> eventLog, auto onResult) {
+        auto stringPool = make_shared<StringPool>();
+        BookManager bookManager(stringPool);
+        RentalManager rentalManager(stringPool);
+        vector<pair<string, string>> rows;
+        for (size_t i = 0; i < BOOK_COUNT; i++) {
+            rows.emplace_back("책" + to_string(i), "작가");
+        }
+        bookManager.addBooks(rows);
+        BorrowerId borrowerId = *rentalManager.registerBorrower("대여자", "010");
+        rentalManager.attachEventLog(eventLog);
+
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < opCount; i++) {
+            auto bookId = static_cast<int>(i / 2 % BOOK_COUNT) + 1;
+            if (i % 2 == 0) {
+                shared_ptr<RentalInfo> rentalInfo;
+                RentalStatus status = rentalManager.rentById(bookId,
+                    borrowerId, returnDate, bookManager, &rentalInfo);
+                onResult(status, rentalInfo.get());
+            }
+            else {
+                onResult(rentalManager.returnById(bookId, bookManager),
+                    nullptr);
+            }
+        }
+        if (eventLog) {
+            eventLog->flush();
+        }
+        return chrono::duration<double>(chrono::steady_clock::now() - start)
+            .count();
+    };
+    auto printResult = [&](const char* name, double seconds) {
+        cout << name << ": " << seconds << "초 ("
+            << static_cast<size_t>(opCount / seconds) << " ops/s)" << endl;
+    };
+
+    cout << "----이벤트 기록 (대여/반납 " << opCount << "번)----" << endl;
+    printResult("기록 없음", run(nullptr, [](RentalStatus, const RentalInfo*) {}));
+
+    // 예전 콘솔 출력: 작업마다 대여정보나 반납 메시지를 쓰고 endl로 flush
+    filesystem::remove(path);
+    {
+        ofstream console(path, ios::binary);
+        streambuf* consoleBuffer = cout.rdbuf(console.rdbuf());
+        double seconds = run(nullptr,
+            [](RentalStatus status, const RentalInfo* rentalInfo) {
+                if (status != RentalStatus::SUCCESS) {
+                    cout << getRentalStatusMessage(status) << endl;
+                }
+                else if (rentalInfo) {
+                    cout << "----대여완료, 대여정보 출력----" << endl;
+                    rentalInfo->displaySelf();
+                }
+                else {
+                    cout << "반납 완료." << endl;
+                }
+            });
+        cout.rdbuf(consoleBuffer);
+        printResult("작업마다 출력", seconds);
+    }
+
+    bool isPassed = true;
+    for (auto policy : { OverflowPolicy::DROP, OverflowPolicy::BLOCK }) {
+        filesystem::remove(path);
+        auto eventLog = make_shared<EventLog>(path, EventLevel::INFO, policy);
+        if (!eventLog->isOpen()) {
+            cout << "이벤트 로그 파일을 열 수 없음: " << path << endl;
+            return 1;
+        }
+        double seconds = run(eventLog, [](RentalStatus, const RentalInfo*) {});
+        size_t written = eventLog->getWrittenCount();
+        size_t dropped = eventLog->getDroppedCount();
+        eventLog.reset();
+
+        ifstream file(path, ios::binary);
+        size_t lineCount = count(istreambuf_iterator<char>(file),
+            istreambuf_iterator<char>(), '\n');
+        bool isSame = lineCount == written && written + dropped == opCount &&
+            (policy == OverflowPolicy::DROP || dropped == 0);
+        isPassed = isPassed && isSame;
+        printResult(policy == OverflowPolicy::DROP ? "이벤트 로그(drop)"
+            : "이벤트 로그(block)", seconds);
+        cout << "  기록 " << written << "줄, 버림 " << dropped << "건"
+            << (isSame ? "" : " 불일치") << endl;
+    }
+    filesystem::remove(path);
+
+    cout << (isPassed ? "통과" : "실패") << endl;
+    return isPassed ? 0 : 1;
+}
+
+// 실행 인자: --bench-server [--clients=N] [--requests=N] [--depth=N]
+//           [--books=N] [--threads=N] [--unix]
+int runServerBenchmark(int argc, char* argv[]) {
+    LoadOptions options;
+    for (int i = 2; i < argc; i++) {
+        string_view arg = argv[i];
+        if (arg.starts_with("--clients=")) {
+            options.clientCount = stoull(string(arg.substr(10)));
+        }
+        else if (arg.starts_with("--requests=")) {
+            options.requestsPerClient = stoull(string(arg.substr(11)));
+        }
+        else if (arg.starts_with("--depth=")) {
+            options.pipelineDepth = max<size_t>(stoull(string(arg.substr(8))), 1);
+        }
+        else if (arg.starts_with("--books=")) {
+            options.bookCount = max<size_t>(stoull(string(arg.substr(8))), 1);
+        }
+        else if (arg.starts_with("--threads=")) {
+            options.serverThreads = max(stoi(string(arg.substr(10))), 1);
+        }
+        else if (arg == "--unix") {
+            options.isUnixSocket = true;
+        }
+        else {
+            cout << "알 수 없는 인자: " << arg << endl;
+            return 1;
+        }
+    }
+    return runServerLoad(options);
+}
+
+int main(int argc, char* argv[]) {
+    // 인자가 없으면 기본 설정으로 작업량 벤치마크를 실행
+    string_view mode = argc > 1 ? argv[1] : "--workload";
+
+    // --stress [스레드 수] [스레드당 반복 횟수]: 동시성 검사만 하고 종료
+    if (mode == "--stress") {
+        int threadCount = argc > 2 ? stoi(argv[2]) : 8;
+        int iterations = argc > 3 ? stoi(argv[3]) : 20000;
+        return runRentalStressTest(threadCount, iterations);
+    }
+    // --bench-recovery [이벤트 수]: 로그 복구 시간만 재고 종료
+    if (mode == "--bench-recovery") {
+        size_t eventCount = argc > 2 ? stoull(argv[2]) : 10'000'000;
+        return runRecoveryBenchmark(eventCount);
+    }
+    // --bench-snapshot [책 수]: 스냅샷 저장/불러오기 시간만 재고 종료
+    if (mode == "--bench-snapshot") {
+        size_t bookCount = argc > 2 ? stoull(argv[2]) : 1'000'000;
+        return runSnapshotBenchmark(bookCount);
+    }
+    // --bench-delayed [대여 수]: 연체 수/페이지 조회 시간만 재고 종료
+    if (mode == "--bench-delayed") {
+        size_t rentalCount = argc > 2 ? stoull(argv[2]) : 1'000'000;
+        return runDelayedRentalBenchmark(rentalCount);
+    }
+    // --bench-alloc [책 수] [대여/반납 횟수]: 대여/반납 중 힙 할당 횟수만 재고 종료
+    if (mode == "--bench-alloc") {
+        size_t bookCount = argc > 2 ? stoull(argv[2]) : 100'000;
+        size_t opCount = argc > 3 ? stoull(argv[3]) : 1'000'000;
+        return runAllocationBenchmark(bookCount, opCount);
+    }
+    // --bench-batch [한 번에 빌리는 권수] [반복 횟수]: 한 권씩과 일괄 대여/반납 비교
+    if (mode == "--bench-batch") {
+        size_t batchSize = argc > 2 ? stoull(argv[2]) : 300;
+        size_t roundCount = argc > 3 ? stoull(argv[3]) : 20;
+        return runBatchBenchmark(max<size_t>(batchSize, 1), roundCount);
+    }
+    // --bench-index [키 수] [조회 횟수]: 문자열 색인의 메모리와 조회 시간 비교
+    if (mode == "--bench-index") {
+        size_t keyCount = argc > 2 ? stoull(argv[2]) : 1'000'000;
+        size_t lookupCount = argc > 3 ? stoull(argv[3]) : 2'000'000;
+        return runIndexBenchmark(max<size_t>(keyCount, 1), lookupCount);
+    }
+    // --bench-history [기록 수] [년수]: 대여 기록 보고서 시간과 결과 확인
+    if (mode == "--bench-history") {
+        size_t recordCount = argc > 2 ? stoull(argv[2]) : 10'000'000;
+        int yearCount = argc > 3 ? stoi(argv[3]) : 5;
+        return runHistoryBenchmark(recordCount, max(yearCount, 1));
+    }
+    // --bench-query [책 수]: 비트맵 조건 검색과 전체 훑기의 결과와 시간 비교
+    if (mode == "--bench-query") {
+        size_t bookCount = argc > 2 ? stoull(argv[2]) : 1'000'000;
+        return runQueryBenchmark(max<size_t>(bookCount, 1));
+    }
+    // --bench-events [대여/반납 횟수]: 작업마다 출력할 때와 이벤트 로그를 쓸 때 비교
+    if (mode == "--bench-events") {
+        size_t opCount = argc > 2 ? stoull(argv[2]) : 1'000'000;
+        return runEventBenchmark(opCount);
+    }
+    // --bench-pages [책 수]: 전체 목록을 한 번에 꺼낼 때와 페이지로 읽을 때 비교
+    if (mode == "--bench-pages") {
+        size_t bookCount = argc > 2 ? stoull(argv[2]) : 1'000'000;
+        return runPageBenchmark(max<size_t>(bookCount, 1));
+    }
+
+    // --workload [옵션...]: 합성 작업량으로 작업별 처리량과 지연 시간을 잼
+    if (mode == "--workload") {
+        return runWorkloadBenchmark(argc, argv);
+    }
+    // --bench-server [옵션...]: loopback 서버에 여러 연결로 요청을 보내
+    // 초당 요청 수와 지연 시간을 잼
+    if (mode == "--bench-server") {
+        return runServerBenchmark(argc, argv);
+    }
+
+    cout << "사용법: BookBench [--workload ...|--stress|--bench-recovery|"
+        "--bench-snapshot|--bench-delayed|--bench-alloc|--bench-batch|--bench-index|--bench-server|"
+        "--bench-history|--bench-pages|--bench-query|--bench-events] [인자...]" << endl;
+    return 1;
+}
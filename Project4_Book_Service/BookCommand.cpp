@@ -0,0 +1,213 @@
+#include "BookCommand.h"
+
+using namespace std;
+
+namespace {
+    optional<int> parseBookId(string_view text) {
+        int value;
+        auto [end, ec] = from_chars(text.data(), text.data() + text.size(), value);
+        if (ec != errc() || end != text.data() + text.size()) {
+            return nullopt;
+        }
+        return value;
+    }
+
+    optional<size_t> parsePageSize(string_view text, size_t maxPageSize) {
+        size_t value;
+        auto [end, ec] = from_chars(text.data(), text.data() + text.size(), value);
+        if (ec != errc() || end != text.data() + text.size() || value == 0 ||
+            value > maxPageSize) {
+            return nullopt;
+        }
+        return value;
+    }
+
+    // "<다음 토큰>\t<책번호>,<책번호>,..."
+    template <typename Items, typename GetId>
+    string formatListPage(const Items& items, bool hasMore, string_view token,
+        GetId getId) {
+        string value(hasMore ? token : "-");
+        value.push_back('\t');
+        char digits[16];
+        for (size_t i = 0; i < items.size(); i++) {
+            if (i > 0) {
+                value.push_back(',');
+            }
+            auto [end, ec] = to_chars(begin(digits), std::end(digits),
+                getId(items[i]));
+            value.append(digits, end);
+        }
+        return value;
+    }
+}
+
+// 필드 수를 돌려줌. MAX_FIELD_COUNT보다 많으면 MAX_FIELD_COUNT + 1
+size_t CommandExecutor::splitFields(string_view line,
+    array<string_view, MAX_FIELD_COUNT + 1>& fields) {
+    bool isTabSeparated = line.find('\t') != string_view::npos;
+    size_t count = 0;
+    while (!line.empty() && count < fields.size()) {
+        size_t end;
+        if (isTabSeparated) {
+            end = min(line.find('\t'), line.size());
+        }
+        else {
+            size_t start = line.find_first_not_of(' ');
+            if (start == string_view::npos) {
+                break;
+            }
+            line.remove_prefix(start);
+            end = min(line.find(' '), line.size());
+        }
+        fields[count++] = line.substr(0, end);
+        line.remove_prefix(min(end + 1, line.size()));
+    }
+    return count;
+}
+
+void CommandExecutor::appendResult(string& out, size_t lineNumber, bool isOk,
+    string_view value) {
+    char digits[24];
+    auto [end, ec] = to_chars(begin(digits), std::end(digits), lineNumber);
+    out.append(digits, end);
+    out.append(isOk ? "\tOK\t" : "\tERR\t");
+    out.append(value);
+    out.push_back('\n');
+}
+
+void CommandExecutor::appendResult(string& out, size_t lineNumber, size_t value) {
+    char digits[24];
+    auto [end, ec] = to_chars(begin(digits), std::end(digits), value);
+    appendResult(out, lineNumber, true, string_view(digits, end - digits));
+}
+
+bool CommandExecutor::execute(string_view line, size_t lineNumber, string& out) {
+    array<string_view, MAX_FIELD_COUNT + 1> fields;
+    size_t fieldCount = splitFields(line, fields);
+    string_view command = fields[0];
+    counts.commands++;
+
+    auto fail = [&](string_view reason, size_t& counter) {
+        appendResult(out, lineNumber, false, reason);
+        counter++;
+    };
+    auto reportRental = [&](RentalStatus status, int bookId) {
+        if (status == RentalStatus::SUCCESS) {
+            appendResult(out, lineNumber, static_cast<size_t>(bookId));
+            counts.succeeded++;
+            return true;
+        }
+        fail(getRentalStatusCode(status), counts.rejected);
+        return false;
+    };
+
+    if (command == "add" && fieldCount == 3) {
+        int bookId = bookManager.registerBook(fields[1], fields[2]);
+        appendResult(out, lineNumber, static_cast<size_t>(bookId));
+        counts.succeeded++;
+        return true;
+    }
+    else if ((command == "rent" || command == "rent-title") && fieldCount == 5) {
+        optional<DateStruct> returnDate = DateStruct::parse(fields[4]);
+        if (!returnDate) {
+            fail("BAD_DATE", counts.invalid);
+            return false;
+        }
+        RentalDTO rentalDTO(fields[2], fields[3], *returnDate);
+        if (command == "rent-title") {
+            shared_ptr<RentalInfo> rentalInfo;
+            RentalStatus status = rentalManager.rentByTitle(fields[1],
+                rentalDTO, bookManager, &rentalInfo);
+            return reportRental(status, rentalInfo ? rentalInfo->bookId : 0);
+        }
+        optional<int> bookId = parseBookId(fields[1]);
+        if (!bookId) {
+            fail("BAD_BOOK_ID", counts.invalid);
+            return false;
+        }
+        return reportRental(
+            rentalManager.rentById(*bookId, rentalDTO, bookManager), *bookId);
+    }
+    else if (command == "return" && fieldCount == 2) {
+        optional<int> bookId = parseBookId(fields[1]);
+        if (!bookId) {
+            fail("BAD_BOOK_ID", counts.invalid);
+            return false;
+        }
+        return reportRental(rentalManager.returnById(*bookId, bookManager),
+            *bookId);
+    }
+    else if (command == "available" && fieldCount == 2) {
+        appendResult(out, lineNumber,
+            bookManager.countAvailableBooksByTitle(fields[1]));
+        counts.succeeded++;
+    }
+    else if (command == "delayed" && fieldCount == 2) {
+        optional<DateStruct> date = DateStruct::parse(fields[1]);
+        if (!date) {
+            fail("BAD_DATE", counts.invalid);
+            return false;
+        }
+        appendResult(out, lineNumber, rentalManager.countDelayedRentals(*date));
+        counts.succeeded++;
+    }
+    else if ((command == "books" || command == "rentals") &&
+        (fieldCount == 3 || fieldCount == 4)) {
+        optional<size_t> pageSize =
+            parsePageSize(fields[2], MAX_LIST_PAGE_SIZE);
+        if (!pageSize) {
+            fail("BAD_PAGE_SIZE", counts.invalid);
+            return false;
+        }
+        string_view order = fields[1];
+        string value;
+        if (command == "books") {
+            if (order != "id" && order != "title") {
+                fail("BAD_ORDER", counts.invalid);
+                return false;
+            }
+            BookCursor cursor;
+            cursor.order = order == "id" ? BookOrder::BY_ID : BookOrder::BY_TITLE;
+            if (fieldCount == 4) {
+                optional<BookCursor> parsed = BookCursor::fromToken(fields[3]);
+                if (!parsed || parsed->order != cursor.order) {
+                    fail("BAD_TOKEN", counts.invalid);
+                    return false;
+                }
+                cursor = move(*parsed);
+            }
+            BookPage page = bookManager.getBookPage(cursor, *pageSize);
+            value = formatListPage(page.books, page.hasMore,
+                page.next.toToken(), [](const BookView& book) { return book.id; });
+        }
+        else {
+            if (order != "id" && order != "return") {
+                fail("BAD_ORDER", counts.invalid);
+                return false;
+            }
+            RentalCursor cursor;
+            cursor.order = order == "id" ? RentalOrder::BY_BOOK_ID
+                : RentalOrder::BY_RETURN_DATE;
+            if (fieldCount == 4) {
+                optional<RentalCursor> parsed = RentalCursor::fromToken(fields[3]);
+                if (!parsed || parsed->order != cursor.order) {
+                    fail("BAD_TOKEN", counts.invalid);
+                    return false;
+                }
+                cursor = *parsed;
+            }
+            RentalPage page =
+                rentalManager.getRentalPage(cursor, *pageSize, bookManager);
+            value = formatListPage(page.rentals, page.hasMore,
+                page.next.toToken(), [](const shared_ptr<RentalInfo>& rental) {
+                    return rental->bookId;
+                });
+        }
+        appendResult(out, lineNumber, true, value);
+        counts.succeeded++;
+    }
+    else {
+        fail("BAD_COMMAND", counts.invalid);
+    }
+    return false;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "BookEngine.h"
+
+struct CommandCounts {
+    size_t commands = 0;
+    size_t succeeded = 0;
+    // 엔진이 거절한 명령 (이미 대여중, 없는 책 등)
+    size_t rejected = 0;
+    // 명령이나 인자 형식이 틀린 줄
+    size_t invalid = 0;
+};
+
+// 한 줄짜리 명령을 실행하고 결과를 한 줄로 씀. 일괄 처리와 네트워크 서버가 같이 씀.
+// 필드는 탭으로 나누고, 탭이 없는 줄은 공백으로 나눔.
+//   add <제목> <작가>                            -> 새 책번호
+//   rent <책번호> <대여자> <휴대폰> <반납일>      -> 대여한 책번호
+//   rent-title <제목> <대여자> <휴대폰> <반납일>  -> 대여한 책번호
+//   return <책번호>                              -> 반납한 책번호
+//   available <제목>                             -> 대여 가능한 권수
+//   delayed <기준일>                             -> 기준일까지 반납해야 하는 대여 수
+//   books <id|title> <개수> [토큰]               -> 다음 토큰, 책번호 목록
+//   rentals <id|return> <개수> [토큰]            -> 다음 토큰, 대여중인 책번호 목록
+// 목록 명령의 값은 "<다음 토큰>\t<책번호>,<책번호>,...". 마지막 페이지면
+// 다음 토큰은 "-". 토큰을 생략하면 처음부터 읽음. 개수는 MAX_LIST_PAGE_SIZE까지
+// 날짜는 YYYY-MM-DD. 결과는 "<줄 번호>\tOK\t<값>" 또는
+// "<줄 번호>\tERR\t<사유>".
+// 스레드마다 따로 만들어 씀
+class CommandExecutor {
+private:
+    static constexpr size_t MAX_FIELD_COUNT = 5;
+    static constexpr size_t MAX_LIST_PAGE_SIZE = 1000;
+
+    BookManager& bookManager;
+    RentalManager& rentalManager;
+    CommandCounts counts;
+
+    static size_t splitFields(std::string_view line,
+        std::array<std::string_view, MAX_FIELD_COUNT + 1>& fields);
+    static void appendResult(std::string& out, size_t lineNumber, size_t value);
+
+public:
+    CommandExecutor(BookManager& bookManager, RentalManager& rentalManager)
+        : bookManager{ bookManager }, rentalManager{ rentalManager } {
+    }
+
+    // 빈 줄이나 #로 시작하는 줄은 명령이 아니므로 호출하지 않아야 함.
+    // 상태를 바꾼 명령(성공한 add/rent/return)이면 true
+    bool execute(std::string_view line, size_t lineNumber, std::string& out);
+
+    static void appendResult(std::string& out, size_t lineNumber, bool isOk,
+        std::string_view value);
+
+    const CommandCounts& getCounts() const {
+        return counts;
+    }
+};
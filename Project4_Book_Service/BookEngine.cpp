@@ -0,0 +1,4248 @@
+#include "BookEngine.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+// wingdi.h의 ERROR 매크로가 EventLevel::ERROR를 가리지 않게 함
+#define NOGDI
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+void Renderer::appendNumber(int value) {
+    char digits[16];
+    auto [end, ec] = to_chars(begin(digits), std::end(digits), value);
+    buffer.append(digits, end);
+}
+
+void Renderer::appendDate(DateStruct date) {
+    char dateString[DateStruct::DATE_STRING_SIZE];
+    date.getDateString(dateString);
+    buffer.append(dateString, DateStruct::DATE_STRING_SIZE - 1);
+}
+
+// TSV는 탭/개행을 공백으로, JSON은 따옴표로 감싸고 이스케이프
+void Renderer::appendField(string_view value) {
+    switch (format) {
+    case RenderFormat::TEXT:
+        buffer.append(value);
+        break;
+    case RenderFormat::TSV:
+        for (char c : value) {
+            buffer.push_back(c == '\t' || c == '\n' || c == '\r' ? ' ' : c);
+        }
+        break;
+    case RenderFormat::JSON:
+        buffer.push_back('"');
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                buffer.push_back('\\');
+                buffer.push_back(c);
+            }
+            else if (static_cast<unsigned char>(c) < 0x20) {
+                constexpr char hexDigits[] = "0123456789abcdef";
+                buffer.append("\\u00");
+                buffer.push_back(hexDigits[(c >> 4) & 0xF]);
+                buffer.push_back(hexDigits[c & 0xF]);
+            }
+            else {
+                buffer.push_back(c);
+            }
+        }
+        buffer.push_back('"');
+        break;
+    }
+}
+
+void Renderer::append(const BookView& book) {
+    switch (format) {
+    case RenderFormat::TEXT:
+        buffer.append("-----책정보-----\n번호: ");
+        appendNumber(book.id);
+        buffer.append("\n제목: ");
+        appendField(book.title);
+        buffer.append("\n작가: ");
+        appendField(book.author);
+        if (book.returnDate) {
+            buffer.append("\n상태: 대여중\n반납일: ");
+            appendDate(*book.returnDate);
+            buffer.append("\n\n");
+        }
+        else {
+            buffer.append("\n상태: 대여가능\n\n");
+        }
+        break;
+    case RenderFormat::TSV:
+        // 번호, 제목, 작가, 반납일(대여가능이면 빈 칸)
+        appendNumber(book.id);
+        buffer.push_back('\t');
+        appendField(book.title);
+        buffer.push_back('\t');
+        appendField(book.author);
+        buffer.push_back('\t');
+        if (book.returnDate) {
+            appendDate(*book.returnDate);
+        }
+        buffer.push_back('\n');
+        break;
+    case RenderFormat::JSON:
+        buffer.append("{\"id\":");
+        appendNumber(book.id);
+        buffer.append(",\"title\":");
+        appendField(book.title);
+        buffer.append(",\"author\":");
+        appendField(book.author);
+        if (book.returnDate) {
+            buffer.append(",\"returnDate\":\"");
+            appendDate(*book.returnDate);
+            buffer.append("\"}\n");
+        }
+        else {
+            buffer.append(",\"returnDate\":null}\n");
+        }
+        break;
+    }
+    writeIfFull();
+}
+
+void Renderer::append(const RentalInfo& rental) {
+    switch (format) {
+    case RenderFormat::TEXT:
+        buffer.append("-----대여정보-----\n책 제목: ");
+        appendField(rental.bookTitle);
+        buffer.append("\n빌린사람: ");
+        appendField(rental.getBorrower());
+        buffer.append("\n전화번호: ");
+        appendField(rental.getPhone());
+        buffer.append("\n반납일: ");
+        appendDate(rental.getReturnDate());
+        buffer.append("\n\n");
+        break;
+    case RenderFormat::TSV:
+        // 책번호, 제목, 대여자, 전화번호, 반납일
+        appendNumber(rental.bookId);
+        buffer.push_back('\t');
+        appendField(rental.bookTitle);
+        buffer.push_back('\t');
+        appendField(rental.getBorrower());
+        buffer.push_back('\t');
+        appendField(rental.getPhone());
+        buffer.push_back('\t');
+        appendDate(rental.getReturnDate());
+        buffer.push_back('\n');
+        break;
+    case RenderFormat::JSON:
+        buffer.append("{\"bookId\":");
+        appendNumber(rental.bookId);
+        buffer.append(",\"title\":");
+        appendField(rental.bookTitle);
+        buffer.append(",\"borrower\":");
+        appendField(rental.getBorrower());
+        buffer.append(",\"phone\":");
+        appendField(rental.getPhone());
+        buffer.append(",\"returnDate\":\"");
+        appendDate(rental.getReturnDate());
+        buffer.append("\"}\n");
+        break;
+    }
+    writeIfFull();
+}
+
+void Renderer::writeIfFull() {
+    if (buffer.size() >= WRITE_THRESHOLD) {
+        out->write(buffer.data(), static_cast<streamsize>(buffer.size()));
+        buffer.clear();
+    }
+}
+
+void Renderer::flush() {
+    out->write(buffer.data(), static_cast<streamsize>(buffer.size()));
+    out->flush();
+    buffer.clear();
+}
+
+void Book::displaySelf() const {
+    Renderer renderer;
+    renderTo(renderer);
+    renderer.flush();
+}
+
+void Book::renderTo(Renderer& renderer) const {
+    optional<DateStruct> returnDate;
+    if (rentalInfo) {
+        returnDate = rentalInfo->getReturnDate();
+    }
+    renderer.append(BookView{ id, title, author, returnDate });
+}
+
+void BookView::displaySelf() const {
+    Renderer renderer;
+    renderer.append(*this);
+    renderer.flush();
+}
+
+void RentalInfo::displaySelf() const {
+    Renderer renderer;
+    renderer.append(*this);
+    renderer.flush();
+}
+
+void RentalInfo::renderTo(Renderer& renderer) const {
+    renderer.append(*this);
+}
+
+const char* getEngineOperationName(EngineOperation operation) {
+    switch (operation) {
+    case EngineOperation::ADD_BOOK:
+        return "add_book";
+    case EngineOperation::RENT_BY_ID:
+        return "rent_by_id";
+    case EngineOperation::RENT_BY_TITLE:
+        return "rent_by_title";
+    case EngineOperation::RETURN_BOOK:
+        return "return_book";
+    case EngineOperation::FIND_BY_ID:
+        return "find_by_id";
+    case EngineOperation::FIND_BY_TITLE:
+        return "find_by_title";
+    case EngineOperation::FIND_BY_AUTHOR:
+        return "find_by_author";
+    case EngineOperation::SEARCH:
+        return "search";
+    case EngineOperation::COUNT_AVAILABLE:
+        return "count_available";
+    case EngineOperation::FIND_BY_BORROWER:
+        return "find_by_borrower";
+    case EngineOperation::FIND_DELAYED:
+        return "find_delayed";
+    case EngineOperation::COUNT_DELAYED:
+        return "count_delayed";
+    case EngineOperation::RENT_BATCH:
+        return "rent_batch";
+    case EngineOperation::RETURN_BATCH:
+        return "return_batch";
+    case EngineOperation::LIST_BOOKS:
+        return "list_books";
+    case EngineOperation::LIST_RENTALS:
+        return "list_rentals";
+    case EngineOperation::QUERY:
+        return "query";
+    }
+    return "";
+}
+
+double LatencyHistogram::getPercentile(double percentile) const {
+    double rank = count * percentile / 100;
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < BUCKET_COUNT; bucket++) {
+        seen += counts[bucket];
+        if (seen > 0 && seen >= rank) {
+            return min(getBucketMidpoint(bucket),
+                static_cast<double>(maxNanoseconds));
+        }
+    }
+    return static_cast<double>(maxNanoseconds);
+}
+
+struct EngineMetrics::Registry {
+    mutex registryMutex;
+    vector<ThreadCounters*> threads;
+    // 끝난 스레드들의 값을 더해 둔 칸
+    ThreadCounters retired;
+};
+
+EngineMetrics::Registry& EngineMetrics::getRegistry() {
+    // 다른 정적 객체가 없어진 뒤에 끝나는 스레드도 쓰므로 없애지 않음
+    static Registry* registry = new Registry();
+    return *registry;
+}
+
+// 스레드가 끝날 때 그 스레드의 칸을 합계에 넘기고 목록에서 뺌
+class EngineMetrics::ThreadRegistration {
+public:
+    unique_ptr<ThreadCounters> counters = make_unique<ThreadCounters>();
+
+    ThreadRegistration() {
+        Registry& registry = getRegistry();
+        lock_guard lock(registry.registryMutex);
+        registry.threads.push_back(counters.get());
+    }
+
+    ~ThreadRegistration() {
+        Registry& registry = getRegistry();
+        lock_guard lock(registry.registryMutex);
+        for (size_t i = 0; i < ENGINE_OPERATION_COUNT; i++) {
+            auto& source = counters->operations[i];
+            auto& target = registry.retired.operations[i];
+            for (size_t bucket = 0; bucket < LatencyHistogram::BUCKET_COUNT;
+                bucket++) {
+                addRelaxed(target.buckets[bucket],
+                    source.buckets[bucket].load(memory_order_relaxed));
+            }
+            addRelaxed(target.failures,
+                source.failures.load(memory_order_relaxed));
+            addRelaxed(target.totalNanoseconds,
+                source.totalNanoseconds.load(memory_order_relaxed));
+            target.maxNanoseconds.store(
+                max(target.maxNanoseconds.load(memory_order_relaxed),
+                    source.maxNanoseconds.load(memory_order_relaxed)),
+                memory_order_relaxed);
+        }
+        erase(registry.threads, counters.get());
+        localCounters = nullptr;
+    }
+};
+
+EngineMetrics::ThreadCounters& EngineMetrics::registerThread() {
+    thread_local ThreadRegistration registration;
+    localCounters = registration.counters.get();
+    return *localCounters;
+}
+
+LatencyHistogram EngineMetrics::collect(EngineOperation operation) {
+    auto index = static_cast<size_t>(operation);
+    LatencyHistogram histogram;
+    auto add = [&histogram](const OperationCounters& counters) {
+        for (size_t bucket = 0; bucket < LatencyHistogram::BUCKET_COUNT;
+            bucket++) {
+            uint64_t count = counters.buckets[bucket].load(memory_order_relaxed);
+            histogram.counts[bucket] += count;
+            histogram.count += count;
+        }
+        histogram.failures += counters.failures.load(memory_order_relaxed);
+        histogram.totalNanoseconds +=
+            counters.totalNanoseconds.load(memory_order_relaxed);
+        histogram.maxNanoseconds = max(histogram.maxNanoseconds,
+            counters.maxNanoseconds.load(memory_order_relaxed));
+    };
+
+    Registry& registry = getRegistry();
+    lock_guard lock(registry.registryMutex);
+    add(registry.retired.operations[index]);
+    for (ThreadCounters* counters : registry.threads) {
+        add(counters->operations[index]);
+    }
+    return histogram;
+}
+
+string EngineMetrics::exportText(const vector<MetricGauge>& gauges) {
+    constexpr array<pair<double, const char*>, 4> QUANTILES = { {
+        { 50, "0.5" }, { 90, "0.9" }, { 99, "0.99" }, { 99.9, "0.999" } } };
+
+    vector<LatencyHistogram> histograms;
+    histograms.reserve(ENGINE_OPERATION_COUNT);
+    for (size_t i = 0; i < ENGINE_OPERATION_COUNT; i++) {
+        histograms.push_back(collect(EngineOperation(i)));
+    }
+    auto label = [](size_t i) {
+        return string("{operation=\"")
+            + getEngineOperationName(EngineOperation(i)) + "\"";
+    };
+
+    ostringstream out;
+    out << "# TYPE book_operations_total counter\n";
+    for (size_t i = 0; i < ENGINE_OPERATION_COUNT; i++) {
+        out << "book_operations_total" << label(i) << "} "
+            << histograms[i].count << '\n';
+    }
+    out << "# TYPE book_operation_failures_total counter\n";
+    for (size_t i = 0; i < ENGINE_OPERATION_COUNT; i++) {
+        out << "book_operation_failures_total" << label(i) << "} "
+            << histograms[i].failures << '\n';
+    }
+    out << "# TYPE book_operation_latency_seconds summary\n";
+    for (size_t i = 0; i < ENGINE_OPERATION_COUNT; i++) {
+        for (auto [percentile, quantile] : QUANTILES) {
+            out << "book_operation_latency_seconds" << label(i)
+                << ",quantile=\"" << quantile << "\"} "
+                << histograms[i].getPercentile(percentile) / 1e9 << '\n';
+        }
+        out << "book_operation_latency_seconds_sum" << label(i) << "} "
+            << histograms[i].totalNanoseconds / 1e9 << '\n';
+        out << "book_operation_latency_seconds_count" << label(i) << "} "
+            << histograms[i].count << '\n';
+    }
+    out << "# TYPE book_operation_latency_max_seconds gauge\n";
+    for (size_t i = 0; i < ENGINE_OPERATION_COUNT; i++) {
+        out << "book_operation_latency_max_seconds" << label(i) << "} "
+            << histograms[i].maxNanoseconds / 1e9 << '\n';
+    }
+
+    // 같은 이름의 게이지는 한데 모아 TYPE 줄을 한 번만 씀
+    auto getFamily = [](const MetricGauge& gauge) {
+        return string_view(gauge.name).substr(0, gauge.name.find('{'));
+    };
+    vector<const MetricGauge*> sorted;
+    for (const auto& gauge : gauges) {
+        sorted.push_back(&gauge);
+    }
+    stable_sort(sorted.begin(), sorted.end(),
+        [&getFamily](const MetricGauge* left, const MetricGauge* right) {
+            return getFamily(*left) < getFamily(*right);
+        });
+    string_view family;
+    for (const MetricGauge* gauge : sorted) {
+        if (getFamily(*gauge) != family) {
+            family = getFamily(*gauge);
+            out << "# TYPE " << family << " gauge\n";
+        }
+        out << gauge->name << ' ' << gauge->value << '\n';
+    }
+    return out.str();
+}
+
+namespace {
+
+template <typename Index>
+void appendIndexGauges(vector<MetricGauge>& gauges, string_view name,
+    const Index& index) {
+    string label = "{index=\"" + string(name) + "\"}";
+    gauges.push_back({ "book_index_entries" + label,
+        static_cast<double>(index.size()) });
+    gauges.push_back({ "book_index_buckets" + label,
+        static_cast<double>(index.getBucketCount()) });
+    gauges.push_back({ "book_index_load_factor" + label, index.getLoadFactor() });
+}
+
+template <typename Number>
+bool parseTokenNumber(string_view text, Number& value) {
+    auto [end, ec] = from_chars(text.data(), text.data() + text.size(), value);
+    return ec == errc() && end == text.data() + text.size();
+}
+
+template <typename Number>
+void appendTokenNumber(string& token, Number value) {
+    char digits[24];
+    auto [end, ec] = to_chars(begin(digits), std::end(digits), value);
+    token.append(digits, end);
+}
+
+// 커서 토큰의 "<숫자>.<나머지>"를 나눔. 점이 없으면 false
+bool splitToken(string_view token, string_view& head, string_view& tail) {
+    size_t dot = token.find('.');
+    if (dot == string_view::npos) {
+        return false;
+    }
+    head = token.substr(0, dot);
+    tail = token.substr(dot + 1);
+    return true;
+}
+
+}
+
+string BookCursor::toToken() const {
+    constexpr char HEX_DIGITS[] = "0123456789abcdef";
+    string token(1, order == BookOrder::BY_ID ? 'i' : 't');
+    appendTokenNumber(token, bookId);
+    if (order == BookOrder::BY_TITLE) {
+        token.push_back('.');
+        for (unsigned char c : title) {
+            token.push_back(HEX_DIGITS[c >> 4]);
+            token.push_back(HEX_DIGITS[c & 0xF]);
+        }
+    }
+    return token;
+}
+
+optional<BookCursor> BookCursor::fromToken(string_view token) {
+    auto hexValue = [](char c) {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        return -1;
+    };
+
+    BookCursor cursor;
+    if (token.empty()) {
+        return nullopt;
+    }
+    char kind = token[0];
+    token.remove_prefix(1);
+    if (kind == 'i') {
+        if (!parseTokenNumber(token, cursor.bookId)) {
+            return nullopt;
+        }
+        return cursor;
+    }
+
+    string_view idText;
+    string_view hexTitle;
+    if (kind != 't' || !splitToken(token, idText, hexTitle) ||
+        !parseTokenNumber(idText, cursor.bookId) || hexTitle.size() % 2 != 0) {
+        return nullopt;
+    }
+    cursor.order = BookOrder::BY_TITLE;
+    cursor.title.reserve(hexTitle.size() / 2);
+    for (size_t pos = 0; pos < hexTitle.size(); pos += 2) {
+        int high = hexValue(hexTitle[pos]);
+        int low = hexValue(hexTitle[pos + 1]);
+        if (high < 0 || low < 0) {
+            return nullopt;
+        }
+        cursor.title.push_back(static_cast<char>(high << 4 | low));
+    }
+    return cursor;
+}
+
+string RentalCursor::toToken() const {
+    string token;
+    if (order == RentalOrder::BY_BOOK_ID) {
+        token.push_back('i');
+    }
+    else {
+        token.push_back('d');
+        appendTokenNumber(token, returnDay);
+        token.push_back('.');
+    }
+    appendTokenNumber(token, bookId);
+    return token;
+}
+
+optional<RentalCursor> RentalCursor::fromToken(string_view token) {
+    RentalCursor cursor;
+    if (token.empty()) {
+        return nullopt;
+    }
+    char kind = token[0];
+    token.remove_prefix(1);
+    if (kind == 'i') {
+        if (!parseTokenNumber(token, cursor.bookId)) {
+            return nullopt;
+        }
+        return cursor;
+    }
+
+    string_view dayText;
+    string_view idText;
+    if (kind != 'd' || !splitToken(token, dayText, idText) ||
+        !parseTokenNumber(dayText, cursor.returnDay) ||
+        !parseTokenNumber(idText, cursor.bookId)) {
+        return nullopt;
+    }
+    cursor.order = RentalOrder::BY_RETURN_DATE;
+    return cursor;
+}
+
+MappedFile::MappedFile(const string& path) {
+#ifdef _WIN32
+    // 매핑한 채로 새 스냅샷으로 바꿔 쓸 수 있도록 FILE_SHARE_DELETE로 엶
+    HANDLE fileHandle = CreateFileA(path.c_str(), GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    LARGE_INTEGER fileSize;
+    HANDLE mapping = nullptr;
+    if (GetFileSizeEx(fileHandle, &fileSize) && fileSize.QuadPart > 0) {
+        mapping = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0,
+            nullptr);
+    }
+    CloseHandle(fileHandle);
+    if (!mapping) {
+        return;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (view) {
+        data = static_cast<const char*>(view);
+        size = static_cast<size_t>(fileSize.QuadPart);
+    }
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) == 0 && fileStat.st_size > 0) {
+        void* view = mmap(nullptr, static_cast<size_t>(fileStat.st_size),
+            PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view != MAP_FAILED) {
+            data = static_cast<const char*>(view);
+            size = static_cast<size_t>(fileStat.st_size);
+        }
+    }
+    ::close(fd);
+#endif
+}
+
+MappedFile::~MappedFile() {
+    if (!data) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+#else
+    munmap(const_cast<char*>(data), size);
+#endif
+}
+
+bool CatalogSnapshot::validate() {
+    if (!file.isOpen() || file.getSize() < sizeof(Header)) {
+        return false;
+    }
+    header = reinterpret_cast<const Header*>(file.getData());
+    if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0
+        || header->version != VERSION
+        || header->sectionCount != SECTION_COUNT) {
+        return false;
+    }
+
+    constexpr size_t elementSizes[SECTION_COUNT] = {
+        sizeof(uint64_t), 1, sizeof(uint32_t), sizeof(uint32_t),
+        sizeof(uint32_t), sizeof(RentalRecord), sizeof(KeyGroup),
+        sizeof(uint32_t), sizeof(KeyGroup), sizeof(uint32_t), sizeof(KeyGroup),
+        sizeof(uint32_t), sizeof(uint32_t)
+    };
+    for (uint32_t section = 0; section < SECTION_COUNT; section++) {
+        const SectionRef& ref = header->sections[section];
+        if (ref.offset % 8 != 0 || ref.offset > file.getSize()
+            || ref.size > file.getSize() - ref.offset
+            || ref.size % elementSizes[section] != 0) {
+            return false;
+        }
+    }
+
+    string_view payload(file.getData() + sizeof(Header),
+        file.getSize() - sizeof(Header));
+    return computeChecksum(*header, payload) == header->checksum
+        && validateReferences();
+}
+
+uint32_t CatalogSnapshot::computeChecksum(const Header& header,
+    string_view payload) {
+    Header unsignedHeader = header;
+    unsignedHeader.checksum = 0;
+    uint32_t checksum = crc32(0, string_view(
+        reinterpret_cast<const char*>(&unsignedHeader), sizeof(unsignedHeader)));
+    return crc32(checksum, payload);
+}
+
+// 체크섬이 맞아도 쓴 프로그램의 버그나 손으로 만든 파일일 수 있으므로
+// 매핑한 메모리를 번호로 찾아가는 곳은 모두 범위를 확인
+bool CatalogSnapshot::validateReferences() const {
+    auto offsets = getSection<uint64_t>(STRING_OFFSETS);
+    if (offsets.empty() || offsets.front() != 0
+        || offsets.back() != header->sections[STRING_BYTES].size
+        || !is_sorted(offsets.begin(), offsets.end())) {
+        return false;
+    }
+    size_t stringCount = offsets.size() - 1;
+    auto isString = [stringCount](uint32_t id) { return id < stringCount; };
+
+    auto sortedStrings = getSection<uint32_t>(SORTED_STRINGS);
+    auto titles = getBookTitles();
+    auto authors = getBookAuthors();
+    if (sortedStrings.size() != stringCount
+        || !all_of(sortedStrings.begin(), sortedStrings.end(), isString)
+        || authors.size() != titles.size()
+        || !all_of(titles.begin(), titles.end(), isString)
+        || !all_of(authors.begin(), authors.end(), isString)) {
+        return false;
+    }
+    // 문자열과 키 묶음은 이진 탐색하므로 문자열 순이고 중복이 없어야 함
+    auto isNotBefore = [this](uint32_t left, uint32_t right) {
+        return getString(left) >= getString(right);
+    };
+    if (adjacent_find(sortedStrings.begin(), sortedStrings.end(),
+        isNotBefore) != sortedStrings.end()) {
+        return false;
+    }
+
+    // 대여는 책번호 순이고 한 책에 하나
+    size_t bookCount = titles.size();
+    auto rentals = getRentals();
+    int32_t previousBookId = 0;
+    for (const auto& rental : rentals) {
+        if (rental.bookId <= previousBookId
+            || static_cast<size_t>(rental.bookId) > bookCount
+            || !isString(rental.borrowerId) || !isString(rental.phoneId)) {
+            return false;
+        }
+        previousBookId = rental.bookId;
+    }
+
+    // 키 묶음은 items 안의 범위를 가리키고, 책 묶음이면 모든 책이 정확히
+    // 한 묶음에 그 책의 제목/작가 키로 들어 있어야 함
+    auto isValidGroups = [&](Section keys, Section items,
+        span<const uint32_t> keyOfItem, size_t itemLimit) {
+        auto itemIds = getSection<uint32_t>(items);
+        vector<bool> isSeen(keyOfItem.empty() ? 0 : itemLimit + 1, false);
+        const KeyGroup* previous = nullptr;
+        for (const auto& group : getSection<KeyGroup>(keys)) {
+            if (!isString(group.stringId)
+                || (previous && isNotBefore(previous->stringId, group.stringId))
+                || uint64_t(group.first) + group.count > itemIds.size()) {
+                return false;
+            }
+            previous = &group;
+            for (uint32_t item : itemIds.subspan(group.first, group.count)) {
+                if (keyOfItem.empty()) {
+                    if (item >= itemLimit) {
+                        return false;
+                    }
+                    continue;
+                }
+                if (item == 0 || item > itemLimit || isSeen[item]
+                    || keyOfItem[item - 1] != group.stringId) {
+                    return false;
+                }
+                isSeen[item] = true;
+            }
+        }
+        return keyOfItem.empty() || itemIds.size() == itemLimit;
+    };
+    if (!isValidGroups(TITLE_KEYS, TITLE_BOOKS, titles, bookCount)
+        || !isValidGroups(AUTHOR_KEYS, AUTHOR_BOOKS, authors, bookCount)
+        || !isValidGroups(BORROWER_KEYS, BORROWER_RENTALS, {},
+            rentals.size())) {
+        return false;
+    }
+
+    // 반납일 순서는 연체 큐에 그대로 넣으므로 모든 대여가 한 번씩
+    // (반납일, 책번호) 순으로 있어야 함. 대여가 책번호 순이라 위치로 비교
+    auto dueRentals = getRentalsByDueDate();
+    if (dueRentals.size() != rentals.size()
+        || !all_of(dueRentals.begin(), dueRentals.end(),
+            [&rentals](uint32_t pos) { return pos < rentals.size(); })) {
+        return false;
+    }
+    return adjacent_find(dueRentals.begin(), dueRentals.end(),
+        [&rentals](uint32_t left, uint32_t right) {
+            return pair(rentals[left].returnDay, left)
+                >= pair(rentals[right].returnDay, right);
+        }) == dueRentals.end();
+}
+
+shared_ptr<const CatalogSnapshot> CatalogSnapshot::open(const string& path) {
+    shared_ptr<CatalogSnapshot> snapshot(new CatalogSnapshot(path));
+    if (!snapshot->validate()) {
+        return nullptr;
+    }
+    return snapshot;
+}
+
+optional<uint32_t> CatalogSnapshot::findString(string_view value) const {
+    auto sorted = getSection<uint32_t>(SORTED_STRINGS);
+    auto it = lower_bound(sorted.begin(), sorted.end(), value,
+        [this](uint32_t id, string_view text) { return getString(id) < text; });
+    if (it == sorted.end() || getString(*it) != value) {
+        return nullopt;
+    }
+    return *it;
+}
+
+const CatalogSnapshot::KeyGroup* CatalogSnapshot::findGroup(Section keys,
+    string_view key) const {
+    auto groups = getSection<KeyGroup>(keys);
+    auto it = lower_bound(groups.begin(), groups.end(), key,
+        [this](const KeyGroup& group, string_view text) {
+            return getString(group.stringId) < text;
+        });
+    if (it == groups.end() || getString(it->stringId) != key) {
+        return nullptr;
+    }
+    return &*it;
+}
+
+void BookSearchIndex::add(string_view text, SearchField field) {
+    auto keyId = static_cast<uint32_t>(keys.size());
+    keys.push_back({ text, field });
+
+    auto& pending = pendingKeys[static_cast<size_t>(field)];
+    pending.push_back(keyId);
+    if (!isBulkLoading && pending.size() >= MERGE_THRESHOLD) {
+        mergePending(static_cast<size_t>(field));
+    }
+
+    // 같은 n-gram이 여러 번 나와도 한 번만 등록
+    vector<uint32_t> trigrams;
+    for (size_t pos = 0; pos + 3 <= text.size(); pos++) {
+        trigrams.push_back(toTrigram(text, pos));
+    }
+    sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(unique(trigrams.begin(), trigrams.end()), trigrams.end());
+    for (uint32_t trigram : trigrams) {
+        trigramIndex[trigram].push_back(keyId);
+    }
+}
+
+void BookSearchIndex::mergePending(size_t field) {
+    auto& sorted = sortedKeys[field];
+    auto& pending = pendingKeys[field];
+    auto keyLess = [this](uint32_t left, uint32_t right) {
+        return isKeyLess(left, right);
+    };
+    sort(pending.begin(), pending.end(), keyLess);
+    size_t middle = sorted.size();
+    sorted.insert(sorted.end(), pending.begin(), pending.end());
+    inplace_merge(sorted.begin(), sorted.begin() + middle, sorted.end(),
+        keyLess);
+    pending.clear();
+}
+
+void BookSearchIndex::flush() {
+    for (size_t field = 0; field < FIELD_COUNT; field++) {
+        if (!pendingKeys[field].empty()) {
+            mergePending(field);
+        }
+    }
+    isBulkLoading = false;
+}
+
+vector<string_view> BookSearchIndex::getKeysAfter(SearchField field,
+    string_view after, bool inclusive, size_t limit) const {
+    auto isAfter = [&](string_view text) {
+        return inclusive ? text >= after : text > after;
+    };
+    const auto& sorted = sortedKeys[static_cast<size_t>(field)];
+    auto it = partition_point(sorted.begin(), sorted.end(),
+        [&](uint32_t keyId) { return !isAfter(keys[keyId].text); });
+
+    // pending은 정렬되어 있지 않으므로 범위에 드는 것만 골라 정렬
+    vector<string_view> pendingTexts;
+    for (uint32_t keyId : pendingKeys[static_cast<size_t>(field)]) {
+        if (isAfter(keys[keyId].text)) {
+            pendingTexts.push_back(keys[keyId].text);
+        }
+    }
+    sort(pendingTexts.begin(), pendingTexts.end());
+
+    vector<string_view> result;
+    result.reserve(min(limit, static_cast<size_t>(sorted.end() - it) +
+        pendingTexts.size()));
+    auto pendingIt = pendingTexts.begin();
+    while (result.size() < limit) {
+        bool hasSorted = it != sorted.end();
+        bool hasPending = pendingIt != pendingTexts.end();
+        if (!hasSorted && !hasPending) {
+            break;
+        }
+        if (hasSorted && (!hasPending || keys[*it].text < *pendingIt)) {
+            result.push_back(keys[*it++].text);
+        }
+        else {
+            result.push_back(*pendingIt++);
+        }
+    }
+    return result;
+}
+
+bool BookBitmap::Container::contains(uint16_t low) const {
+    if (isBitset()) {
+        return (words[low / 64] >> (low % 64) & 1) != 0;
+    }
+    return binary_search(values.begin(), values.end(), low);
+}
+
+void BookBitmap::Container::finishBitset() {
+    cardinality = 0;
+    for (uint64_t word : words) {
+        cardinality += static_cast<uint32_t>(popcount(word));
+    }
+    if (cardinality > ARRAY_LIMIT) {
+        return;
+    }
+    values.clear();
+    values.reserve(cardinality);
+    for (size_t i = 0; i < WORD_COUNT; i++) {
+        for (uint64_t word = words[i]; word != 0; word &= word - 1) {
+            values.push_back(static_cast<uint16_t>(i * 64 +
+                static_cast<size_t>(countr_zero(word))));
+        }
+    }
+    vector<uint64_t>().swap(words);
+}
+
+void BookBitmap::Container::finishArray() {
+    cardinality = static_cast<uint32_t>(values.size());
+    if (cardinality <= ARRAY_LIMIT) {
+        return;
+    }
+    words.assign(WORD_COUNT, 0);
+    for (uint16_t low : values) {
+        words[low / 64] |= uint64_t{ 1 } << (low % 64);
+    }
+    vector<uint16_t>().swap(values);
+}
+
+// 배열끼리는 정렬된 두 배열을 합치고, 비트셋이 끼면 워드 단위로 계산
+BookBitmap::Container BookBitmap::intersect(const Container& left,
+    const Container& right) {
+    Container result;
+    result.key = left.key;
+    if (left.isBitset() && right.isBitset()) {
+        result.words.resize(WORD_COUNT);
+        for (size_t i = 0; i < WORD_COUNT; i++) {
+            result.words[i] = left.words[i] & right.words[i];
+        }
+        result.finishBitset();
+        return result;
+    }
+    if (!left.isBitset() && !right.isBitset()) {
+        set_intersection(left.values.begin(), left.values.end(),
+            right.values.begin(), right.values.end(),
+            back_inserter(result.values));
+    }
+    else {
+        const Container& array = left.isBitset() ? right : left;
+        const Container& bitset = left.isBitset() ? left : right;
+        for (uint16_t low : array.values) {
+            if (bitset.contains(low)) {
+                result.values.push_back(low);
+            }
+        }
+    }
+    result.finishArray();
+    return result;
+}
+
+BookBitmap::Container BookBitmap::unite(const Container& left,
+    const Container& right) {
+    Container result;
+    result.key = left.key;
+    if (!left.isBitset() && !right.isBitset()) {
+        result.values.reserve(left.values.size() + right.values.size());
+        set_union(left.values.begin(), left.values.end(),
+            right.values.begin(), right.values.end(),
+            back_inserter(result.values));
+        result.finishArray();
+        return result;
+    }
+    const Container& bitset = left.isBitset() ? left : right;
+    const Container& other = left.isBitset() ? right : left;
+    result.words = bitset.words;
+    if (other.isBitset()) {
+        for (size_t i = 0; i < WORD_COUNT; i++) {
+            result.words[i] |= other.words[i];
+        }
+    }
+    else {
+        for (uint16_t low : other.values) {
+            result.words[low / 64] |= uint64_t{ 1 } << (low % 64);
+        }
+    }
+    result.finishBitset();
+    return result;
+}
+
+BookBitmap::Container BookBitmap::subtract(const Container& left,
+    const Container& right) {
+    Container result;
+    result.key = left.key;
+    if (!left.isBitset()) {
+        for (uint16_t low : left.values) {
+            if (!right.contains(low)) {
+                result.values.push_back(low);
+            }
+        }
+        result.finishArray();
+        return result;
+    }
+    result.words = left.words;
+    if (right.isBitset()) {
+        for (size_t i = 0; i < WORD_COUNT; i++) {
+            result.words[i] &= ~right.words[i];
+        }
+    }
+    else {
+        for (uint16_t low : right.values) {
+            result.words[low / 64] &= ~(uint64_t{ 1 } << (low % 64));
+        }
+    }
+    result.finishBitset();
+    return result;
+}
+
+BookBitmap BookBitmap::fromSortedIds(span<const int> ids) {
+    BookBitmap bitmap;
+    for (int id : ids) {
+        auto value = static_cast<uint32_t>(id);
+        auto key = static_cast<uint16_t>(value >> 16);
+        if (bitmap.containers.empty() || bitmap.containers.back().key != key) {
+            if (!bitmap.containers.empty()) {
+                bitmap.containers.back().finishArray();
+            }
+            bitmap.containers.emplace_back();
+            bitmap.containers.back().key = key;
+        }
+        bitmap.containers.back().values.push_back(
+            static_cast<uint16_t>(value & 0xFFFF));
+    }
+    if (!bitmap.containers.empty()) {
+        bitmap.containers.back().finishArray();
+    }
+    return bitmap;
+}
+
+BookBitmap BookBitmap::fromIds(span<const int> ids, size_t maxId) {
+    size_t keyCount = (maxId >> 16) + 1;
+    // 컨테이너 하나에 평균 ARRAY_LIMIT개보다 적으면 정렬이 더 쌈
+    if (ids.size() < keyCount * ARRAY_LIMIT) {
+        vector<int> sorted(ids.begin(), ids.end());
+        sort(sorted.begin(), sorted.end());
+        return fromSortedIds(sorted);
+    }
+    vector<uint64_t> words(keyCount * WORD_COUNT);
+    for (int id : ids) {
+        auto value = static_cast<uint32_t>(id);
+        words[value / 64] |= uint64_t{ 1 } << (value % 64);
+    }
+    BookBitmap bitmap;
+    for (size_t key = 0; key < keyCount; key++) {
+        Container container;
+        container.key = static_cast<uint16_t>(key);
+        auto first = words.begin() + static_cast<ptrdiff_t>(key * WORD_COUNT);
+        container.words.assign(first, first + WORD_COUNT);
+        container.finishBitset();
+        if (container.cardinality > 0) {
+            bitmap.containers.push_back(move(container));
+        }
+    }
+    return bitmap;
+}
+
+const BookBitmap::Container* BookBitmap::find(uint16_t key) const {
+    auto it = lower_bound(containers.begin(), containers.end(), key,
+        [](const Container& container, uint16_t value) {
+            return container.key < value;
+        });
+    return it != containers.end() && it->key == key ? &*it : nullptr;
+}
+
+size_t BookBitmap::getCardinality() const {
+    size_t cardinality = 0;
+    for (const Container& container : containers) {
+        cardinality += container.cardinality;
+    }
+    return cardinality;
+}
+
+// pageNumber는 0부터 시작
+SearchPage BookSearchIndex::search(string_view query, SearchMode mode,
+    optional<SearchField> field, size_t pageNumber, size_t pageSize) const {
+    SearchPage page{ {}, 0 };
+    if (query.empty() || pageSize == 0) {
+        return page;
+    }
+    if (mode == SearchMode::PREFIX) {
+        searchPrefix(query, field, pageNumber * pageSize, pageSize, page);
+    }
+    else {
+        searchSubstring(query, field, pageNumber * pageSize, pageSize, page);
+    }
+    return page;
+}
+
+// 결과는 문자열 순서. 조건에 맞는 범위를 이진 탐색으로 찾고, 정렬된 범위
+// 여러 개를 합치면서 skip개를 건너뛰어 limit개만 꺼냄
+void BookSearchIndex::searchPrefix(string_view prefix,
+    optional<SearchField> field, size_t skip, size_t limit,
+    SearchPage& page) const {
+    using Range = pair<const uint32_t*, const uint32_t*>;
+    vector<Range> ranges;
+    // pending은 정렬되어 있지 않으므로 일치하는 것만 골라 정렬
+    array<vector<uint32_t>, FIELD_COUNT> pendingMatches;
+
+    auto addRange = [&](const vector<uint32_t>& sorted) {
+        auto first = lower_bound(sorted.begin(), sorted.end(), prefix,
+            [this](uint32_t keyId, string_view value) {
+                return keys[keyId].text < value;
+            });
+        // 앞부분이 prefix인 문자열은 lower_bound 뒤로 연속해서 있음
+        auto last = partition_point(first, sorted.end(),
+            [this, prefix](uint32_t keyId) {
+                return keys[keyId].text.substr(0, prefix.size()) == prefix;
+            });
+        if (first != last) {
+            ranges.push_back({ sorted.data() + (first - sorted.begin()),
+                sorted.data() + (last - sorted.begin()) });
+            page.totalCount += static_cast<size_t>(last - first);
+        }
+    };
+    for (size_t f = 0; f < FIELD_COUNT; f++) {
+        if (field && static_cast<size_t>(*field) != f) {
+            continue;
+        }
+        addRange(sortedKeys[f]);
+
+        for (uint32_t keyId : pendingKeys[f]) {
+            if (keys[keyId].text.substr(0, prefix.size()) == prefix) {
+                pendingMatches[f].push_back(keyId);
+            }
+        }
+        sort(pendingMatches[f].begin(), pendingMatches[f].end(),
+            [this](uint32_t left, uint32_t right) {
+                return isKeyLess(left, right);
+            });
+        addRange(pendingMatches[f]);
+    }
+
+    // 정렬된 범위들을 합치며 순서대로 꺼냄. 범위 수는 최대 4개
+    size_t taken = 0;
+    while (page.hits.size() < limit) {
+        Range* smallest = nullptr;
+        for (auto& range : ranges) {
+            if (range.first != range.second &&
+                (!smallest || isKeyLess(*range.first, *smallest->first))) {
+                smallest = &range;
+            }
+        }
+        if (!smallest) {
+            break;
+        }
+        const Key& key = keys[*smallest->first++];
+        if (taken++ >= skip) {
+            page.hits.push_back({ key.field, key.text });
+        }
+    }
+}
+
+// 결과는 앞부분이 일치하는 것, 짧은 것, 문자열 순서
+void BookSearchIndex::searchSubstring(string_view query,
+    optional<SearchField> field, size_t skip, size_t limit,
+    SearchPage& page) const {
+    vector<uint32_t> candidates;
+
+    if (query.size() >= 3) {
+        // 가장 짧은 posting 목록부터 교집합
+        vector<const vector<uint32_t>*> postings;
+        for (size_t pos = 0; pos + 3 <= query.size(); pos++) {
+            auto postingIt = trigramIndex.find(toTrigram(query, pos));
+            if (postingIt == trigramIndex.end()) {
+                return;
+            }
+            postings.push_back(&postingIt->second);
+        }
+        sort(postings.begin(), postings.end(),
+            [](auto left, auto right) { return left->size() < right->size(); });
+
+        // 긴 목록은 전부 훑지 않고 이진 탐색으로 건너뜀
+        candidates = *postings.front();
+        for (size_t i = 1; i < postings.size() && !candidates.empty(); i++) {
+            auto postingIt = postings[i]->begin();
+            size_t kept = 0;
+            for (uint32_t keyId : candidates) {
+                postingIt = lower_bound(postingIt, postings[i]->end(), keyId);
+                if (postingIt == postings[i]->end()) {
+                    break;
+                }
+                if (*postingIt == keyId) {
+                    candidates[kept++] = keyId;
+                }
+            }
+            candidates.resize(kept);
+        }
+    }
+    else {
+        // n-gram보다 짧은 검색어는 전체 문자열을 확인
+        candidates.resize(keys.size());
+        for (uint32_t keyId = 0; keyId < keys.size(); keyId++) {
+            candidates[keyId] = keyId;
+        }
+    }
+
+    struct Match {
+        bool isPrefix;
+        uint32_t keyId;
+    };
+    vector<Match> matches;
+    for (uint32_t keyId : candidates) {
+        const Key& key = keys[keyId];
+        if (field && key.field != *field) {
+            continue;
+        }
+        size_t pos = key.text.find(query);
+        if (pos != string_view::npos) {
+            matches.push_back({ pos == 0, keyId });
+        }
+    }
+    page.totalCount = matches.size();
+    if (skip >= matches.size()) {
+        return;
+    }
+
+    auto rankLess = [this](const Match& left, const Match& right) {
+        const Key& leftKey = keys[left.keyId];
+        const Key& rightKey = keys[right.keyId];
+        if (left.isPrefix != right.isPrefix) {
+            return left.isPrefix;
+        }
+        if (leftKey.text.size() != rightKey.text.size()) {
+            return leftKey.text.size() < rightKey.text.size();
+        }
+        if (leftKey.text != rightKey.text) {
+            return leftKey.text < rightKey.text;
+        }
+        return leftKey.field < rightKey.field;
+    };
+    size_t end = min(matches.size(), skip + limit);
+    partial_sort(matches.begin(), matches.begin() + end, matches.end(), rankLess);
+    for (size_t i = skip; i < end; i++) {
+        const Key& key = keys[matches[i].keyId];
+        page.hits.push_back({ key.field, key.text });
+    }
+}
+
+FILE* openBinaryFile(const string& path, const char* mode) {
+#ifdef _WIN32
+    FILE* file = nullptr;
+    if (fopen_s(&file, path.c_str(), mode) != 0) {
+        return nullptr;
+    }
+    return file;
+#else
+    return fopen(path.c_str(), mode);
+#endif
+}
+
+bool syncFile(FILE* file) {
+    if (fflush(file) != 0) {
+        return false;
+    }
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+uint32_t crc32(uint32_t crc, string_view bytes) {
+    static constexpr auto table = [] {
+        array<uint32_t, 256> result{};
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; bit++) {
+                value = (value & 1) ? (value >> 1) ^ 0xEDB88320u : value >> 1;
+            }
+            result[i] = value;
+        }
+        return result;
+    }();
+
+    crc = ~crc;
+    for (unsigned char byte : bytes) {
+        crc = table[(crc ^ byte) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+const char* getEventLevelName(EventLevel level) {
+    switch (level) {
+    case EventLevel::ERROR:
+        return "error";
+    case EventLevel::WARNING:
+        return "warning";
+    case EventLevel::INFO:
+        return "info";
+    case EventLevel::DEBUG:
+        return "debug";
+    }
+    return "";
+}
+
+const char* getEventTypeName(EventType type) {
+    switch (type) {
+    case EventType::BOOK_ADDED:
+        return "book_added";
+    case EventType::BOOKS_ADDED:
+        return "books_added";
+    case EventType::BOOKS_IMPORTED:
+        return "books_imported";
+    case EventType::IMPORT_FAILED:
+        return "import_failed";
+    case EventType::BOOK_RENTED:
+        return "book_rented";
+    case EventType::RENT_REJECTED:
+        return "rent_rejected";
+    case EventType::BOOK_RETURNED:
+        return "book_returned";
+    case EventType::RETURN_REJECTED:
+        return "return_rejected";
+    case EventType::RENT_BATCH:
+        return "rent_batch";
+    case EventType::RETURN_BATCH:
+        return "return_batch";
+    case EventType::LOG_WRITE_FAILED:
+        return "log_write_failed";
+    }
+    return "";
+}
+
+EventLog::EventLog(const string& path, EventLevel level, OverflowPolicy policy,
+    size_t capacity)
+    : policy{ policy }, level{ level } {
+    capacity = bit_ceil(max<size_t>(capacity, 2));
+    mask = capacity - 1;
+    slots = make_unique<Slot[]>(capacity);
+    for (size_t i = 0; i < capacity; i++) {
+        slots[i].sequence.store(i, memory_order_relaxed);
+    }
+
+    if (path == "-") {
+        file = stdout;
+        isStdout = true;
+    }
+    else {
+        file = openBinaryFile(path, "ab");
+    }
+    if (file) {
+        writer = thread(&EventLog::writeLoop, this);
+    }
+}
+
+EventLog::~EventLog() {
+    if (!file) {
+        return;
+    }
+    {
+        lock_guard lock(writerMutex);
+        isStopping = true;
+    }
+    wakeRequested.notify_one();
+    writer.join();
+    if (!isStdout) {
+        fclose(file);
+    }
+}
+
+bool EventLog::tryPush(const EngineEvent& event) {
+    size_t position = enqueuePosition.load(memory_order_relaxed);
+    while (true) {
+        Slot& slot = slots[position & mask];
+        size_t sequence = slot.sequence.load(memory_order_acquire);
+        auto difference = static_cast<ptrdiff_t>(sequence - position);
+        if (difference == 0) {
+            if (enqueuePosition.compare_exchange_weak(position, position + 1,
+                memory_order_relaxed)) {
+                slot.event = event;
+                slot.sequence.store(position + 1, memory_order_release);
+                return true;
+            }
+        }
+        else if (difference < 0) {
+            // 한 바퀴 전의 이벤트를 아직 기록 스레드가 꺼내지 않음
+            return false;
+        }
+        else {
+            position = enqueuePosition.load(memory_order_relaxed);
+        }
+    }
+}
+
+bool EventLog::push(const EngineEvent& event) {
+    if (!file) {
+        return false;
+    }
+    if (tryPush(event)) {
+        return true;
+    }
+    if (policy == OverflowPolicy::DROP) {
+        droppedCount.fetch_add(1, memory_order_relaxed);
+        return false;
+    }
+    // 기록 스레드를 깨우고 자리가 날 때까지 양보
+    wakeRequested.notify_one();
+    while (!tryPush(event)) {
+        this_thread::yield();
+    }
+    return true;
+}
+
+size_t EventLog::drain(string& buffer) {
+    size_t position = dequeuePosition.load(memory_order_relaxed);
+    size_t count = 0;
+    while (true) {
+        Slot& slot = slots[position & mask];
+        if (slot.sequence.load(memory_order_acquire) != position + 1) {
+            break;
+        }
+        format(slot.event, buffer);
+        slot.sequence.store(position + mask + 1, memory_order_release);
+        position++;
+        count++;
+    }
+    dequeuePosition.store(position, memory_order_release);
+    return count;
+}
+
+// 예: ts=1760000000.123456789 level=info event=book_rented book=3
+// borrower=0 return=2025-01-07
+void EventLog::format(const EngineEvent& event, string& buffer) {
+    char digits[24];
+    auto appendNumber = [&](auto value) {
+        auto [end, ec] = to_chars(begin(digits), std::end(digits), value);
+        buffer.append(digits, end);
+    };
+
+    constexpr int64_t NANOSECONDS_PER_SECOND = 1'000'000'000;
+    buffer.append("ts=");
+    appendNumber(event.timestamp / NANOSECONDS_PER_SECOND);
+    buffer.push_back('.');
+    string fraction = to_string(event.timestamp % NANOSECONDS_PER_SECOND);
+    buffer.append(9 - fraction.size(), '0');
+    buffer.append(fraction);
+    buffer.append(" level=");
+    buffer.append(getEventLevelName(event.level));
+    buffer.append(" event=");
+    buffer.append(getEventTypeName(event.type));
+
+    auto appendBook = [&] {
+        buffer.append(" book=");
+        appendNumber(event.bookId);
+    };
+    auto appendBorrower = [&] {
+        buffer.append(" borrower=");
+        appendNumber(event.borrowerId);
+    };
+    auto appendStatus = [&] {
+        buffer.append(" status=");
+        buffer.append(getRentalStatusCode(event.status));
+    };
+    auto appendCounts = [&](const char* countName, const char* failedName) {
+        buffer.append(countName);
+        appendNumber(event.count);
+        buffer.append(failedName);
+        appendNumber(event.failedCount);
+    };
+
+    switch (event.type) {
+    case EventType::BOOK_ADDED:
+        appendBook();
+        break;
+    case EventType::BOOKS_ADDED:
+        buffer.append(" books=");
+        appendNumber(event.count);
+        break;
+    case EventType::BOOKS_IMPORTED:
+        appendCounts(" rows=", " skipped=");
+        break;
+    case EventType::IMPORT_FAILED:
+    case EventType::LOG_WRITE_FAILED:
+        break;
+    case EventType::BOOK_RENTED: {
+        appendBook();
+        appendBorrower();
+        char dateString[DateStruct::DATE_STRING_SIZE];
+        DateStruct::fromDayNumber(event.returnDay).getDateString(dateString);
+        buffer.append(" return=");
+        buffer.append(dateString, DateStruct::DATE_STRING_SIZE - 1);
+        break;
+    }
+    case EventType::RENT_REJECTED:
+        appendBook();
+        appendBorrower();
+        appendStatus();
+        break;
+    case EventType::BOOK_RETURNED:
+        appendBook();
+        appendBorrower();
+        break;
+    case EventType::RETURN_REJECTED:
+        appendBook();
+        appendStatus();
+        break;
+    case EventType::RENT_BATCH:
+    case EventType::RETURN_BATCH:
+        appendCounts(" succeeded=", " failed=");
+        break;
+    }
+    buffer.push_back('\n');
+}
+
+// 깨울 때까지나 FLUSH_INTERVAL마다 쌓인 이벤트를 한 번의 write로 내보냄
+void EventLog::writeLoop() {
+    string buffer;
+    unique_lock lock(writerMutex);
+    while (true) {
+        lock.unlock();
+        size_t count = drain(buffer);
+        if (!buffer.empty()) {
+            fwrite(buffer.data(), 1, buffer.size(), file);
+            fflush(file);
+            buffer.clear();
+        }
+        writtenCount.fetch_add(count, memory_order_relaxed);
+        lock.lock();
+
+        if (count > 0) {
+            drained.notify_all();
+            continue;
+        }
+        if (isStopping) {
+            break;
+        }
+        wakeRequested.wait_for(lock, FLUSH_INTERVAL);
+    }
+    drained.notify_all();
+}
+
+void EventLog::flush() {
+    if (!file) {
+        return;
+    }
+    size_t target = enqueuePosition.load(memory_order_relaxed);
+    unique_lock lock(writerMutex);
+    wakeRequested.notify_one();
+    drained.wait(lock, [&] {
+        return dequeuePosition.load(memory_order_acquire) >= target ||
+            isStopping;
+    });
+}
+
+MutationLog::MutationLog(const string& path, DurabilityMode mode)
+    : mode{ mode } {
+    file = openBinaryFile(path, "ab");
+    if (file) {
+        error_code error;
+        durableBytes = filesystem::file_size(path, error);
+        flusher = thread(&MutationLog::flushLoop, this);
+    }
+}
+
+MutationLog::~MutationLog() {
+    if (!file) {
+        return;
+    }
+    {
+        lock_guard lock(bufferMutex);
+        isStopping = true;
+    }
+    flushRequested.notify_one();
+    flusher.join();
+    fclose(file);
+}
+
+size_t MutationLog::beginRecord(RecordType type) {
+    size_t recordStart = pending.size();
+    pending.append(HEADER_SIZE - 1, '\0');
+    pending.push_back(static_cast<char>(type));
+    return recordStart;
+}
+
+void MutationLog::endRecord(size_t recordStart) {
+    // 체크섬은 종류 바이트와 내용을 함께 계산
+    string_view record = string_view(pending).substr(recordStart + HEADER_SIZE - 1);
+    auto payloadSize = static_cast<uint32_t>(record.size() - 1);
+    uint32_t crc = crc32(0, record);
+    memcpy(&pending[recordStart], &payloadSize, sizeof(payloadSize));
+    memcpy(&pending[recordStart + 4], &crc, sizeof(crc));
+    appendedCount++;
+
+    if (pending.size() >= FLUSH_THRESHOLD) {
+        flushRequested.notify_one();
+    }
+}
+
+void MutationLog::appendAddBook(string_view title, string_view author) {
+    lock_guard lock(bufferMutex);
+    size_t recordStart = beginRecord(RecordType::ADD_BOOK);
+    putString(pending, title);
+    putString(pending, author);
+    endRecord(recordStart);
+}
+
+// 대여일은 나중에 추가되어 끝에 붙임. 대여일이 없는 예전 기록도 읽을 수 있음
+void MutationLog::appendRent(int bookId, string_view borrower,
+    string_view phone, DateStruct rentDate, DateStruct returnDate) {
+    lock_guard lock(bufferMutex);
+    size_t recordStart = beginRecord(RecordType::RENT);
+    putU32(pending, static_cast<uint32_t>(bookId));
+    putString(pending, borrower);
+    putString(pending, phone);
+    putU32(pending, static_cast<uint32_t>(returnDate.dayNumber));
+    putU32(pending, static_cast<uint32_t>(rentDate.dayNumber));
+    endRecord(recordStart);
+}
+
+void MutationLog::appendReturn(int bookId) {
+    lock_guard lock(bufferMutex);
+    size_t recordStart = beginRecord(RecordType::RETURN);
+    putU32(pending, static_cast<uint32_t>(bookId));
+    endRecord(recordStart);
+}
+
+bool MutationLog::commit() {
+    if (!file) {
+        return false;
+    }
+
+    unique_lock lock(bufferMutex);
+    if (mode == DurabilityMode::ASYNC || deferredCommitDepth > 0) {
+        return !isFailed;
+    }
+    return waitDurable(lock);
+}
+
+uint64_t MutationLog::requestCommit() {
+    lock_guard lock(bufferMutex);
+    if (mode == DurabilityMode::SYNC && requestedCount < appendedCount) {
+        requestedCount = appendedCount;
+        flushRequested.notify_one();
+    }
+    return appendedCount;
+}
+
+bool MutationLog::waitCommitted(uint64_t ticket) {
+    if (!file) {
+        return false;
+    }
+
+    unique_lock lock(bufferMutex);
+    if (mode == DurabilityMode::ASYNC) {
+        return !isFailed;
+    }
+    flushed.wait(lock, [&] { return durableCount >= ticket || isFailed; });
+    return !isFailed;
+}
+
+uint64_t MutationLog::checkpoint() {
+    if (!file) {
+        return 0;
+    }
+    unique_lock lock(bufferMutex);
+    waitDurable(lock);
+    return durableBytes;
+}
+
+bool MutationLog::waitDurable(unique_lock<mutex>& lock) {
+    uint64_t target = appendedCount;
+    waitingCommits++;
+    flushRequested.notify_one();
+    flushed.wait(lock, [&] { return durableCount >= target || isFailed; });
+    waitingCommits--;
+    return !isFailed;
+}
+
+bool MutationLog::writeBatch(const string& batch) {
+    if (fwrite(batch.data(), 1, batch.size(), file) != batch.size()) {
+        return false;
+    }
+    return syncFile(file);
+}
+
+// 기다리는 commit이 있거나 버퍼가 차면 바로, 아니면 FLUSH_INTERVAL마다
+// 그동안 쌓인 레코드를 한 번에 내보냄
+void MutationLog::flushLoop() {
+    string batch;
+    unique_lock lock(bufferMutex);
+    while (true) {
+        flushRequested.wait_for(lock, FLUSH_INTERVAL, [&] {
+            return isStopping || pending.size() >= FLUSH_THRESHOLD
+                || ((waitingCommits > 0 || requestedCount > durableCount)
+                    && !pending.empty());
+        });
+        if (pending.empty()) {
+            if (isStopping) {
+                break;
+            }
+            continue;
+        }
+
+        batch.swap(pending);
+        pending.clear();
+        uint64_t batchCount = appendedCount;
+        lock.unlock();
+
+        bool isWritten = writeBatch(batch);
+
+        lock.lock();
+        if (isWritten) {
+            durableCount = batchCount;
+            durableBytes += batch.size();
+        }
+        else if (!isFailed) {
+            isFailed = true;
+            if (eventLog) {
+                eventLog->record(EventLevel::ERROR,
+                    EventType::LOG_WRITE_FAILED);
+            }
+        }
+        flushed.notify_all();
+    }
+}
+
+const char* getRentalStatusMessage(RentalStatus status) {
+    switch (status) {
+    case RentalStatus::SUCCESS:
+        return "성공";
+    case RentalStatus::NO_SUCH_BOOK:
+        return "없는 책번호";
+    case RentalStatus::ALREADY_RENTED:
+        return "이미 대여된 책";
+    case RentalStatus::NOT_RENTED:
+        return "대여되지 않은 책";
+    case RentalStatus::NO_AVAILABLE_COPY:
+        return "모두 대여중이거나 없는 책";
+    case RentalStatus::NO_SUCH_BORROWER:
+        return "없는 대여자";
+    case RentalStatus::LOAN_LIMIT_REACHED:
+        return "대여 한도를 넘음";
+    case RentalStatus::BORROWER_LIMIT_REACHED:
+        return "대여자를 더 등록할 수 없음";
+    }
+    return "";
+}
+
+const char* getRentalStatusCode(RentalStatus status) {
+    switch (status) {
+    case RentalStatus::SUCCESS:
+        return "SUCCESS";
+    case RentalStatus::NO_SUCH_BOOK:
+        return "NO_SUCH_BOOK";
+    case RentalStatus::ALREADY_RENTED:
+        return "ALREADY_RENTED";
+    case RentalStatus::NOT_RENTED:
+        return "NOT_RENTED";
+    case RentalStatus::NO_AVAILABLE_COPY:
+        return "NO_AVAILABLE_COPY";
+    case RentalStatus::NO_SUCH_BORROWER:
+        return "NO_SUCH_BORROWER";
+    case RentalStatus::LOAN_LIMIT_REACHED:
+        return "LOAN_LIMIT_REACHED";
+    case RentalStatus::BORROWER_LIMIT_REACHED:
+        return "BORROWER_LIMIT_REACHED";
+    }
+    return "UNKNOWN";
+}
+
+void DelayedRentalQueue::recenter(DateStruct day) {
+    auto newStart = static_cast<int32_t>(clamp<int64_t>(
+        int64_t(day.dayNumber) - WINDOW_LEAD_DAYS, INT32_MIN,
+        int64_t(INT32_MAX) - WINDOW_DAYS));
+    if (totalCount == 0) {
+        // 비어 있으므로 칸과 비트맵, Fenwick 트리는 모두 0이라 옮길 것이 없음
+        windowStart = newStart;
+        isAnchored = true;
+        return;
+    }
+    if (newStart <= windowStart) {
+        return;
+    }
+    if (buckets.empty()) {
+        buckets.resize(WINDOW_DAYS);
+        dueCounts.assign(WINDOW_DAYS + 1, 0);
+        occupiedDays.assign(WINDOW_DAYS / WORD_BITS, 0);
+    }
+
+    // 창 앞에서 밀려나는 칸은 이미 지난 날짜로 접음. vector를 통째로 옮기므로
+    // 칸 안의 위치(delayedPos)는 그대로
+    auto shift = static_cast<int32_t>(min<int64_t>(
+        int64_t(newStart) - windowStart, WINDOW_DAYS));
+    for (int32_t offset = 0; offset < shift; offset++) {
+        Bucket& bucket = buckets[offset];
+        if (!bucket.rentals.empty()) {
+            earlyOverflowCount += bucket.rentals.size();
+            overflow.emplace(windowStart + offset, move(bucket));
+            bucket = Bucket{};
+        }
+    }
+    rotate(buckets.begin(), buckets.begin() + shift, buckets.end());
+    windowStart = newStart;
+
+    // 새로 창에 든 날짜는 모두 옛 창 뒤의 overflow에 있었음
+    auto it = overflow.lower_bound(windowStart);
+    while (it != overflow.end() && isInWindow(it->first)) {
+        buckets[it->first - windowStart] = move(it->second);
+        it = overflow.erase(it);
+    }
+    rebuildWindowCounts();
+}
+
+void DelayedRentalQueue::rebuildWindowCounts() {
+    fill(occupiedDays.begin(), occupiedDays.end(), 0);
+    occupiedDayCount = 0;
+    dueCounts[0] = 0;
+    for (size_t offset = 0; offset < buckets.size(); offset++) {
+        size_t count = buckets[offset].rentals.size();
+        dueCounts[offset + 1] = count;
+        if (count != 0) {
+            occupiedDays[offset / WORD_BITS] |=
+                uint64_t(1) << (offset % WORD_BITS);
+            occupiedDayCount++;
+        }
+    }
+    // 각 노드의 합을 바로 위 부모에 한 번씩 더하면 O(n)에 Fenwick 트리가 됨
+    for (size_t i = 1; i <= buckets.size(); i++) {
+        size_t parent = i + (i & (~i + 1));
+        if (parent <= buckets.size()) {
+            dueCounts[parent] += dueCounts[i];
+        }
+    }
+}
+
+DelayedRentalQueue::Bucket* DelayedRentalQueue::findBucket(int32_t day) {
+    if (isInWindow(day)) {
+        return buckets.empty() ? nullptr : &buckets[day - windowStart];
+    }
+    auto it = overflow.find(day);
+    return it == overflow.end() ? nullptr : &it->second;
+}
+
+DelayedRentalQueue::Bucket& DelayedRentalQueue::getBucket(int32_t day) {
+    if (!isAnchored) {
+        recenter(DateStruct::fromDayNumber(day));
+    }
+    if (!isInWindow(day)) {
+        return overflow[day];
+    }
+    if (buckets.empty()) {
+        buckets.resize(WINDOW_DAYS);
+        dueCounts.assign(WINDOW_DAYS + 1, 0);
+        occupiedDays.assign(WINDOW_DAYS / WORD_BITS, 0);
+    }
+    return buckets[day - windowStart];
+}
+
+void DelayedRentalQueue::updateWindowCount(int32_t day, ptrdiff_t delta) {
+    auto offset = static_cast<size_t>(day - windowStart);
+    for (size_t i = offset + 1; i <= static_cast<size_t>(WINDOW_DAYS);
+        i += i & (~i + 1)) {
+        dueCounts[i] += delta;
+    }
+
+    uint64_t bit = uint64_t(1) << (offset % WORD_BITS);
+    uint64_t& word = occupiedDays[offset / WORD_BITS];
+    bool isOccupied = !buckets[offset].rentals.empty();
+    if (isOccupied != ((word & bit) != 0)) {
+        word ^= bit;
+        if (isOccupied) {
+            occupiedDayCount++;
+        }
+        else {
+            occupiedDayCount--;
+        }
+    }
+}
+
+// 칸의 대여 수가 바뀐 뒤 호출
+void DelayedRentalQueue::updateCount(int32_t day, ptrdiff_t delta) {
+    totalCount += delta;
+    if (isInWindow(day)) {
+        updateWindowCount(day, delta);
+        return;
+    }
+    if (day < windowStart) {
+        earlyOverflowCount += delta;
+    }
+}
+
+size_t DelayedRentalQueue::countWindowPrefix(int32_t offset) const {
+    size_t count = 0;
+    for (auto i = static_cast<size_t>(offset) + 1; i > 0; i &= i - 1) {
+        count += dueCounts[i];
+    }
+    return count;
+}
+
+int32_t DelayedRentalQueue::findOccupiedDay(int32_t offset) const {
+    size_t index = static_cast<size_t>(offset) / WORD_BITS;
+    if (index >= occupiedDays.size()) {
+        return WINDOW_DAYS;
+    }
+    uint64_t word = occupiedDays[index] >> (offset % WORD_BITS)
+        << (offset % WORD_BITS);
+    while (word == 0) {
+        if (++index == occupiedDays.size()) {
+            return WINDOW_DAYS;
+        }
+        word = occupiedDays[index];
+    }
+    return static_cast<int32_t>(index * WORD_BITS + countr_zero(word));
+}
+
+void DelayedRentalQueue::sortBucket(Bucket& bucket) {
+    if (bucket.isSorted) {
+        return;
+    }
+    sort(bucket.rentals.begin(), bucket.rentals.end(),
+        [](const shared_ptr<RentalInfo>& left,
+            const shared_ptr<RentalInfo>& right) {
+            return left->bookId < right->bookId;
+        });
+    for (size_t pos = 0; pos < bucket.rentals.size(); pos++) {
+        bucket.rentals[pos]->delayedPos = pos;
+    }
+    bucket.isSorted = true;
+}
+
+void DelayedRentalQueue::add(const shared_ptr<RentalInfo>& rentalInfo) {
+    int32_t day = rentalInfo->returnDate.dayNumber;
+    Bucket& bucket = getBucket(day);
+    if (!bucket.rentals.empty()
+        && bucket.rentals.back()->bookId > rentalInfo->bookId) {
+        bucket.isSorted = false;
+    }
+    rentalInfo->delayedPos = bucket.rentals.size();
+    bucket.rentals.push_back(rentalInfo);
+    updateCount(day, 1);
+}
+
+void DelayedRentalQueue::addSorted(
+    span<const shared_ptr<RentalInfo>> sortedRentals) {
+    for (size_t begin = 0; begin < sortedRentals.size();) {
+        int32_t day = sortedRentals[begin]->returnDate.dayNumber;
+        size_t end = begin + 1;
+        while (end < sortedRentals.size()
+            && sortedRentals[end]->returnDate.dayNumber == day) {
+            end++;
+        }
+
+        Bucket& bucket = getBucket(day);
+        if (!bucket.rentals.empty()
+            && bucket.rentals.back()->bookId > sortedRentals[begin]->bookId) {
+            bucket.isSorted = false;
+        }
+        bucket.rentals.reserve(bucket.rentals.size() + (end - begin));
+        for (size_t i = begin; i < end; i++) {
+            sortedRentals[i]->delayedPos = bucket.rentals.size();
+            bucket.rentals.push_back(sortedRentals[i]);
+        }
+        updateCount(day, static_cast<ptrdiff_t>(end - begin));
+        begin = end;
+    }
+}
+
+void DelayedRentalQueue::remove(const RentalInfo& rentalInfo) {
+    int32_t day = rentalInfo.returnDate.dayNumber;
+    Bucket& bucket = *findBucket(day);
+    size_t pos = rentalInfo.delayedPos;
+    if (pos + 1 != bucket.rentals.size()) {
+        bucket.rentals[pos] = move(bucket.rentals.back());
+        bucket.rentals[pos]->delayedPos = pos;
+        bucket.isSorted = false;
+    }
+    bucket.rentals.pop_back();
+    if (bucket.rentals.empty()) {
+        bucket.isSorted = true;
+    }
+    updateCount(day, -1);
+
+    if (!isInWindow(day) && bucket.rentals.empty()) {
+        overflow.erase(day);
+    }
+}
+
+size_t DelayedRentalQueue::countDueBy(DateStruct returnDate) {
+    int32_t targetDay = returnDate.dayNumber;
+    if (targetDay < windowStart) {
+        size_t count = 0;
+        forEachBucket(INT32_MIN, targetDay, [&count](int32_t, Bucket& bucket) {
+            count += bucket.rentals.size();
+            return true;
+        });
+        return count;
+    }
+
+    size_t count = earlyOverflowCount;
+    if (!buckets.empty()) {
+        count += countWindowPrefix(static_cast<int32_t>(
+            min<int64_t>(int64_t(targetDay) - windowStart, WINDOW_DAYS - 1)));
+    }
+    int32_t windowEnd = windowStart + WINDOW_DAYS;
+    for (auto it = overflow.lower_bound(windowEnd);
+        it != overflow.end() && it->first <= targetDay; it++) {
+        count += it->second.rentals.size();
+    }
+    return count;
+}
+
+DelayedRentalPage DelayedRentalQueue::getPage(DateStruct returnDate,
+    DelayedRentalCursor after, size_t pageSize) {
+    DelayedRentalPage page{ {}, after, false };
+    forEachBucket(after.returnDay, returnDate.dayNumber,
+        [&](int32_t day, Bucket& bucket) {
+            sortBucket(bucket);
+            auto it = bucket.rentals.begin();
+            if (day == after.returnDay) {
+                it = upper_bound(bucket.rentals.begin(), bucket.rentals.end(),
+                    after.bookId,
+                    [](int bookId, const shared_ptr<RentalInfo>& rental) {
+                        return bookId < rental->bookId;
+                    });
+            }
+            for (; it != bucket.rentals.end(); it++) {
+                if (page.rentals.size() == pageSize) {
+                    page.hasMore = true;
+                    return false;
+                }
+                page.rentals.push_back(*it);
+                page.next = { day, (*it)->bookId };
+            }
+            return true;
+        });
+    return page;
+}
+
+// 저장소에 한 행을 붙이고 제목/작가 인덱스에 책번호를 추가
+int BookManager::appendBook(string_view title, string_view author) {
+    int newId = store->append(title, author);
+    // 쓰기 잠금 안에서 기록하므로 로그 순서와 책번호 순서가 같음
+    if (mutationLog) {
+        mutationLog->appendAddBook(title, author);
+    }
+
+    // titleIndex, authorIndex에 추가. 새 책은 대여 가능
+    string_view storedTitle = store->getTitle(newId);
+    auto& titleEntry = (*titleIndex)[storedTitle];
+    if (titleEntry.ids.empty()) {
+        searchIndex->add(storedTitle, SearchField::TITLE);
+    }
+    titleEntry.ids.push_back(newId);
+    freePositions->emplace_back();
+    titleEntries->push_back(&titleEntry);
+    pushFree(titleEntry, newId);
+
+    string_view storedAuthor = store->getAuthor(newId);
+    auto& authorIds = (*authorIndex)[storedAuthor];
+    if (authorIds.empty()) {
+        searchIndex->add(storedAuthor, SearchField::AUTHOR);
+    }
+    authorIds.push_back(newId);
+
+    return newId;
+}
+
+int BookManager::registerBook(string_view title, string_view author) {
+    OperationTimer timer(EngineOperation::ADD_BOOK);
+    int newId;
+    {
+        unique_lock lock(catalogMutex);
+        newId = appendBook(title, author);
+    }
+    if (mutationLog) {
+        mutationLog->commit();
+    }
+    if (eventLog) {
+        eventLog->record(EventLevel::INFO, EventType::BOOK_ADDED, newId);
+    }
+    return newId;
+}
+
+void BookManager::reserveBooks(size_t count) {
+    unique_lock lock(catalogMutex);
+    store->reserve(store->size() + count);
+    freePositions->reserve(store->size() + count);
+    titleEntries->reserve(store->size() + count);
+}
+
+// 한 묶음의 (제목, 작가)를 등록. 인덱스는 한 번의 순회로 갱신
+void BookManager::addBooks(vector<pair<string, string>>& rows) {
+    auto rowCount = static_cast<uint32_t>(rows.size());
+    unique_lock lock(catalogMutex);
+    store->reserve(store->size() + rows.size());
+    freePositions->reserve(store->size() + rows.size());
+    titleEntries->reserve(store->size() + rows.size());
+    searchIndex->beginBulkLoad();
+
+    for (auto& [title, author] : rows) {
+        appendBook(title, author);
+    }
+    searchIndex->flush();
+    rows.clear();
+    lock.unlock();
+
+    if (mutationLog) {
+        mutationLog->commit();
+    }
+    if (eventLog && rowCount > 0) {
+        eventLog->record(EventLevel::DEBUG, EventType::BOOKS_ADDED, 0, 0, 0,
+            RentalStatus::SUCCESS, rowCount);
+    }
+}
+
+namespace {
+    enum class RecordStatus { COMPLETE, INCOMPLETE };
+
+    // buffer[pos]부터 한 레코드를 읽어 fields에 채움.
+    // CSV 따옴표("..", "" 이스케이프)를 지원하고, 버퍼 끝에서 레코드가
+    // 끊기면 INCOMPLETE를 돌려줘 다음 청크와 이어 읽게 함
+    RecordStatus parseRecord(const string& buffer, size_t& pos, char delimiter,
+        bool isLastChunk, vector<string>& fields) {
+        size_t cursor = pos;
+        fields.clear();
+        string field;
+        bool quoted = false;
+
+        while (cursor < buffer.size()) {
+            char c = buffer[cursor];
+            if (quoted) {
+                if (c == '"') {
+                    if (cursor + 1 >= buffer.size() && !isLastChunk) {
+                        return RecordStatus::INCOMPLETE;
+                    }
+                    if (cursor + 1 < buffer.size() && buffer[cursor + 1] == '"') {
+                        field.push_back('"');
+                        cursor += 2;
+                        continue;
+                    }
+                    quoted = false;
+                }
+                else {
+                    field.push_back(c);
+                }
+                cursor++;
+                continue;
+            }
+
+            if (c == '"' && field.empty()) {
+                quoted = true;
+            }
+            else if (c == delimiter) {
+                fields.push_back(move(field));
+                field.clear();
+            }
+            else if (c == '\n') {
+                if (!field.empty() && field.back() == '\r') {
+                    field.pop_back();
+                }
+                fields.push_back(move(field));
+                pos = cursor + 1;
+                return RecordStatus::COMPLETE;
+            }
+            else {
+                field.push_back(c);
+            }
+            cursor++;
+        }
+
+        if (!isLastChunk) {
+            return RecordStatus::INCOMPLETE;
+        }
+        // 마지막 줄에 개행이 없는 경우
+        if (!field.empty() && field.back() == '\r') {
+            field.pop_back();
+        }
+        if (!field.empty() || !fields.empty()) {
+            fields.push_back(move(field));
+        }
+        pos = cursor;
+        return RecordStatus::COMPLETE;
+    }
+}
+
+// CSV/TSV 파일을 청크 단위로 읽어 대량 등록. 한 줄에 "제목,작가"
+// delimiter를 생략하면 확장자가 .tsv일 때 탭, 아니면 쉼표를 사용
+ImportReport BookManager::importBooks(const string& path, char delimiter,
+    bool hasHeader) {
+    constexpr size_t CHUNK_SIZE = 1 << 20;
+    constexpr size_t BATCH_SIZE = 1 << 16;
+
+    auto startTime = chrono::steady_clock::now();
+    ImportReport report{ 0, 0, 0, true };
+
+    ifstream file(path, ios::binary | ios::ate);
+    if (!file) {
+        report.isFileOpened = false;
+        if (eventLog) {
+            eventLog->record(EventLevel::ERROR, EventType::IMPORT_FAILED);
+        }
+        return report;
+    }
+    auto fileSize = static_cast<size_t>(file.tellg());
+    file.seekg(0);
+
+    if (delimiter == '\0') {
+        bool isTsv = path.size() >= 4 &&
+            path.compare(path.size() - 4, 4, ".tsv") == 0;
+        delimiter = isTsv ? '\t' : ',';
+    }
+
+    string buffer;
+    vector<string> fields;
+    vector<pair<string, string>> rows;
+    rows.reserve(BATCH_SIZE);
+    bool isCapacityReserved = false;
+    size_t bytesRead = 0;
+
+    while (true) {
+        size_t carried = buffer.size();
+        buffer.resize(carried + CHUNK_SIZE);
+        file.read(buffer.data() + carried, CHUNK_SIZE);
+        size_t readSize = static_cast<size_t>(file.gcount());
+        buffer.resize(carried + readSize);
+        bytesRead += readSize;
+        bool isLastChunk = readSize < CHUNK_SIZE;
+
+        size_t pos = 0;
+        while (pos < buffer.size() &&
+            parseRecord(buffer, pos, delimiter, isLastChunk, fields) ==
+            RecordStatus::COMPLETE) {
+            if (hasHeader) {
+                hasHeader = false;
+                continue;
+            }
+            if (fields.size() < 2 || fields[0].empty() || fields[1].empty()) {
+                if (!(fields.size() == 1 && fields[0].empty())) {
+                    report.skipped++;
+                }
+                continue;
+            }
+            rows.emplace_back(move(fields[0]), move(fields[1]));
+            report.rows++;
+        }
+        buffer.erase(0, pos);
+
+        // 첫 청크의 평균 줄 길이로 전체 권수를 추정해 한 번에 예약
+        if (!isCapacityReserved && report.rows > 0) {
+            size_t estimatedRows = fileSize / (bytesRead / report.rows) + 1;
+            reserveBooks(estimatedRows);
+            isCapacityReserved = true;
+        }
+
+        if (rows.size() >= BATCH_SIZE || isLastChunk) {
+            addBooks(rows);
+        }
+        if (isLastChunk) {
+            break;
+        }
+    }
+
+    report.seconds = chrono::duration<double>(
+        chrono::steady_clock::now() - startTime).count();
+    if (eventLog) {
+        eventLog->record(EventLevel::INFO, EventType::BOOKS_IMPORTED, 0, 0, 0,
+            RentalStatus::SUCCESS, static_cast<uint32_t>(report.rows),
+            static_cast<uint32_t>(report.skipped));
+    }
+    return report;
+}
+
+vector<shared_ptr<Book>>
+BookManager::materializeBooks(span<const int> ids) const {
+    vector<shared_ptr<Book>> result;
+    result.reserve(ids.size());
+    for (int id : ids) {
+        result.push_back(store->materialize(id));
+    }
+    return result;
+}
+
+span<const int> BookManager::findIds(const StringKeyMap<BookIdList>& index,
+    string_view key) const {
+    if (const BookIdList* ids = index.find(key)) {
+        return *ids;
+    }
+    return {};
+}
+
+TitleEntry* BookManager::findTitle(string_view title) const {
+    return titleIndex->find(title);
+}
+
+TitleEntry& BookManager::getTitleEntry(int id) const {
+    return *(*titleEntries)[id - 1];
+}
+
+// entry.availabilityMutex를 잡은 상태에서 호출
+void BookManager::pushFree(TitleEntry& entry, int id) {
+    (*freePositions)[id - 1] = static_cast<uint32_t>(entry.freeIds.size());
+    entry.freeIds.push_back(id);
+}
+
+// entry.availabilityMutex를 잡은 상태에서 호출. 마지막 원소를 빈 자리로 옮김
+void BookManager::removeFree(TitleEntry& entry, int id) {
+    uint32_t pos = (*freePositions)[id - 1];
+    int lastId = entry.freeIds.back();
+    entry.freeIds[pos] = lastId;
+    (*freePositions)[lastId - 1] = pos;
+    entry.freeIds.pop_back();
+}
+
+vector<shared_ptr<Book>> BookManager::getAllBooks() {
+    shared_lock lock(catalogMutex);
+    vector<shared_ptr<Book>> result;
+    result.reserve(store->size());
+    for (size_t row = 0; row < store->size(); row++) {
+        result.push_back(store->materialize(store->getIdAt(row)));
+    }
+    return result;
+}
+
+vector<shared_ptr<Book>> BookManager::getBooksByTitle(string_view title) {
+    OperationTimer timer(EngineOperation::FIND_BY_TITLE);
+    shared_lock lock(catalogMutex);
+    TitleEntry* entry = findTitle(title);
+    return materializeBooks(entry ? span<const int>(entry->ids) : span<const int>());
+}
+
+vector<shared_ptr<Book>> BookManager::getBooksByAuthor(string_view author) {
+    OperationTimer timer(EngineOperation::FIND_BY_AUTHOR);
+    shared_lock lock(catalogMutex);
+    return materializeBooks(findIds(*authorIndex, author));
+}
+
+span<const int> BookManager::getBookIdsByTitle(string_view title) const {
+    shared_lock lock(catalogMutex);
+    TitleEntry* entry = findTitle(title);
+    return entry ? span<const int>(entry->ids) : span<const int>();
+}
+
+span<const int> BookManager::getBookIdsByAuthor(string_view author) const {
+    shared_lock lock(catalogMutex);
+    return findIds(*authorIndex, author);
+}
+
+shared_ptr<Book> BookManager::getBookById(int id) {
+    OperationTimer timer(EngineOperation::FIND_BY_ID);
+    shared_lock lock(catalogMutex);
+    if (store->contains(id)) {
+        return store->materialize(id);
+    }
+    timer.markFailed();
+    return nullptr;
+}
+
+bool BookManager::hasBook(int id) const {
+    shared_lock lock(catalogMutex);
+    return store->contains(id);
+}
+
+bool BookManager::isRented(int id) const {
+    shared_lock lock(catalogMutex);
+    return store->contains(id) && store->isRented(id);
+}
+
+string_view BookManager::getTitleById(int id) const {
+    shared_lock lock(catalogMutex);
+    return store->getTitle(id);
+}
+
+shared_ptr<RentalInfo> BookManager::getRentalInfo(int id) const {
+    shared_lock lock(catalogMutex);
+    return store->getRentalInfo(id);
+}
+
+size_t BookManager::getBookCount() const {
+    shared_lock lock(catalogMutex);
+    return store->size();
+}
+
+void BookManager::appendGauges(vector<MetricGauge>& gauges) const {
+    shared_lock lock(catalogMutex);
+    gauges.push_back({ "book_count", static_cast<double>(store->size()) });
+    appendIndexGauges(gauges, "title", *titleIndex);
+    appendIndexGauges(gauges, "author", *authorIndex);
+}
+
+BookGrouping BookManager::getBookGrouping(SearchField field) const {
+    shared_lock lock(catalogMutex);
+    return field == SearchField::TITLE ? store->groupByTitle()
+        : store->groupByAuthor();
+}
+
+shared_ptr<RentalInfo> BookManager::releaseBook(int id) {
+    shared_lock lock(catalogMutex);
+    TitleEntry& entry = getTitleEntry(id);
+    lock_guard availabilityLock(entry.availabilityMutex);
+    auto released = store->release(id);
+    if (released) {
+        pushFree(entry, id);
+    }
+    return released;
+}
+
+// 제목이 같은 책 중 대여 가능한 책번호 하나. 없으면 0
+int BookManager::findAvailableBookByTitle(string_view title) const {
+    shared_lock lock(catalogMutex);
+    TitleEntry* entry = findTitle(title);
+    if (!entry) {
+        return 0;
+    }
+    lock_guard availabilityLock(entry->availabilityMutex);
+    return entry->freeIds.empty() ? 0 : entry->freeIds.back();
+}
+
+size_t BookManager::countAvailableBooksByTitle(string_view title) const {
+    OperationTimer timer(EngineOperation::COUNT_AVAILABLE);
+    shared_lock lock(catalogMutex);
+    TitleEntry* entry = findTitle(title);
+    if (!entry) {
+        return 0;
+    }
+    lock_guard availabilityLock(entry->availabilityMutex);
+    return entry->freeIds.size();
+}
+
+bool BookManager::loadSnapshot(shared_ptr<const CatalogSnapshot> snapshot) {
+    unique_lock lock(catalogMutex);
+    if (!store->load(*snapshot)) {
+        return false;
+    }
+
+    size_t bookCount = store->size();
+    freePositions->resize(bookCount);
+    titleEntries->resize(bookCount);
+
+    titleIndex->reserve(snapshot->getTitleKeys().size());
+    for (const auto& group : snapshot->getTitleKeys()) {
+        auto books = snapshot->getTitleBooks(group);
+        TitleEntry& entry = (*titleIndex)[snapshot->getString(group.stringId)];
+        entry.ids.assign(books.begin(), books.end());
+        entry.freeIds.reserve(books.size());
+        for (int id : entry.ids) {
+            (*titleEntries)[id - 1] = &entry;
+            pushFree(entry, id);
+        }
+    }
+
+    authorIndex->reserve(snapshot->getAuthorKeys().size());
+    for (const auto& group : snapshot->getAuthorKeys()) {
+        auto books = snapshot->getAuthorBooks(group);
+        (*authorIndex)[snapshot->getString(group.stringId)]
+            .assign(books.begin(), books.end());
+    }
+
+    unindexedSnapshot = move(snapshot);
+    hasUnindexedSnapshot.store(true, memory_order_release);
+    return true;
+}
+
+void BookManager::indexSnapshotKeys() const {
+    unique_lock lock(catalogMutex);
+    if (!hasUnindexedSnapshot.load(memory_order_relaxed)) {
+        return;
+    }
+    searchIndex->beginBulkLoad();
+    for (const auto& group : unindexedSnapshot->getTitleKeys()) {
+        searchIndex->add(unindexedSnapshot->getString(group.stringId),
+            SearchField::TITLE);
+    }
+    for (const auto& group : unindexedSnapshot->getAuthorKeys()) {
+        searchIndex->add(unindexedSnapshot->getString(group.stringId),
+            SearchField::AUTHOR);
+    }
+    searchIndex->flush();
+    hasUnindexedSnapshot.store(false, memory_order_release);
+}
+
+SearchPage BookManager::searchBooks(string_view query, SearchMode mode,
+    optional<SearchField> field, size_t pageNumber, size_t pageSize) const {
+    OperationTimer timer(EngineOperation::SEARCH);
+    if (hasUnindexedSnapshot.load(memory_order_acquire)) {
+        indexSnapshotKeys();
+    }
+    shared_lock lock(catalogMutex);
+    return searchIndex->search(query, mode, field, pageNumber, pageSize);
+}
+
+BookPage BookManager::getBookPage(const BookCursor& after,
+    size_t pageSize) const {
+    OperationTimer timer(EngineOperation::LIST_BOOKS);
+    BookPage page{ {}, after, false };
+    if (pageSize == 0) {
+        return page;
+    }
+    if (after.order == BookOrder::BY_TITLE &&
+        hasUnindexedSnapshot.load(memory_order_acquire)) {
+        indexSnapshotKeys();
+    }
+    shared_lock lock(catalogMutex);
+    size_t pageCapacity = min(pageSize, store->size());
+    page.books.reserve(pageCapacity);
+
+    if (after.order == BookOrder::BY_ID) {
+        // 책번호 n은 n - 1번째 행이므로 after.bookId번째 행부터
+        size_t row = static_cast<size_t>(max(after.bookId, 0));
+        for (; row < store->size(); row++) {
+            if (page.books.size() == pageSize) {
+                page.hasMore = true;
+                break;
+            }
+            page.books.push_back(store->getView(store->getIdAt(row)));
+        }
+        if (!page.books.empty()) {
+            page.next.bookId = page.books.back().id;
+        }
+        return page;
+    }
+
+    // 서로 다른 제목을 정렬된 색인에서 페이지 크기 + 1개씩 꺼내며 그 제목의 책을
+    // 책번호 순으로 채움. 남은 책을 확인하려고 한 권 더 봄
+    size_t titleBatch = pageCapacity + 1;
+    string_view lastTitle = after.title;
+    bool isFirstBatch = true;
+    while (true) {
+        vector<string_view> titles = searchIndex->getKeysAfter(
+            SearchField::TITLE, lastTitle, isFirstBatch, titleBatch);
+        for (string_view title : titles) {
+            const BookIdList& ids = findTitle(title)->ids;
+            auto it = ids.begin();
+            if (isFirstBatch && title == after.title) {
+                it = upper_bound(ids.begin(), ids.end(), after.bookId);
+            }
+            for (; it != ids.end(); it++) {
+                if (page.books.size() == pageSize) {
+                    page.hasMore = true;
+                    page.next.title = string(page.books.back().title);
+                    page.next.bookId = page.books.back().id;
+                    return page;
+                }
+                page.books.push_back(store->getView(*it));
+            }
+        }
+        if (titles.size() < titleBatch) {
+            break;
+        }
+        lastTitle = titles.back();
+        isFirstBatch = false;
+    }
+    if (!page.books.empty()) {
+        page.next.title = string(page.books.back().title);
+        page.next.bookId = page.books.back().id;
+    }
+    return page;
+}
+
+RentalPage BookManager::getRentalPage(const RentalCursor& after,
+    size_t pageSize) const {
+    RentalPage page{ {}, after, false };
+    shared_lock lock(catalogMutex);
+    size_t row = static_cast<size_t>(max(after.bookId, 0));
+    for (; row < store->size() && pageSize > 0; row++) {
+        int id = store->getIdAt(row);
+        if (!store->isRented(id)) {
+            continue;
+        }
+        // 대여 칸을 읽는 사이에 반납되었으면 건너뜀
+        shared_ptr<RentalInfo> rentalInfo = store->getRentalInfo(id);
+        if (!rentalInfo) {
+            continue;
+        }
+        if (page.rentals.size() == pageSize) {
+            page.hasMore = true;
+            break;
+        }
+        page.rentals.push_back(move(rentalInfo));
+        page.next.bookId = id;
+    }
+    return page;
+}
+
+namespace {
+
+// 책 65536권 단위(비트맵 컨테이너 하나) 안에서 조건을 계산. 여러 스레드가
+// 단위를 나눠 같이 씀. 제목/작가 조건은 미리 만든 비트맵에서 그 단위의
+// 컨테이너를 꺼내고, 대여 상태는 저장소의 대여중 비트를 워드 단위로 읽음
+class QueryEvaluator {
+private:
+    using Container = BookBitmap::Container;
+
+    const CatalogStore& store;
+    const unordered_map<const BookQuery*, BookBitmap>& leaves;
+    // 책번호는 1 ~ bookCount
+    uint32_t bookCount;
+
+    // 단위 안의 모든 책
+    Container makeUniverse(uint16_t key) const {
+        Container result;
+        result.key = key;
+        uint32_t first = max<uint32_t>(static_cast<uint32_t>(key) << 16, 1);
+        uint32_t last = min<uint32_t>(static_cast<uint32_t>(key) << 16 | 0xFFFF,
+            bookCount);
+        if (first > last) {
+            return result;
+        }
+        // first ~ last 비트를 워드 단위로 채움
+        uint32_t low = first & 0xFFFF;
+        uint32_t high = last & 0xFFFF;
+        result.words.assign(BookBitmap::WORD_COUNT, 0);
+        for (uint32_t word = low / 64; word <= high / 64; word++) {
+            uint64_t mask = ~uint64_t{ 0 };
+            if (word == low / 64) {
+                mask &= ~uint64_t{ 0 } << (low % 64);
+            }
+            if (word == high / 64) {
+                mask &= ~uint64_t{ 0 } >> (63 - high % 64);
+            }
+            result.words[word] = mask;
+        }
+        result.finishBitset();
+        return result;
+    }
+
+    // isAvailable이면 대여 가능한 책, 아니면 대여중인 책
+    Container loadRentalState(uint16_t key, bool isAvailable) const {
+        Container universe = makeUniverse(key);
+        if (!universe.isBitset()) {
+            // 책이 ARRAY_LIMIT권 이하인 마지막 단위
+            Container result;
+            result.key = key;
+            for (uint16_t low : universe.values) {
+                int id = static_cast<int>(static_cast<uint32_t>(key) << 16 | low);
+                if (store.isRented(id) != isAvailable) {
+                    result.values.push_back(low);
+                }
+            }
+            result.finishArray();
+            return result;
+        }
+        size_t firstWord = static_cast<size_t>(key) * BookBitmap::WORD_COUNT;
+        for (size_t i = 0; i < BookBitmap::WORD_COUNT; i++) {
+            if (universe.words[i] == 0) {
+                continue;
+            }
+            uint64_t rented = store.loadRentedWord(firstWord + i);
+            universe.words[i] &= isAvailable ? ~rented : rented;
+        }
+        universe.finishBitset();
+        return universe;
+    }
+
+    Container loadDueBy(uint16_t key, int32_t dayNumber) const {
+        Container result = loadRentalState(key, false);
+        Container due;
+        due.key = key;
+        result.forEach([&](uint32_t id) {
+            if (store.isDueBy(static_cast<int>(id), dayNumber)) {
+                due.values.push_back(static_cast<uint16_t>(id & 0xFFFF));
+            }
+        });
+        due.finishArray();
+        return due;
+    }
+
+public:
+    QueryEvaluator(const CatalogStore& store,
+        const unordered_map<const BookQuery*, BookBitmap>& leaves)
+        : store{ store }, leaves{ leaves },
+        bookCount{ static_cast<uint32_t>(store.size()) } {
+    }
+
+    Container evaluate(const BookQuery& query, uint16_t key) const {
+        switch (query.kind) {
+        case BookQuery::Kind::TITLE:
+        case BookQuery::Kind::AUTHOR:
+        case BookQuery::Kind::TITLE_PREFIX:
+        case BookQuery::Kind::AUTHOR_PREFIX: {
+            if (const Container* leaf = leaves.at(&query).find(key)) {
+                return *leaf;
+            }
+            Container empty;
+            empty.key = key;
+            return empty;
+        }
+        case BookQuery::Kind::AVAILABLE:
+            return loadRentalState(key, true);
+        case BookQuery::Kind::RENTED:
+            return loadRentalState(key, false);
+        case BookQuery::Kind::DUE_BY:
+            return loadDueBy(key, query.day);
+        case BookQuery::Kind::ALL_OF: {
+            if (query.children.empty()) {
+                return makeUniverse(key);
+            }
+            // 빈 결과가 나오면 나머지 조건은 보지 않음
+            Container result = evaluate(query.children.front(), key);
+            for (size_t i = 1; i < query.children.size(); i++) {
+                if (result.cardinality == 0) {
+                    break;
+                }
+                result = BookBitmap::intersect(result,
+                    evaluate(query.children[i], key));
+            }
+            return result;
+        }
+        case BookQuery::Kind::ANY_OF: {
+            Container result;
+            result.key = key;
+            for (const BookQuery& child : query.children) {
+                result = BookBitmap::unite(result, evaluate(child, key));
+            }
+            return result;
+        }
+        case BookQuery::Kind::NOT: {
+            Container universe = makeUniverse(key);
+            if (query.children.empty()) {
+                return universe;
+            }
+            return BookBitmap::subtract(universe,
+                evaluate(query.children.front(), key));
+        }
+        }
+        return Container{};
+    }
+};
+
+}
+
+void BookManager::buildQueryLeaves(const BookQuery& query,
+    unordered_map<const BookQuery*, BookBitmap>& leaves) const {
+    auto collect = [&](SearchField field, vector<int>& ids) {
+        SearchPage page = searchIndex->search(query.text, SearchMode::PREFIX,
+            field, 0, SIZE_MAX);
+        for (const SearchHit& hit : page.hits) {
+            span<const int> matched = field == SearchField::TITLE
+                ? span<const int>(findTitle(hit.text)->ids)
+                : findIds(*authorIndex, hit.text);
+            ids.insert(ids.end(), matched.begin(), matched.end());
+        }
+    };
+
+    switch (query.kind) {
+    case BookQuery::Kind::TITLE: {
+        TitleEntry* entry = findTitle(query.text);
+        leaves.emplace(&query, BookBitmap::fromSortedIds(
+            entry ? span<const int>(entry->ids) : span<const int>()));
+        break;
+    }
+    case BookQuery::Kind::AUTHOR:
+        leaves.emplace(&query,
+            BookBitmap::fromSortedIds(findIds(*authorIndex, query.text)));
+        break;
+    case BookQuery::Kind::TITLE_PREFIX:
+    case BookQuery::Kind::AUTHOR_PREFIX: {
+        // 일치하는 제목/작가의 책번호를 모아 한 번에 만듦
+        vector<int> ids;
+        collect(query.kind == BookQuery::Kind::TITLE_PREFIX
+            ? SearchField::TITLE : SearchField::AUTHOR, ids);
+        leaves.emplace(&query, BookBitmap::fromIds(ids, store->size()));
+        break;
+    }
+    default:
+        for (const BookQuery& child : query.children) {
+            buildQueryLeaves(child, leaves);
+        }
+        break;
+    }
+}
+
+// catalogMutex를 읽기 잠금으로 잡은 상태에서 호출. 단위 몇 개만 계산할 때는
+// 스레드를 띄우는 비용이 더 크므로 한 스레드가 모두 계산
+vector<BookBitmap::Container> BookManager::evaluateQuery(
+    const BookQuery& query) const {
+    constexpr size_t KEYS_PER_THREAD = 4;
+
+    unordered_map<const BookQuery*, BookBitmap> leaves;
+    buildQueryLeaves(query, leaves);
+    QueryEvaluator evaluator(*store, leaves);
+
+    size_t keyCount = (store->size() >> 16) + 1;
+    vector<BookBitmap::Container> results(keyCount);
+    size_t threadCount = clamp<size_t>(
+        (keyCount + KEYS_PER_THREAD - 1) / KEYS_PER_THREAD, 1,
+        max(thread::hardware_concurrency(), 1u));
+    atomic<size_t> nextKey{ 0 };
+    auto evaluateKeys = [&] {
+        for (size_t key = nextKey.fetch_add(1, memory_order_relaxed);
+            key < keyCount; key = nextKey.fetch_add(1, memory_order_relaxed)) {
+            results[key] = evaluator.evaluate(query, static_cast<uint16_t>(key));
+        }
+    };
+
+    vector<thread> threads;
+    for (size_t threadIndex = 1; threadIndex < threadCount; threadIndex++) {
+        threads.emplace_back(evaluateKeys);
+    }
+    evaluateKeys();
+    for (auto& worker : threads) {
+        worker.join();
+    }
+    return results;
+}
+
+BookQueryResult BookManager::queryBooks(const BookQuery& query,
+    size_t limit) const {
+    OperationTimer timer(EngineOperation::QUERY);
+    if (hasUnindexedSnapshot.load(memory_order_acquire)) {
+        indexSnapshotKeys();
+    }
+    vector<BookBitmap::Container> containers;
+    {
+        shared_lock lock(catalogMutex);
+        containers = evaluateQuery(query);
+    }
+
+    BookQueryResult result{ {}, 0 };
+    for (const auto& container : containers) {
+        result.totalCount += container.cardinality;
+    }
+    result.ids.reserve(min(limit, result.totalCount));
+    for (const auto& container : containers) {
+        if (result.ids.size() == limit) {
+            break;
+        }
+        container.forEach([&](uint32_t id) {
+            if (result.ids.size() < limit) {
+                result.ids.push_back(static_cast<int>(id));
+            }
+        });
+    }
+    return result;
+}
+
+size_t BookManager::countBooks(const BookQuery& query) const {
+    OperationTimer timer(EngineOperation::QUERY);
+    if (hasUnindexedSnapshot.load(memory_order_acquire)) {
+        indexSnapshotKeys();
+    }
+    shared_lock lock(catalogMutex);
+    size_t count = 0;
+    for (const auto& container : evaluateQuery(query)) {
+        count += container.cardinality;
+    }
+    return count;
+}
+
+// 제목이 같은 책 중 대여 가능한 한 권을 O(1)로 차지하고 그 책번호를
+// 돌려줌. 없으면 0
+optional<BorrowerId> BorrowerRegistry::findLocked(string_view name,
+    string_view phone) const {
+    if (const BorrowerIdList* ids = phoneIndex.find(phone)) {
+        for (BorrowerId id : *ids) {
+            if (get(id).name == name) {
+                return id;
+            }
+        }
+    }
+    return nullopt;
+}
+
+optional<BorrowerId> BorrowerRegistry::find(string_view name,
+    string_view phone) const {
+    shared_lock lock(registryMutex);
+    return findLocked(name, phone);
+}
+
+optional<BorrowerId> BorrowerRegistry::registerBorrower(string_view name,
+    string_view phone) {
+    {
+        shared_lock lock(registryMutex);
+        if (auto id = findLocked(name, phone)) {
+            return id;
+        }
+        if (count.load(memory_order_relaxed) == CAPACITY) {
+            return nullopt;
+        }
+    }
+    // 색인의 키와 대여정보가 가리킬 문자열은 풀에 넣어 둠
+    optional<uint32_t> nameId = stringPool->tryIntern(name);
+    optional<uint32_t> phoneId = stringPool->tryIntern(phone);
+    if (!nameId || !phoneId) {
+        return nullopt;
+    }
+    string_view pooledName = stringPool->get(*nameId);
+    string_view pooledPhone = stringPool->get(*phoneId);
+
+    unique_lock lock(registryMutex);
+    if (auto id = findLocked(name, phone)) {
+        return id;
+    }
+    size_t newId = count.load(memory_order_relaxed);
+    if (newId == CAPACITY) {
+        return nullopt;
+    }
+    if (newId % CHUNK_SIZE == 0) {
+        chunks[newId / CHUNK_SIZE] = make_unique<Borrower[]>(CHUNK_SIZE);
+    }
+    Borrower& borrower = chunks[newId / CHUNK_SIZE][newId % CHUNK_SIZE];
+    borrower.id = static_cast<BorrowerId>(newId);
+    borrower.name = pooledName;
+    borrower.phone = pooledPhone;
+    phoneIndex[pooledPhone].push_back(borrower.id);
+    nameIndex[pooledName].push_back(borrower.id);
+    count.store(newId + 1, memory_order_release);
+    return borrower.id;
+}
+
+void BorrowerRegistry::appendGauges(vector<MetricGauge>& gauges) const {
+    shared_lock lock(registryMutex);
+    gauges.push_back({ "book_borrower_count",
+        static_cast<double>(count.load(memory_order_relaxed)) });
+    appendIndexGauges(gauges, "borrower", nameIndex);
+    appendIndexGauges(gauges, "borrower_phone", phoneIndex);
+}
+
+void RentalHistory::appendLocked(uint32_t bookId, BorrowerId borrowerId,
+    int32_t rentDay, int32_t returnDay) {
+    if (count == CHUNK_SIZE * MAX_CHUNKS) {
+        droppedCount++;
+        return;
+    }
+    size_t pos = count % CHUNK_SIZE;
+    unique_ptr<Chunk>& chunk = chunks[count / CHUNK_SIZE];
+    if (pos == 0) {
+        // 열은 쓰기 전에 읽지 않으므로 0으로 채우지 않음
+        chunk = make_unique_for_overwrite<Chunk>();
+    }
+    chunk->bookIds[pos] = bookId;
+    chunk->borrowerIds[pos] = borrowerId;
+    chunk->rentDays[pos] = rentDay;
+    chunk->returnDays[pos] = returnDay;
+    chunk->minRentDay = min(chunk->minRentDay, rentDay);
+    chunk->maxRentDay = max(chunk->maxRentDay, rentDay);
+    count++;
+}
+
+void RentalHistory::append(int bookId, BorrowerId borrowerId,
+    DateStruct rentDate, DateStruct returnDate) {
+    lock_guard lock(historyMutex);
+    appendLocked(static_cast<uint32_t>(bookId), borrowerId,
+        rentDate.dayNumber, returnDate.dayNumber);
+}
+
+size_t RentalHistory::size() const {
+    lock_guard lock(historyMutex);
+    return count;
+}
+
+size_t RentalHistory::getChunkCount() const {
+    lock_guard lock(historyMutex);
+    return (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+}
+
+size_t RentalHistory::getDroppedCount() const {
+    lock_guard lock(historyMutex);
+    return droppedCount;
+}
+
+// 잠금 안에서 청크마다 그때까지 쓴 칸 수만 정해 두면, 잠금을 푼 뒤에는 append가
+// 그 뒤 칸에만 쓰므로 잠금 없이 훑어도 됨
+vector<RentalHistory::ChunkView> RentalHistory::getChunkViews(DateStruct from,
+    DateStruct to) const {
+    vector<ChunkView> views;
+    lock_guard lock(historyMutex);
+    for (size_t begin = 0; begin < count; begin += CHUNK_SIZE) {
+        const Chunk& chunk = *chunks[begin / CHUNK_SIZE];
+        if (chunk.maxRentDay < from.dayNumber
+            || chunk.minRentDay > to.dayNumber) {
+            continue;
+        }
+        views.push_back({ &chunk, min(CHUNK_SIZE, count - begin) });
+    }
+    return views;
+}
+
+// 청크를 스레드들이 하나씩 가져가 스레드마다 따로 둔 initial의 복사본에
+// 모음. 합치는 것은 호출자가 함
+template <typename Accumulator, typename Kernel>
+vector<Accumulator> RentalHistory::scanChunks(span<const ChunkView> views,
+    const Accumulator& initial, Kernel kernel) const {
+    // 청크 몇 개만 훑을 때는 스레드를 띄우는 비용이 더 큼
+    constexpr size_t CHUNKS_PER_THREAD = 4;
+    size_t threadCount = clamp<size_t>(
+        (views.size() + CHUNKS_PER_THREAD - 1) / CHUNKS_PER_THREAD, 1,
+        max(thread::hardware_concurrency(), 1u));
+    vector<Accumulator> results(threadCount, initial);
+    atomic<size_t> nextView{ 0 };
+    auto scan = [&](size_t threadIndex) {
+        for (size_t i = nextView.fetch_add(1, memory_order_relaxed);
+            i < views.size();
+            i = nextView.fetch_add(1, memory_order_relaxed)) {
+            kernel(*views[i].chunk, views[i].size, results[threadIndex]);
+        }
+    };
+
+    vector<thread> threads;
+    for (size_t threadIndex = 1; threadIndex < threadCount; threadIndex++) {
+        threads.emplace_back(scan, threadIndex);
+    }
+    scan(0);
+    for (auto& worker : threads) {
+        worker.join();
+    }
+    return results;
+}
+
+template <typename KeyOf>
+HistoryTotals RentalHistory::sumByKey(DateStruct from, DateStruct to,
+    size_t keyCount, KeyOf keyOf) const {
+    HistoryTotals totals{ vector<uint64_t>(keyCount),
+        vector<int64_t>(keyCount) };
+    if (to < from || keyCount == 0) {
+        return totals;
+    }
+    auto views = getChunkViews(from, to);
+    // 기간 검사는 부호 없는 뺄셈 한 번과 비교 한 번
+    auto firstDay = static_cast<uint32_t>(from.dayNumber);
+    auto dayWidth = static_cast<uint32_t>(to.dayNumber - from.dayNumber);
+    auto results = scanChunks(span<const ChunkView>(views), totals,
+        [&](const Chunk& chunk, size_t size, HistoryTotals& local) {
+            uint64_t* rentals = local.rentals.data();
+            int64_t* loanDays = local.loanDays.data();
+            for (size_t i = 0; i < size; i++) {
+                auto [key, isKnown] = keyOf(chunk, i);
+                uint32_t isIn = isKnown & (static_cast<uint32_t>(
+                    chunk.rentDays[i]) - firstDay <= dayWidth);
+                rentals[key] += isIn;
+                loanDays[key] += isIn * static_cast<int64_t>(
+                    chunk.returnDays[i] - chunk.rentDays[i]);
+            }
+        });
+
+    totals = move(results[0]);
+    for (size_t result = 1; result < results.size(); result++) {
+        for (size_t key = 0; key < keyCount; key++) {
+            totals.rentals[key] += results[result].rentals[key];
+            totals.loanDays[key] += results[result].loanDays[key];
+        }
+    }
+    return totals;
+}
+
+HistoryTotals RentalHistory::groupByBook(DateStruct from, DateStruct to,
+    span<const uint32_t> keyOfBook, size_t keyCount) const {
+    if (keyOfBook.empty()) {
+        return { vector<uint64_t>(keyCount), vector<int64_t>(keyCount) };
+    }
+    // 모르는 책번호는 마지막 책의 묶음을 읽되 0을 더함
+    auto lastRow = static_cast<uint32_t>(keyOfBook.size() - 1);
+    return sumByKey(from, to, keyCount,
+        [keyOfBook, lastRow](const Chunk& chunk, size_t i) {
+            uint32_t row = chunk.bookIds[i] - 1;
+            return pair(keyOfBook[min(row, lastRow)],
+                static_cast<uint32_t>(row <= lastRow));
+        });
+}
+
+HistoryTotals RentalHistory::groupByBorrower(DateStruct from,
+    DateStruct to) const {
+    // 대여자 수를 먼저 정하므로 그 뒤에 등록된 대여자의 기록은 집계하지 않음
+    auto keyCount = static_cast<uint32_t>(borrowers->size());
+    return sumByKey(from, to, keyCount,
+        [keyCount](const Chunk& chunk, size_t i) {
+            BorrowerId borrowerId = chunk.borrowerIds[i];
+            return pair(min(borrowerId, keyCount - 1),
+                static_cast<uint32_t>(borrowerId < keyCount));
+        });
+}
+
+vector<uint64_t> RentalHistory::countByDay(DateStruct from,
+    DateStruct to) const {
+    if (to < from) {
+        return {};
+    }
+    auto views = getChunkViews(from, to);
+    // 기간 밖의 날은 마지막 칸에 세고 버림
+    auto firstDay = static_cast<uint32_t>(from.dayNumber);
+    auto dayWidth = static_cast<uint32_t>(to.dayNumber - from.dayNumber);
+    auto results = scanChunks(span<const ChunkView>(views),
+        vector<uint64_t>(dayWidth + 2),
+        [&](const Chunk& chunk, size_t size, vector<uint64_t>& local) {
+            uint64_t* dayCounts = local.data();
+            for (size_t i = 0; i < size; i++) {
+                dayCounts[min(static_cast<uint32_t>(chunk.rentDays[i])
+                    - firstDay, dayWidth + 1)]++;
+            }
+        });
+
+    vector<uint64_t> dayCounts = move(results[0]);
+    for (size_t result = 1; result < results.size(); result++) {
+        for (size_t day = 0; day <= dayWidth; day++) {
+            dayCounts[day] += results[result][day];
+        }
+    }
+    dayCounts.resize(dayWidth + 1);
+    return dayCounts;
+}
+
+bool RentalHistory::save(const string& path) const {
+    // 쓰는 동안 기록이 늘어도 되도록 여기까지의 칸 수만 정해 둠. 기록의
+    // 대여자는 모두 그 전에 등록되었으므로 대여자 수는 그 뒤에 읽음
+    size_t recordCount;
+    {
+        lock_guard lock(historyMutex);
+        recordCount = count;
+    }
+    vector<string_view> names;
+    for (BorrowerId id = 0; id < borrowers->size(); id++) {
+        const Borrower& borrower = borrowers->get(id);
+        names.push_back(borrower.name);
+        names.push_back(borrower.phone);
+    }
+
+    FileHeader header{};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.borrowerCount = static_cast<uint32_t>(names.size() / 2);
+    header.recordCount = recordCount;
+    for (string_view name : names) {
+        header.nameBytes += sizeof(uint32_t) + name.size();
+    }
+
+    string tempPath = path + ".tmp";
+    FILE* file = openBinaryFile(tempPath, "wb");
+    if (!file) {
+        return false;
+    }
+    bool isWritten = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (size_t i = 0; i < names.size() && isWritten; i++) {
+        auto length = static_cast<uint32_t>(names[i].size());
+        isWritten = fwrite(&length, sizeof(length), 1, file) == 1
+            && fwrite(names[i].data(), 1, length, file) == length;
+    }
+    auto writeColumn = [&](auto Chunk::* column) {
+        for (size_t begin = 0; begin < recordCount && isWritten;
+            begin += CHUNK_SIZE) {
+            const Chunk& chunk = *chunks[begin / CHUNK_SIZE];
+            size_t size = min(CHUNK_SIZE, recordCount - begin);
+            isWritten = fwrite(chunk.*column, sizeof((chunk.*column)[0]), size,
+                file) == size;
+        }
+    };
+    writeColumn(&Chunk::bookIds);
+    writeColumn(&Chunk::borrowerIds);
+    writeColumn(&Chunk::rentDays);
+    writeColumn(&Chunk::returnDays);
+    isWritten = isWritten && syncFile(file);
+    isWritten = fclose(file) == 0 && isWritten;
+
+    error_code error;
+    if (isWritten) {
+        filesystem::rename(tempPath, path, error);
+    }
+    if (!isWritten || error) {
+        filesystem::remove(tempPath, error);
+        return false;
+    }
+    return true;
+}
+
+bool RentalHistory::load(const string& path) {
+    ifstream file(path, ios::binary);
+    if (!file) {
+        return false;
+    }
+    string bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    string_view in = bytes;
+
+    FileHeader header;
+    if (in.size() < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, in.data(), sizeof(header));
+    in.remove_prefix(sizeof(header));
+    constexpr size_t RECORD_SIZE = 4 * sizeof(uint32_t);
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0
+        || header.version != VERSION || header.nameBytes > in.size()
+        || header.recordCount != (in.size() - header.nameBytes) / RECORD_SIZE
+        || (in.size() - header.nameBytes) % RECORD_SIZE != 0) {
+        return false;
+    }
+
+    vector<string_view> names;
+    string_view nameBytes = in.substr(0, header.nameBytes);
+    for (size_t i = 0; i < size_t{ header.borrowerCount } * 2; i++) {
+        uint32_t length;
+        if (nameBytes.size() < sizeof(length)) {
+            return false;
+        }
+        memcpy(&length, nameBytes.data(), sizeof(length));
+        nameBytes.remove_prefix(sizeof(length));
+        if (nameBytes.size() < length) {
+            return false;
+        }
+        names.push_back(nameBytes.substr(0, length));
+        nameBytes.remove_prefix(length);
+    }
+    in.remove_prefix(header.nameBytes);
+
+    size_t recordCount = header.recordCount;
+    auto readValue = [&](size_t column, size_t i) {
+        uint32_t value;
+        memcpy(&value, in.data() + (column * recordCount + i) * sizeof(value),
+            sizeof(value));
+        return value;
+    };
+    for (size_t i = 0; i < recordCount; i++) {
+        if (readValue(1, i) >= header.borrowerCount) {
+            return false;
+        }
+    }
+
+    // 파일의 대여자 번호를 지금 대여자 표의 번호로 바꿈
+    vector<BorrowerId> borrowerIdOf(header.borrowerCount);
+    for (size_t i = 0; i < borrowerIdOf.size(); i++) {
+        optional<BorrowerId> borrowerId =
+            borrowers->registerBorrower(names[i * 2], names[i * 2 + 1]);
+        if (!borrowerId) {
+            return false;
+        }
+        borrowerIdOf[i] = *borrowerId;
+    }
+    lock_guard lock(historyMutex);
+    for (size_t i = 0; i < recordCount; i++) {
+        appendLocked(readValue(0, i), borrowerIdOf[readValue(1, i)],
+            static_cast<int32_t>(readValue(2, i)),
+            static_cast<int32_t>(readValue(3, i)));
+    }
+    return true;
+}
+
+// 대여자의 이름과 전화번호는 대여자 표에 있는 풀의 문자열을 가리킴
+shared_ptr<RentalInfo> RentalManager::makeRentalInfo(int bookId,
+    string_view bookTitle, const Borrower& borrower, DateStruct rentDate,
+    DateStruct returnDate) {
+    auto rentalInfo = allocate_shared<RentalInfo>(
+        PoolAllocator<RentalInfo>(rentalPool), bookId, bookTitle,
+        RentalDTO(borrower.name, borrower.phone, returnDate));
+    rentalInfo->borrowerId = borrower.id;
+    rentalInfo->rentDate = rentDate;
+    return rentalInfo;
+}
+
+shared_ptr<RentalInfo> RentalManager::prepareRental(int bookId,
+    string_view bookTitle, optional<BorrowerId>& borrowerId,
+    const RentalDTO& rentalDTO, RentalStatus& status) {
+    if (!borrowerId) {
+        borrowerId = borrowers->registerBorrower(rentalDTO.borrower,
+            rentalDTO.phone);
+        if (!borrowerId) {
+            status = RentalStatus::BORROWER_LIMIT_REACHED;
+            return nullptr;
+        }
+    }
+    Borrower& borrower = borrowers->get(*borrowerId);
+    if (!reserveLoan(borrower)) {
+        status = RentalStatus::LOAN_LIMIT_REACHED;
+        return nullptr;
+    }
+    return makeRentalInfo(bookId, bookTitle, borrower, getCurrentDate(),
+        rentalDTO.date);
+}
+
+bool RentalManager::reserveLoan(Borrower& borrower) {
+    uint32_t limit = loanLimit.load(memory_order_relaxed);
+    uint32_t activeCount =
+        borrower.activeRentalCount.load(memory_order_relaxed);
+    do {
+        if (limit != 0 && activeCount >= limit) {
+            return false;
+        }
+    } while (!borrower.activeRentalCount.compare_exchange_weak(activeCount,
+        activeCount + 1, memory_order_relaxed));
+    return true;
+}
+
+bool RentalManager::canBorrow(BorrowerId borrowerId) const {
+    if (!borrowers->contains(borrowerId)) {
+        return false;
+    }
+    uint32_t limit = loanLimit.load(memory_order_relaxed);
+    return limit == 0 || borrowers->get(borrowerId).activeRentalCount.load(
+        memory_order_relaxed) < limit;
+}
+
+// BookManager에서 책을 차지한 대여정보를 인덱스에 넣음
+void RentalManager::rentalBook(const shared_ptr<RentalInfo>& rentalInfo) {
+    {
+        unique_lock lock(rentalMutex);
+
+        // rentals에 추가
+        rentalInfo->rentalsPos = rentals->size();
+        rentals->push_back(rentalInfo);
+
+        // 대여자의 대여 목록에 추가
+        auto& borrowerRentals = borrowers->get(rentalInfo->borrowerId).rentals;
+        rentalInfo->borrowerPos = borrowerRentals.size();
+        borrowerRentals.push_back(rentalInfo);
+
+        // 반납일 칸에 추가. 오늘이 바뀌었으면 창을 먼저 오늘 근처로 옮김
+        delayedRentals->recenter(getCurrentDate());
+        delayedRentals->add(rentalInfo);
+
+        rentalInfo->isIndexed = true;
+
+        // 같은 책의 대여/반납이 적용된 순서대로 기록되도록 잠금 안에서 기록
+        if (mutationLog) {
+            mutationLog->appendRent(rentalInfo->bookId, rentalInfo->borrower,
+                rentalInfo->phone, rentalInfo->rentDate,
+                rentalInfo->returnDate);
+        }
+    }
+
+    if (mutationLog) {
+        mutationLog->commit();
+    }
+}
+
+// rentalBook을 여러 대여정보에 한 번에 적용. newRentals의 순서는 바뀜
+void RentalManager::rentalBooks(vector<shared_ptr<RentalInfo>>& newRentals) {
+    {
+        unique_lock lock(rentalMutex);
+
+        rentals->reserve(rentals->size() + newRentals.size());
+        for (auto& rentalInfo : newRentals) {
+            rentalInfo->rentalsPos = rentals->size();
+            rentals->push_back(rentalInfo);
+        }
+
+        // 대여자 번호로 묶어 대여자마다 목록을 한 번만 늘림
+        sort(newRentals.begin(), newRentals.end(),
+            [](const shared_ptr<RentalInfo>& left,
+                const shared_ptr<RentalInfo>& right) {
+                return left->borrowerId < right->borrowerId;
+            });
+        for (size_t begin = 0; begin < newRentals.size();) {
+            size_t end = begin + 1;
+            while (end < newRentals.size() && newRentals[end]->borrowerId
+                == newRentals[begin]->borrowerId) {
+                end++;
+            }
+            auto& borrowerRentals =
+                borrowers->get(newRentals[begin]->borrowerId).rentals;
+            borrowerRentals.reserve(borrowerRentals.size() + (end - begin));
+            for (size_t i = begin; i < end; i++) {
+                newRentals[i]->borrowerPos = borrowerRentals.size();
+                borrowerRentals.push_back(newRentals[i]);
+            }
+            begin = end;
+        }
+
+        sort(newRentals.begin(), newRentals.end(),
+            [](const shared_ptr<RentalInfo>& left,
+                const shared_ptr<RentalInfo>& right) {
+                return pair(left->returnDate.dayNumber, left->bookId)
+                    < pair(right->returnDate.dayNumber, right->bookId);
+            });
+        delayedRentals->recenter(getCurrentDate());
+        delayedRentals->addSorted(newRentals);
+
+        for (auto& rentalInfo : newRentals) {
+            rentalInfo->isIndexed = true;
+            if (mutationLog) {
+                mutationLog->appendRent(rentalInfo->bookId,
+                    rentalInfo->borrower, rentalInfo->phone,
+                    rentalInfo->rentDate, rentalInfo->returnDate);
+            }
+        }
+    }
+
+    if (mutationLog) {
+        mutationLog->commit();
+    }
+}
+
+RentalStatus RentalManager::reject(OperationTimer& timer, EventType type,
+    RentalStatus status, int bookId, BorrowerId borrowerId) {
+    timer.markFailed();
+    if (eventLog) {
+        eventLog->record(EventLevel::WARNING, type, bookId, borrowerId, 0,
+            status);
+    }
+    return status;
+}
+
+// rentalMutex 쓰기 잠금을 잡은 상태에서 호출
+void RentalManager::returnBook(const shared_ptr<RentalInfo>& rentalInfo) {
+    // rentals 에서 제거
+    swapAndPop(*rentals, rentalInfo->rentalsPos, &RentalInfo::rentalsPos);
+
+    // 대여자의 대여 목록에서 제거
+    Borrower& borrower = borrowers->get(rentalInfo->borrowerId);
+    swapAndPop(borrower.rentals, rentalInfo->borrowerPos,
+        &RentalInfo::borrowerPos);
+    borrower.activeRentalCount.fetch_sub(1, memory_order_relaxed);
+
+    // 반납일 칸에서 제거
+    DateStruct today = getCurrentDate();
+    delayedRentals->remove(*rentalInfo);
+    delayedRentals->recenter(today);
+
+    rentalInfo->isIndexed = false;
+
+    history->append(rentalInfo->bookId, rentalInfo->borrowerId,
+        rentalInfo->rentDate, today);
+}
+
+RentalStatus RentalManager::returnById(int bookId, BookManager& bookManager) {
+    OperationTimer timer(EngineOperation::RETURN_BOOK);
+    if (!bookManager.hasBook(bookId)) {
+        return reject(timer, EventType::RETURN_REJECTED,
+            RentalStatus::NO_SUCH_BOOK, bookId);
+    }
+
+    BorrowerId borrowerId;
+    {
+        unique_lock lock(rentalMutex);
+        // 다른 스레드가 차지만 하고 아직 인덱스에 넣지 않은 책은
+        // 대여가 끝나지 않은 것으로 봄
+        auto targetRental = bookManager.getRentalInfo(bookId);
+        if (!targetRental || !targetRental->isIndexed) {
+            return reject(timer, EventType::RETURN_REJECTED,
+                RentalStatus::NOT_RENTED, bookId);
+        }
+        borrowerId = targetRental->borrowerId;
+        returnBook(targetRental);
+        // 저장소의 대여 칸 비우기
+        bookManager.releaseBook(bookId);
+
+        if (mutationLog) {
+            mutationLog->appendReturn(bookId);
+        }
+    }
+
+    if (mutationLog) {
+        mutationLog->commit();
+    }
+    if (eventLog) {
+        eventLog->record(EventLevel::INFO, EventType::BOOK_RETURNED, bookId,
+            borrowerId);
+    }
+    return RentalStatus::SUCCESS;
+}
+
+// 처음 보는 대여자는 책을 차지할 수 있을 때만 등록하므로 거절된 대여는
+// 대여자 표를 늘리지 않음
+RentalStatus RentalManager::rentById(int bookId, RentalDTO rentalDTO,
+    BookManager& bookManager, shared_ptr<RentalInfo>* rentalInfo) {
+    return rentById(bookId,
+        borrowers->find(rentalDTO.borrower, rentalDTO.phone), rentalDTO,
+        bookManager, rentalInfo);
+}
+
+RentalStatus RentalManager::rentById(int bookId, BorrowerId borrowerId,
+    DateStruct returnDate, BookManager& bookManager,
+    shared_ptr<RentalInfo>* rentalInfo) {
+    return rentById(bookId, optional<BorrowerId>(borrowerId),
+        RentalDTO({}, {}, returnDate), bookManager, rentalInfo);
+}
+
+RentalStatus RentalManager::rentById(int bookId,
+    optional<BorrowerId> borrowerId, const RentalDTO& rentalDTO,
+    BookManager& bookManager, shared_ptr<RentalInfo>* rentalInfo) {
+    OperationTimer timer(EngineOperation::RENT_BY_ID);
+    if (!bookManager.hasBook(bookId)) {
+        return reject(timer, EventType::RENT_REJECTED,
+            RentalStatus::NO_SUCH_BOOK, bookId, borrowerId.value_or(0));
+    }
+    if (borrowerId && !borrowers->contains(*borrowerId)) {
+        return reject(timer, EventType::RENT_REJECTED,
+            RentalStatus::NO_SUCH_BORROWER, bookId, *borrowerId);
+    }
+
+    RentalStatus status = RentalStatus::ALREADY_RENTED;
+    shared_ptr<RentalInfo> newRentalInfo;
+    bookManager.claimBookWith(bookId, [&](string_view bookTitle) {
+        newRentalInfo = prepareRental(bookId, bookTitle, borrowerId,
+            rentalDTO, status);
+        return newRentalInfo;
+    });
+    if (!newRentalInfo) {
+        return reject(timer, EventType::RENT_REJECTED, status, bookId,
+            borrowerId.value_or(0));
+    }
+
+    rentalBook(newRentalInfo);
+    if (eventLog) {
+        eventLog->record(EventLevel::INFO, EventType::BOOK_RENTED, bookId,
+            *borrowerId, rentalDTO.date.dayNumber);
+    }
+    if (rentalInfo) {
+        *rentalInfo = move(newRentalInfo);
+    }
+    return RentalStatus::SUCCESS;
+}
+
+RentalStatus RentalManager::rentByTitle(string_view title,
+    RentalDTO rentalDTO, BookManager& bookManager,
+    shared_ptr<RentalInfo>* rentalInfo) {
+    return rentByTitle(title,
+        borrowers->find(rentalDTO.borrower, rentalDTO.phone), rentalDTO,
+        bookManager, rentalInfo);
+}
+
+RentalStatus RentalManager::rentByTitle(string_view title,
+    BorrowerId borrowerId, DateStruct returnDate, BookManager& bookManager,
+    shared_ptr<RentalInfo>* rentalInfo) {
+    return rentByTitle(title, optional<BorrowerId>(borrowerId),
+        RentalDTO({}, {}, returnDate), bookManager, rentalInfo);
+}
+
+RentalStatus RentalManager::rentByTitle(string_view title,
+    optional<BorrowerId> borrowerId, const RentalDTO& rentalDTO,
+    BookManager& bookManager, shared_ptr<RentalInfo>* rentalInfo) {
+    OperationTimer timer(EngineOperation::RENT_BY_TITLE);
+    if (borrowerId && !borrowers->contains(*borrowerId)) {
+        return reject(timer, EventType::RENT_REJECTED,
+            RentalStatus::NO_SUCH_BORROWER, 0, *borrowerId);
+    }
+
+    RentalStatus status = RentalStatus::NO_AVAILABLE_COPY;
+    shared_ptr<RentalInfo> newRentalInfo;
+    int bookId = bookManager.claimAvailableBookByTitle(title,
+        [&](int id, string_view bookTitle) {
+            newRentalInfo = prepareRental(id, bookTitle, borrowerId,
+                rentalDTO, status);
+            return newRentalInfo;
+        });
+    if (bookId == 0) {
+        return reject(timer, EventType::RENT_REJECTED, status, 0,
+            borrowerId.value_or(0));
+    }
+
+    rentalBook(newRentalInfo);
+    if (eventLog) {
+        eventLog->record(EventLevel::INFO, EventType::BOOK_RENTED, bookId,
+            *borrowerId, rentalDTO.date.dayNumber);
+    }
+    if (rentalInfo) {
+        *rentalInfo = move(newRentalInfo);
+    }
+    return RentalStatus::SUCCESS;
+}
+
+vector<RentalStatus> RentalManager::rentBatch(
+    span<const RentalRequest> requests, BookManager& bookManager) {
+    OperationTimer timer(EngineOperation::RENT_BATCH);
+    vector<RentalStatus> statuses(requests.size(), RentalStatus::SUCCESS);
+    vector<shared_ptr<RentalInfo>> newRentals;
+    newRentals.reserve(requests.size());
+
+    // 1단계: 책을 차지하거나 대여자를 등록하기 전에 모든 항목을 검사.
+    // 책은 지워지지 않으므로 책번호는 지금 책 수로 한 번에 검사
+    size_t bookCount = bookManager.getBookCount();
+    for (size_t i = 0; i < requests.size(); i++) {
+        int bookId = requests[i].bookId;
+        if (bookId < 1 || static_cast<size_t>(bookId) > bookCount) {
+            statuses[i] = RentalStatus::NO_SUCH_BOOK;
+        }
+    }
+    // 같은 책이 여러 번 있으면 처음 것만 남김
+    vector<size_t> byBookId(requests.size());
+    iota(byBookId.begin(), byBookId.end(), 0);
+    stable_sort(byBookId.begin(), byBookId.end(),
+        [&](size_t left, size_t right) {
+            return requests[left].bookId < requests[right].bookId;
+        });
+    for (size_t k = 1; k < byBookId.size(); k++) {
+        size_t i = byBookId[k];
+        if (statuses[i] == RentalStatus::SUCCESS &&
+            requests[i].bookId == requests[byBookId[k - 1]].bookId) {
+            statuses[i] = RentalStatus::ALREADY_RENTED;
+        }
+    }
+    // 한도는 이미 빌린 권수에 이 묶음에서 앞서 통과한 권수를 더해 봄
+    uint32_t limit = loanLimit.load(memory_order_relaxed);
+    map<pair<string_view, string_view>, uint32_t> batchLoans;
+    vector<optional<BorrowerId>> borrowerIds(requests.size());
+    for (size_t i = 0; i < requests.size(); i++) {
+        if (statuses[i] != RentalStatus::SUCCESS) {
+            continue;
+        }
+        if (bookManager.isRented(requests[i].bookId)) {
+            statuses[i] = RentalStatus::ALREADY_RENTED;
+            continue;
+        }
+        const RentalDTO& rentalDTO = requests[i].rentalDTO;
+        borrowerIds[i] = borrowers->find(rentalDTO.borrower, rentalDTO.phone);
+        if (limit == 0) {
+            continue;
+        }
+        uint32_t& loans = batchLoans[{ rentalDTO.borrower, rentalDTO.phone }];
+        uint32_t activeCount = borrowerIds[i]
+            ? borrowers->get(*borrowerIds[i]).activeRentalCount.load(
+                memory_order_relaxed)
+            : 0;
+        if (activeCount + loans >= limit) {
+            statuses[i] = RentalStatus::LOAN_LIMIT_REACHED;
+            continue;
+        }
+        loans++;
+    }
+
+    // 2단계: 통과한 항목만 책을 차지. 검사한 뒤 다른 스레드가 먼저 빌린
+    // 책이나 그사이 찬 한도는 여기서 거절되고, 처음 보는 대여자는 책을
+    // 차지할 수 있을 때만 등록됨
+    for (size_t i = 0; i < requests.size(); i++) {
+        if (statuses[i] != RentalStatus::SUCCESS) {
+            continue;
+        }
+        int bookId = requests[i].bookId;
+        const RentalDTO& rentalDTO = requests[i].rentalDTO;
+        optional<BorrowerId>& borrowerId = borrowerIds[i];
+        RentalStatus status = RentalStatus::ALREADY_RENTED;
+        shared_ptr<RentalInfo> rentalInfo;
+        bookManager.claimBookWith(bookId, [&](string_view bookTitle) {
+            rentalInfo = prepareRental(bookId, bookTitle, borrowerId,
+                rentalDTO, status);
+            return rentalInfo;
+        });
+        if (!rentalInfo) {
+            statuses[i] = status;
+            continue;
+        }
+        newRentals.push_back(move(rentalInfo));
+    }
+
+    if (newRentals.size() != requests.size()) {
+        timer.markFailed();
+    }
+    if (!newRentals.empty()) {
+        rentalBooks(newRentals);
+    }
+    if (eventLog) {
+        eventLog->record(EventLevel::INFO, EventType::RENT_BATCH, 0, 0, 0,
+            RentalStatus::SUCCESS, static_cast<uint32_t>(newRentals.size()),
+            static_cast<uint32_t>(requests.size() - newRentals.size()));
+    }
+    return statuses;
+}
+
+vector<RentalStatus> RentalManager::returnBatch(span<const int> bookIds,
+    BookManager& bookManager) {
+    OperationTimer timer(EngineOperation::RETURN_BATCH);
+    vector<RentalStatus> statuses(bookIds.size(), RentalStatus::SUCCESS);
+    size_t bookCount = bookManager.getBookCount();
+    size_t returnedCount = 0;
+    {
+        unique_lock lock(rentalMutex);
+        for (size_t i = 0; i < bookIds.size(); i++) {
+            int bookId = bookIds[i];
+            if (bookId < 1 || static_cast<size_t>(bookId) > bookCount) {
+                statuses[i] = RentalStatus::NO_SUCH_BOOK;
+                continue;
+            }
+            auto targetRental = bookManager.getRentalInfo(bookId);
+            if (!targetRental || !targetRental->isIndexed) {
+                statuses[i] = RentalStatus::NOT_RENTED;
+                continue;
+            }
+            returnBook(targetRental);
+            bookManager.releaseBook(bookId);
+            if (mutationLog) {
+                mutationLog->appendReturn(bookId);
+            }
+            returnedCount++;
+        }
+    }
+
+    if (returnedCount != bookIds.size()) {
+        timer.markFailed();
+    }
+    if (mutationLog && returnedCount > 0) {
+        mutationLog->commit();
+    }
+    if (eventLog) {
+        eventLog->record(EventLevel::INFO, EventType::RETURN_BATCH, 0, 0, 0,
+            RentalStatus::SUCCESS, static_cast<uint32_t>(returnedCount),
+            static_cast<uint32_t>(bookIds.size() - returnedCount));
+    }
+    return statuses;
+}
+
+bool RentalManager::restoreRentals(span<const RestoredRental> restored,
+    BookManager& bookManager) {
+    bool isRestored = true;
+    vector<shared_ptr<RentalInfo>> newRentals;
+    newRentals.reserve(restored.size());
+    for (const auto& rental : restored) {
+        if (!borrowers->contains(rental.borrowerId)) {
+            isRestored = false;
+            continue;
+        }
+        Borrower& borrower = borrowers->get(rental.borrowerId);
+        shared_ptr<RentalInfo> rentalInfo;
+        bool isClaimed = bookManager.claimBookWith(rental.bookId,
+            [&](string_view bookTitle) {
+                rentalInfo = makeRentalInfo(rental.bookId, bookTitle, borrower,
+                    rental.rentDate, rental.returnDate);
+                return rentalInfo;
+            });
+        if (!isClaimed) {
+            isRestored = false;
+            continue;
+        }
+        borrower.activeRentalCount.fetch_add(1, memory_order_relaxed);
+        newRentals.push_back(move(rentalInfo));
+    }
+
+    auto isDueBefore = [](const shared_ptr<RentalInfo>& left,
+        const shared_ptr<RentalInfo>& right) {
+        return pair(left->returnDate.dayNumber, left->bookId)
+            < pair(right->returnDate.dayNumber, right->bookId);
+    };
+    if (!is_sorted(newRentals.begin(), newRentals.end(), isDueBefore)) {
+        sort(newRentals.begin(), newRentals.end(), isDueBefore);
+    }
+
+    unique_lock lock(rentalMutex);
+    rentals->reserve(rentals->size() + newRentals.size());
+    for (auto& rentalInfo : newRentals) {
+        rentalInfo->rentalsPos = rentals->size();
+        rentals->push_back(rentalInfo);
+        auto& borrowerRentals = borrowers->get(rentalInfo->borrowerId).rentals;
+        rentalInfo->borrowerPos = borrowerRentals.size();
+        borrowerRentals.push_back(rentalInfo);
+        rentalInfo->isIndexed = true;
+    }
+    delayedRentals->recenter(getCurrentDate());
+    delayedRentals->addSorted(newRentals);
+    return isRestored;
+}
+
+bool RentalManager::loadSnapshot(const CatalogSnapshot& snapshot,
+    BookManager& bookManager) {
+    auto records = snapshot.getRentals();
+    // 대여자는 스냅샷의 (이름, 전화번호) 문자열 번호마다 한 번만 등록
+    unordered_map<uint64_t, optional<BorrowerId>> borrowerIdOf;
+    bool isLoaded = true;
+    vector<RestoredRental> restored;
+    restored.reserve(records.size());
+    for (uint32_t pos : snapshot.getRentalsByDueDate()) {
+        const auto& rental = records[pos];
+        auto [it, isInserted] = borrowerIdOf.try_emplace(
+            uint64_t(rental.borrowerId) << 32 | rental.phoneId);
+        if (isInserted) {
+            it->second = borrowers->registerBorrower(
+                snapshot.getString(rental.borrowerId),
+                snapshot.getString(rental.phoneId));
+        }
+        if (!it->second) {
+            isLoaded = false;
+            continue;
+        }
+        restored.push_back({ rental.bookId, *it->second,
+            DateStruct::fromDayNumber(rental.rentDay),
+            DateStruct::fromDayNumber(rental.returnDay) });
+    }
+    return restoreRentals(restored, bookManager) && isLoaded;
+}
+
+vector<shared_ptr<RentalInfo>> RentalManager::getAllRentals() {
+    shared_lock lock(rentalMutex);
+    return vector<shared_ptr<RentalInfo>>(rentals->begin(), rentals->end());
+}
+
+vector<shared_ptr<RentalInfo>>
+RentalManager::getRentalsByBorrower(string_view borrower) {
+    OperationTimer timer(EngineOperation::FIND_BY_BORROWER);
+    shared_lock lock(rentalMutex);
+    vector<shared_ptr<RentalInfo>> result;
+    borrowers->forEachByName(borrower, [&](BorrowerId borrowerId) {
+        const auto& borrowerRentals = borrowers->get(borrowerId).rentals;
+        result.insert(result.end(), borrowerRentals.begin(),
+            borrowerRentals.end());
+    });
+    return result;
+}
+
+vector<shared_ptr<RentalInfo>>
+RentalManager::getRentalsByBorrower(BorrowerId borrowerId) {
+    OperationTimer timer(EngineOperation::FIND_BY_BORROWER);
+    if (!borrowers->contains(borrowerId)) {
+        return {};
+    }
+    shared_lock lock(rentalMutex);
+    const auto& borrowerRentals = borrowers->get(borrowerId).rentals;
+    return vector<shared_ptr<RentalInfo>>(borrowerRentals.begin(),
+        borrowerRentals.end());
+}
+
+vector<shared_ptr<RentalInfo>>
+RentalManager::getDelayedRentalsByReturnDate(DateStruct returnDate) {
+    OperationTimer timer(EngineOperation::FIND_DELAYED);
+    shared_lock lock(rentalMutex);
+    lock_guard delayedLock(delayedMutex);
+    vector<shared_ptr<RentalInfo>> result;
+    delayedRentals->forEachDueBy(returnDate,
+        [&result](const shared_ptr<RentalInfo>& rental) {
+            result.push_back(rental);
+        });
+    return result;
+}
+
+size_t RentalManager::getRentalCount() const {
+    shared_lock lock(rentalMutex);
+    return rentals->size();
+}
+
+void RentalManager::appendGauges(vector<MetricGauge>& gauges) const {
+    shared_lock lock(rentalMutex);
+    gauges.push_back({ "book_rental_count",
+        static_cast<double>(rentals->size()) });
+    borrowers->appendGauges(gauges);
+    // 달력 큐는 하루가 한 칸이라 부하율은 창 안에서 대여가 있는 날짜 수 / 칸 수
+    gauges.push_back({ "book_delayed_queue_entries",
+        static_cast<double>(delayedRentals->size()) });
+    gauges.push_back({ "book_delayed_queue_buckets",
+        static_cast<double>(delayedRentals->getBucketCount()) });
+    gauges.push_back({ "book_delayed_queue_load_factor",
+        delayedRentals->getBucketCount() == 0 ? 0.0
+            : static_cast<double>(delayedRentals->getDayCount())
+                / delayedRentals->getBucketCount() });
+    gauges.push_back({ "book_delayed_queue_overflow_days",
+        static_cast<double>(delayedRentals->getOverflowDayCount()) });
+    gauges.push_back({ "book_history_records",
+        static_cast<double>(history->size()) });
+    gauges.push_back({ "book_history_chunks",
+        static_cast<double>(history->getChunkCount()) });
+    gauges.push_back({ "book_history_dropped",
+        static_cast<double>(history->getDroppedCount()) });
+}
+
+DateStruct RentalManager::getCurrentDate() const {
+    int32_t day = currentDay.load(memory_order_relaxed);
+    return day == INT32_MIN ? DateStruct::today()
+        : DateStruct::fromDayNumber(day);
+}
+
+namespace {
+
+// 집계를 HistoryGroup으로 바꿔 대여 수가 많은 순(같으면 이름 순)으로 정렬.
+// 대여 수가 minRentals보다 적은 묶음은 뺌. count개가 넘으면 앞의 count개만 남김
+vector<HistoryGroup> rankHistoryGroups(const HistoryTotals& totals,
+    span<const string_view> names, uint64_t minRentals, size_t count) {
+    vector<HistoryGroup> groups;
+    for (size_t key = 0; key < totals.rentals.size(); key++) {
+        uint64_t rentals = totals.rentals[key];
+        if (rentals == 0 || rentals < minRentals) {
+            continue;
+        }
+        groups.push_back({ names[key], rentals,
+            static_cast<double>(totals.loanDays[key]) / rentals });
+    }
+    auto isBefore = [](const HistoryGroup& left, const HistoryGroup& right) {
+        return left.rentals != right.rentals ? left.rentals > right.rentals
+            : left.name < right.name;
+    };
+    if (count < groups.size()) {
+        partial_sort(groups.begin(), groups.begin() + count, groups.end(),
+            isBefore);
+        groups.resize(count);
+    }
+    else {
+        sort(groups.begin(), groups.end(), isBefore);
+    }
+    return groups;
+}
+
+}
+
+vector<HistoryGroup> RentalManager::getTopTitles(DateStruct from,
+    DateStruct to, size_t count, const BookManager& bookManager) const {
+    BookGrouping grouping = bookManager.getBookGrouping(SearchField::TITLE);
+    HistoryTotals totals = history->groupByBook(from, to, grouping.keyOfBook,
+        grouping.names.size());
+    return rankHistoryGroups(totals, grouping.names, 1, count);
+}
+
+vector<HistoryGroup> RentalManager::getLoanDaysByAuthor(DateStruct from,
+    DateStruct to, const BookManager& bookManager) const {
+    BookGrouping grouping = bookManager.getBookGrouping(SearchField::AUTHOR);
+    HistoryTotals totals = history->groupByBook(from, to, grouping.keyOfBook,
+        grouping.names.size());
+    return rankHistoryGroups(totals, grouping.names, 1, SIZE_MAX);
+}
+
+vector<HistoryGroup> RentalManager::getRepeatBorrowers(DateStruct from,
+    DateStruct to, uint64_t minRentals) const {
+    HistoryTotals totals = history->groupByBorrower(from, to);
+    vector<string_view> names(totals.rentals.size());
+    for (BorrowerId id = 0; id < names.size(); id++) {
+        names[id] = borrowers->get(id).name;
+    }
+    return rankHistoryGroups(totals, names, minRentals, SIZE_MAX);
+}
+
+vector<uint64_t> RentalManager::getRentalsPerDay(DateStruct from,
+    DateStruct to) const {
+    return history->countByDay(from, to);
+}
+
+size_t RentalManager::countDelayedRentals(DateStruct returnDate) const {
+    OperationTimer timer(EngineOperation::COUNT_DELAYED);
+    shared_lock lock(rentalMutex);
+    lock_guard delayedLock(delayedMutex);
+    return delayedRentals->countDueBy(returnDate);
+}
+
+DelayedRentalPage RentalManager::getDelayedRentalPage(DateStruct returnDate,
+    DelayedRentalCursor after, size_t pageSize) const {
+    OperationTimer timer(EngineOperation::FIND_DELAYED);
+    shared_lock lock(rentalMutex);
+    lock_guard delayedLock(delayedMutex);
+    return delayedRentals->getPage(returnDate, after, pageSize);
+}
+
+RentalPage RentalManager::getRentalPage(const RentalCursor& after,
+    size_t pageSize, const BookManager& bookManager) const {
+    OperationTimer timer(EngineOperation::LIST_RENTALS);
+    if (after.order == RentalOrder::BY_BOOK_ID) {
+        return bookManager.getRentalPage(after, pageSize);
+    }
+
+    DelayedRentalPage delayedPage;
+    {
+        shared_lock lock(rentalMutex);
+        lock_guard delayedLock(delayedMutex);
+        delayedPage = delayedRentals->getPage(
+            DateStruct::fromDayNumber(INT32_MAX),
+            { after.returnDay, after.bookId }, pageSize);
+    }
+    RentalPage page{ move(delayedPage.rentals), after, delayedPage.hasMore };
+    page.next.returnDay = delayedPage.next.returnDay;
+    page.next.bookId = delayedPage.next.bookId;
+    return page;
+}
+
+span<const shared_ptr<RentalInfo>> RentalManager::viewAllRentals() const {
+    return *rentals;
+}
+
+span<const shared_ptr<RentalInfo>>
+RentalManager::viewRentalsByBorrower(BorrowerId borrowerId) const {
+    if (!borrowers->contains(borrowerId)) {
+        return {};
+    }
+    return borrowers->get(borrowerId).rentals;
+}
+
+ReplayReport MutationLog::replay(const string& path, BookManager& bookManager,
+    RentalManager& rentalManager, uint64_t fromOffset) {
+    constexpr size_t CHUNK_SIZE = 1 << 22;
+    // 이보다 긴 레코드는 쓰지 않으므로 길이가 깨진 것으로 봄
+    constexpr uint32_t MAX_PAYLOAD_SIZE = 1 << 20;
+
+    auto startTime = chrono::steady_clock::now();
+    ReplayReport report{ 0, 0, 0 };
+
+    ifstream file(path, ios::binary);
+    if (!file) {
+        return report;
+    }
+    error_code error;
+    if (fromOffset > filesystem::file_size(path, error)) {
+        fromOffset = 0;
+    }
+    file.seekg(static_cast<streamoff>(fromOffset));
+
+    auto readU32 = [](string_view& in, uint32_t& value) {
+        if (in.size() < sizeof(value)) {
+            return false;
+        }
+        memcpy(&value, in.data(), sizeof(value));
+        in.remove_prefix(sizeof(value));
+        return true;
+    };
+    auto readString = [&](string_view& in, string_view& text) {
+        uint32_t length;
+        if (!readU32(in, length) || in.size() < length) {
+            return false;
+        }
+        text = in.substr(0, length);
+        in.remove_prefix(length);
+        return true;
+    };
+
+    // 책 추가는 모아서 한 묶음씩 등록
+    constexpr size_t BATCH_SIZE = 1 << 16;
+    vector<pair<string, string>> pendingBooks;
+    size_t bookCount = bookManager.getBookCount();
+
+    // 책마다 대여 상태는 다른 책과 상관없이 그 책의 대여/반납 순서로만
+    // 정해지므로, 책마다 마지막 상태만 모았다가 끝에 한 번씩 적용
+    struct FinalRental {
+        string borrower;
+        string phone;
+        int32_t rentDay = 0;
+        int32_t returnDay = 0;
+        bool isRented = false;
+        bool isChanged = false;
+    };
+    vector<FinalRental> finalRentals(bookCount);
+    bookManager.forEachBook([&finalRentals](const BookView& book) {
+        finalRentals[book.id - 1].isRented = book.returnDate.has_value();
+        });
+
+    auto applyRecord = [&](RecordType type, string_view payload) {
+        uint32_t bookId;
+        switch (type) {
+        case RecordType::ADD_BOOK: {
+            string_view title, author;
+            if (!readString(payload, title) || !readString(payload, author)) {
+                return false;
+            }
+            pendingBooks.emplace_back(title, author);
+            if (pendingBooks.size() >= BATCH_SIZE) {
+                bookManager.addBooks(pendingBooks);
+            }
+            bookCount++;
+            finalRentals.emplace_back();
+            return true;
+        }
+        case RecordType::RENT: {
+            string_view borrower, phone;
+            uint32_t returnDay;
+            if (!readU32(payload, bookId) || !readString(payload, borrower)
+                || !readString(payload, phone) || !readU32(payload, returnDay)) {
+                return false;
+            }
+            // 대여일이 없는 예전 기록은 되살리는 날을 대여일로 씀
+            uint32_t rentDay;
+            if (!readU32(payload, rentDay)) {
+                rentDay = static_cast<uint32_t>(
+                    rentalManager.getCurrentDate().dayNumber);
+            }
+            // 없는 책이나 이미 대여된 책은 원래도 실패했을 기록
+            if (bookId == 0 || bookId > bookCount
+                || finalRentals[bookId - 1].isRented) {
+                return true;
+            }
+            FinalRental& rental = finalRentals[bookId - 1];
+            rental.borrower = borrower;
+            rental.phone = phone;
+            rental.rentDay = static_cast<int32_t>(rentDay);
+            rental.returnDay = static_cast<int32_t>(returnDay);
+            rental.isRented = true;
+            rental.isChanged = true;
+            return true;
+        }
+        case RecordType::RETURN:
+            if (!readU32(payload, bookId)) {
+                return false;
+            }
+            if (bookId != 0 && bookId <= bookCount) {
+                finalRentals[bookId - 1].isRented = false;
+                finalRentals[bookId - 1].isChanged = true;
+            }
+            return true;
+        }
+        return false;
+    };
+
+    vector<char> chunk(CHUNK_SIZE);
+    string buffer;
+    size_t pos = 0;
+    uintmax_t validBytes = fromOffset;
+    bool isCorrupt = false;
+
+    while (!isCorrupt) {
+        file.read(chunk.data(), chunk.size());
+        size_t readCount = static_cast<size_t>(file.gcount());
+        if (readCount == 0) {
+            break;
+        }
+        buffer.erase(0, pos);
+        pos = 0;
+        buffer.append(chunk.data(), readCount);
+
+        while (buffer.size() - pos >= HEADER_SIZE) {
+            uint32_t length, crc;
+            memcpy(&length, buffer.data() + pos, sizeof(length));
+            memcpy(&crc, buffer.data() + pos + 4, sizeof(crc));
+            if (length > MAX_PAYLOAD_SIZE) {
+                isCorrupt = true;
+                break;
+            }
+            if (buffer.size() - pos - HEADER_SIZE < length) {
+                break;
+            }
+
+            // 종류 바이트와 내용을 함께 검사
+            string_view record(buffer.data() + pos + HEADER_SIZE - 1,
+                length + 1);
+            if (crc32(0, record) != crc
+                || !applyRecord(static_cast<RecordType>(record[0]),
+                    record.substr(1))) {
+                isCorrupt = true;
+                break;
+            }
+            pos += HEADER_SIZE + length;
+            validBytes += HEADER_SIZE + length;
+            report.events++;
+        }
+    }
+    file.close();
+
+    if (!pendingBooks.empty()) {
+        bookManager.addBooks(pendingBooks);
+    }
+    vector<RestoredRental> restored;
+    for (size_t row = 0; row < finalRentals.size(); row++) {
+        const FinalRental& rental = finalRentals[row];
+        if (!rental.isChanged) {
+            continue;
+        }
+        // 적용 전부터 대여중이던 책은 반납한 뒤 마지막 대여를 적용
+        auto bookId = static_cast<int>(row + 1);
+        if (bookManager.getRentalInfo(bookId)) {
+            rentalManager.returnById(bookId, bookManager);
+        }
+        if (!rental.isRented) {
+            continue;
+        }
+        // 대여자 표가 꽉 차 등록할 수 없는 대여는 원래도 거절됐을 기록
+        auto borrowerId = rentalManager.registerBorrower(rental.borrower,
+            rental.phone);
+        if (borrowerId) {
+            restored.push_back({ bookId, *borrowerId,
+                DateStruct::fromDayNumber(rental.rentDay),
+                DateStruct::fromDayNumber(rental.returnDay) });
+        }
+    }
+    rentalManager.restoreRentals(restored, bookManager);
+
+    // 마지막 기록 중에 꺼져 끝이 잘린 경우. 다음 기록이 이어 붙도록 자름
+    uintmax_t fileSize = filesystem::file_size(path, error);
+    if (!error && fileSize > validBytes) {
+        report.truncatedBytes = static_cast<size_t>(fileSize - validBytes);
+        filesystem::resize_file(path, validBytes, error);
+    }
+
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - startTime;
+    report.seconds = elapsed.count();
+    return report;
+}
+
+bool CatalogSnapshot::write(const string& path, const BookManager& bookManager,
+    const RentalManager& rentalManager, uint64_t walOffset) {
+    // 풀에는 반납된 대여자처럼 더 쓰이지 않는 문자열도 남아 있으므로
+    // 지금 쓰이는 문자열만 새로 번호를 매김
+    StringKeyMap<uint32_t> stringIds;
+    vector<string_view> strings;
+    auto intern = [&](string_view value) {
+        auto [id, isInserted] = stringIds.tryEmplace(value);
+        if (isInserted) {
+            *id = static_cast<uint32_t>(strings.size());
+            strings.push_back(value);
+        }
+        return *id;
+    };
+
+    vector<uint32_t> bookTitles;
+    vector<uint32_t> bookAuthors;
+    bookManager.forEachBook([&](const BookView& book) {
+        bookTitles.push_back(intern(book.title));
+        bookAuthors.push_back(intern(book.author));
+        });
+
+    vector<RentalRecord> rentals;
+    rentalManager.forEachRental([&](const RentalInfo& rental) {
+        rentals.push_back({ rental.bookId, intern(rental.getBorrower()),
+            intern(rental.getPhone()), rental.getRentDate().dayNumber,
+            rental.getReturnDate().dayNumber });
+        });
+    sort(rentals.begin(), rentals.end(),
+        [](const RentalRecord& left, const RentalRecord& right) {
+            return left.bookId < right.bookId;
+        });
+    vector<uint32_t> rentalBorrowers;
+    rentalBorrowers.reserve(rentals.size());
+    for (const auto& rental : rentals) {
+        rentalBorrowers.push_back(rental.borrowerId);
+    }
+
+    vector<uint64_t> stringOffsets{ 0 };
+    string stringBytes;
+    for (string_view text : strings) {
+        stringBytes.append(text);
+        stringOffsets.push_back(stringBytes.size());
+    }
+    vector<uint32_t> sortedStrings(strings.size());
+    iota(sortedStrings.begin(), sortedStrings.end(), 0);
+    sort(sortedStrings.begin(), sortedStrings.end(),
+        [&strings](uint32_t left, uint32_t right) {
+            return strings[left] < strings[right];
+        });
+
+    // 항목 i의 키가 keys[i]일 때 키를 문자열 순서로 묶음. 계수 정렬이라
+    // 같은 키 안에서는 항목 순서가 유지됨
+    auto groupByKey = [&](const vector<uint32_t>& keys, uint32_t itemBase,
+        vector<KeyGroup>& groups, vector<uint32_t>& items) {
+        vector<uint32_t> counts(strings.size(), 0);
+        for (uint32_t key : keys) {
+            counts[key]++;
+        }
+        vector<uint32_t> next(strings.size(), 0);
+        uint32_t first = 0;
+        for (uint32_t stringId : sortedStrings) {
+            if (counts[stringId] > 0) {
+                groups.push_back({ stringId, first, counts[stringId] });
+                next[stringId] = first;
+                first += counts[stringId];
+            }
+        }
+        items.resize(keys.size());
+        for (size_t i = 0; i < keys.size(); i++) {
+            items[next[keys[i]]++] = static_cast<uint32_t>(i) + itemBase;
+        }
+    };
+
+    vector<KeyGroup> titleKeys, authorKeys, borrowerKeys;
+    vector<uint32_t> titleBooks, authorBooks, borrowerRentals;
+    groupByKey(bookTitles, 1, titleKeys, titleBooks);
+    groupByKey(bookAuthors, 1, authorKeys, authorBooks);
+    groupByKey(rentalBorrowers, 0, borrowerKeys, borrowerRentals);
+
+    vector<uint32_t> dueRentals(rentals.size());
+    iota(dueRentals.begin(), dueRentals.end(), 0);
+    stable_sort(dueRentals.begin(), dueRentals.end(),
+        [&rentals](uint32_t left, uint32_t right) {
+            return rentals[left].returnDay < rentals[right].returnDay;
+        });
+
+    auto bytesOf = [](const auto& values) {
+        return string_view(reinterpret_cast<const char*>(values.data()),
+            values.size() * sizeof(values[0]));
+    };
+    const array<string_view, SECTION_COUNT> sections = {
+        bytesOf(stringOffsets), stringBytes, bytesOf(sortedStrings),
+        bytesOf(bookTitles), bytesOf(bookAuthors), bytesOf(rentals),
+        bytesOf(titleKeys), bytesOf(titleBooks), bytesOf(authorKeys),
+        bytesOf(authorBooks), bytesOf(borrowerKeys), bytesOf(borrowerRentals),
+        bytesOf(dueRentals)
+    };
+
+    auto alignUp = [](uint64_t offset) { return (offset + 7) & ~uint64_t{ 7 }; };
+    Header header{};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.sectionCount = SECTION_COUNT;
+    header.walOffset = walOffset;
+    uint64_t offset = alignUp(sizeof(Header));
+    for (size_t section = 0; section < SECTION_COUNT; section++) {
+        header.sections[section] = { offset, sections[section].size() };
+        offset = alignUp(offset + sections[section].size());
+    }
+
+    // 파일에 쓰는 순서 그대로 구간 사이의 0 채움까지 체크섬에 넣음
+    const char padding[8] = {};
+    uint32_t checksum = computeChecksum(header, {});
+    uint64_t position = sizeof(Header);
+    for (size_t section = 0; section < SECTION_COUNT; section++) {
+        uint64_t gap = header.sections[section].offset - position;
+        checksum = crc32(checksum, string_view(padding, gap));
+        checksum = crc32(checksum, sections[section]);
+        position = header.sections[section].offset + sections[section].size();
+    }
+    header.checksum = checksum;
+
+    // 쓰는 도중에 꺼져도 이전 스냅샷이 남도록 임시 파일에 다 쓴 뒤 교체
+    string tempPath = path + ".tmp";
+    FILE* file = openBinaryFile(tempPath, "wb");
+    if (!file) {
+        return false;
+    }
+    bool isWritten = fwrite(&header, sizeof(header), 1, file) == 1;
+    uint64_t written = sizeof(header);
+    for (size_t section = 0; section < SECTION_COUNT && isWritten; section++) {
+        uint64_t gap = header.sections[section].offset - written;
+        isWritten = fwrite(padding, 1, gap, file) == gap
+            && fwrite(sections[section].data(), 1, sections[section].size(),
+                file) == sections[section].size();
+        written += gap + sections[section].size();
+    }
+    isWritten = isWritten && syncFile(file);
+    isWritten = fclose(file) == 0 && isWritten;
+
+    error_code error;
+    if (isWritten) {
+        filesystem::rename(tempPath, path, error);
+    }
+    if (!isWritten || error) {
+        filesystem::remove(tempPath, error);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,2874 @@
+#pragma once
+
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <numeric>
+#include <random>
+#include <unordered_map>
+#include <utility>
+#include <memory>
+#include <span>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <thread>
+#include <bit>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+
+class RentalInfo;
+class Book;
+class Renderer;
+class BookManager;
+class RentalManager;
+struct RentalCursor;
+struct RentalPage;
+enum class RentalStatus : uint8_t;
+template <typename T, size_t N>
+class SmallVector;
+
+// 날짜를 1970-01-01부터의 일수 하나로 저장. 비교는 정수 비교 한 번
+struct DateStruct {
+    // "YYYY-MM-DD" + 널 문자
+    static constexpr size_t DATE_STRING_SIZE = 11;
+
+    int32_t dayNumber;
+
+    constexpr DateStruct(int year, int month, int day)
+        : dayNumber{ toDayNumber(year, month, day) } {
+    }
+
+    static constexpr DateStruct fromDayNumber(int32_t dayNumber) {
+        DateStruct date{ 1970, 1, 1 };
+        date.dayNumber = dayNumber;
+        return date;
+    }
+
+    static constexpr bool isLeapYear(int year) {
+        return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    }
+
+    static constexpr bool isValid(int year, int month, int day) {
+        constexpr int daysInMonth[] = { 31, 28, 31, 30, 31, 30,
+                                        31, 31, 30, 31, 30, 31 };
+        if (year < 1 || year > 9999 || month < 1 || month > 12 || day < 1) {
+            return false;
+        }
+        int lastDay = daysInMonth[month - 1] +
+            (month == 2 && isLeapYear(year) ? 1 : 0);
+        return day <= lastDay;
+    }
+
+    constexpr int getYear() const {
+        return toCivil().year;
+    }
+
+    constexpr int getMonth() const {
+        return toCivil().month;
+    }
+
+    constexpr int getDay() const {
+        return toCivil().day;
+    }
+
+    // buffer에 "YYYY-MM-DD"를 쓰고 널 문자로 끝냄. 할당 없음
+    void getDateString(char (&buffer)[DATE_STRING_SIZE]) const {
+        Civil civil = toCivil();
+        auto writeDigits = [](char* out, int value, int width) {
+            for (int i = width - 1; i >= 0; i--) {
+                out[i] = static_cast<char>('0' + value % 10);
+                value /= 10;
+            }
+        };
+        writeDigits(buffer, civil.year, 4);
+        buffer[4] = '-';
+        writeDigits(buffer + 5, civil.month, 2);
+        buffer[7] = '-';
+        writeDigits(buffer + 8, civil.day, 2);
+        buffer[10] = '\0';
+    }
+
+    std::string getDateString() const {
+        char buffer[DATE_STRING_SIZE];
+        getDateString(buffer);
+        return std::string(buffer, DATE_STRING_SIZE - 1);
+    }
+
+    // 시스템 시계의 오늘 (UTC)
+    static DateStruct today() {
+        auto days = std::chrono::floor<std::chrono::days>(
+            std::chrono::system_clock::now());
+        return fromDayNumber(
+            static_cast<int32_t>(days.time_since_epoch().count()));
+    }
+
+    // "YYYY-MM-DD"를 읽음. 형식이 틀렸거나 없는 날짜면 nullopt
+    static std::optional<DateStruct> parse(std::string_view text) {
+        if (text.size() != DATE_STRING_SIZE - 1 || text[4] != '-'
+            || text[7] != '-') {
+            return std::nullopt;
+        }
+        auto readDigits = [&](size_t pos, size_t width, int& value) {
+            auto [end, ec] = std::from_chars(text.data() + pos,
+                text.data() + pos + width, value);
+            return ec == std::errc() && end == text.data() + pos + width;
+        };
+        int year, month, day;
+        if (!readDigits(0, 4, year) || !readDigits(5, 2, month)
+            || !readDigits(8, 2, day) || !isValid(year, month, day)) {
+            return std::nullopt;
+        }
+        return DateStruct(year, month, day);
+    }
+
+    constexpr bool operator<(const DateStruct& date) const {
+        return dayNumber < date.dayNumber;
+    }
+
+    constexpr bool operator==(const DateStruct& date) const {
+        return dayNumber == date.dayNumber;
+    }
+
+private:
+    struct Civil {
+        int year, month, day;
+    };
+
+    // 그레고리력 <-> 일수 변환 (H. Hinnant, "chrono-Compatible Low-Level
+    // Date Algorithms")
+    static constexpr int32_t toDayNumber(int year, int month, int day) {
+        year -= month <= 2 ? 1 : 0;
+        int era = (year >= 0 ? year : year - 399) / 400;
+        int yearOfEra = year - era * 400;
+        int dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 +
+            day - 1;
+        int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 +
+            dayOfYear;
+        return era * 146097 + dayOfEra - 719468;
+    }
+
+    constexpr Civil toCivil() const {
+        int32_t days = dayNumber + 719468;
+        int era = (days >= 0 ? days : days - 146096) / 146097;
+        int dayOfEra = days - era * 146097;
+        int yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 -
+            dayOfEra / 146096) / 365;
+        int dayOfYear = dayOfEra -
+            (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+        int shiftedMonth = (5 * dayOfYear + 2) / 153;
+        int day = dayOfYear - (153 * shiftedMonth + 2) / 5 + 1;
+        int month = shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9;
+        return { yearOfEra + era * 400 + (month <= 2 ? 1 : 0), month, day };
+    }
+};
+
+static_assert(sizeof(DateStruct) == sizeof(int32_t));
+static_assert(DateStruct(2025, 1, 31) < DateStruct(2025, 2, 1));
+static_assert(DateStruct(2024, 12, 31) < DateStruct(2025, 1, 1));
+static_assert(DateStruct(2024, 3, 1).dayNumber -
+    DateStruct(2024, 2, 28).dayNumber == 2);
+static_assert(DateStruct(2025, 1, 7).getDay() == 7);
+
+// 호출하는 동안만 쓰는 입력값. 문자열은 호출자가 가진 것을 가리킴
+struct RentalDTO {
+    std::string_view borrower;
+    std::string_view phone;
+    DateStruct date;
+
+    RentalDTO(std::string_view borrower, std::string_view phone,
+        DateStruct date)
+        : borrower{ borrower }, phone{ phone }, date(date) {
+    };
+};
+
+// 일괄 대여의 한 항목
+struct RentalRequest {
+    int bookId;
+    RentalDTO rentalDTO;
+};
+
+class Idisplayable {
+public:
+    virtual ~Idisplayable() = default;
+    virtual void displaySelf() const = 0;
+    virtual void renderTo(Renderer& renderer) const = 0;
+};
+
+// CatalogStore의 한 행을 복사 없이 가리키는 뷰. 저장소가 바뀌면 무효
+struct BookView {
+    int id;
+    std::string_view title;
+    std::string_view author;
+    // 대여중이면 반납일
+    std::optional<DateStruct> returnDate;
+
+    void displaySelf() const;
+};
+
+// CatalogStore의 한 행을 꺼내 만든 스냅샷. 대여 상태를 바꿔도 저장소에는
+// 반영되지 않으므로 변경은 BookManager를 통해서 함.
+// 제목과 작가는 StringPool의 문자열을 가리킴
+class Book : public Idisplayable {
+private:
+    int id;
+    std::string_view title;
+    std::string_view author;
+
+public:
+    std::shared_ptr<RentalInfo> rentalInfo;
+
+    Book(int id, std::string_view title, std::string_view author,
+        std::shared_ptr<RentalInfo> rentalInfo = nullptr)
+        : id{ id }, title{ title }, author{ author }, rentalInfo{ rentalInfo } {
+    }
+
+    int getId() const {
+        return id;
+    }
+    std::string_view getTitle() const {
+        return title;
+    }
+    std::string_view getAuthor() const {
+        return author;
+    }
+    void displaySelf() const override;
+    void renderTo(Renderer& renderer) const override;
+};
+
+// 대여자 번호. BorrowerRegistry에 등록한 순서대로 0부터 빈틈없이 매김
+using BorrowerId = uint32_t;
+
+// 스냅샷이나 로그에서 되살리는 대여 하나. 대여자는 이미 등록된 번호
+struct RestoredRental {
+    int bookId;
+    BorrowerId borrowerId;
+    DateStruct rentDate;
+    DateStruct returnDate;
+};
+
+class RentalInfo : public Idisplayable {
+private:
+    friend class RentalManager;
+    friend class DelayedRentalQueue;
+
+    // 대여자와 전화번호는 StringPool에 있는 문자열을 가리킴
+    std::string_view borrower;
+    std::string_view phone;
+    BorrowerId borrowerId;
+    DateStruct returnDate;
+    // 대여 처리한 날. 반납하면 실제 반납일과 함께 대여 기록에 남음
+    DateStruct rentDate;
+
+    // RentalManager 인덱스 안에서의 위치. 반납할 때 탐색 없이 바로 제거
+    bool isIndexed;
+    size_t rentalsPos;
+    size_t borrowerPos;
+    size_t delayedPos;
+
+public:
+    int bookId;
+    // StringPool에 있는 제목을 가리킴
+    std::string_view bookTitle;
+
+    RentalInfo(int bookId, std::string_view bookTitle, RentalDTO rentalDTO)
+        : borrower{ rentalDTO.borrower }, phone{ rentalDTO.phone },
+        borrowerId{ 0 }, returnDate(rentalDTO.date), rentDate(rentalDTO.date),
+        isIndexed{ false }, rentalsPos{ 0 }, borrowerPos{ 0 }, delayedPos{ 0 }, bookId{ bookId },
+        bookTitle{ bookTitle } {
+    }
+
+    std::string_view getBorrower() const {
+        return borrower;
+    }
+
+    std::string_view getPhone() const {
+        return phone;
+    }
+
+    // RentalManager의 대여자 표에서의 번호
+    BorrowerId getBorrowerId() const {
+        return borrowerId;
+    }
+
+    DateStruct getReturnDate() const {
+        return returnDate;
+    }
+
+    DateStruct getRentDate() const {
+        return rentDate;
+    }
+
+    void displaySelf() const override;
+    void renderTo(Renderer& renderer) const override;
+};
+
+enum class RenderFormat { TEXT, TSV, JSON };
+
+// 책/대여정보 여러 개를 한 버퍼에 모아 flush할 때 한 번에 출력.
+// TEXT는 예전 displaySelf 출력과 바이트 단위로 같음.
+// TSV와 JSON은 한 줄에 한 항목 (JSON은 JSON Lines)
+class Renderer {
+private:
+    // 버퍼가 이보다 커지면 flush 전에 미리 내보내 메모리를 제한
+    static constexpr size_t WRITE_THRESHOLD = 1 << 20;
+
+    RenderFormat format;
+    std::string buffer;
+    std::ostream* out;
+
+    void appendNumber(int value);
+    void appendDate(DateStruct date);
+    void appendField(std::string_view value);
+    void writeIfFull();
+
+public:
+    explicit Renderer(RenderFormat format = RenderFormat::TEXT,
+        std::ostream& out = std::cout)
+        : format{ format }, out{ &out } {
+    }
+
+    void setFormat(RenderFormat newFormat) {
+        format = newFormat;
+    }
+
+    void append(const BookView& book);
+    void append(const RentalInfo& rental);
+    void flush();
+};
+
+// 원소가 N개 이하일 때는 객체 안에 담고, 넘치면 힙으로 옮기는 vector.
+// 한 제목의 책이나 한 사람의 대여처럼 대부분 몇 개뿐인 목록에 씀.
+// 원소가 객체 안에 있는 동안에는 객체를 옮기면 원소의 주소도 바뀜
+template <typename T, size_t N>
+class SmallVector {
+private:
+    T* items;
+    uint32_t count = 0;
+    uint32_t capacity = N;
+    alignas(T) unsigned char inlineStorage[sizeof(T) * N];
+
+    T* getInlineItems() {
+        return reinterpret_cast<T*>(inlineStorage);
+    }
+
+    bool isInline() const {
+        return items == reinterpret_cast<const T*>(inlineStorage);
+    }
+
+    void release() {
+        if (!isInline()) {
+            std::allocator<T>().deallocate(items, capacity);
+        }
+    }
+
+    void grow(size_t minCapacity) {
+        size_t newCapacity =
+            std::max<size_t>(minCapacity, size_t{ capacity } * 2);
+        T* newItems = std::allocator<T>().allocate(newCapacity);
+        std::uninitialized_move(items, items + count, newItems);
+        std::destroy(items, items + count);
+        release();
+        items = newItems;
+        capacity = static_cast<uint32_t>(newCapacity);
+    }
+
+public:
+    SmallVector() : items{ getInlineItems() } {
+    }
+
+    SmallVector(const SmallVector& other) : SmallVector() {
+        assign(other.begin(), other.end());
+    }
+
+    SmallVector(SmallVector&& other) noexcept : SmallVector() {
+        *this = std::move(other);
+    }
+
+    ~SmallVector() {
+        std::destroy(items, items + count);
+        release();
+    }
+
+    SmallVector& operator=(const SmallVector& other) {
+        if (this != &other) {
+            assign(other.begin(), other.end());
+        }
+        return *this;
+    }
+
+    SmallVector& operator=(SmallVector&& other) noexcept {
+        if (this == &other) {
+            return *this;
+        }
+        clear();
+        if (!other.isInline()) {
+            release();
+            items = std::exchange(other.items, other.getInlineItems());
+            capacity = std::exchange(other.capacity, static_cast<uint32_t>(N));
+            count = std::exchange(other.count, 0);
+        }
+        else {
+            std::uninitialized_move(other.begin(), other.end(), items);
+            count = other.count;
+            other.clear();
+        }
+        return *this;
+    }
+
+    template <typename Iterator>
+    void assign(Iterator first, Iterator last) {
+        clear();
+        reserve(static_cast<size_t>(std::distance(first, last)));
+        count = static_cast<uint32_t>(
+            std::uninitialized_copy(first, last, items) - items);
+    }
+
+    void reserve(size_t minCapacity) {
+        if (minCapacity > capacity) {
+            grow(minCapacity);
+        }
+    }
+
+    template <typename... Args>
+    T& emplace_back(Args&&... args) {
+        if (count == capacity) {
+            // args가 이 목록의 원소를 가리킬 수 있으므로 옮기기 전에 만듦
+            T item(std::forward<Args>(args)...);
+            grow(size_t{ count } + 1);
+            return *new (items + count++) T(std::move(item));
+        }
+        return *new (items + count++) T(std::forward<Args>(args)...);
+    }
+
+    void push_back(const T& value) {
+        emplace_back(value);
+    }
+
+    void push_back(T&& value) {
+        emplace_back(std::move(value));
+    }
+
+    void pop_back() {
+        items[--count].~T();
+    }
+
+    void clear() {
+        std::destroy(items, items + count);
+        count = 0;
+    }
+
+    T& operator[](size_t pos) {
+        return items[pos];
+    }
+
+    const T& operator[](size_t pos) const {
+        return items[pos];
+    }
+
+    T& back() {
+        return items[count - 1];
+    }
+
+    const T& back() const {
+        return items[count - 1];
+    }
+
+    T* data() {
+        return items;
+    }
+
+    const T* data() const {
+        return items;
+    }
+
+    T* begin() {
+        return items;
+    }
+
+    T* end() {
+        return items + count;
+    }
+
+    const T* begin() const {
+        return items;
+    }
+
+    const T* end() const {
+        return items + count;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+};
+
+// string, string_view, const char* 어느 것으로도 찾을 수 있는 해시.
+// 조회할 때 임시 string을 만들지 않음
+struct StringHash {
+    using is_transparent = void;
+
+    size_t operator()(std::string_view value) const {
+        return std::hash<std::string_view>{}(value);
+    }
+};
+
+// 문자열 키의 open addressing(선형 탐사) 해시 테이블. 슬롯에는 해시 32비트와
+// 항목 번호만 두어 캐시 라인 하나에 8칸이 들어가고, 해시가 같은 칸에서만
+// 키 문자열을 비교함. rehash는 슬롯만 다시 배치하므로 키를 다시 해시하지 않음.
+// 항목(키와 값)은 고정 크기 청크에 넣은 순서대로 쌓아 rehash에도 값의 주소가
+// 바뀌지 않음. 키는 가리키기만 하므로 키 문자열이 맵보다 오래 살아야 함.
+// 색인은 키를 지우지 않으므로 삭제는 없음
+template <typename T>
+class StringKeyMap {
+private:
+    static constexpr size_t CHUNK_BITS = 8;
+    static constexpr size_t CHUNK_SIZE = size_t{ 1 } << CHUNK_BITS;
+    static constexpr size_t MIN_SLOT_COUNT = 16;
+
+    struct Slot {
+        uint32_t hash;
+        // 항목 번호 + 1. 0이면 빈 칸
+        uint32_t entry;
+    };
+
+    struct Entry {
+        std::string_view key;
+        T value;
+    };
+
+    std::vector<Slot> slots;
+    std::vector<std::unique_ptr<Entry[]>> chunks;
+    size_t count = 0;
+
+    static uint32_t hashKey(std::string_view key) {
+        return static_cast<uint32_t>(StringHash{}(key));
+    }
+
+    Entry& getEntry(size_t index) const {
+        return chunks[index >> CHUNK_BITS][index & (CHUNK_SIZE - 1)];
+    }
+
+    // 부하율이 3/4를 넘지 않게 하는 슬롯 수
+    static size_t getSlotCountFor(size_t entryCount) {
+        return std::max(std::bit_ceil(entryCount + entryCount / 3 + 1),
+            MIN_SLOT_COUNT);
+    }
+
+    void rehash(size_t slotCount) {
+        std::vector<Slot> oldSlots(slotCount);
+        oldSlots.swap(slots);
+        size_t mask = slotCount - 1;
+        for (const Slot& slot : oldSlots) {
+            if (slot.entry == 0) {
+                continue;
+            }
+            size_t pos = slot.hash & mask;
+            while (slots[pos].entry != 0) {
+                pos = (pos + 1) & mask;
+            }
+            slots[pos] = slot;
+        }
+    }
+
+public:
+    const T* find(std::string_view key) const {
+        if (slots.empty()) {
+            return nullptr;
+        }
+        uint32_t hash = hashKey(key);
+        size_t mask = slots.size() - 1;
+        for (size_t pos = hash & mask;; pos = (pos + 1) & mask) {
+            const Slot& slot = slots[pos];
+            if (slot.entry == 0) {
+                return nullptr;
+            }
+            if (slot.hash == hash) {
+                const Entry& entry = getEntry(slot.entry - 1);
+                if (entry.key == key) {
+                    return &entry.value;
+                }
+            }
+        }
+    }
+
+    T* find(std::string_view key) {
+        return const_cast<T*>(std::as_const(*this).find(key));
+    }
+
+    // key가 없으면 기본값으로 넣음. 새로 넣었으면 second가 true
+    std::pair<T*, bool> tryEmplace(std::string_view key) {
+        if (getSlotCountFor(count + 1) > slots.size()) {
+            rehash(getSlotCountFor(count + 1) * 2);
+        }
+        uint32_t hash = hashKey(key);
+        size_t mask = slots.size() - 1;
+        size_t pos = hash & mask;
+        for (; slots[pos].entry != 0; pos = (pos + 1) & mask) {
+            if (slots[pos].hash == hash) {
+                Entry& entry = getEntry(slots[pos].entry - 1);
+                if (entry.key == key) {
+                    return { &entry.value, false };
+                }
+            }
+        }
+
+        if (count % CHUNK_SIZE == 0) {
+            chunks.push_back(std::make_unique<Entry[]>(CHUNK_SIZE));
+        }
+        Entry& entry = getEntry(count);
+        entry.key = key;
+        slots[pos] = { hash, static_cast<uint32_t>(++count) };
+        return { &entry.value, true };
+    }
+
+    T& operator[](std::string_view key) {
+        return *tryEmplace(key).first;
+    }
+
+    void reserve(size_t entryCount) {
+        if (getSlotCountFor(entryCount) > slots.size()) {
+            rehash(getSlotCountFor(entryCount));
+        }
+        chunks.reserve((entryCount + CHUNK_SIZE - 1) / CHUNK_SIZE);
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    size_t getBucketCount() const {
+        return slots.size();
+    }
+
+    double getLoadFactor() const {
+        return slots.empty() ? 0.0
+            : static_cast<double>(count) / static_cast<double>(slots.size());
+    }
+
+    // 넣은 순서대로 순회. visitor는 (string_view 키, const T& 값)을 받음
+    template <typename Visitor>
+    void forEach(Visitor&& visitor) const {
+        for (size_t i = 0; i < count; i++) {
+            const Entry& entry = getEntry(i);
+            visitor(entry.key, entry.value);
+        }
+    }
+};
+
+// 대부분 1~4권인 같은 제목/작가의 책번호 목록
+using BookIdList = SmallVector<int, 4>;
+// 한 대여자의 대여정보 목록
+using BorrowerRentalList = SmallVector<std::shared_ptr<RentalInfo>, 4>;
+
+// 16바이트 단위 크기별로 블록을 나눠 주는 풀. 블록은 청크 단위로 한 번에
+// 잡아 두고, 돌려받은 블록은 크기별 free list에 넣어 같은 크기 요청에 다시
+// 씀. 청크는 풀이 없어질 때까지 돌려주지 않음. 여러 스레드에서 같이 써도 됨
+class SizeClassPool {
+private:
+    static constexpr size_t GRANULARITY = 16;
+    static constexpr size_t CLASS_COUNT = 16;
+    static constexpr size_t BLOCKS_PER_CHUNK = 1024;
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    struct alignas(64) SizeClass {
+        std::mutex classMutex;
+        FreeBlock* freeList = nullptr;
+        std::vector<std::unique_ptr<char[]>> chunks;
+    };
+
+    std::array<SizeClass, CLASS_COUNT> classes;
+
+    static size_t toClass(size_t bytes) {
+        return (std::max<size_t>(bytes, 1) - 1) / GRANULARITY;
+    }
+
+public:
+    static constexpr size_t MAX_BLOCK_SIZE = GRANULARITY * CLASS_COUNT;
+
+    void* allocate(size_t bytes) {
+        if (bytes > MAX_BLOCK_SIZE) {
+            return ::operator new(bytes);
+        }
+        size_t classIndex = toClass(bytes);
+        SizeClass& sizeClass = classes[classIndex];
+        std::lock_guard lock(sizeClass.classMutex);
+        if (!sizeClass.freeList) {
+            // 청크 하나를 잘라 free list를 채움
+            size_t blockSize = (classIndex + 1) * GRANULARITY;
+            auto chunk = std::make_unique<char[]>(blockSize * BLOCKS_PER_CHUNK);
+            for (size_t i = BLOCKS_PER_CHUNK; i-- > 0;) {
+                auto block = reinterpret_cast<FreeBlock*>(chunk.get() + i * blockSize);
+                block->next = sizeClass.freeList;
+                sizeClass.freeList = block;
+            }
+            sizeClass.chunks.push_back(std::move(chunk));
+        }
+        FreeBlock* block = sizeClass.freeList;
+        sizeClass.freeList = block->next;
+        return block;
+    }
+
+    void deallocate(void* block, size_t bytes) {
+        if (bytes > MAX_BLOCK_SIZE) {
+            ::operator delete(block);
+            return;
+        }
+        SizeClass& sizeClass = classes[toClass(bytes)];
+        std::lock_guard lock(sizeClass.classMutex);
+        auto freeBlock = static_cast<FreeBlock*>(block);
+        freeBlock->next = sizeClass.freeList;
+        sizeClass.freeList = freeBlock;
+    }
+};
+
+// SizeClassPool에서 할당하는 allocator. allocate_shared에 넘기면 객체와
+// 참조 카운트 블록을 한 블록으로 풀에서 받음. 풀은 마지막 객체가 없어질
+// 때까지 살아 있음
+template <typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+
+    std::shared_ptr<SizeClassPool> pool;
+
+    explicit PoolAllocator(std::shared_ptr<SizeClassPool> pool)
+        : pool{ std::move(pool) } {
+    }
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& other)
+        : pool{ other.pool } {
+    }
+
+    T* allocate(size_t count) {
+        static_assert(alignof(T) <= 16, "풀 블록은 16바이트 정렬");
+        return static_cast<T*>(pool->allocate(count * sizeof(T)));
+    }
+
+    void deallocate(T* block, size_t count) {
+        pool->deallocate(block, count * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>& other) const {
+        return pool == other.pool;
+    }
+};
+
+// 읽기 잠금을 스레드마다 정해진 조각에만 걸어 여러 코어에서 읽기끼리
+// 캐시 라인을 다투지 않게 함. 쓰기 잠금은 모든 조각을 잠금.
+// shared_lock, unique_lock과 함께 쓸 수 있음
+class ShardedSharedMutex {
+private:
+    static constexpr size_t SHARD_COUNT = 16;
+
+    struct alignas(64) Shard {
+        std::shared_mutex mutex;
+    };
+    std::array<Shard, SHARD_COUNT> shards;
+
+    static size_t currentShard() {
+        thread_local size_t shard =
+            std::hash<std::thread::id>{}(std::this_thread::get_id()) %
+            SHARD_COUNT;
+        return shard;
+    }
+
+public:
+    void lock() {
+        for (auto& shard : shards) {
+            shard.mutex.lock();
+        }
+    }
+
+    void unlock() {
+        for (auto& shard : shards) {
+            shard.mutex.unlock();
+        }
+    }
+
+    void lock_shared() {
+        shards[currentShard()].mutex.lock_shared();
+    }
+
+    void unlock_shared() {
+        shards[currentShard()].mutex.unlock_shared();
+    }
+};
+
+// 엔진 작업 종류. 지연 시간과 횟수를 작업별로 따로 셈
+enum class EngineOperation {
+    ADD_BOOK,
+    RENT_BY_ID,
+    RENT_BY_TITLE,
+    RETURN_BOOK,
+    FIND_BY_ID,
+    FIND_BY_TITLE,
+    FIND_BY_AUTHOR,
+    SEARCH,
+    COUNT_AVAILABLE,
+    FIND_BY_BORROWER,
+    FIND_DELAYED,
+    COUNT_DELAYED,
+    RENT_BATCH,
+    RETURN_BATCH,
+    LIST_BOOKS,
+    LIST_RENTALS,
+    QUERY
+};
+
+inline constexpr size_t ENGINE_OPERATION_COUNT =
+    static_cast<size_t>(EngineOperation::QUERY) + 1;
+
+// 내보내기에 쓰는 이름 (rent_by_id 등)
+const char* getEngineOperationName(EngineOperation operation);
+
+// HDR 방식의 로그-선형 지연 시간 히스토그램. 나노초 단위로, 16ns까지는 1ns
+// 칸이고 그 위는 2의 거듭제곱 구간마다 16칸이라 상대 오차가 1/16 이하.
+// 2^40ns(약 18분)를 넘는 값은 마지막 칸에 넣음
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 4;
+    static constexpr size_t SUB_BUCKET_COUNT = size_t{ 1 } << SUB_BUCKET_BITS;
+    static constexpr int MAX_EXPONENT = 40;
+    static constexpr size_t BUCKET_COUNT =
+        (MAX_EXPONENT - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+    static size_t toBucket(uint64_t nanoseconds) {
+        if (nanoseconds < SUB_BUCKET_COUNT) {
+            return static_cast<size_t>(nanoseconds);
+        }
+        int exponent = static_cast<int>(std::bit_width(nanoseconds)) - 1;
+        if (exponent >= MAX_EXPONENT) {
+            return BUCKET_COUNT - 1;
+        }
+        int shift = exponent - SUB_BUCKET_BITS;
+        return (shift + 1) * SUB_BUCKET_COUNT
+            + static_cast<size_t>((nanoseconds >> shift) - SUB_BUCKET_COUNT);
+    }
+
+    // 칸에 들어가는 값 범위의 가운데
+    static double getBucketMidpoint(size_t bucket) {
+        if (bucket < SUB_BUCKET_COUNT) {
+            return static_cast<double>(bucket);
+        }
+        int shift = static_cast<int>(bucket / SUB_BUCKET_COUNT) - 1;
+        uint64_t lower = (SUB_BUCKET_COUNT + bucket % SUB_BUCKET_COUNT) << shift;
+        return lower + ((uint64_t{ 1 } << shift) - 1) / 2.0;
+    }
+
+    std::array<uint64_t, BUCKET_COUNT> counts{};
+    uint64_t count = 0;
+    uint64_t failures = 0;
+    uint64_t totalNanoseconds = 0;
+    uint64_t maxNanoseconds = 0;
+
+    // percentile은 0~100, 결과는 나노초
+    double getPercentile(double percentile) const;
+};
+
+// 게이지 하나. name은 라벨까지 붙인 이름 (book_index_entries{index="title"})
+struct MetricGauge {
+    std::string name;
+    double value;
+};
+
+// 엔진 작업의 횟수, 실패 수, 지연 시간 히스토그램을 프로세스 전체에서 모음.
+// 스레드마다 자기 칸에만 기록해 기록하는 쪽은 잠금도 캐시 라인 다툼도 없고,
+// 읽는 쪽이 모든 스레드의 칸을 더함. 끝난 스레드의 값은 합계에 넘겨 둠
+class EngineMetrics {
+private:
+    struct OperationCounters {
+        std::array<std::atomic<uint64_t>, LatencyHistogram::BUCKET_COUNT>
+            buckets{};
+        std::atomic<uint64_t> failures{ 0 };
+        std::atomic<uint64_t> totalNanoseconds{ 0 };
+        std::atomic<uint64_t> maxNanoseconds{ 0 };
+    };
+
+    struct ThreadCounters {
+        std::array<OperationCounters, ENGINE_OPERATION_COUNT> operations;
+    };
+
+    struct Registry;
+    class ThreadRegistration;
+
+    static Registry& getRegistry();
+    static ThreadCounters& registerThread();
+
+    // 쓰는 스레드가 하나뿐이라 읽고-더하고-쓰기를 원자적으로 할 필요가 없음
+    static void addRelaxed(std::atomic<uint64_t>& counter, uint64_t value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value,
+            std::memory_order_relaxed);
+    }
+
+    static inline thread_local ThreadCounters* localCounters = nullptr;
+
+public:
+    static void record(EngineOperation operation,
+        std::chrono::nanoseconds elapsed, bool isFailed) {
+        ThreadCounters* counters = localCounters;
+        if (!counters) {
+            counters = &registerThread();
+        }
+        auto& target = counters->operations[static_cast<size_t>(operation)];
+        auto nanoseconds =
+            static_cast<uint64_t>(std::max<int64_t>(elapsed.count(), 0));
+        addRelaxed(target.buckets[LatencyHistogram::toBucket(nanoseconds)], 1);
+        addRelaxed(target.totalNanoseconds, nanoseconds);
+        if (isFailed) {
+            addRelaxed(target.failures, 1);
+        }
+        if (nanoseconds >
+            target.maxNanoseconds.load(std::memory_order_relaxed)) {
+            target.maxNanoseconds.store(nanoseconds, std::memory_order_relaxed);
+        }
+    }
+
+    // 지금까지 모든 스레드가 기록한 값을 더함
+    static LatencyHistogram collect(EngineOperation operation);
+
+    // Prometheus 텍스트 형식. 작업별 횟수/실패 수와 지연 시간 요약
+    // (p50/p90/p99/p99.9, 합계, 최대), 그 뒤에 gauges
+    static std::string exportText(const std::vector<MetricGauge>& gauges);
+};
+
+// 만들 때부터 없어질 때까지의 시간을 EngineMetrics에 기록
+class OperationTimer {
+private:
+    EngineOperation operation;
+    std::chrono::steady_clock::time_point start;
+    bool isFailed = false;
+
+public:
+    explicit OperationTimer(EngineOperation operation)
+        : operation{ operation }, start{ std::chrono::steady_clock::now() } {
+    }
+
+    ~OperationTimer() {
+        EngineMetrics::record(operation,
+            std::chrono::steady_clock::now() - start, isFailed);
+    }
+
+    OperationTimer(const OperationTimer&) = delete;
+    OperationTimer& operator=(const OperationTimer&) = delete;
+
+    void markFailed() {
+        isFailed = true;
+    }
+};
+
+// 파일 전체를 읽기 전용으로 메모리에 매핑
+class MappedFile {
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool isOpen() const {
+        return data != nullptr;
+    }
+
+    const char* getData() const {
+        return data;
+    }
+
+    size_t getSize() const {
+        return size;
+    }
+};
+
+static_assert(std::endian::native == std::endian::little,
+    "스냅샷과 변경 로그는 리틀 엔디언 바이트 순서로 기록함");
+
+// 책, 문자열, 대여정보와 제목/작가/대여자/반납일 색인을 담은 스냅샷 파일.
+// 모든 구역이 8바이트 단위로 정렬된 고정 크기 배열이라 매핑한 메모리를
+// 그대로 조회함. 열 때 체크섬과 모든 번호의 범위, 정렬 순서를 한 번
+// 확인하므로 이후 조회는 검사 없이 씀
+class CatalogSnapshot {
+public:
+    // 2부터 헤더에 checksum이 있고, 3부터 대여정보에 대여일이 있음
+    static constexpr uint32_t VERSION = 3;
+
+    struct RentalRecord {
+        int32_t bookId;
+        uint32_t borrowerId;
+        uint32_t phoneId;
+        int32_t rentDay;
+        int32_t returnDay;
+    };
+
+    // 정렬된 키 하나와 그 키에 속한 번호들이 있는 범위
+    struct KeyGroup {
+        uint32_t stringId;
+        uint32_t first;
+        uint32_t count;
+    };
+
+private:
+    enum Section : uint32_t {
+        STRING_OFFSETS,     // u64[문자열 수 + 1]
+        STRING_BYTES,
+        SORTED_STRINGS,     // 문자열 순서로 정렬한 문자열 번호
+        BOOK_TITLES,        // 책번호 - 1 위치에 제목의 문자열 번호
+        BOOK_AUTHORS,
+        RENTALS,            // 책번호 순 RentalRecord
+        TITLE_KEYS,         // 제목 순 KeyGroup
+        TITLE_BOOKS,        // 책번호
+        AUTHOR_KEYS,
+        AUTHOR_BOOKS,
+        BORROWER_KEYS,
+        BORROWER_RENTALS,   // RENTALS 안의 위치
+        DUE_RENTALS,        // 반납일, 책번호 순으로 정렬한 RENTALS 안의 위치
+        SECTION_COUNT
+    };
+
+    struct SectionRef {
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t sectionCount;
+        uint64_t walOffset;
+        // checksum을 0으로 둔 헤더와 그 뒤 파일 끝까지의 crc32
+        uint32_t checksum;
+        uint32_t reserved;
+        SectionRef sections[SECTION_COUNT];
+    };
+
+    static constexpr char MAGIC[8] = { 'B', 'O', 'O', 'K', 'S', 'N', 'A', 'P' };
+
+    MappedFile file;
+    const Header* header = nullptr;
+
+    explicit CatalogSnapshot(const std::string& path)
+        : file(path) {
+    }
+
+    // 헤더와 체크섬, 구간 범위를 본 뒤 문자열 번호, 책번호, 대여 위치,
+    // 키 묶음의 범위와 정렬 순서가 모두 맞는지 확인
+    bool validate();
+    bool validateReferences() const;
+    static uint32_t computeChecksum(const Header& header,
+        std::string_view payload);
+
+    template <typename T>
+    std::span<const T> getSection(Section section) const {
+        const SectionRef& ref = header->sections[section];
+        return { reinterpret_cast<const T*>(file.getData() + ref.offset),
+            static_cast<size_t>(ref.size / sizeof(T)) };
+    }
+
+    std::span<const uint32_t> getGroupItems(Section items,
+        const KeyGroup* group) const {
+        if (!group) {
+            return {};
+        }
+        return getSection<uint32_t>(items).subspan(group->first, group->count);
+    }
+
+    const KeyGroup* findGroup(Section keys, std::string_view key) const;
+
+public:
+    // 없거나 형식이 맞지 않는 파일이면 nullptr
+    static std::shared_ptr<const CatalogSnapshot> open(const std::string& path);
+    // 임시 파일에 쓴 뒤 이름을 바꿔 교체. 변경이 없는 동안 호출해야 함.
+    // walOffset은 스냅샷에 이미 반영된 변경 로그의 길이
+    static bool write(const std::string& path, const BookManager& bookManager,
+        const RentalManager& rentalManager, uint64_t walOffset);
+
+    uint64_t getWalOffset() const {
+        return header->walOffset;
+    }
+
+    size_t getStringCount() const {
+        return getSection<uint64_t>(STRING_OFFSETS).size() - 1;
+    }
+
+    std::string_view getString(uint32_t id) const {
+        auto offsets = getSection<uint64_t>(STRING_OFFSETS);
+        return { file.getData() + header->sections[STRING_BYTES].offset
+            + offsets[id], static_cast<size_t>(offsets[id + 1] - offsets[id]) };
+    }
+
+    std::optional<uint32_t> findString(std::string_view value) const;
+
+    std::span<const uint32_t> getBookTitles() const {
+        return getSection<uint32_t>(BOOK_TITLES);
+    }
+
+    std::span<const uint32_t> getBookAuthors() const {
+        return getSection<uint32_t>(BOOK_AUTHORS);
+    }
+
+    std::span<const RentalRecord> getRentals() const {
+        return getSection<RentalRecord>(RENTALS);
+    }
+
+    // getRentals() 안의 위치를 반납일, 책번호 순으로
+    std::span<const uint32_t> getRentalsByDueDate() const {
+        return getSection<uint32_t>(DUE_RENTALS);
+    }
+
+    std::span<const KeyGroup> getTitleKeys() const {
+        return getSection<KeyGroup>(TITLE_KEYS);
+    }
+
+    std::span<const KeyGroup> getAuthorKeys() const {
+        return getSection<KeyGroup>(AUTHOR_KEYS);
+    }
+
+    std::span<const uint32_t> getTitleBooks(const KeyGroup& group) const {
+        return getGroupItems(TITLE_BOOKS, &group);
+    }
+
+    std::span<const uint32_t> getAuthorBooks(const KeyGroup& group) const {
+        return getGroupItems(AUTHOR_BOOKS, &group);
+    }
+
+    // 매핑한 메모리를 바로 보는 조회. 결과는 책번호나 getRentals() 안의 위치
+    std::span<const uint32_t> findBooksByTitle(std::string_view title) const {
+        return getGroupItems(TITLE_BOOKS, findGroup(TITLE_KEYS, title));
+    }
+
+    std::span<const uint32_t> findBooksByAuthor(std::string_view author) const {
+        return getGroupItems(AUTHOR_BOOKS, findGroup(AUTHOR_KEYS, author));
+    }
+
+    std::span<const uint32_t> findRentalsByBorrower(
+        std::string_view borrower) const {
+        return getGroupItems(BORROWER_RENTALS,
+            findGroup(BORROWER_KEYS, borrower));
+    }
+};
+
+// 같은 문자열을 한 번만 저장하고 번호로 참조하게 하는 풀.
+// BookManager와 RentalManager가 하나를 같이 쓸 수 있음.
+// 문자열은 고정 크기 청크에 저장해 한 번 넣은 문자열의 주소가 바뀌지 않고,
+// get()은 잠금 없이 여러 스레드에서 부를 수 있음
+class StringPool {
+private:
+    static constexpr size_t CHUNK_SIZE = 1 << 14;
+    static constexpr size_t MAX_CHUNKS = 1 << 12;
+
+    // 스냅샷의 문자열은 복사하지 않고 그 번호를 그대로 씀.
+    // 새 문자열은 baseCount부터 번호를 매김
+    std::shared_ptr<const CatalogSnapshot> base;
+    uint32_t baseCount;
+    std::unique_ptr<std::unique_ptr<std::string[]>[]> chunks;
+    size_t count;
+    StringKeyMap<uint32_t> ids;
+    mutable std::shared_mutex mutex;
+
+public:
+    // 스냅샷 밖에서 새로 넣을 수 있는 문자열 수
+    static constexpr size_t CAPACITY = CHUNK_SIZE * MAX_CHUNKS;
+
+    explicit StringPool(std::shared_ptr<const CatalogSnapshot> base = nullptr)
+        : base{ std::move(base) },
+        baseCount{ this->base
+            ? static_cast<uint32_t>(this->base->getStringCount()) : 0 },
+        chunks{
+            std::make_unique<std::unique_ptr<std::string[]>[]>(MAX_CHUNKS) },
+        count{ 0 } {
+    }
+
+    // 같은 문자열의 번호. 없으면 새로 넣고, 풀이 꽉 찼으면 nullopt
+    std::optional<uint32_t> tryIntern(std::string_view value) {
+        if (base) {
+            if (auto baseId = base->findString(value)) {
+                return *baseId;
+            }
+        }
+        {
+            std::shared_lock lock(mutex);
+            if (const uint32_t* id = ids.find(value)) {
+                return *id;
+            }
+        }
+
+        std::unique_lock lock(mutex);
+        if (const uint32_t* id = ids.find(value)) {
+            return *id;
+        }
+        if (count == CAPACITY) {
+            return std::nullopt;
+        }
+        if (count % CHUNK_SIZE == 0) {
+            chunks[count / CHUNK_SIZE] =
+                std::make_unique<std::string[]>(CHUNK_SIZE);
+        }
+        auto newId = baseCount + static_cast<uint32_t>(count);
+        std::string& stored = chunks[count / CHUNK_SIZE][count % CHUNK_SIZE];
+        stored = value;
+        ids[stored] = newId;
+        count++;
+        return newId;
+    }
+
+    // 책 제목/작가처럼 실패를 돌려줄 곳이 없을 때 씀. 꽉 찬 풀에 넣으려 하면
+    // 범위 밖에 쓰지 않고 프로그램을 끝냄
+    uint32_t intern(std::string_view value) {
+        std::optional<uint32_t> id = tryIntern(value);
+        if (!id) {
+            std::abort();
+        }
+        return *id;
+    }
+
+    std::string_view get(uint32_t id) const {
+        if (id < baseCount) {
+            return base->getString(id);
+        }
+        id -= baseCount;
+        return chunks[id / CHUNK_SIZE][id % CHUNK_SIZE];
+    }
+
+    const CatalogSnapshot* getBase() const {
+        return base.get();
+    }
+
+    size_t size() const {
+        std::shared_lock lock(mutex);
+        return baseCount + count;
+    }
+};
+
+// 책들을 제목이나 작가로 묶은 표. keyOfBook[책번호 - 1]이 그 책의 묶음 번호이고
+// names[묶음 번호]가 묶음의 제목/작가
+struct BookGrouping {
+    std::vector<uint32_t> keyOfBook;
+    std::vector<std::string_view> names;
+};
+
+// 책번호를 위치로 쓰는 열(column) 단위 도서 저장소. i번째 행이 책번호 i + 1.
+// 책 한 권은 열마다 한 칸씩만 차지하고 제목과 작가는 StringPool 번호로 저장.
+// 행 추가는 BookManager가 쓰기 잠금을 잡고 함. 대여 칸은 책번호로 나눈
+// slotLocks로 보호하고, 반납일 열은 atomic_ref로 잠금 없이 읽음
+class CatalogStore {
+private:
+    static constexpr int32_t NOT_RENTED = INT32_MIN;
+    static constexpr size_t SLOT_LOCK_COUNT = 64;
+
+    std::shared_ptr<StringPool> strings;
+    // materialize로 만드는 Book은 여기서 할당
+    std::shared_ptr<SizeClassPool> bookPool;
+    std::vector<int> ids;
+    std::vector<uint32_t> titleIds;
+    std::vector<uint32_t> authorIds;
+    // 대여중이면 반납일의 dayNumber, 아니면 NOT_RENTED
+    mutable std::vector<int32_t> returnDays;
+    // 책번호 위치의 비트가 대여중인지. 비트 0은 쓰지 않음.
+    // 조건 검색에서 대여 상태 조건을 워드 단위로 읽음
+    mutable std::vector<uint64_t> rentedWords;
+    std::vector<std::shared_ptr<RentalInfo>> rentalSlots;
+    mutable std::array<std::mutex, SLOT_LOCK_COUNT> slotLocks;
+
+    size_t toRow(int id) const {
+        return static_cast<size_t>(id - 1);
+    }
+
+    std::mutex& slotLock(int id) const {
+        return slotLocks[static_cast<size_t>(id) % SLOT_LOCK_COUNT];
+    }
+
+    int32_t loadReturnDay(size_t row) const {
+        return std::atomic_ref<int32_t>(returnDays[row])
+            .load(std::memory_order_acquire);
+    }
+
+    void storeReturnDay(size_t row, int32_t dayNumber) {
+        std::atomic_ref<int32_t>(returnDays[row])
+            .store(dayNumber, std::memory_order_release);
+        size_t bit = row + 1;
+        std::atomic_ref<uint64_t> word(rentedWords[bit / 64]);
+        if (dayNumber == NOT_RENTED) {
+            word.fetch_and(~(uint64_t{ 1 } << bit % 64),
+                std::memory_order_relaxed);
+        }
+        else {
+            word.fetch_or(uint64_t{ 1 } << bit % 64, std::memory_order_relaxed);
+        }
+    }
+
+    static size_t getWordCount(size_t bookCount) {
+        return bookCount / 64 + 1;
+    }
+
+public:
+    explicit CatalogStore(std::shared_ptr<StringPool> strings)
+        : strings{ std::move(strings) },
+        bookPool{ std::make_shared<SizeClassPool>() } {
+    }
+
+    void reserve(size_t count) {
+        ids.reserve(count);
+        titleIds.reserve(count);
+        authorIds.reserve(count);
+        returnDays.reserve(count);
+        rentedWords.reserve(getWordCount(count));
+        rentalSlots.reserve(count);
+    }
+
+    // 비어 있는 저장소에 스냅샷의 책들을 한 번에 채움. 풀이 같은 스냅샷을
+    // 바탕으로 해야 문자열 번호를 그대로 쓸 수 있음
+    bool load(const CatalogSnapshot& snapshot) {
+        if (!ids.empty() || strings->getBase() != &snapshot) {
+            return false;
+        }
+        auto titles = snapshot.getBookTitles();
+        auto authors = snapshot.getBookAuthors();
+        ids.resize(titles.size());
+        std::iota(ids.begin(), ids.end(), 1);
+        titleIds.assign(titles.begin(), titles.end());
+        authorIds.assign(authors.begin(), authors.end());
+        returnDays.assign(titles.size(), NOT_RENTED);
+        rentedWords.assign(getWordCount(titles.size()), 0);
+        rentalSlots.resize(titles.size());
+        return true;
+    }
+
+    int append(std::string_view title, std::string_view author) {
+        int newId = static_cast<int>(ids.size()) + 1;
+        ids.push_back(newId);
+        titleIds.push_back(strings->intern(title));
+        authorIds.push_back(strings->intern(author));
+        returnDays.push_back(NOT_RENTED);
+        rentedWords.resize(getWordCount(ids.size()));
+        rentalSlots.emplace_back();
+        return newId;
+    }
+
+    size_t size() const {
+        return ids.size();
+    }
+
+    bool contains(int id) const {
+        return id >= 1 && static_cast<size_t>(id) <= ids.size();
+    }
+
+    int getIdAt(size_t row) const {
+        return ids[row];
+    }
+
+    std::string_view getTitle(int id) const {
+        return strings->get(titleIds[toRow(id)]);
+    }
+
+    std::string_view getAuthor(int id) const {
+        return strings->get(authorIds[toRow(id)]);
+    }
+
+    bool isRented(int id) const {
+        return loadReturnDay(toRow(id)) != NOT_RENTED;
+    }
+
+    // 책번호 64 * index ~ 64 * index + 63의 대여중 비트
+    uint64_t loadRentedWord(size_t index) const {
+        return std::atomic_ref<uint64_t>(rentedWords[index])
+            .load(std::memory_order_relaxed);
+    }
+
+    bool isDueBy(int id, int32_t dayNumber) const {
+        int32_t returnDay = loadReturnDay(toRow(id));
+        return returnDay != NOT_RENTED && returnDay <= dayNumber;
+    }
+
+    std::optional<DateStruct> getReturnDate(int id) const {
+        int32_t returnDay = loadReturnDay(toRow(id));
+        if (returnDay == NOT_RENTED) {
+            return std::nullopt;
+        }
+        return DateStruct::fromDayNumber(returnDay);
+    }
+
+    std::shared_ptr<RentalInfo> getRentalInfo(int id) const {
+        std::lock_guard lock(slotLock(id));
+        return rentalSlots[toRow(id)];
+    }
+
+    // 비어 있는 대여 칸을 원자적으로 차지. 이미 대여중이면 false
+    bool claim(int id, std::shared_ptr<RentalInfo> rentalInfo) {
+        size_t row = toRow(id);
+        std::lock_guard lock(slotLock(id));
+        if (rentalSlots[row]) {
+            return false;
+        }
+        storeReturnDay(row, rentalInfo->getReturnDate().dayNumber);
+        rentalSlots[row] = std::move(rentalInfo);
+        return true;
+    }
+
+    // 대여 칸을 비우고 들어 있던 대여정보를 돌려줌
+    std::shared_ptr<RentalInfo> release(int id) {
+        size_t row = toRow(id);
+        std::lock_guard lock(slotLock(id));
+        storeReturnDay(row, NOT_RENTED);
+        return std::move(rentalSlots[row]);
+    }
+
+    BookView getView(int id) const {
+        size_t row = toRow(id);
+        return { ids[row], strings->get(titleIds[row]),
+            strings->get(authorIds[row]), getReturnDate(id) };
+    }
+
+    std::shared_ptr<Book> materialize(int id) const {
+        size_t row = toRow(id);
+        return std::allocate_shared<Book>(PoolAllocator<Book>(bookPool),
+            ids[row], strings->get(titleIds[row]),
+            strings->get(authorIds[row]), getRentalInfo(id));
+    }
+
+    // 풀 번호를 나온 순서대로 0부터 다시 매겨 묶음 번호로 씀
+    BookGrouping groupByTitle() const {
+        return groupByString(titleIds);
+    }
+
+    BookGrouping groupByAuthor() const {
+        return groupByString(authorIds);
+    }
+
+private:
+    BookGrouping groupByString(const std::vector<uint32_t>& stringIds) const {
+        constexpr uint32_t NO_KEY = UINT32_MAX;
+        BookGrouping grouping;
+        grouping.keyOfBook.resize(stringIds.size());
+        std::vector<uint32_t> keyOfString(strings->size(), NO_KEY);
+        for (size_t row = 0; row < stringIds.size(); row++) {
+            uint32_t& key = keyOfString[stringIds[row]];
+            if (key == NO_KEY) {
+                key = static_cast<uint32_t>(grouping.names.size());
+                grouping.names.push_back(strings->get(stringIds[row]));
+            }
+            grouping.keyOfBook[row] = key;
+        }
+        return grouping;
+    }
+};
+
+struct ImportReport {
+    size_t rows;
+    size_t skipped;
+    double seconds;
+    bool isFileOpened;
+
+    double getRowsPerSecond() const {
+        return seconds > 0 ? rows / seconds : 0;
+    }
+};
+
+// 제목 하나에 속한 책들과 그중 대여 가능한 책들.
+// freeIds는 대여/반납 때 O(1)로 갱신하고 availabilityMutex로 보호
+struct TitleEntry {
+    BookIdList ids;
+    BookIdList freeIds;
+    mutable std::mutex availabilityMutex;
+};
+
+enum class SearchField { TITLE, AUTHOR };
+enum class SearchMode { PREFIX, SUBSTRING };
+
+struct SearchHit {
+    SearchField field;
+    std::string_view text;
+};
+
+struct SearchPage {
+    std::vector<SearchHit> hits;
+    // 페이지와 상관없이 조건에 맞는 전체 건수
+    size_t totalCount;
+};
+
+enum class BookOrder : uint8_t { BY_ID, BY_TITLE };
+
+// 전체 책 목록을 이어 읽기 위한 위치. 마지막으로 받은 책의 번호와,
+// 제목 순이면 그 제목. 기본값은 처음부터
+struct BookCursor {
+    BookOrder order = BookOrder::BY_ID;
+    int bookId = 0;
+    std::string title;
+
+    // 공백 없는 문자열로 바꿔 클라이언트에 넘기고 그대로 돌려받아 이어 읽음.
+    // 제목은 16진수로 담음
+    std::string toToken() const;
+    // 형식이 틀리면 nullopt
+    static std::optional<BookCursor> fromToken(std::string_view token);
+};
+
+struct BookPage {
+    // 제목/작가는 StringPool의 문자열을 가리킴
+    std::vector<BookView> books;
+    // 다음 페이지를 읽을 때 넘길 커서
+    BookCursor next;
+    bool hasMore;
+};
+
+// 책번호 집합을 담는 로어링 방식의 압축 비트맵. 책번호의 위 16비트마다
+// 컨테이너를 하나 두고, 원소가 ARRAY_LIMIT개 이하면 아래 16비트의 정렬된
+// 배열, 넘으면 65536비트 비트셋으로 담음. 연산 결과도 원소 수에 맞춰 둘 중
+// 작은 쪽으로 바꾸므로 컨테이너 하나는 많아야 8KB
+class BookBitmap {
+public:
+    static constexpr size_t ARRAY_LIMIT = 4096;
+    static constexpr size_t WORD_COUNT = 1024;
+
+    struct Container {
+        uint16_t key = 0;
+        uint32_t cardinality = 0;
+        // 배열이면 values, 비트셋이면 words(WORD_COUNT개)를 씀
+        std::vector<uint16_t> values;
+        std::vector<uint64_t> words;
+
+        bool isBitset() const {
+            return !words.empty();
+        }
+
+        bool contains(uint16_t low) const;
+
+        // words를 채운 뒤 부름. 원소 수를 세고 적으면 배열로 바꿈
+        void finishBitset();
+        // 배열이 ARRAY_LIMIT개를 넘으면 비트셋으로 바꿈
+        void finishArray();
+
+        // visitor는 책번호(uint32_t)를 오름차순으로 받음
+        template <typename Visitor>
+        void forEach(Visitor&& visitor) const {
+            uint32_t high = static_cast<uint32_t>(key) << 16;
+            if (!isBitset()) {
+                for (uint16_t low : values) {
+                    visitor(high | low);
+                }
+                return;
+            }
+            for (size_t i = 0; i < WORD_COUNT; i++) {
+                for (uint64_t word = words[i]; word != 0; word &= word - 1) {
+                    visitor(high | static_cast<uint32_t>(i * 64 +
+                        static_cast<size_t>(std::countr_zero(word))));
+                }
+            }
+        }
+    };
+
+    static Container intersect(const Container& left, const Container& right);
+    static Container unite(const Container& left, const Container& right);
+    // left에서 right를 뺌
+    static Container subtract(const Container& left, const Container& right);
+
+private:
+    // key 오름차순
+    std::vector<Container> containers;
+
+public:
+    // 오름차순으로 정렬된 책번호로 만듦
+    static BookBitmap fromSortedIds(std::span<const int> ids);
+    // 정렬되지 않은 책번호로 만듦. 책번호는 1 ~ maxId. 많으면 정렬하지 않고
+    // 비트를 바로 세움
+    static BookBitmap fromIds(std::span<const int> ids, size_t maxId);
+
+    // 없으면 nullptr
+    const Container* find(uint16_t key) const;
+    size_t getCardinality() const;
+
+    size_t getContainerCount() const {
+        return containers.size();
+    }
+};
+
+// 책 조건 검색의 조건. 제목/작가/대여 상태 조건을 allOf/anyOf/negate로 묶음
+struct BookQuery {
+    enum class Kind : uint8_t {
+        TITLE,
+        AUTHOR,
+        TITLE_PREFIX,
+        AUTHOR_PREFIX,
+        AVAILABLE,
+        RENTED,
+        // 반납일이 day(포함)까지인 대여중인 책
+        DUE_BY,
+        ALL_OF,
+        ANY_OF,
+        NOT
+    };
+
+    Kind kind;
+    std::string text;
+    int32_t day = 0;
+    std::vector<BookQuery> children;
+
+    static BookQuery title(std::string_view title) {
+        return { Kind::TITLE, std::string(title), 0, {} };
+    }
+    static BookQuery author(std::string_view author) {
+        return { Kind::AUTHOR, std::string(author), 0, {} };
+    }
+    static BookQuery titlePrefix(std::string_view prefix) {
+        return { Kind::TITLE_PREFIX, std::string(prefix), 0, {} };
+    }
+    static BookQuery authorPrefix(std::string_view prefix) {
+        return { Kind::AUTHOR_PREFIX, std::string(prefix), 0, {} };
+    }
+    static BookQuery available() {
+        return { Kind::AVAILABLE, {}, 0, {} };
+    }
+    static BookQuery rented() {
+        return { Kind::RENTED, {}, 0, {} };
+    }
+    static BookQuery dueBy(DateStruct returnDate) {
+        return { Kind::DUE_BY, {}, returnDate.dayNumber, {} };
+    }
+    static BookQuery allOf(std::vector<BookQuery> children) {
+        return { Kind::ALL_OF, {}, 0, std::move(children) };
+    }
+    static BookQuery anyOf(std::vector<BookQuery> children) {
+        return { Kind::ANY_OF, {}, 0, std::move(children) };
+    }
+    static BookQuery negate(BookQuery query) {
+        std::vector<BookQuery> children;
+        children.push_back(std::move(query));
+        return { Kind::NOT, {}, 0, std::move(children) };
+    }
+};
+
+struct BookQueryResult {
+    // 조건에 맞는 책번호를 오름차순으로 limit개까지
+    std::vector<int> ids;
+    // limit와 상관없이 조건에 맞는 전체 권수
+    size_t totalCount;
+};
+
+// 서로 다른 제목/작가 문자열에 대한 부분 검색 색인.
+// 앞부분 일치는 필드별로 정렬된 배열에서 이진 탐색하고, 포함 검색은
+// 3바이트 n-gram 색인으로 후보를 좁힌 뒤 확인함. 한글 한 글자가 UTF-8로
+// 3바이트라 한 글자 검색도 n-gram 색인을 탐. 대소문자는 구분함.
+// 추가된 문자열은 pending에 모았다가 MERGE_THRESHOLD를 넘거나 flush할 때
+// 정렬해서 본 배열에 합침. 대량 적재 중에는 flush 때만 합침.
+// 잠금은 BookManager가 잡음
+class BookSearchIndex {
+private:
+    static constexpr size_t MERGE_THRESHOLD = 1024;
+    static constexpr size_t FIELD_COUNT = 2;
+
+    struct Key {
+        std::string_view text;
+        SearchField field;
+    };
+
+    std::vector<Key> keys;
+    // 필드별로 text 순서로 정렬된 keyId
+    std::array<std::vector<uint32_t>, FIELD_COUNT> sortedKeys;
+    // 아직 합치지 않은 keyId. 정렬되어 있지 않음
+    std::array<std::vector<uint32_t>, FIELD_COUNT> pendingKeys;
+    bool isBulkLoading = false;
+    // n-gram -> 그 n-gram을 가진 keyId (오름차순)
+    std::unordered_map<uint32_t, std::vector<uint32_t>> trigramIndex;
+
+    static uint32_t toTrigram(std::string_view text, size_t pos) {
+        return static_cast<uint32_t>(static_cast<unsigned char>(text[pos])) << 16 |
+            static_cast<uint32_t>(static_cast<unsigned char>(text[pos + 1])) << 8 |
+            static_cast<uint32_t>(static_cast<unsigned char>(text[pos + 2]));
+    }
+
+    bool isKeyLess(uint32_t left, uint32_t right) const {
+        return keys[left].text < keys[right].text;
+    }
+
+    void mergePending(size_t field);
+    void searchPrefix(std::string_view prefix, std::optional<SearchField> field,
+        size_t skip, size_t limit, SearchPage& page) const;
+    void searchSubstring(std::string_view query,
+        std::optional<SearchField> field, size_t skip, size_t limit,
+        SearchPage& page) const;
+
+public:
+    void add(std::string_view text, SearchField field);
+    // 대량 적재 중에는 add할 때 합치지 않음. flush로 끝냄
+    void beginBulkLoad() {
+        isBulkLoading = true;
+    }
+    // pending에 남은 문자열을 본 배열에 합침
+    void flush();
+    SearchPage search(std::string_view query, SearchMode mode,
+        std::optional<SearchField> field, size_t pageNumber,
+        size_t pageSize) const;
+    // field의 문자열 중 after 다음(inclusive면 after 포함)부터 limit개를
+    // 문자열 순서로
+    std::vector<std::string_view> getKeysAfter(SearchField field,
+        std::string_view after, bool inclusive, size_t limit) const;
+};
+
+// 이진 파일을 열기. Windows에서는 fopen_s를 씀
+FILE* openBinaryFile(const std::string& path, const char* mode);
+// 버퍼를 비우고 디스크에 내려갈 때까지 기다림
+bool syncFile(FILE* file);
+// CRC-32(IEEE). crc에 앞 부분의 결과를 넘기면 이어서 계산
+uint32_t crc32(uint32_t crc, std::string_view bytes);
+
+enum class DurabilityMode {
+    SYNC,   // commit이 디스크에 내려갈 때까지 기다림
+    ASYNC   // 백그라운드 스레드가 주기적으로 내보냄. 종료 직전 일부 유실 가능
+};
+
+struct ReplayReport {
+    size_t events;
+    size_t truncatedBytes;
+    double seconds;
+
+    double getEventsPerSecond() const {
+        return seconds > 0 ? events / seconds : 0;
+    }
+};
+
+// 숫자가 작을수록 중요. 로그 수준보다 숫자가 큰 이벤트는 남기지 않음
+enum class EventLevel : uint8_t { ERROR, WARNING, INFO, DEBUG };
+
+enum class EventType : uint8_t {
+    BOOK_ADDED,
+    BOOKS_ADDED,
+    BOOKS_IMPORTED,
+    IMPORT_FAILED,
+    BOOK_RENTED,
+    RENT_REJECTED,
+    BOOK_RETURNED,
+    RETURN_REJECTED,
+    RENT_BATCH,
+    RETURN_BATCH,
+    LOG_WRITE_FAILED
+};
+
+// 링 버퍼가 꽉 찼을 때
+enum class OverflowPolicy : uint8_t {
+    DROP,   // 버리고 dropped로 셈. 엔진 작업은 기다리지 않음
+    BLOCK   // 기록 스레드가 자리를 비울 때까지 기다림. 잃는 이벤트 없음
+};
+
+const char* getEventLevelName(EventLevel level);
+const char* getEventTypeName(EventType type);
+
+// 이벤트 한 건. 문자열 없이 고정 크기라 링 버퍼에 복사만 하면 됨.
+// 종류마다 쓰는 필드가 다르고 쓰지 않는 필드는 0
+struct EngineEvent {
+    // system_clock 기준 나노초
+    int64_t timestamp;
+    EventType type;
+    EventLevel level;
+    RentalStatus status;
+    int32_t bookId;
+    uint32_t borrowerId;
+    // 반납일의 dayNumber
+    int32_t returnDay;
+    // 일괄 처리의 성공/실패 건수, 적재한 권수/건너뛴 줄 수
+    uint32_t count;
+    uint32_t failedCount;
+};
+
+static_assert(sizeof(EngineEvent) == 32);
+
+// 엔진 작업의 이벤트를 남기는 구조화 로그. 작업은 고정 크기 레코드를 잠금
+// 없는 링 버퍼(슬롯마다 순번을 두는 bounded MPMC 큐)에 넣기만 하고, 기록
+// 스레드가 모아서 "ts=... level=... event=... 키=값" 한 줄씩 파일이나
+// 표준 출력에 씀. 작업 스레드는 포맷도 입출력도 하지 않음
+class EventLog {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 1 << 16;
+
+private:
+    static constexpr auto FLUSH_INTERVAL = std::chrono::milliseconds(5);
+
+    struct Slot {
+        // 쓸 차례면 위치, 읽을 차례면 위치 + 1
+        std::atomic<size_t> sequence;
+        EngineEvent event;
+    };
+
+    FILE* file = nullptr;
+    bool isStdout = false;
+    OverflowPolicy policy;
+    std::atomic<EventLevel> level;
+
+    std::unique_ptr<Slot[]> slots;
+    size_t mask;
+    alignas(64) std::atomic<size_t> enqueuePosition{ 0 };
+    // 기록 스레드만 옮김. flush가 읽음
+    alignas(64) std::atomic<size_t> dequeuePosition{ 0 };
+    std::atomic<uint64_t> droppedCount{ 0 };
+    std::atomic<uint64_t> writtenCount{ 0 };
+
+    std::mutex writerMutex;
+    std::condition_variable wakeRequested;
+    std::condition_variable drained;
+    bool isStopping = false;
+    std::thread writer;
+
+    // 넣을 자리를 잡으면 true. 꽉 찼으면 false
+    bool tryPush(const EngineEvent& event);
+    // 읽을 수 있는 이벤트를 모두 꺼내 buffer에 한 줄씩 쓰고 그 수를 돌려줌
+    size_t drain(std::string& buffer);
+    static void format(const EngineEvent& event, std::string& buffer);
+    void writeLoop();
+
+public:
+    // path가 "-"면 표준 출력. capacity는 2의 거듭제곱으로 올림
+    EventLog(const std::string& path, EventLevel level = EventLevel::INFO,
+        OverflowPolicy policy = OverflowPolicy::DROP,
+        size_t capacity = DEFAULT_CAPACITY);
+    // 남은 이벤트를 모두 쓰고 끝냄
+    ~EventLog();
+
+    EventLog(const EventLog&) = delete;
+    EventLog& operator=(const EventLog&) = delete;
+
+    bool isOpen() const {
+        return file != nullptr;
+    }
+
+    void setLevel(EventLevel newLevel) {
+        level.store(newLevel, std::memory_order_relaxed);
+    }
+    EventLevel getLevel() const {
+        return level.load(std::memory_order_relaxed);
+    }
+    bool isEnabled(EventLevel eventLevel) const {
+        return eventLevel <= level.load(std::memory_order_relaxed);
+    }
+
+    // 로그 수준을 넘으면 바로 돌아옴. 버리면 false
+    bool record(EventLevel eventLevel, EventType type, int32_t bookId = 0,
+        uint32_t borrowerId = 0, int32_t returnDay = 0,
+        RentalStatus status = RentalStatus{}, uint32_t count = 0,
+        uint32_t failedCount = 0) {
+        if (!isEnabled(eventLevel)) {
+            return true;
+        }
+        auto timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        return push({ timestamp, type, eventLevel, status, bookId, borrowerId,
+            returnDay, count, failedCount });
+    }
+    // 꽉 찼을 때 DROP이면 버리고 false, BLOCK이면 자리가 날 때까지 기다림
+    bool push(const EngineEvent& event);
+    // 지금까지 넣은 이벤트가 모두 쓰일 때까지 기다림
+    void flush();
+
+    uint64_t getWrittenCount() const {
+        return writtenCount.load(std::memory_order_relaxed);
+    }
+    uint64_t getDroppedCount() const {
+        return droppedCount.load(std::memory_order_relaxed);
+    }
+};
+
+// 책 추가/대여/반납을 일어난 순서대로 남기는 추가 전용 로그.
+// 레코드: [내용 길이 u32][crc32 u32][종류 u8][내용], 리틀 엔디언.
+// 여러 스레드의 기록을 버퍼에 모았다가 백그라운드 스레드가 한 번의
+// fsync로 내보내므로, 동시에 commit한 변경들이 fsync 하나를 나눠 씀
+class MutationLog {
+public:
+    enum class RecordType : uint8_t { ADD_BOOK = 1, RENT = 2, RETURN = 3 };
+
+    static constexpr size_t HEADER_SIZE = 9;
+
+private:
+    static constexpr auto FLUSH_INTERVAL = std::chrono::milliseconds(5);
+    static constexpr size_t FLUSH_THRESHOLD = 1 << 20;
+
+    FILE* file = nullptr;
+    DurabilityMode mode;
+
+    std::mutex bufferMutex;
+    std::condition_variable flushRequested;
+    std::condition_variable flushed;
+    std::string pending;
+    uint64_t appendedCount = 0;
+    uint64_t durableCount = 0;
+    // 디스크에 내려간 파일 길이
+    uint64_t durableBytes = 0;
+    size_t waitingCommits = 0;
+    // requestCommit으로 내려 달라고 한 레코드 수
+    uint64_t requestedCount = 0;
+    bool isFailed = false;
+    bool isStopping = false;
+    std::thread flusher;
+    std::shared_ptr<EventLog> eventLog;
+
+    static inline thread_local int deferredCommitDepth = 0;
+
+    static void putU32(std::string& out, uint32_t value) {
+        char bytes[4];
+        memcpy(bytes, &value, sizeof(bytes));
+        out.append(bytes, sizeof(bytes));
+    }
+
+    static void putString(std::string& out, std::string_view text) {
+        putU32(out, static_cast<uint32_t>(text.size()));
+        out.append(text);
+    }
+
+    // bufferMutex를 잡은 상태에서 호출. 내용은 pending에 바로 쓰고
+    // endRecord에서 길이와 체크섬을 채우므로 레코드마다 따로 할당하지 않음
+    size_t beginRecord(RecordType type);
+    void endRecord(size_t recordStart);
+    void flushLoop();
+    bool writeBatch(const std::string& batch);
+    // bufferMutex를 잡은 lock을 받아, 지금까지 기록된 레코드가 디스크에
+    // 내려갈 때까지 기다림
+    bool waitDurable(std::unique_lock<std::mutex>& lock);
+
+public:
+    // 살아 있는 동안 이 스레드의 commit은 기다리지 않고 바로 돌아옴.
+    // 여러 변경을 모은 뒤 requestCommit/waitCommitted로 한 번에 내릴 때 씀
+    class DeferredCommits {
+    public:
+        DeferredCommits() {
+            deferredCommitDepth++;
+        }
+
+        ~DeferredCommits() {
+            deferredCommitDepth--;
+        }
+
+        DeferredCommits(const DeferredCommits&) = delete;
+        DeferredCommits& operator=(const DeferredCommits&) = delete;
+    };
+
+    MutationLog(const std::string& path,
+        DurabilityMode mode = DurabilityMode::SYNC);
+    ~MutationLog();
+
+    MutationLog(const MutationLog&) = delete;
+    MutationLog& operator=(const MutationLog&) = delete;
+
+    bool isOpen() const {
+        return file != nullptr;
+    }
+
+    void appendAddBook(std::string_view title, std::string_view author);
+    void appendRent(int bookId, std::string_view borrower,
+        std::string_view phone, DateStruct rentDate, DateStruct returnDate);
+    void appendReturn(int bookId);
+
+    // SYNC 모드면 지금까지 기록된 레코드가 디스크에 내려갈 때까지 기다림.
+    // 쓰기에 실패했으면 false
+    bool commit();
+    // 지금까지 기록된 레코드를 기다리지 않고 내려 달라고 하고 그 번호를 돌려줌.
+    // waitCommitted(번호)는 SYNC 모드면 그 레코드까지 디스크에 내려갈 때까지
+    // 기다림. 그 사이에 다음 변경을 실행할 수 있음
+    uint64_t requestCommit();
+    bool waitCommitted(uint64_t ticket);
+    // 모드와 상관없이 지금까지 기록된 레코드를 디스크에 내리고 그 끝 위치를
+    // 돌려줌. 스냅샷에 반영된 지점을 남길 때 씀
+    uint64_t checkpoint();
+
+    // 쓰기 실패를 이벤트 로그에 남김
+    void attachEventLog(std::shared_ptr<EventLog> log) {
+        std::lock_guard lock(bufferMutex);
+        eventLog = std::move(log);
+    }
+
+    // fromOffset부터 로그를 다시 적용. 끝이 잘렸거나 체크섬이 틀린
+    // 레코드부터는 버리고 파일을 그 앞까지 자름. 로그를 붙이기 전에
+    // 호출해야 함. 로그가 fromOffset보다 짧으면 새로 시작한 로그로 보고
+    // 처음부터 적용. 대여는 기록된 대여일과 반납일 그대로 되살림
+    static ReplayReport replay(const std::string& path,
+        BookManager& bookManager, RentalManager& rentalManager,
+        uint64_t fromOffset = 0);
+};
+
+// 여러 스레드에서 같이 써도 됨. 책 추가는 쓰기 잠금, 나머지는 읽기 잠금을
+// 잡고, 대여 칸의 변경(claim/release)은 제목마다 따로 원자적으로 처리함
+class BookManager {
+private:
+    // 책번호가 곧 저장소의 행 위치이므로 idIndex는 따로 두지 않음
+    std::unique_ptr<CatalogStore> store;
+    // 키는 StringPool에 있는 문자열을 가리킴
+    std::unique_ptr<StringKeyMap<TitleEntry>> titleIndex;
+    std::unique_ptr<StringKeyMap<BookIdList>> authorIndex;
+    // 책번호 - 1 위치에 그 책이 제목의 freeIds 안에서 있는 위치
+    std::unique_ptr<std::vector<uint32_t>> freePositions;
+    // 책번호 - 1 위치에 그 책의 titleIndex 항목. 대여/반납 때 제목 해시 조회를 생략
+    std::unique_ptr<std::vector<TitleEntry*>> titleEntries;
+    std::unique_ptr<BookSearchIndex> searchIndex;
+    mutable ShardedSharedMutex catalogMutex;
+
+    std::shared_ptr<MutationLog> mutationLog;
+    std::shared_ptr<EventLog> eventLog;
+    // 스냅샷의 제목/작가는 첫 부분 검색 때 searchIndex에 넣음
+    std::shared_ptr<const CatalogSnapshot> unindexedSnapshot;
+    mutable std::atomic<bool> hasUnindexedSnapshot{ false };
+
+    int appendBook(std::string_view title, std::string_view author);
+    void indexSnapshotKeys() const;
+    // 제목/작가 조건마다 비트맵을 만들고 책 65536권 단위로 조건을 계산
+    std::vector<BookBitmap::Container> evaluateQuery(
+        const BookQuery& query) const;
+    void buildQueryLeaves(const BookQuery& query,
+        std::unordered_map<const BookQuery*, BookBitmap>& leaves) const;
+    void reserveBooks(size_t count);
+    std::vector<std::shared_ptr<Book>> materializeBooks(
+        std::span<const int> ids) const;
+    // 잠금을 잡지 않는 내부용 조회
+    std::span<const int> findIds(const StringKeyMap<BookIdList>& index,
+        std::string_view key) const;
+    TitleEntry* findTitle(std::string_view title) const;
+    TitleEntry& getTitleEntry(int id) const;
+    void pushFree(TitleEntry& entry, int id);
+    void removeFree(TitleEntry& entry, int id);
+
+public:
+    explicit BookManager(
+        std::shared_ptr<StringPool> stringPool =
+            std::make_shared<StringPool>()) {
+        store = std::make_unique<CatalogStore>(std::move(stringPool));
+        titleIndex = std::make_unique<StringKeyMap<TitleEntry>>();
+        authorIndex = std::make_unique<StringKeyMap<BookIdList>>();
+        freePositions = std::make_unique<std::vector<uint32_t>>();
+        titleEntries = std::make_unique<std::vector<TitleEntry*>>();
+        searchIndex = std::make_unique<BookSearchIndex>();
+    }
+
+    // 한 권을 등록하고 책번호를 돌려줌
+    int registerBook(std::string_view title, std::string_view author);
+    // 한 묶음을 등록. rows는 비워짐
+    void addBooks(std::vector<std::pair<std::string, std::string>>& rows);
+    // 파일을 열지 못하면 isFileOpened가 false
+    ImportReport importBooks(const std::string& path, char delimiter = '\0',
+        bool hasHeader = false);
+    std::vector<std::shared_ptr<Book>> getAllBooks();
+    std::vector<std::shared_ptr<Book>> getBooksByTitle(std::string_view title);
+    std::vector<std::shared_ptr<Book>> getBooksByAuthor(
+        std::string_view author);
+    std::shared_ptr<Book> getBookById(int id);
+
+    bool hasBook(int id) const;
+    // 없는 책이면 false
+    bool isRented(int id) const;
+    size_t getBookCount() const;
+    std::string_view getTitleById(int id) const;
+    std::shared_ptr<RentalInfo> getRentalInfo(int id) const;
+    int findAvailableBookByTitle(std::string_view title) const;
+    // 제목이 같은 책 중 대여 가능한 권수. O(1)
+    size_t countAvailableBooksByTitle(std::string_view title) const;
+    // 책 수와 제목/작가 색인의 크기, 버킷 수, 부하율
+    void appendGauges(std::vector<MetricGauge>& gauges) const;
+    // 지금까지의 책을 제목이나 작가로 묶은 표. 대여 기록 집계에 씀
+    BookGrouping getBookGrouping(SearchField field) const;
+    // 이후의 책 추가를 로그에 기록
+    void attachLog(std::shared_ptr<MutationLog> log) {
+        mutationLog = std::move(log);
+    }
+    // 이후의 책 추가와 가져오기 결과를 이벤트 로그에 남김
+    void attachEventLog(std::shared_ptr<EventLog> log) {
+        eventLog = std::move(log);
+    }
+
+    // 비어 있는 BookManager를 스냅샷의 책으로 채움. 문자열은 복사하지 않고
+    // 제목/작가 색인은 스냅샷에 묶여 있는 그대로 만듦. 실패하면 false
+    bool loadSnapshot(std::shared_ptr<const CatalogSnapshot> snapshot);
+
+    // 제목/작가 부분 검색. field를 생략하면 둘 다, pageNumber는 0부터
+    SearchPage searchBooks(std::string_view query, SearchMode mode,
+        std::optional<SearchField> field, size_t pageNumber,
+        size_t pageSize) const;
+
+    // 전체 책을 pageSize개씩 읽음. 처음에는 after를 기본값(순서만 정해서)으로
+    // 두고, 다음부터는 앞 페이지의 next를 넘김. 페이지마다 잠금을 새로 잡으므로
+    // 페이지 사이에 추가된 책도 순서상 뒤에 있으면 나옴.
+    // 제목 순은 제목, 책번호 순
+    BookPage getBookPage(const BookCursor& after, size_t pageSize) const;
+    // 대여중인 책의 대여정보를 책번호 순으로 after.bookId 다음부터 pageSize개
+    RentalPage getRentalPage(const RentalCursor& after, size_t pageSize) const;
+
+    // 조건에 맞는 책번호와 권수. 책 65536권 단위로 나눠 비트맵 연산으로
+    // 계산하고, 단위가 많으면 여러 스레드가 나눠 맡음.
+    // 대여 상태는 계산하는 동안 바뀔 수 있음
+    BookQueryResult queryBooks(const BookQuery& query,
+        size_t limit = SIZE_MAX) const;
+    // 책번호를 꺼내지 않고 권수만 셈
+    size_t countBooks(const BookQuery& query) const;
+
+    // 책의 대여 칸을 비우고 들어 있던 대여정보를 돌려줌
+    std::shared_ptr<RentalInfo> releaseBook(int id);
+
+    // 책의 대여 칸을 원자적으로 차지. 두 스레드가 같은 책을 동시에 차지하려
+    // 해도 하나만 성공함.
+    // 책이 비어 있을 때만 prepare(제목)이 만든 대여정보로 차지. prepare는
+    // 제목의 대여 가능 잠금 안에서 불리므로 그동안 다른 스레드가 그 책을
+    // 차지할 수 없음. prepare가 nullptr을 돌려주면 차지하지 않음.
+    // 없거나 이미 대여중인 책이면 prepare를 부르지 않음
+    template <typename Prepare>
+    bool claimBookWith(int id, Prepare&& prepare) {
+        std::shared_lock lock(catalogMutex);
+        if (!store->contains(id)) {
+            return false;
+        }
+        TitleEntry& entry = getTitleEntry(id);
+        std::lock_guard availabilityLock(entry.availabilityMutex);
+        if (store->isRented(id)) {
+            return false;
+        }
+        std::shared_ptr<RentalInfo> rentalInfo = prepare(store->getTitle(id));
+        if (!rentalInfo) {
+            return false;
+        }
+        store->claim(id, std::move(rentalInfo));
+        removeFree(entry, id);
+        return true;
+    }
+
+    // 제목이 같은 책 중 대여 가능한 책 하나를 prepare(책번호, 제목)이 만든
+    // 대여정보로 차지하고 그 책번호를 돌려줌. 대여 가능한 책이 없거나
+    // prepare가 nullptr을 돌려주면 0
+    template <typename Prepare>
+    int claimAvailableBookByTitle(std::string_view title, Prepare&& prepare) {
+        std::shared_lock lock(catalogMutex);
+        TitleEntry* entry = findTitle(title);
+        if (!entry) {
+            return 0;
+        }
+        std::lock_guard availabilityLock(entry->availabilityMutex);
+        if (entry->freeIds.empty()) {
+            return 0;
+        }
+        int id = entry->freeIds.back();
+        std::shared_ptr<RentalInfo> rentalInfo =
+            prepare(id, store->getTitle(id));
+        if (!rentalInfo) {
+            return 0;
+        }
+        store->claim(id, std::move(rentalInfo));
+        removeFree(*entry, id);
+        return id;
+    }
+
+    // 복사 없이 인덱스의 책번호 목록을 그대로 보여줌. 책이 추가되면 무효라
+    // 다른 스레드가 책을 추가할 수 있을 때는 forEach 함수를 사용
+    std::span<const int> getBookIdsByTitle(std::string_view title) const;
+    std::span<const int> getBookIdsByAuthor(std::string_view author) const;
+
+    // 복사나 참조 카운트 증가 없이 저장소를 순회. 순회하는 동안 읽기 잠금을
+    // 잡으므로 visitor 안에서 책을 추가하면 안 됨.
+    // visitor는 const BookView&를 받음
+    template <typename Visitor>
+    void forEachBook(Visitor&& visitor) const {
+        std::shared_lock lock(catalogMutex);
+        for (size_t row = 0; row < store->size(); row++) {
+            visitor(store->getView(store->getIdAt(row)));
+        }
+    }
+
+    template <typename Visitor>
+    void forEachBookByTitle(std::string_view title, Visitor&& visitor) const {
+        OperationTimer timer(EngineOperation::FIND_BY_TITLE);
+        std::shared_lock lock(catalogMutex);
+        if (TitleEntry* entry = findTitle(title)) {
+            for (int id : entry->ids) {
+                visitor(store->getView(id));
+            }
+        }
+    }
+
+    template <typename Visitor>
+    void forEachBookByAuthor(std::string_view author, Visitor&& visitor) const {
+        OperationTimer timer(EngineOperation::FIND_BY_AUTHOR);
+        std::shared_lock lock(catalogMutex);
+        for (int id : findIds(*authorIndex, author)) {
+            visitor(store->getView(id));
+        }
+    }
+};
+
+enum class RentalStatus : uint8_t {
+    SUCCESS,
+    NO_SUCH_BOOK,
+    ALREADY_RENTED,
+    NOT_RENTED,
+    NO_AVAILABLE_COPY,
+    NO_SUCH_BORROWER,
+    LOAN_LIMIT_REACHED,
+    // 대여자 표가 꽉 차 처음 보는 대여자를 등록할 수 없음
+    BORROWER_LIMIT_REACHED
+};
+
+// 콘솔에 보여줄 실패 메시지
+const char* getRentalStatusMessage(RentalStatus status);
+// 명령 응답과 이벤트 로그에 쓰는 고정 코드
+const char* getRentalStatusCode(RentalStatus status);
+
+// 연체 목록을 이어 읽기 위한 위치. 마지막으로 받은 대여정보의 반납일과 책번호
+struct DelayedRentalCursor {
+    int32_t returnDay = INT32_MIN;
+    int bookId = 0;
+};
+
+struct DelayedRentalPage {
+    std::vector<std::shared_ptr<RentalInfo>> rentals;
+    // 다음 페이지를 읽을 때 넘길 커서
+    DelayedRentalCursor next;
+    bool hasMore;
+};
+
+enum class RentalOrder : uint8_t { BY_BOOK_ID, BY_RETURN_DATE };
+
+// 전체 대여 목록을 이어 읽기 위한 위치. 마지막으로 받은 대여정보의 책번호와,
+// 반납일 순이면 그 반납일. 기본값은 처음부터
+struct RentalCursor {
+    RentalOrder order = RentalOrder::BY_BOOK_ID;
+    int bookId = 0;
+    int32_t returnDay = INT32_MIN;
+
+    // 공백 없는 문자열로 바꿔 클라이언트에 넘기고 그대로 돌려받아 이어 읽음
+    std::string toToken() const;
+    // 형식이 틀리면 nullopt
+    static std::optional<RentalCursor> fromToken(std::string_view token);
+};
+
+struct RentalPage {
+    std::vector<std::shared_ptr<RentalInfo>> rentals;
+    // 다음 페이지를 읽을 때 넘길 커서
+    RentalCursor next;
+    bool hasMore;
+};
+
+// 반납일 하루를 칸 하나로 두는 달력 큐. 오늘 근처 WINDOW_DAYS일의 창은 날짜마다
+// 칸을 두고 대여/반납을 O(1)로 넣고 빼며, 창 밖의 날짜는 날짜 순 map에 둠.
+// 오늘이 바뀌면 창을 앞으로 밀어 지난 칸은 map으로 접고 새 날짜를 창에 들임.
+// 기준일까지의 대여 수는 창 안의 칸 수를 Fenwick 트리로 더해 O(log 창 크기)에
+// 구하고, 목록은 빈 날짜를 비트맵으로 건너뛰므로 날짜가 아무리 멀리
+// 떨어져도 메모리와 시간은 대여가 있는 날짜 수만큼만 씀.
+// 칸 안은 읽을 때만 책번호 순으로 정렬. 잠금은 RentalManager가 잡음
+class DelayedRentalQueue {
+private:
+    struct Bucket {
+        std::vector<std::shared_ptr<RentalInfo>> rentals;
+        bool isSorted = true;
+    };
+
+    // 2의 거듭제곱. 약 11년
+    static constexpr int32_t WINDOW_DAYS = 1 << 12;
+    // 창을 옮길 때 기준일 앞쪽에 남겨 두는 날짜 수. 이미 지난 반납일용
+    static constexpr int32_t WINDOW_LEAD_DAYS = WINDOW_DAYS / 4;
+    static constexpr size_t WORD_BITS = 64;
+
+    // 창은 windowStart부터 WINDOW_DAYS일. 칸과 그 안의 vector는 비워도 그대로
+    // 두고 다시 쓰므로 처음 한 번만 할당함
+    std::vector<Bucket> buckets;
+    // 1부터 시작하는 Fenwick 트리. 창 안 날짜별 대여 수의 누적 합
+    std::vector<size_t> dueCounts;
+    // 대여가 있는 창 안 날짜
+    std::vector<uint64_t> occupiedDays;
+    int32_t windowStart = 0;
+    bool isAnchored = false;
+    size_t occupiedDayCount = 0;
+    // 창 밖의 날짜. 빈 칸은 지움
+    std::map<int32_t, Bucket> overflow;
+    // overflow 중 창보다 앞선 날짜의 대여 수. 창이 지나간 칸도 여기로 접음
+    size_t earlyOverflowCount = 0;
+    size_t totalCount = 0;
+
+    bool isInWindow(int32_t day) const {
+        return day >= windowStart && day - windowStart < WINDOW_DAYS;
+    }
+
+    // 창 안이면 칸을, 밖이면 overflow의 칸을 찾음. 없으면 nullptr
+    Bucket* findBucket(int32_t day);
+    Bucket& getBucket(int32_t day);
+    // 창 안 날짜의 대여 수를 delta만큼 바꾸고 빈 날짜 비트맵을 맞춤
+    void updateWindowCount(int32_t day, ptrdiff_t delta);
+    // 칸을 옮긴 뒤 Fenwick 트리와 빈 날짜 비트맵을 칸에서 다시 만듦. O(창 크기)
+    void rebuildWindowCounts();
+    void updateCount(int32_t day, ptrdiff_t delta);
+    // 창 안에서 offset(포함)까지의 대여 수
+    size_t countWindowPrefix(int32_t offset) const;
+    // 창 안에서 offset(포함) 이후로 대여가 있는 첫 위치. 없으면 WINDOW_DAYS
+    int32_t findOccupiedDay(int32_t offset) const;
+    void sortBucket(Bucket& bucket);
+
+    // fromDay~lastDay(포함)의 대여가 있는 칸을 날짜 순으로 방문.
+    // visitor(day, Bucket&)가 false를 돌려주면 멈춤
+    template <typename Visitor>
+    void forEachBucket(int32_t fromDay, int32_t lastDay, Visitor&& visitor) {
+        if (fromDay > lastDay) {
+            return;
+        }
+        auto it = overflow.lower_bound(fromDay);
+        for (; it != overflow.end() && it->first < windowStart
+            && it->first <= lastDay; it++) {
+            if (!visitor(it->first, it->second)) {
+                return;
+            }
+        }
+
+        if (!buckets.empty() && lastDay >= windowStart) {
+            int32_t lastOffset = static_cast<int32_t>(
+                std::min<int64_t>(int64_t(lastDay) - windowStart,
+                    WINDOW_DAYS - 1));
+            int32_t offset = static_cast<int32_t>(
+                std::max<int64_t>(int64_t(fromDay) - windowStart, 0));
+            while (offset <= lastOffset) {
+                offset = findOccupiedDay(offset);
+                if (offset > lastOffset) {
+                    break;
+                }
+                if (!visitor(windowStart + offset, buckets[offset])) {
+                    return;
+                }
+                offset++;
+            }
+        }
+
+        int32_t windowEnd = windowStart + WINDOW_DAYS;
+        it = overflow.lower_bound(std::max(fromDay, windowEnd));
+        for (; it != overflow.end() && it->first <= lastDay; it++) {
+            if (!visitor(it->first, it->second)) {
+                return;
+            }
+        }
+    }
+
+public:
+    // 창이 day보다 WINDOW_LEAD_DAYS일 앞에서 시작하도록 옮김. 비어 있으면
+    // 어느 쪽으로든 옮기고, 아니면 앞으로만 밀어 창을 벗어난 칸은 창보다
+    // 앞선 overflow로 접고 새로 창에 든 날짜는 overflow에서 가져옴.
+    // 창이 이미 맞으면 O(1)이라 대여/반납마다 불러도 되고, 옮길 때만
+    // O(창 크기 + 옮긴 날짜 수 × log)
+    void recenter(DateStruct day);
+    void add(const std::shared_ptr<RentalInfo>& rentalInfo);
+    // 반납일, 책번호 순으로 정렬된 대여정보를 한 번에 넣음. 날짜마다 칸을
+    // 한 번만 찾음
+    void addSorted(std::span<const std::shared_ptr<RentalInfo>> sortedRentals);
+    void remove(const RentalInfo& rentalInfo);
+
+    size_t size() const {
+        return totalCount;
+    }
+
+    // 창의 칸 수
+    size_t getBucketCount() const {
+        return buckets.size();
+    }
+
+    // 창 안에서 대여가 있는 날짜 수
+    size_t getDayCount() const {
+        return occupiedDayCount;
+    }
+
+    // 창 밖에서 대여가 있는 날짜 수
+    size_t getOverflowDayCount() const {
+        return overflow.size();
+    }
+
+    // returnDate(포함)까지 반납해야 하는 대여 수. 창 안의 기준일이면
+    // O(log 창 크기), 창 밖이면 그 사이의 창 밖 날짜 수만큼 더 봄
+    size_t countDueBy(DateStruct returnDate);
+    // returnDate(포함)까지 반납해야 하는 대여정보 중 after 다음부터
+    // pageSize개. 반납일, 책번호 순
+    DelayedRentalPage getPage(DateStruct returnDate, DelayedRentalCursor after,
+        size_t pageSize);
+
+    // visitor는 const shared_ptr<RentalInfo>&를 받음
+    template <typename Visitor>
+    void forEachDueBy(DateStruct returnDate, Visitor&& visitor) {
+        forEachBucket(INT32_MIN, returnDate.dayNumber,
+            [&](int32_t, Bucket& bucket) {
+                sortBucket(bucket);
+                for (const auto& rental : bucket.rentals) {
+                    visitor(rental);
+                }
+                return true;
+            });
+    }
+};
+
+// 이름이나 전화번호가 같은 대여자들의 번호. 대부분 한 명
+using BorrowerIdList = SmallVector<BorrowerId, 2>;
+
+// 대여자 한 명. 이름과 전화번호는 StringPool에 있는 문자열을 가리킴
+struct Borrower {
+    BorrowerId id = 0;
+    std::string_view name;
+    std::string_view phone;
+    // 대여 한도 검사에 쓰는 대여 수. 책을 차지하기 전에 늘리므로 아직
+    // rentals에 넣지 않은 대여도 셈
+    std::atomic<uint32_t> activeRentalCount{ 0 };
+    // 대여중인 대여정보. RentalManager가 쓰기 잠금을 잡고 바꿈
+    BorrowerRentalList rentals;
+};
+
+// 이름과 전화번호가 모두 같으면 같은 사람으로 보는 대여자 표. 동명이인은
+// 전화번호로, 전화번호를 같이 쓰는 가족은 이름으로 구분함.
+// 대여자는 고정 크기 청크에 넣어 주소가 바뀌지 않고, 번호로 찾는 get()은
+// 잠금 없이 O(1). 이름/전화번호 색인은 등록과 조회 때만 씀.
+// 여러 스레드에서 같이 써도 됨
+class BorrowerRegistry {
+private:
+    static constexpr size_t CHUNK_SIZE = 1 << 12;
+    static constexpr size_t MAX_CHUNKS = 1 << 14;
+
+    std::shared_ptr<StringPool> stringPool;
+    std::unique_ptr<std::unique_ptr<Borrower[]>[]> chunks;
+    // 등록 잠금 안에서만 늘리고, contains는 잠금 없이 읽음
+    std::atomic<size_t> count{ 0 };
+    // 키는 StringPool에 있는 문자열을 가리킴
+    StringKeyMap<BorrowerIdList> phoneIndex;
+    StringKeyMap<BorrowerIdList> nameIndex;
+    mutable std::shared_mutex registryMutex;
+
+    std::optional<BorrowerId> findLocked(std::string_view name,
+        std::string_view phone) const;
+
+public:
+    static constexpr size_t CAPACITY = CHUNK_SIZE * MAX_CHUNKS;
+
+    explicit BorrowerRegistry(std::shared_ptr<StringPool> stringPool)
+        : stringPool{ std::move(stringPool) },
+        chunks{ std::make_unique<std::unique_ptr<Borrower[]>[]>(MAX_CHUNKS) } {
+    }
+
+    // 이름과 전화번호가 같은 대여자가 있으면 그 번호, 없으면 새로 등록.
+    // 대여자 표나 문자열 풀이 꽉 찼으면 nullopt
+    std::optional<BorrowerId> registerBorrower(std::string_view name,
+        std::string_view phone);
+    std::optional<BorrowerId> find(std::string_view name,
+        std::string_view phone) const;
+
+    Borrower& get(BorrowerId id) {
+        return chunks[id / CHUNK_SIZE][id % CHUNK_SIZE];
+    }
+
+    const Borrower& get(BorrowerId id) const {
+        return chunks[id / CHUNK_SIZE][id % CHUNK_SIZE];
+    }
+
+    bool contains(BorrowerId id) const {
+        return id < count.load(std::memory_order_acquire);
+    }
+
+    size_t size() const {
+        return count.load(std::memory_order_acquire);
+    }
+
+    // 대여자 수와 이름/전화번호 색인의 크기, 버킷 수, 부하율
+    void appendGauges(std::vector<MetricGauge>& gauges) const;
+
+    // 이름이 같은 대여자들을 등록 순으로 순회. visitor는 BorrowerId를 받음
+    template <typename Visitor>
+    void forEachByName(std::string_view name, Visitor&& visitor) const {
+        std::shared_lock lock(registryMutex);
+        if (const BorrowerIdList* ids = nameIndex.find(name)) {
+            for (BorrowerId id : *ids) {
+                visitor(id);
+            }
+        }
+    }
+
+    template <typename Visitor>
+    void forEachByPhone(std::string_view phone, Visitor&& visitor) const {
+        std::shared_lock lock(registryMutex);
+        if (const BorrowerIdList* ids = phoneIndex.find(phone)) {
+            for (BorrowerId id : *ids) {
+                visitor(id);
+            }
+        }
+    }
+};
+
+// 대여 기록을 제목/작가/대여자로 묶은 집계 하나
+struct HistoryGroup {
+    std::string_view name;
+    uint64_t rentals;
+    // 대여일부터 실제 반납일까지의 평균 일수
+    double averageLoanDays;
+};
+
+// 묶음 번호마다의 대여 수와 대여 일수 합계
+struct HistoryTotals {
+    std::vector<uint64_t> rentals;
+    std::vector<int64_t> loanDays;
+};
+
+// 반납까지 끝난 대여를 열(column) 단위로 쌓는 추가 전용 기록. 책번호, 대여자,
+// 대여일, 반납일을 열마다 고정 크기 청크에 이어 붙여 이미 쓴 칸은 옮기지 않음.
+// 청크마다 대여일의 최솟값/최댓값을 두어 기간에 걸리지 않는 청크는 건너뛰고,
+// 집계는 청크를 여러 스레드에 나눠 청크 안을 분기 없이 한 열씩 훑음.
+// 여러 스레드에서 같이 써도 됨. 집계는 시작할 때까지 쌓인 기록만 봄
+class RentalHistory {
+public:
+    static constexpr size_t CHUNK_SIZE = 1 << 16;
+    static constexpr size_t MAX_CHUNKS = 1 << 14;
+
+private:
+    struct Chunk {
+        uint32_t bookIds[CHUNK_SIZE];
+        BorrowerId borrowerIds[CHUNK_SIZE];
+        int32_t rentDays[CHUNK_SIZE];
+        int32_t returnDays[CHUNK_SIZE];
+        int32_t minRentDay = INT32_MAX;
+        int32_t maxRentDay = INT32_MIN;
+    };
+
+    // 집계 하나가 훑을 청크와 그때까지 쓴 칸 수
+    struct ChunkView {
+        const Chunk* chunk;
+        size_t size;
+    };
+
+    // 파일: 머리말, 대여자(이름과 전화번호, 각각 [길이 u32][내용]) *
+    // borrowerCount, 책번호/대여자 번호/대여일/반납일 열(recordCount개씩).
+    // 리틀 엔디언
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t borrowerCount;
+        uint64_t recordCount;
+        uint64_t nameBytes;
+    };
+    static constexpr uint32_t VERSION = 2;
+    static constexpr char MAGIC[8] = { 'B', 'O', 'O', 'K', 'H', 'I', 'S', 'T' };
+
+    // 대여자는 번호로만 남기고 이름은 여기서 찾음
+    std::shared_ptr<BorrowerRegistry> borrowers;
+    std::unique_ptr<std::unique_ptr<Chunk>[]> chunks;
+    size_t count = 0;
+    size_t droppedCount = 0;
+    mutable std::mutex historyMutex;
+
+    std::vector<ChunkView> getChunkViews(DateStruct from, DateStruct to) const;
+    template <typename Accumulator, typename Kernel>
+    std::vector<Accumulator> scanChunks(std::span<const ChunkView> views,
+        const Accumulator& initial, Kernel kernel) const;
+    // keyOf(chunk, i)는 i번째 기록의 묶음 번호와 집계에 넣을지(0/1)를 돌려줌
+    template <typename KeyOf>
+    HistoryTotals sumByKey(DateStruct from, DateStruct to, size_t keyCount,
+        KeyOf keyOf) const;
+    void appendLocked(uint32_t bookId, BorrowerId borrowerId, int32_t rentDay,
+        int32_t returnDay);
+
+public:
+    explicit RentalHistory(std::shared_ptr<BorrowerRegistry> borrowers)
+        : borrowers{ std::move(borrowers) },
+        chunks{ std::make_unique<std::unique_ptr<Chunk>[]>(MAX_CHUNKS) } {
+    }
+
+    // 대여 한 건을 남김. borrowerId는 borrowers에 등록된 번호여야 함.
+    // 꽉 차면(CHUNK_SIZE * MAX_CHUNKS건) 남기지 않고 droppedCount만 셈
+    void append(int bookId, BorrowerId borrowerId, DateStruct rentDate,
+        DateStruct returnDate);
+
+    size_t size() const;
+    size_t getChunkCount() const;
+    size_t getDroppedCount() const;
+
+    // 대여일이 from~to(포함)인 기록을 keyOfBook[책번호 - 1]로 묶어 셈.
+    // keyOfBook에 없는 책번호의 기록은 빠짐
+    HistoryTotals groupByBook(DateStruct from, DateStruct to,
+        std::span<const uint32_t> keyOfBook, size_t keyCount) const;
+    // 대여자 번호로 묶어 셈. 결과의 칸 수는 집계를 시작할 때의 대여자 수
+    HistoryTotals groupByBorrower(DateStruct from, DateStruct to) const;
+    // from부터 하루에 한 칸씩 그날 대여한 수
+    std::vector<uint64_t> countByDay(DateStruct from, DateStruct to) const;
+
+    // 기록을 열 단위 이진 파일로 저장/적재. 대여자는 이름과 전화번호로
+    // 저장하고 불러올 때 다시 등록함. 적재한 기록은 지금 기록 뒤에 붙음
+    bool save(const std::string& path) const;
+    bool load(const std::string& path);
+};
+
+// 여러 스레드에서 같이 써도 됨. 어떤 책을 빌려줄지는 BookManager의
+// claim으로 책마다 원자적으로 정하고, 대여 인덱스 갱신만 쓰기 잠금으로 직렬화
+class RentalManager {
+private:
+    std::shared_ptr<StringPool> stringPool;
+    // 대여정보는 대여/반납마다 생기고 없어지므로 풀에서 할당
+    std::shared_ptr<SizeClassPool> rentalPool;
+    std::unique_ptr<std::vector<std::shared_ptr<RentalInfo>>> rentals;
+    // 대여자별 대여 목록은 대여자 표의 각 대여자가 가짐
+    std::shared_ptr<BorrowerRegistry> borrowers;
+    std::unique_ptr<DelayedRentalQueue> delayedRentals;
+    std::unique_ptr<RentalHistory> history;
+    mutable ShardedSharedMutex rentalMutex;
+    // 연체 조회는 읽기 잠금만 잡지만 delayedRentals의 커서와 정렬을 바꾸므로
+    // 조회끼리는 이것으로 직렬화
+    mutable std::mutex delayedMutex;
+
+    std::shared_ptr<MutationLog> mutationLog;
+    std::shared_ptr<EventLog> eventLog;
+    // setCurrentDate로 정한 오늘. INT32_MIN이면 시스템 시계를 씀
+    std::atomic<int32_t> currentDay{ INT32_MIN };
+    // 한 사람이 동시에 빌릴 수 있는 권수. 0이면 제한 없음
+    std::atomic<uint32_t> loanLimit{ 0 };
+
+    std::shared_ptr<RentalInfo> makeRentalInfo(int bookId,
+        std::string_view bookTitle, const Borrower& borrower,
+        DateStruct rentDate, DateStruct returnDate);
+    // 대여 한도 안에서 대여자의 대여 수를 하나 늘림. 한도에 찼으면 false
+    bool reserveLoan(Borrower& borrower);
+    // 책을 차지하기 직전, 책의 대여 가능 잠금 안에서 부름. borrowerId가
+    // 없으면 rentalDTO의 이름과 전화번호로 등록하고 대여 한도를 잡은 뒤
+    // 대여정보를 만듦. 실패하면 status에 이유를 남기고 nullptr
+    std::shared_ptr<RentalInfo> prepareRental(int bookId,
+        std::string_view bookTitle, std::optional<BorrowerId>& borrowerId,
+        const RentalDTO& rentalDTO, RentalStatus& status);
+    RentalStatus rentById(int bookId, std::optional<BorrowerId> borrowerId,
+        const RentalDTO& rentalDTO, BookManager& bookManager,
+        std::shared_ptr<RentalInfo>* rentalInfo);
+    RentalStatus rentByTitle(std::string_view title,
+        std::optional<BorrowerId> borrowerId, const RentalDTO& rentalDTO,
+        BookManager& bookManager, std::shared_ptr<RentalInfo>* rentalInfo);
+    void rentalBook(const std::shared_ptr<RentalInfo>& rentalInfo);
+    void rentalBooks(std::vector<std::shared_ptr<RentalInfo>>& newRentals);
+    void returnBook(const std::shared_ptr<RentalInfo>& rentalInfo);
+    // 실패를 타이머와 이벤트 로그에 남기고 status를 그대로 돌려줌
+    RentalStatus reject(OperationTimer& timer, EventType type,
+        RentalStatus status, int bookId, BorrowerId borrowerId = 0);
+    template <typename RentalList>
+    static void swapAndPop(RentalList& target, size_t pos,
+        size_t RentalInfo::* posMember) {
+        if (pos + 1 != target.size()) {
+            target[pos] = std::move(target.back());
+            target[pos].get()->*posMember = pos;
+        }
+        target.pop_back();
+    }
+
+public:
+    explicit RentalManager(
+        std::shared_ptr<StringPool> stringPool = std::make_shared<StringPool>())
+        : stringPool{ std::move(stringPool) },
+        rentalPool{ std::make_shared<SizeClassPool>() } {
+        rentals = std::make_unique<std::vector<std::shared_ptr<RentalInfo>>>();
+
+        borrowers = std::make_shared<BorrowerRegistry>(this->stringPool);
+
+        delayedRentals = std::make_unique<DelayedRentalQueue>();
+
+        history = std::make_unique<RentalHistory>(borrowers);
+    }
+
+    // 대여/반납하고 결과를 돌려줌. 성공하면 rentalInfo에 대여정보를 채움
+    RentalStatus rentById(int bookId, RentalDTO rentalDTO,
+        BookManager& bookManager,
+        std::shared_ptr<RentalInfo>* rentalInfo = nullptr);
+    RentalStatus rentByTitle(std::string_view title, RentalDTO rentalDTO,
+        BookManager& bookManager,
+        std::shared_ptr<RentalInfo>* rentalInfo = nullptr);
+    RentalStatus returnById(int bookId, BookManager& bookManager);
+    // 등록된 대여자로 대여. 대여자 확인과 한도 검사에 문자열을 쓰지 않음
+    RentalStatus rentById(int bookId, BorrowerId borrowerId,
+        DateStruct returnDate, BookManager& bookManager,
+        std::shared_ptr<RentalInfo>* rentalInfo = nullptr);
+    RentalStatus rentByTitle(std::string_view title, BorrowerId borrowerId,
+        DateStruct returnDate, BookManager& bookManager,
+        std::shared_ptr<RentalInfo>* rentalInfo = nullptr);
+
+    // 대여자 표. RentalDTO로 빌리면 책을 차지할 수 있을 때 이름과 전화번호로
+    // 자동 등록됨. 꽉 찼으면 nullopt
+    std::optional<BorrowerId> registerBorrower(std::string_view name,
+        std::string_view phone) {
+        return borrowers->registerBorrower(name, phone);
+    }
+    std::optional<BorrowerId> findBorrower(std::string_view name,
+        std::string_view phone) const {
+        return borrowers->find(name, phone);
+    }
+    bool hasBorrower(BorrowerId borrowerId) const {
+        return borrowers->contains(borrowerId);
+    }
+    // borrowerId는 등록된 번호여야 함
+    const Borrower& getBorrower(BorrowerId borrowerId) const {
+        return borrowers->get(borrowerId);
+    }
+    const BorrowerRegistry& getBorrowers() const {
+        return *borrowers;
+    }
+    size_t getBorrowerCount() const {
+        return borrowers->size();
+    }
+
+    // 한 사람이 동시에 빌릴 수 있는 권수. 0이면 제한 없음. 이미 빌린 책은
+    // 그대로 두고 이후의 대여에만 적용
+    void setLoanLimit(uint32_t limit) {
+        loanLimit.store(limit, std::memory_order_relaxed);
+    }
+    uint32_t getLoanLimit() const {
+        return loanLimit.load(std::memory_order_relaxed);
+    }
+    // 한 권 더 빌릴 수 있는지. O(1)
+    bool canBorrow(BorrowerId borrowerId) const;
+
+    // 여러 권을 한 번에 대여/반납하고 요청과 같은 순서로 결과를
+    // 돌려줌. 대여는 먼저 모든 항목을 검사(없는 책, 묶음 안의 같은 책,
+    // 이미 대여중인 책, 대여 한도)해 거절할 항목을 정하고, 통과한 항목만
+    // 책을 한 권씩 원자적으로 차지함. 검사한 뒤 다른 스레드가 먼저 빌린
+    // 책은 그 항목만 거절하고 묶음 전체를 되돌리지는 않음. 거절된 항목의
+    // 처음 보는 대여자는 등록하지 않음. 인덱스는 한 번의 쓰기 잠금 안에서
+    // 대여자별, 반납일별로 묶어 갱신하고 로그는 한 번만 commit.
+    // 같은 책이 두 번 있으면 뒤의 것은 ALREADY_RENTED(반납은 NOT_RENTED)
+    std::vector<RentalStatus> rentBatch(std::span<const RentalRequest> requests,
+        BookManager& bookManager);
+    std::vector<RentalStatus> returnBatch(std::span<const int> bookIds,
+        BookManager& bookManager);
+
+    // 이후의 대여/반납을 로그에 기록
+    void attachLog(std::shared_ptr<MutationLog> log) {
+        mutationLog = std::move(log);
+    }
+    // 이후의 대여/반납 결과를 이벤트 로그에 남김
+    void attachEventLog(std::shared_ptr<EventLog> log) {
+        eventLog = std::move(log);
+    }
+
+    // 되살린 대여를 저장된 대여일과 반납일 그대로 넣음. 대여 한도와 이벤트,
+    // 변경 로그 없이 책을 차지하고 인덱스를 한 번의 쓰기 잠금 안에서 채움.
+    // 반납일, 책번호 순으로 주면 정렬을 건너뜀. 없는 대여자나 책, 이미
+    // 대여중인 책이 있으면 그 대여만 빼고 false
+    bool restoreRentals(std::span<const RestoredRental> restored,
+        BookManager& bookManager);
+    // 스냅샷의 대여정보를 restoreRentals로 되살림. bookManager가 같은
+    // 스냅샷을 먼저 불러와 있어야 함. 하나라도 실패하면 false
+    bool loadSnapshot(const CatalogSnapshot& snapshot, BookManager& bookManager);
+    std::vector<std::shared_ptr<RentalInfo>> getAllRentals();
+    // 이름이 같은 대여자가 여럿이면 등록 순으로 이어 붙임
+    std::vector<std::shared_ptr<RentalInfo>> getRentalsByBorrower(
+        std::string_view borrower);
+    // O(대여 수). 문자열 조회 없음
+    std::vector<std::shared_ptr<RentalInfo>> getRentalsByBorrower(
+        BorrowerId borrowerId);
+    std::vector<std::shared_ptr<RentalInfo>>
+        getDelayedRentalsByReturnDate(DateStruct returnDate);
+    size_t getRentalCount() const;
+    // 대여 수, 대여자 색인과 연체 달력 큐의 크기, 칸 수, 부하율, 대여 기록 수
+    void appendGauges(std::vector<MetricGauge>& gauges) const;
+
+    // 대여일과 반납 처리일로 쓰는 오늘. 정하지 않으면 시스템 시계의 오늘
+    void setCurrentDate(DateStruct date) {
+        currentDay.store(date.dayNumber, std::memory_order_relaxed);
+    }
+    DateStruct getCurrentDate() const;
+
+    // 반납까지 끝난 대여의 기록. 대여일이 from~to(포함)인 것만 집계함.
+    // 로그와 스냅샷에는 들어가지 않으므로 남기려면 saveHistory를 씀
+    const RentalHistory& getHistory() const {
+        return *history;
+    }
+    RentalHistory& getHistory() {
+        return *history;
+    }
+    // 가장 많이 대여된 제목 count개. 대여 수가 같으면 제목 순
+    std::vector<HistoryGroup> getTopTitles(DateStruct from, DateStruct to,
+        size_t count, const BookManager& bookManager) const;
+    // 작가별 대여 수와 평균 대여 일수. 대여 수가 많은 순
+    std::vector<HistoryGroup> getLoanDaysByAuthor(DateStruct from,
+        DateStruct to, const BookManager& bookManager) const;
+    // minRentals번 이상 대여한 대여자. 대여 수가 많은 순
+    std::vector<HistoryGroup> getRepeatBorrowers(DateStruct from, DateStruct to,
+        uint64_t minRentals) const;
+    // from부터 하루에 한 칸씩 그날 대여한 수
+    std::vector<uint64_t> getRentalsPerDay(DateStruct from,
+        DateStruct to) const;
+    bool saveHistory(const std::string& path) const {
+        return history->save(path);
+    }
+    bool loadHistory(const std::string& path) {
+        return history->load(path);
+    }
+
+    // returnDate(포함)까지 반납해야 하는 대여 수. 기준일이 연체 큐의 창
+    // 안(오늘 앞뒤 몇 년)이면 O(log 창 크기)
+    size_t countDelayedRentals(DateStruct returnDate) const;
+    // 연체 목록을 pageSize개씩 읽음. 처음에는 after를 기본값으로 두고,
+    // 다음부터는 앞 페이지의 next를 넘김. 페이지 사이에 대여/반납이 있어도
+    // 같은 대여정보를 두 번 돌려주지 않음
+    DelayedRentalPage getDelayedRentalPage(DateStruct returnDate,
+        DelayedRentalCursor after, size_t pageSize) const;
+    // 전체 대여 목록을 pageSize개씩 읽음. 책번호 순은 bookManager의
+    // 대여 칸을, 반납일 순은 연체 달력 큐를 따라가므로 대여 수와 상관없이
+    // 페이지 크기만큼만 복사함
+    RentalPage getRentalPage(const RentalCursor& after, size_t pageSize,
+        const BookManager& bookManager) const;
+
+    // 복사 없이 내부 목록을 그대로 보여줌. 대여/반납이 일어나면 무효라
+    // 다른 스레드가 대여/반납할 수 있을 때는 forEach 함수를 사용
+    std::span<const std::shared_ptr<RentalInfo>> viewAllRentals() const;
+    std::span<const std::shared_ptr<RentalInfo>>
+        viewRentalsByBorrower(BorrowerId borrowerId) const;
+
+    // 순회하는 동안 읽기 잠금을 잡으므로 visitor 안에서 대여/반납하면 안 됨.
+    // visitor는 const RentalInfo&를 받음
+    template <typename Visitor>
+    void forEachRental(Visitor&& visitor) const {
+        std::shared_lock lock(rentalMutex);
+        for (auto& rental : *rentals) {
+            visitor(*rental);
+        }
+    }
+
+    // 이름이 같은 대여자가 여럿이면 등록 순으로 모두 순회
+    template <typename Visitor>
+    void forEachRentalByBorrower(std::string_view borrower,
+        Visitor&& visitor) const {
+        OperationTimer timer(EngineOperation::FIND_BY_BORROWER);
+        std::shared_lock lock(rentalMutex);
+        borrowers->forEachByName(borrower, [&](BorrowerId borrowerId) {
+            for (auto& rental : borrowers->get(borrowerId).rentals) {
+                visitor(*rental);
+            }
+        });
+    }
+
+    template <typename Visitor>
+    void forEachRentalByBorrower(BorrowerId borrowerId,
+        Visitor&& visitor) const {
+        OperationTimer timer(EngineOperation::FIND_BY_BORROWER);
+        if (!borrowers->contains(borrowerId)) {
+            return;
+        }
+        std::shared_lock lock(rentalMutex);
+        for (auto& rental : borrowers->get(borrowerId).rentals) {
+            visitor(*rental);
+        }
+    }
+
+    // returnDate 이전(포함)에 반납해야 하는 대여정보를 반납일, 책번호 순으로
+    // 순회
+    template <typename Visitor>
+    void forEachDelayedRental(DateStruct returnDate, Visitor&& visitor) const {
+        OperationTimer timer(EngineOperation::FIND_DELAYED);
+        std::shared_lock lock(rentalMutex);
+        std::lock_guard delayedLock(delayedMutex);
+        delayedRentals->forEachDueBy(returnDate,
+            [&visitor](const std::shared_ptr<RentalInfo>& rental) {
+                visitor(*rental);
+            });
+    }
+};
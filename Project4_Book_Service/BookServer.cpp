@@ -0,0 +1,415 @@
+#include "BookServer.h"
+
+using namespace std;
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+struct BookServer::Connection {
+    int fd;
+    string input;
+    string output;
+    // output에서 이미 보낸 바이트 수
+    size_t sentBytes = 0;
+    size_t lineNumber = 0;
+    uint32_t events = 0;
+    // 이번에 깨어난 뒤 응답을 보내야 하는 목록에 들어 있음
+    bool isTouched = false;
+    // 상대가 닫았거나 오류가 나서 남은 응답만 보내고 닫음
+    bool isClosing = false;
+
+    size_t getPendingOutput() const {
+        return output.size() - sentBytes;
+    }
+};
+
+class BookServer::EventLoop {
+private:
+    static constexpr int MAX_EVENTS = 256;
+    static constexpr size_t READ_SIZE = 1 << 16;
+
+    BookServer& server;
+    int epollFd;
+    CommandExecutor executor;
+    unordered_map<int, unique_ptr<Connection>> connections;
+    vector<Connection*> touched;
+    bool hasMutations = false;
+
+    void acceptConnections();
+    void readRequests(Connection& connection);
+    void executeLines(Connection& connection);
+    void flush(Connection& connection);
+    void updateEvents(Connection& connection);
+    void close(Connection& connection);
+
+    void touch(Connection& connection) {
+        if (!connection.isTouched) {
+            connection.isTouched = true;
+            touched.push_back(&connection);
+        }
+    }
+
+public:
+    explicit EventLoop(BookServer& server)
+        : server{ server }, epollFd{ epoll_create1(EPOLL_CLOEXEC) },
+        executor(server.bookManager, server.rentalManager) {
+    }
+
+    ~EventLoop() {
+        for (auto& [fd, connection] : connections) {
+            ::close(fd);
+            server.openConnections--;
+        }
+        ::close(epollFd);
+    }
+
+    void run();
+};
+
+void BookServer::EventLoop::run() {
+    // 듣기 소켓은 여러 루프 중 하나만 깨우고, 멈춤 신호는 모두 깨움
+    epoll_event listenEvent{};
+    listenEvent.events = EPOLLIN | EPOLLEXCLUSIVE;
+    listenEvent.data.ptr = nullptr;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, server.listenFd, &listenEvent);
+    epoll_event stopEvent{};
+    stopEvent.events = EPOLLIN;
+    stopEvent.data.ptr = &server;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, server.stopFd, &stopEvent);
+
+    epoll_event events[MAX_EVENTS];
+    bool isStopping = false;
+    while (!isStopping) {
+        int count = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        {
+            // 이번에 읽은 요청의 변경은 아래에서 한 번에 디스크에 내림
+            MutationLog::DeferredCommits deferredCommits;
+            for (int i = 0; i < count; i++) {
+                void* target = events[i].data.ptr;
+                if (target == nullptr) {
+                    acceptConnections();
+                    continue;
+                }
+                if (target == &server) {
+                    isStopping = true;
+                    continue;
+                }
+
+                auto& connection = *static_cast<Connection*>(target);
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    readRequests(connection);
+                }
+                touch(connection);
+            }
+        }
+
+        if (hasMutations && server.mutationLog) {
+            server.mutationLog->waitCommitted(
+                server.mutationLog->requestCommit());
+        }
+        hasMutations = false;
+
+        for (Connection* connection : touched) {
+            connection->isTouched = false;
+            flush(*connection);
+        }
+        touched.clear();
+    }
+}
+
+void BookServer::EventLoop::acceptConnections() {
+    while (true) {
+        int fd = accept4(server.listenFd, nullptr, nullptr,
+            SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        int isNoDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &isNoDelay, sizeof(isNoDelay));
+
+        auto connection = make_unique<Connection>();
+        connection->fd = fd;
+        connection->events = EPOLLIN;
+        epoll_event event{};
+        event.events = connection->events;
+        event.data.ptr = connection.get();
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+        connections.emplace(fd, move(connection));
+        server.acceptedConnections++;
+        server.openConnections++;
+    }
+}
+
+void BookServer::EventLoop::readRequests(Connection& connection) {
+    while (!connection.isClosing
+        && connection.getPendingOutput() < MAX_PENDING_OUTPUT) {
+        size_t filled = connection.input.size();
+        connection.input.resize(filled + READ_SIZE);
+        ssize_t received = recv(connection.fd, connection.input.data() + filled,
+            READ_SIZE, 0);
+        connection.input.resize(filled + max<ssize_t>(received, 0));
+        if (received == 0 || (received < 0 && errno != EAGAIN
+            && errno != EWOULDBLOCK && errno != EINTR)) {
+            connection.isClosing = true;
+        }
+        else if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        executeLines(connection);
+    }
+}
+
+void BookServer::EventLoop::executeLines(Connection& connection) {
+    string_view input = connection.input;
+    size_t pos = 0;
+    size_t executed = 0;
+    bool isChanged = false;
+    while (true) {
+        size_t newline = input.find('\n', pos);
+        if (newline == string_view::npos) {
+            break;
+        }
+        string_view line = input.substr(pos, newline - pos);
+        pos = newline + 1;
+        connection.lineNumber++;
+
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (line.empty() || line.front() == '#') {
+            continue;
+        }
+        isChanged |=
+            executor.execute(line, connection.lineNumber, connection.output);
+        executed++;
+    }
+    connection.input.erase(0, pos);
+
+    if (connection.input.size() > MAX_LINE_SIZE) {
+        CommandExecutor::appendResult(connection.output,
+            connection.lineNumber + 1, false, "LINE_TOO_LONG");
+        connection.input.clear();
+        connection.isClosing = true;
+    }
+    // 읽기만 한 요청은 로그가 디스크에 내려가기를 기다릴 필요가 없음
+    hasMutations |= isChanged;
+    server.requests += executed;
+}
+
+void BookServer::EventLoop::flush(Connection& connection) {
+    while (connection.getPendingOutput() > 0) {
+        ssize_t sent = send(connection.fd,
+            connection.output.data() + connection.sentBytes,
+            connection.getPendingOutput(), MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                close(connection);
+                return;
+            }
+            break;
+        }
+        connection.sentBytes += static_cast<size_t>(sent);
+    }
+    if (connection.getPendingOutput() == 0) {
+        connection.output.clear();
+        connection.sentBytes = 0;
+        if (connection.isClosing) {
+            close(connection);
+            return;
+        }
+    }
+    updateEvents(connection);
+}
+
+// 보낼 응답이 남았으면 쓸 수 있을 때 깨우고, 응답이 너무 쌓였으면 읽지 않음
+void BookServer::EventLoop::updateEvents(Connection& connection) {
+    uint32_t events = 0;
+    if (!connection.isClosing
+        && connection.getPendingOutput() < MAX_PENDING_OUTPUT) {
+        events |= EPOLLIN;
+    }
+    if (connection.getPendingOutput() > 0) {
+        events |= EPOLLOUT;
+    }
+    if (events == connection.events) {
+        return;
+    }
+    connection.events = events;
+    epoll_event event{};
+    event.events = events;
+    event.data.ptr = &connection;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+}
+
+void BookServer::EventLoop::close(Connection& connection) {
+    int fd = connection.fd;
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    ::close(fd);
+    connections.erase(fd);
+    server.openConnections--;
+}
+
+BookServer::BookServer(BookManager& bookManager, RentalManager& rentalManager,
+    shared_ptr<MutationLog> mutationLog)
+    : bookManager{ bookManager }, rentalManager{ rentalManager },
+    mutationLog{ move(mutationLog) } {
+    stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+BookServer::~BookServer() {
+    if (listenFd >= 0) {
+        ::close(listenFd);
+    }
+    if (!unixSocketPath.empty()) {
+        unlink(unixSocketPath.c_str());
+    }
+    if (stopFd >= 0) {
+        ::close(stopFd);
+    }
+}
+
+bool BookServer::listen(const string& address, string& error) {
+    constexpr int BACKLOG = 4096;
+
+    if (address.starts_with("unix:")) {
+        sockaddr_un socketAddress{};
+        socketAddress.sun_family = AF_UNIX;
+        string path = address.substr(5);
+        if (path.empty() || path.size() >= sizeof(socketAddress.sun_path)) {
+            error = "잘못된 소켓 경로: " + path;
+            return false;
+        }
+        memcpy(socketAddress.sun_path, path.c_str(), path.size() + 1);
+        // 지난번에 남은 소켓 파일은 지우고 다시 만듦
+        unlink(path.c_str());
+
+        listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listenFd < 0 || bind(listenFd,
+            reinterpret_cast<sockaddr*>(&socketAddress), sizeof(socketAddress)) != 0
+            || ::listen(listenFd, BACKLOG) != 0) {
+            error = "소켓을 열 수 없음: " + string(strerror(errno));
+            return false;
+        }
+        unixSocketPath = path;
+        return true;
+    }
+
+    size_t colon = address.rfind(':');
+    if (colon == string::npos) {
+        error = "주소는 호스트:포트 또는 unix:경로: " + address;
+        return false;
+    }
+    string host = address.substr(0, colon);
+    string service = address.substr(colon + 1);
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo* results = nullptr;
+    int status = getaddrinfo(host.empty() ? nullptr : host.c_str(),
+        service.c_str(), &hints, &results);
+    if (status != 0) {
+        error = "주소를 찾을 수 없음: " + string(gai_strerror(status));
+        return false;
+    }
+
+    for (addrinfo* result = results; result; result = result->ai_next) {
+        listenFd = socket(result->ai_family,
+            result->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, result->ai_protocol);
+        if (listenFd < 0) {
+            continue;
+        }
+        int isReusable = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &isReusable,
+            sizeof(isReusable));
+        if (bind(listenFd, result->ai_addr, result->ai_addrlen) == 0
+            && ::listen(listenFd, BACKLOG) == 0) {
+            break;
+        }
+        ::close(listenFd);
+        listenFd = -1;
+    }
+    freeaddrinfo(results);
+    if (listenFd < 0) {
+        error = "포트를 열 수 없음: " + string(strerror(errno));
+        return false;
+    }
+
+    sockaddr_storage bound{};
+    socklen_t boundSize = sizeof(bound);
+    getsockname(listenFd, reinterpret_cast<sockaddr*>(&bound), &boundSize);
+    port = ntohs(bound.ss_family == AF_INET6
+        ? reinterpret_cast<sockaddr_in6*>(&bound)->sin6_port
+        : reinterpret_cast<sockaddr_in*>(&bound)->sin_port);
+    return true;
+}
+
+void BookServer::runLoop() {
+    EventLoop(*this).run();
+}
+
+void BookServer::run(int threadCount) {
+    vector<thread> loops;
+    for (int i = 1; i < threadCount; i++) {
+        loops.emplace_back(&BookServer::runLoop, this);
+    }
+    runLoop();
+    for (auto& loop : loops) {
+        loop.join();
+    }
+}
+
+void BookServer::stop() {
+    uint64_t value = 1;
+    ssize_t written = write(stopFd, &value, sizeof(value));
+    (void)written;
+}
+
+#else
+
+BookServer::BookServer(BookManager& bookManager, RentalManager& rentalManager,
+    shared_ptr<MutationLog> mutationLog)
+    : bookManager{ bookManager }, rentalManager{ rentalManager },
+    mutationLog{ move(mutationLog) } {
+}
+
+BookServer::~BookServer() {
+}
+
+bool BookServer::listen(const string&, string& error) {
+    error = "이 플랫폼에서는 서버를 지원하지 않음";
+    return false;
+}
+
+void BookServer::runLoop() {
+}
+
+void BookServer::run(int) {
+}
+
+void BookServer::stop() {
+}
+
+#endif
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "BookCommand.h"
+
+struct ServerStats {
+    size_t acceptedConnections;
+    size_t openConnections;
+    size_t requests;
+};
+
+// CommandExecutor의 명령을 TCP나 Unix 소켓으로 받는 서버. 요청과 응답은
+// 한 줄씩이고, 한 연결에서 응답을 기다리지 않고 요청을 여러 개 보내도
+// 보낸 순서대로 응답함. 줄 번호는 연결마다 1부터 셈.
+// 스레드마다 non-blocking epoll 이벤트 루프 하나를 돌림. 로그가 있으면
+// 한 번 깨어날 때 처리한 모든 연결의 변경을 한 번에 디스크에 내린 뒤 응답함.
+// Linux에서만 동작
+class BookServer {
+private:
+    struct Connection;
+    class EventLoop;
+
+    static constexpr size_t MAX_LINE_SIZE = 1 << 16;
+    // 보내지 못한 응답이 이보다 많으면 그 연결은 더 읽지 않음
+    static constexpr size_t MAX_PENDING_OUTPUT = 1 << 20;
+
+    BookManager& bookManager;
+    RentalManager& rentalManager;
+    std::shared_ptr<MutationLog> mutationLog;
+
+    int listenFd = -1;
+    int stopFd = -1;
+    int port = 0;
+    std::string unixSocketPath;
+
+    std::atomic<size_t> acceptedConnections{ 0 };
+    std::atomic<size_t> openConnections{ 0 };
+    std::atomic<size_t> requests{ 0 };
+
+    void runLoop();
+
+public:
+    BookServer(BookManager& bookManager, RentalManager& rentalManager,
+        std::shared_ptr<MutationLog> mutationLog);
+    ~BookServer();
+
+    BookServer(const BookServer&) = delete;
+    BookServer& operator=(const BookServer&) = delete;
+
+    // address는 "호스트:포트" 또는 "unix:경로". 포트가 0이면 빈 포트를 씀.
+    // 실패하면 이유를 error에 채우고 false
+    bool listen(const std::string& address, std::string& error);
+
+    int getPort() const {
+        return port;
+    }
+
+    // 이벤트 루프를 threadCount개 돌리고 stop이 불릴 때까지 기다림
+    void run(int threadCount);
+    // 다른 스레드나 시그널 처리기에서 불러도 됨
+    void stop();
+
+    ServerStats getStats() const {
+        return { acceptedConnections.load(), openConnections.load(),
+            requests.load() };
+    }
+};
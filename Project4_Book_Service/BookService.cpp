@@ -1,437 +1,8 @@
-#include <iostream>
-#include <iterator>
-#include <map>
-#include <unordered_map>
-#include <memory>
-#include <sstream>
-#include <string>
-#include <vector>
-#include <algorithm>
+#include "BookServer.h"
 
-using namespace std;
-
-class RentalInfo;
-class Book;
-
-struct DateStruct {
-    int year, month, day;
-
-    DateStruct(int year, int month, int day)
-        : year{ year }, month{ month }, day{ day } {
-    }
-
-    string getDateString() const {
-        return to_string(year) + "-" +
-            (month < 10 ? "0" + to_string(month) : to_string(month)) + "-" +
-            (day < 10 ? "0" + to_string(day) : to_string(day));
-    }
-
-    bool operator<(const DateStruct& date) const {
-        if (year != date.year) {
-            return year < date.year;
-        }
-        else if (month < date.month) {
-            return month < date.month;
-        }
-        else {
-            return day < date.day;
-        }
-    }
-
-    bool operator==(const DateStruct& date) const {
-        return year == date.year && month == date.month && day == date.day;
-    }
-};
-
-struct RentalDTO {
-    string borrower;
-    string phone;
-    DateStruct date;
-
-    RentalDTO(string borrower, string phone, DateStruct date)
-        : borrower{ borrower }, phone{ phone }, date(date) {
-    };
-};
-
-class Idisplayable {
-public:
-    virtual ~Idisplayable() = default;
-    virtual void displaySelf() const = 0;
-};
-
-class Book : public Idisplayable {
-private:
-    int id;
-    string title;
-    string author;
-
-public:
-    shared_ptr<RentalInfo> rentalInfo;
-
-    Book(int id, string title, string author)
-        : id{ id }, title{ title }, author{ author }, rentalInfo{ nullptr } {
-        cout << "생성됨. 책번호: " << id << endl;
-    }
-
-    ~Book() {
-        cout << "소멸함, 책번호:" << id << endl;
-    }
-    int getId() const {
-        return id;
-    }
-    string getTitle() const {
-        return title;
-    }
-    string getAuthor() const {
-        return author;
-    }
-    void displaySelf() const override;
-};
-
-class RentalInfo : public Idisplayable {
-private:
-    string borrower;
-    string phone;
-    DateStruct returnDate;
-
-public:
-    weak_ptr<Book> book;
-    RentalInfo(shared_ptr<Book> book, RentalDTO rentalDTO)
-        : borrower{ rentalDTO.borrower }, phone{ rentalDTO.phone },
-        returnDate(rentalDTO.date), book(book) {
-    }
-
-    string getBorrower() const {
-        return borrower;
-    }
-
-    DateStruct getReturnDate() const {
-        return returnDate;
-    }
-
-    void displaySelf() const override;
-};
-
-void Book::displaySelf() const {
-    string dateString =
-        rentalInfo
-        ? "대여중\n반납일: " + rentalInfo->getReturnDate().getDateString()
-        : "대여가능";
-
-    cout << "-----책정보-----" << endl;
-    cout << "번호: " << id << endl;
-    cout << "제목: " << title << endl;
-    cout << "작가: " << author << endl;
-    cout << "상태: " << dateString << endl;
-    cout << endl;
-}
-
-void RentalInfo::displaySelf() const {
-    auto lockedBook = book.lock();
-
-    cout << "-----대여정보-----" << endl;
-    cout << "책 제목: " << lockedBook->getTitle() << endl;
-    cout << "빌린사람: " << borrower << endl;
-    cout << "전화번호: " << phone << endl;
-    cout << "반납일: " << returnDate.getDateString() << endl;
-    cout << endl;
-}
-
-class BookManager {
-private:
-    unique_ptr<vector<shared_ptr<Book>>> books;
-    unique_ptr<unordered_map<int, shared_ptr<Book>>> idIndex;
-    unique_ptr<unordered_map<string, vector<shared_ptr<Book>>>> titleIndex;
-    unique_ptr<unordered_map<string, vector<shared_ptr<Book>>>> authorIndex;
-    void sortBooksById();
-
-public:
-    BookManager() {
-        books = make_unique<vector<shared_ptr<Book>>>();
-        idIndex = make_unique<unordered_map<int, shared_ptr<Book>>>();
-        titleIndex =
-            make_unique<unordered_map<string, vector<shared_ptr<Book>>>>();
-        authorIndex =
-            make_unique<unordered_map<string, vector<shared_ptr<Book>>>>();
-    }
-
-    void addBook(string title, string author);
-    vector<shared_ptr<Book>> getAllBooks();
-    vector<shared_ptr<Book>> getBooksByTitle(string title);
-    vector<shared_ptr<Book>> getBooksByAuthor(string author);
-    shared_ptr<Book> getBookById(int id);
-};
-
-class RentalManager {
-private:
-    unique_ptr<vector<shared_ptr<RentalInfo>>> rentals;
-    unique_ptr<unordered_map<string, vector<shared_ptr<RentalInfo>>>>
-        borrowerIndex;
-    unique_ptr<multimap<DateStruct, shared_ptr<RentalInfo>>> returnDateIndex;
-    void rentalBook(shared_ptr<Book> book, RentalDTO rentalDTO);
-    void returnBook(shared_ptr<Book> book);
-
-public:
-    RentalManager() {
-        rentals = make_unique<vector<shared_ptr<RentalInfo>>>();
-
-        borrowerIndex = make_unique<
-            unordered_map<string, vector<shared_ptr<RentalInfo>>>>();
-
-        returnDateIndex =
-            make_unique<multimap<DateStruct, shared_ptr<RentalInfo>>>();
-    }
-
-    void returnBookById(int bookId, BookManager& bookManager);
-    void rentalBookById(int bookId, RentalDTO rentalDTO,
-        BookManager& bookManager);
-    void rentalBookByTitle(string title, RentalDTO rentalDTO,
-        BookManager& bookManager);
-    vector<shared_ptr<RentalInfo>> getAllRentals();
-    vector<shared_ptr<RentalInfo>> getRentalsByBorrower(string borrower);
-    vector<shared_ptr<RentalInfo>>
-        getDelayedRentalsByReturnDate(DateStruct returnDate);
-};
-
-void BookManager::sortBooksById() {
-    sort(books->begin(), books->end(), [](auto b1, auto b2) -> bool {
-        int b1Id = b1->getId();
-        int b2Id = b2->getId();
-        return b1Id < b2Id;
-        });
-}
-
-void BookManager::addBook(string title, string author) {
-    // 안해도 유지될거 같긴 한데..
-    // sortBooksById();
-    int newId = 1;
-    if (books->size() > 0) {
-        newId = books->back()->getId() + 1;
-    }
-
-    // Book 생성
-    shared_ptr<Book> newBook = make_shared<Book>(newId, title, author);
-
-    // idIndex에 추가
-    auto idIndexIt = idIndex->find(newId);
-
-    if (idIndexIt != idIndex->end()) {
-        cout << "이미 등록된 책입니다." << endl;
-        return;
-    }
-    else {
-
-        idIndex->insert({ newId, newBook });
-    }
-
-    // books에 추가
-    books->push_back(newBook);
-
-    // titleIndex에 추가
-    auto titleIndexIt = titleIndex->find(title);
-    if (titleIndexIt != titleIndex->end()) {
-        titleIndexIt->second.push_back(newBook);
-    }
-    else {
-        titleIndex->insert({ title, {newBook} });
-    }
-
-    // authorIndex에 추가
-    auto authorIndexIt = authorIndex->find(author);
-    if (authorIndexIt != authorIndex->end()) {
-        authorIndexIt->second.push_back(newBook);
-    }
-    else {
-        authorIndex->insert({ author, {newBook} });
-    }
-
-    cout << "----책 추가 완료, 아래는 추가된 책----" << endl;
-    newBook->displaySelf();
-}
-
-vector<shared_ptr<Book>> BookManager::getAllBooks() {
-    vector<shared_ptr<Book>> result(*books);
-    return result;
-}
-
-vector<shared_ptr<Book>> BookManager::getBooksByTitle(string title) {
-    auto result = vector<shared_ptr<Book>>();
-
-    auto targetIt = titleIndex->find(title);
-    if (targetIt != titleIndex->end()) {
-        for (auto book : targetIt->second) {
-            result.push_back(book);
-        }
-    }
-
-    return result;
-}
-
-vector<shared_ptr<Book>> BookManager::getBooksByAuthor(string author) {
-    vector<shared_ptr<Book>> result;
-
-    auto targetIt = authorIndex->find(author);
-    if (targetIt != titleIndex->end()) {
-        for (auto book : targetIt->second) {
-            result.push_back(book);
-        }
-    }
-
-    return result;
-}
-
-shared_ptr<Book> BookManager::getBookById(int id) {
-    auto targetIt = idIndex->find(id);
-
-    if (targetIt != idIndex->end()) {
-        return targetIt->second;
-    }
-    return nullptr;
-}
-
-void RentalManager::rentalBook(shared_ptr<Book> book, RentalDTO rentalDTO) {
-    auto [borrower, phone, returnDate] = rentalDTO;
-    auto newRentalInfo = make_shared<RentalInfo>(book, rentalDTO);
-    book->rentalInfo = newRentalInfo;
-
-    // rentals에 추가
-    rentals->push_back(newRentalInfo);
-
-    // borrowerIndex에 추가
-    auto borrowerIndexIt = borrowerIndex->find(borrower);
-    if (borrowerIndexIt != borrowerIndex->end()) {
-        borrowerIndexIt->second.push_back(newRentalInfo);
-    }
-    else {
-        borrowerIndex->insert({ borrower, {newRentalInfo} });
-    }
-
-    // returnDateIndex에 추가
-    returnDateIndex->insert({ returnDate, newRentalInfo });
-
-    cout << "----대여완료, 대여정보 출력----" << endl;
-    newRentalInfo->displaySelf();
-}
-
-void RentalManager::returnBook(shared_ptr<Book> book) {
-    auto targetRental = book->rentalInfo;
-    string targetBorrower = targetRental->getBorrower();
-    DateStruct targetReturnDate = targetRental->getReturnDate();
-
-    // rentals 에서 제거
-    rentals->erase(remove(rentals->begin(), rentals->end(), targetRental),
-        rentals->end());
-
-    // borrowerIndex에서 제거
-    auto& targetVector = borrowerIndex->at(targetBorrower);
-    targetVector.erase(
-        remove(targetVector.begin(), targetVector.end(), targetRental),
-        targetVector.end());
-
-    // returnDateIndex에서 제거
-    auto [targetBeginIt, targetEndIt] =
-        returnDateIndex->equal_range(targetReturnDate);
-    vector<shared_ptr<RentalInfo>> backupVector;
-    for (auto it = targetBeginIt; it != targetEndIt; it++) {
-        auto backupRentalInfo = it->second;
-        if (targetRental != backupRentalInfo) {
-            backupVector.push_back(it->second);
-        }
-    }
-    returnDateIndex->erase(targetReturnDate);
-    for (auto el : backupVector) {
-        returnDateIndex->insert({ targetReturnDate, el });
-    }
-
-    // book -> rentalInfo 참조 해제
-    book->rentalInfo = nullptr;
-
-    cout << "반납 완료." << endl;
-}
-
-void RentalManager::returnBookById(int bookId, BookManager& bookManager) {
-    auto targetBook = bookManager.getBookById(bookId);
-    if (!targetBook) {
-        cout << "없는 책번호" << endl;
-        return;
-    }
-
-    if (targetBook->rentalInfo) {
-        returnBook(targetBook);
-        return;
-    }
-
-    cout << "대여되지 않은 책" << endl;
-}
-
-void RentalManager::rentalBookById(int bookId, RentalDTO rentalDTO,
-    BookManager& bookManager) {
-    auto targetBook = bookManager.getBookById(bookId);
-    if (!targetBook) {
-        cout << "없는 책번호" << endl;
-        return;
-    }
-
-    if (!targetBook->rentalInfo) {
-        rentalBook(targetBook, rentalDTO);
-        return;
-    }
-
-    cout << "이미 대여된 책" << endl;
-}
-
-void RentalManager::rentalBookByTitle(string title, RentalDTO rentalDTO,
-    BookManager& bookManager) {
-    auto targetBooks = bookManager.getBooksByTitle(title);
-
-    for (auto book : targetBooks) {
-        if (!book->rentalInfo) {
-            rentalBook(book, rentalDTO);
-            return;
-        }
-    }
-    cout << "모두 대여중이거나 없는 책" << endl;
-}
-
-vector<shared_ptr<RentalInfo>> RentalManager::getAllRentals() {
-    vector<shared_ptr<RentalInfo>> result;
-    for (int i = 0; i < rentals->size(); i++) {
-        result.push_back(rentals->at(i));
-    }
-    return result;
-}
-
-vector<shared_ptr<RentalInfo>>
-RentalManager::getRentalsByBorrower(string borrower) {
-    vector<shared_ptr<RentalInfo>> result;
-    auto borrowerIndexIt = borrowerIndex->find(borrower);
-    if (borrowerIndexIt != borrowerIndex->end()) {
-        for (auto rentalInfo : borrowerIndexIt->second) {
-            result.push_back(rentalInfo);
-        }
-    }
-    else {
-        cout << "이 사람은 대여중이지 않음." << endl;
-    }
-
-    return result;
-}
-
-vector<shared_ptr<RentalInfo>>
-RentalManager::getDelayedRentalsByReturnDate(DateStruct returnDate) {
-    vector<shared_ptr<RentalInfo>> result;
-    auto upperBoundIt = returnDateIndex->upper_bound(returnDate);
+#include <csignal>
 
-    for (auto it = returnDateIndex->begin(); it != upperBoundIt; it++) {
-        result.push_back(it->second);
-    }
-
-    if (result.empty()) {
-        cout << "이 날짜 이전 날짜로 반납해야 되는 책이 없음." << endl;
-    }
-
-    return result;
-}
+using namespace std;
 
 class BookService {
 private:
@@ -441,17 +12,22 @@ private:
         RETURN,
         RENTAL_INFO_SEARCH,
         ADD_BOOK,
-        PROGRAM_END
+        PROGRAM_END,
+        METRICS,
+        HISTORY_REPORT
     };
-    enum BookSearchMode { ALL_BOOKS = 1, TITLE, AUTHOR };
+    enum BookSearchMode { ALL_BOOKS = 1, TITLE, AUTHOR, KEYWORD };
     enum RentalSearchMode { ALL_RENTALS = 1, BORROWER, RETURN_DATE };
 
     BookManager& bookManager;
     RentalManager& rentalManager;
     unique_ptr<vector<shared_ptr<Idisplayable>>> displayables;
+    // 목록 출력은 모두 이 버퍼에 모았다가 한 번에 내보냄
+    Renderer renderer;
 
     int getInputInteger(int min, int max);
     string getInputString();
+    DateStruct getInputDate();
 
     void initBuffer() {
         displayables->clear();
@@ -462,6 +38,7 @@ private:
     void displayBookSerachAllBooks();
     void displayBookSearchTitle();
     void displayBookSearchAuthor();
+    void displayBookSearchKeyword();
     void displayRent();
     void displayReturn();
     void displayRentalSearchMode();
@@ -469,6 +46,8 @@ private:
     void displayRentalSearchBorrower();
     void displayRentalSearchReturnDate();
     void displayAddBook();
+    void displayMetrics();
+    void displayHistoryReport();
 
 public:
     BookService(BookManager& bookManager, RentalManager& rentalManager)
@@ -477,12 +56,17 @@ public:
     };
 
     void displayAllBuffer() {
-        for (auto displayable : *displayables) {
-            displayable->displaySelf();
+        for (auto& displayable : *displayables) {
+            displayable->renderTo(renderer);
         }
+        renderer.flush();
         initBuffer();
     }
 
+    void setRenderFormat(RenderFormat format) {
+        renderer.setFormat(format);
+    }
+
     void setToDisplay(shared_ptr<Idisplayable> displayable) {
         displayables->push_back(displayable);
     }
@@ -490,6 +74,27 @@ public:
     void route();
 };
 
+// 한 권을 등록하고 추가된 책을 출력
+void addBookAndPrint(BookManager& bookManager, string_view title,
+    string_view author) {
+    int newId = bookManager.registerBook(title, author);
+    cout << "생성됨. 책번호: " << newId << endl;
+
+    cout << "----책 추가 완료, 아래는 추가된 책----" << endl;
+    bookManager.getBookById(newId)->displaySelf();
+}
+
+// 대여에 성공하면 대여정보를, 실패하면 이유를 출력
+void printRentalReceipt(RentalStatus status,
+    const shared_ptr<RentalInfo>& rentalInfo) {
+    if (status != RentalStatus::SUCCESS) {
+        cout << getRentalStatusMessage(status) << endl;
+        return;
+    }
+    cout << "----대여완료, 대여정보 출력----" << endl;
+    rentalInfo->displaySelf();
+}
+
 int BookService::getInputInteger(int min, int max) {
     int result;
     stringstream ss;
@@ -531,42 +136,110 @@ string BookService::getInputString() {
     return result;
 }
 
+DateStruct BookService::getInputDate() {
+    while (true) {
+        cout << "----년도 입력----" << endl;
+        int year = getInputInteger(2025, 2100);
+        cout << "----월 입력----" << endl;
+        int month = getInputInteger(1, 12);
+        cout << "----일 입력----" << endl;
+        int day = getInputInteger(1, 31);
+
+        if (DateStruct::isValid(year, month, day)) {
+            return DateStruct(year, month, day);
+        }
+        cout << "없는 날짜입니다. 다시 입력해주세요." << endl << endl;
+    }
+}
+
 void BookService::displayMainMode() {
     cout << endl;
     cout << "----무엇을 하시겠습니까?----" << endl;
     cout << "1. 도서 검색 2. 도서 대여 3. 도서 반납 4. 대여정보 검색 5. 도서 "
-        "등록 6. 나가기 "
+        "등록 6. 나가기 7. 통계 8. 대여 기록 "
         << endl;
 }
 void BookService::displayBookSearchMode() {
     cout << "----검색 방법을 선택하세요.----" << endl;
-    cout << "1. 전체 출력 2. 제목 3. 작가";
+    cout << "1. 전체 출력 2. 제목 3. 작가 4. 부분 검색";
 }
+// 페이지마다 잠금을 놓고 출력하므로 책이 많아도 메모리는 페이지 크기만큼만
+// 쓰고 첫 페이지가 바로 나옴
 void BookService::displayBookSerachAllBooks() {
-    vector<shared_ptr<Book>> books = bookManager.getAllBooks();
-    for (auto book : books) {
-        setToDisplay(book);
+    constexpr size_t PAGE_SIZE = 4096;
+
+    BookPage page{ {}, {}, true };
+    while (page.hasMore) {
+        page = bookManager.getBookPage(page.next, PAGE_SIZE);
+        for (const BookView& book : page.books) {
+            renderer.append(book);
+        }
+        renderer.flush();
     }
-    displayAllBuffer();
 }
 void BookService::displayBookSearchTitle() {
     cout << "책 제목을 입력하세요." << endl;
     string title = getInputString();
-    vector<shared_ptr<Book>> books = bookManager.getBooksByTitle(title);
-    for (auto book : books) {
-        setToDisplay(book);
-    }
-    displayAllBuffer();
+    cout << "대여 가능: " << bookManager.countAvailableBooksByTitle(title)
+        << "권 / 전체: " << bookManager.getBookIdsByTitle(title).size() << "권"
+        << endl;
+    bookManager.forEachBookByTitle(
+        title, [this](const BookView& book) { renderer.append(book); });
+    renderer.flush();
 }
 void BookService::displayBookSearchAuthor() {
     cout << "작가명을 입력하세요." << endl;
     string author = getInputString();
-    vector<shared_ptr<Book>> books = bookManager.getBooksByAuthor(author);
-    for (auto book : books) {
-        setToDisplay(book);
+    bookManager.forEachBookByAuthor(
+        author, [this](const BookView& book) { renderer.append(book); });
+    renderer.flush();
+}
+void BookService::displayBookSearchKeyword() {
+    constexpr size_t PAGE_SIZE = 10;
+
+    cout << "----검색 방식을 선택하세요.----" << endl;
+    cout << "1. 앞부분 일치 2. 포함" << endl;
+    SearchMode mode =
+        getInputInteger(1, 2) == 1 ? SearchMode::PREFIX : SearchMode::SUBSTRING;
+    cout << "제목이나 작가명의 일부를 입력하세요." << endl;
+    string query = getInputString();
+
+    for (size_t pageNumber = 0;; pageNumber++) {
+        SearchPage page =
+            bookManager.searchBooks(query, mode, nullopt, pageNumber, PAGE_SIZE);
+        if (page.totalCount == 0) {
+            cout << "검색 결과 없음." << endl;
+            return;
+        }
+
+        size_t first = pageNumber * PAGE_SIZE;
+        cout << "----검색 결과 " << page.totalCount << "건 중 " << first + 1
+            << "-" << first + page.hits.size() << "----" << endl;
+        for (auto& hit : page.hits) {
+            if (hit.field == SearchField::TITLE) {
+                cout << "[제목] " << hit.text << " - 대여 가능: "
+                    << bookManager.countAvailableBooksByTitle(hit.text)
+                    << "권 / 전체: "
+                    << bookManager.getBookIdsByTitle(hit.text).size() << "권"
+                    << endl;
+            }
+            else {
+                cout << "[작가] " << hit.text << " - "
+                    << bookManager.getBookIdsByAuthor(hit.text).size() << "권"
+                    << endl;
+            }
+        }
+
+        if (first + page.hits.size() >= page.totalCount) {
+            return;
+        }
+        cout << "1. 다음 페이지 2. 그만 보기" << endl;
+        if (getInputInteger(1, 2) == 2) {
+            return;
+        }
     }
-    displayAllBuffer();
 }
+
 void BookService::displayRent() {
     cout << "책 제목, 대여자 이름, 휴대폰 번호, 날짜를 입력하세요." << endl;
     cout << "----책 제목----" << endl;
@@ -575,62 +248,67 @@ void BookService::displayRent() {
     string borrower = getInputString();
     cout << "----휴대폰 번호----" << endl;
     string phone = getInputString();
+    DateStruct returnDate = getInputDate();
 
-    cout << "----년도 입력----" << endl;
-    int year = getInputInteger(2025, 2100);
-    cout << "----월 입력----" << endl;
-    int month = getInputInteger(1, 12);
-    cout << "----일 입력----" << endl;
-    int day = getInputInteger(1, 31);
-
-    rentalManager.rentalBookByTitle(
-        title, RentalDTO(borrower, phone, DateStruct(year, month, day)),
-        bookManager);
+    shared_ptr<RentalInfo> rentalInfo;
+    RentalStatus status = rentalManager.rentByTitle(title,
+        RentalDTO(borrower, phone, returnDate), bookManager, &rentalInfo);
+    printRentalReceipt(status, rentalInfo);
 }
 void BookService::displayReturn() {
     cout << "반납할 책 번호를 입력하세요." << endl;
-    int id = getInputInteger(1, 10000);
-    rentalManager.returnBookById(id, bookManager);
+    size_t bookCount = max<size_t>(bookManager.getBookCount(), 1);
+    int id = getInputInteger(1, static_cast<int>(
+        min<size_t>(bookCount, numeric_limits<int>::max())));
+    RentalStatus status = rentalManager.returnById(id, bookManager);
+    cout << (status == RentalStatus::SUCCESS
+        ? "반납 완료." : getRentalStatusMessage(status)) << endl;
 }
 void BookService::displayRentalSearchMode() {
     cout << "----검색 방법을 선택하세요.----" << endl;
     cout << "1. 전체 출력 2. 대여자 이름 3. 반납일" << endl;
 }
 void BookService::displayRentalSearchAllRentals() {
+    constexpr size_t PAGE_SIZE = 4096;
+
     cout << "----모든 대여정보 출력----" << endl;
-    vector<shared_ptr<RentalInfo>> rentals = rentalManager.getAllRentals();
-    for (auto rental : rentals) {
-        setToDisplay(rental);
+    RentalPage page{ {}, {}, true };
+    while (page.hasMore) {
+        page = rentalManager.getRentalPage(page.next, PAGE_SIZE, bookManager);
+        for (const auto& rental : page.rentals) {
+            renderer.append(*rental);
+        }
+        renderer.flush();
     }
-    displayAllBuffer();
 }
 void BookService::displayRentalSearchBorrower() {
     cout << "대여자 이름을 입력하세요." << endl;
     string borrower = getInputString();
-    vector<shared_ptr<RentalInfo>> rentals =
-        rentalManager.getRentalsByBorrower(borrower);
-    for (auto rental : rentals) {
-        setToDisplay(rental);
+    bool isEmpty = true;
+    rentalManager.forEachRentalByBorrower(
+        borrower, [this, &isEmpty](const RentalInfo& rental) {
+            renderer.append(rental);
+            isEmpty = false;
+        });
+    if (isEmpty) {
+        cout << "이 사람은 대여중이지 않음." << endl;
     }
-    displayAllBuffer();
+    renderer.flush();
 }
 void BookService::displayRentalSearchReturnDate() {
     cout << "기준 반납일을 입력하세요." << endl;
-    cout << "----년도 입력----" << endl;
-    int year = getInputInteger(2025, 2100);
-    cout << "----월 입력----" << endl;
-    int month = getInputInteger(1, 12);
-    cout << "----일 입력----" << endl;
-    int day = getInputInteger(1, 31);
-
-    DateStruct returnDate{ year, month, day };
+    DateStruct returnDate = getInputDate();
 
-    vector<shared_ptr<RentalInfo>> rentals{
-        rentalManager.getDelayedRentalsByReturnDate(returnDate) };
-    for (auto rental : rentals) {
-        setToDisplay(rental);
+    bool isEmpty = true;
+    rentalManager.forEachDelayedRental(
+        returnDate, [this, &isEmpty](const RentalInfo& rental) {
+            renderer.append(rental);
+            isEmpty = false;
+        });
+    renderer.flush();
+    if (isEmpty) {
+        cout << "이 날짜 이전 날짜로 반납해야 되는 책이 없음." << endl;
     }
-    displayAllBuffer();
 }
 
 void BookService::displayAddBook() {
@@ -639,7 +317,66 @@ void BookService::displayAddBook() {
     string title = getInputString();
     cout << "----작가 입력----" << endl;
     string author = getInputString();
-    bookManager.addBook(title, author);
+    addBookAndPrint(bookManager, title, author);
+}
+
+void BookService::displayMetrics() {
+    cout << "----작업별 횟수와 지연 시간----" << endl;
+    for (size_t i = 0; i < ENGINE_OPERATION_COUNT; i++) {
+        auto operation = EngineOperation(i);
+        LatencyHistogram histogram = EngineMetrics::collect(operation);
+        if (histogram.count == 0) {
+            continue;
+        }
+        cout << getEngineOperationName(operation) << ": " << histogram.count
+            << "번 (실패 " << histogram.failures << "), p50 "
+            << histogram.getPercentile(50) / 1000 << "us, p99 "
+            << histogram.getPercentile(99) / 1000 << "us, p99.9 "
+            << histogram.getPercentile(99.9) / 1000 << "us, 최대 "
+            << histogram.maxNanoseconds / 1000.0 << "us" << endl;
+    }
+
+    cout << "----색인 크기----" << endl;
+    vector<MetricGauge> gauges;
+    bookManager.appendGauges(gauges);
+    rentalManager.appendGauges(gauges);
+    for (const auto& gauge : gauges) {
+        cout << gauge.name << ": " << gauge.value << endl;
+    }
+}
+
+void BookService::displayHistoryReport() {
+    constexpr size_t TOP_COUNT = 10;
+
+    cout << "----시작일----" << endl;
+    DateStruct from = getInputDate();
+    cout << "----마지막 날----" << endl;
+    DateStruct to = getInputDate();
+
+    cout << "----많이 빌린 제목----" << endl;
+    for (const auto& title : rentalManager.getTopTitles(from, to, TOP_COUNT,
+        bookManager)) {
+        cout << title.name << ": " << title.rentals << "번" << endl;
+    }
+    cout << "----작가별 평균 대여 일수----" << endl;
+    for (const auto& author : rentalManager.getLoanDaysByAuthor(from, to,
+        bookManager)) {
+        cout << author.name << ": " << author.rentals << "번, 평균 "
+            << author.averageLoanDays << "일" << endl;
+    }
+    cout << "----두 번 이상 빌린 대여자----" << endl;
+    for (const auto& borrower : rentalManager.getRepeatBorrowers(from, to, 2)) {
+        cout << borrower.name << ": " << borrower.rentals << "번" << endl;
+    }
+    cout << "----날짜별 대여 수----" << endl;
+    auto perDay = rentalManager.getRentalsPerDay(from, to);
+    for (size_t day = 0; day < perDay.size(); day++) {
+        if (perDay[day] > 0) {
+            cout << DateStruct::fromDayNumber(from.dayNumber
+                + static_cast<int32_t>(day)).getDateString() << ": "
+                << perDay[day] << "번" << endl;
+        }
+    }
 }
 
 void BookService::route() {
@@ -647,12 +384,12 @@ void BookService::route() {
 
     while (!isEnd) {
         displayMainMode();
-        int mainMode = getInputInteger(1, 6);
+        int mainMode = getInputInteger(1, 8);
 
         switch (MainMode(mainMode)) {
         case BOOK_SEARCH: {
             displayBookSearchMode();
-            int bookSearchMode = getInputInteger(1, 3);
+            int bookSearchMode = getInputInteger(1, 4);
 
             switch (BookSearchMode(bookSearchMode)) {
             case ALL_BOOKS:
@@ -664,6 +401,9 @@ void BookService::route() {
             case AUTHOR:
                 displayBookSearchAuthor();
                 break;
+            case KEYWORD:
+                displayBookSearchKeyword();
+                break;
             }
             break;
         }
@@ -696,49 +436,506 @@ void BookService::route() {
         case PROGRAM_END:
             isEnd = true;
             break;
+        case METRICS:
+            displayMetrics();
+            break;
+        case HISTORY_REPORT:
+            displayHistoryReport();
+            break;
         }
     }
 }
 
-int main() {
+struct BatchReport {
+    CommandCounts counts;
+    bool isDurable;
+    double seconds;
+
+    double getCommandsPerSecond() const {
+        return seconds > 0 ? counts.commands / seconds : 0;
+    }
+};
+
+// 한 줄에 명령 하나인 스크립트(CommandExecutor의 명령)를 프롬프트 없이 실행하고
+// 명령마다 결과를 한 줄씩 씀. 빈 줄과 #로 시작하는 줄은 건너뜀.
+// 명령은 GROUP_SIZE개씩 묶어 실행하고, 로그가 있으면 한 묶음의 변경이 디스크에
+// 내려간 뒤에 그 묶음의 결과를 씀. 한 묶음이 내려가는 동안 다음 묶음을 실행
+class BatchRunner {
+private:
+    static constexpr size_t CHUNK_SIZE = 1 << 20;
+    static constexpr size_t GROUP_SIZE = 4096;
+
+    CommandExecutor executor;
+    shared_ptr<MutationLog> mutationLog;
+
+public:
+    BatchRunner(BookManager& bookManager, RentalManager& rentalManager,
+        shared_ptr<MutationLog> mutationLog)
+        : executor(bookManager, rentalManager),
+        mutationLog{ move(mutationLog) } {
+    }
 
-    BookManager bookManager;
-    RentalManager rentalManager;
+    BatchReport run(istream& input, ostream& output);
+};
+
+BatchReport BatchRunner::run(istream& input, ostream& output) {
+    auto start = chrono::steady_clock::now();
+    BatchReport report{};
+    report.isDurable = true;
+
+    // 실행 중인 묶음의 결과와, 디스크에 내려가기를 기다리는 앞 묶음의 결과
+    string results;
+    string committingResults;
+    uint64_t committingTicket = 0;
+    size_t groupCommands = 0;
+    optional<MutationLog::DeferredCommits> deferredCommits;
+    deferredCommits.emplace();
+
+    auto writeCommitted = [&] {
+        if (mutationLog && !mutationLog->waitCommitted(committingTicket)) {
+            report.isDurable = false;
+        }
+        output.write(committingResults.data(), committingResults.size());
+        committingResults.clear();
+    };
+    auto finishGroup = [&] {
+        deferredCommits.reset();
+        uint64_t ticket = mutationLog ? mutationLog->requestCommit() : 0;
+        writeCommitted();
+        committingResults.swap(results);
+        committingTicket = ticket;
+        groupCommands = 0;
+        deferredCommits.emplace();
+    };
+
+    string buffer;
+    size_t pos = 0;
+    size_t lineNumber = 0;
+    bool isEnd = false;
+    while (!isEnd) {
+        // 처리한 부분을 버리고 남은 조각 뒤에 다음 청크를 이어 붙임
+        buffer.erase(0, pos);
+        pos = 0;
+        size_t filled = buffer.size();
+        buffer.resize(filled + CHUNK_SIZE);
+        input.read(buffer.data() + filled, CHUNK_SIZE);
+        buffer.resize(filled + static_cast<size_t>(input.gcount()));
+        isEnd = !input;
+
+        while (pos < buffer.size()) {
+            size_t newline = buffer.find('\n', pos);
+            if (newline == string::npos && !isEnd) {
+                break;
+            }
+            size_t lineEnd = min(newline, buffer.size());
+            string_view line(buffer.data() + pos, lineEnd - pos);
+            pos = lineEnd + 1;
+            lineNumber++;
+
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+            if (line.empty() || line.front() == '#') {
+                continue;
+            }
+            executor.execute(line, lineNumber, results);
+            if (++groupCommands == GROUP_SIZE) {
+                finishGroup();
+            }
+        }
+    }
+    finishGroup();
+    writeCommitted();
+    output.flush();
+    deferredCommits.reset();
+
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    report.counts = executor.getCounts();
+    report.seconds = elapsed.count();
+    return report;
+}
+
+// 처음 실행할 때 넣는 예시 도서와 대여정보
+void addSampleData(BookManager& bookManager, RentalManager& rentalManager) {
+    addBookAndPrint(bookManager, "책1", "이승현");
+    addBookAndPrint(bookManager, "책1", "이승현");
+    addBookAndPrint(bookManager, "책1", "이승현");
+    addBookAndPrint(bookManager, "책2", "이승현");
+    addBookAndPrint(bookManager, "책2", "이승현");
+    addBookAndPrint(bookManager, "책3", "승현");
+    addBookAndPrint(bookManager, "책3", "승현");
+    addBookAndPrint(bookManager, "책3", "승현");
+    addBookAndPrint(bookManager, "책3", "승현");
+    addBookAndPrint(bookManager, "책4", "승현");
+    addBookAndPrint(bookManager, "책4", "승현");
+
+    auto rentById = [&](int bookId, RentalDTO rentalDTO) {
+        shared_ptr<RentalInfo> rentalInfo;
+        printRentalReceipt(rentalManager.rentById(bookId, rentalDTO,
+            bookManager, &rentalInfo), rentalInfo);
+    };
+    auto rentByTitle = [&](string_view title, RentalDTO rentalDTO) {
+        shared_ptr<RentalInfo> rentalInfo;
+        printRentalReceipt(rentalManager.rentByTitle(title, rentalDTO,
+            bookManager, &rentalInfo), rentalInfo);
+    };
+
+    rentById(1, RentalDTO("철수", "01012345678", DateStruct(2025, 1, 7)));
+    rentById(2, RentalDTO("철수", "01012345678", DateStruct(2025, 1, 7)));
+    rentById(2, RentalDTO("철수", "01012345678", DateStruct(2025, 1, 7)));
+    rentByTitle("책1", RentalDTO("영희", "01056781234", DateStruct(2025, 1, 6)));
+    rentByTitle("책1", RentalDTO("영희", "01056781234", DateStruct(2025, 1, 6)));
+    rentByTitle("책3", RentalDTO("영희", "01056781234", DateStruct(2025, 1, 6)));
+}
+
+// 작업 통계와 색인 크기를 Prometheus 텍스트 형식으로 파일에 씀. 수집기가
+// 쓰다 만 파일을 읽지 않도록 임시 파일에 쓰고 이름을 바꿈
+bool writeMetricsFile(const string& path, const BookManager& bookManager,
+    const RentalManager& rentalManager) {
+    vector<MetricGauge> gauges;
+    bookManager.appendGauges(gauges);
+    rentalManager.appendGauges(gauges);
+    string text = EngineMetrics::exportText(gauges);
+
+    string temporaryPath = path + ".tmp";
+    {
+        ofstream file(temporaryPath, ios::binary | ios::trunc);
+        if (!file.write(text.data(), text.size())) {
+            return false;
+        }
+    }
+    error_code error;
+    filesystem::rename(temporaryPath, path, error);
+    return !error;
+}
+
+// 프로그램이 도는 동안 INTERVAL마다 통계 파일을 새로 씀. 없어질 때 한 번 더 씀
+class MetricsFileWriter {
+private:
+    static constexpr auto INTERVAL = chrono::seconds(1);
+
+    string path;
+    const BookManager& bookManager;
+    const RentalManager& rentalManager;
+    mutex stopMutex;
+    condition_variable stopCondition;
+    bool isStopping = false;
+    thread writer;
+
+public:
+    MetricsFileWriter(string path, const BookManager& bookManager,
+        const RentalManager& rentalManager)
+        : path{ move(path) }, bookManager{ bookManager },
+        rentalManager{ rentalManager } {
+        writer = thread([this] {
+            unique_lock lock(stopMutex);
+            while (!stopCondition.wait_for(lock, INTERVAL,
+                [this] { return isStopping; })) {
+                writeMetricsFile(this->path, this->bookManager,
+                    this->rentalManager);
+            }
+        });
+    }
+
+    ~MetricsFileWriter() {
+        {
+            lock_guard lock(stopMutex);
+            isStopping = true;
+        }
+        stopCondition.notify_one();
+        writer.join();
+        writeMetricsFile(path, bookManager, rentalManager);
+    }
+};
+
+// Ctrl+C나 SIGTERM을 받으면 서버를 멈추고 스냅샷 저장까지 마친 뒤 끝냄
+atomic<BookServer*> runningServer{ nullptr };
+
+void stopRunningServer(int) {
+    if (BookServer* server = runningServer.load()) {
+        server->stop();
+    }
+}
+
+int main(int argc, char* argv[]) {
+    // --snapshot=경로: 시작할 때 스냅샷이 있으면 불러오고, 끝낼 때 저장.
+    // --wal=경로: 로그를 다시 적용해 지난 상태를 복구하고 이후 변경을 기록.
+    // 스냅샷이 있으면 스냅샷 이후의 로그만 적용.
+    // --wal-async를 주면 commit을 기다리지 않음.
+    // --batch=경로: 화면 대신 명령 스크립트를 실행(-는 표준 입력)하고 결과를
+    // 표준 출력에 씀. 안내 문구는 표준 에러로 보냄.
+    // --listen=호스트:포트|unix:경로: 화면 대신 네트워크로 명령을 받음.
+    // --listen-threads=N: 서버의 이벤트 루프 수.
+    // --metrics=경로: 작업 통계와 색인 크기를 1초마다 파일에 씀.
+    // --history=경로: 반납까지 끝난 대여 기록을 시작할 때 불러오고 끝낼 때
+    // 저장. 로그와 스냅샷에는 기록이 들어가지 않음.
+    // --loan-limit=N: 한 사람(이름과 전화번호)이 동시에 빌릴 수 있는 권수.
+    // 복구한 대여에는 적용하지 않음.
+    // --events=경로|-: 책 추가, 대여, 반납과 거절을 한 줄씩 이벤트 로그로 씀.
+    // 기록은 백그라운드 스레드가 하므로 작업은 기다리지 않음.
+    // --event-level=error|warning|info|debug: 남길 이벤트의 수준. 기본 info.
+    // --event-overflow=drop|block: 버퍼가 차면 버릴지 기다릴지. 기본 drop
+    string snapshotPath;
+    string eventsPath;
+    string historyPath;
+    string metricsPath;
+    string walPath;
+    string batchPath;
+    string listenAddress;
+    int listenThreads = 1;
+    uint32_t loanLimit = 0;
+    EventLevel eventLevel = EventLevel::INFO;
+    OverflowPolicy overflowPolicy = OverflowPolicy::DROP;
+    DurabilityMode durabilityMode = DurabilityMode::SYNC;
+    for (int i = 1; i < argc; i++) {
+        string_view arg = argv[i];
+        if (arg.starts_with("--snapshot=")) {
+            snapshotPath = arg.substr(11);
+        }
+        else if (arg.starts_with("--batch=")) {
+            batchPath = arg.substr(8);
+        }
+        else if (arg.starts_with("--metrics=")) {
+            metricsPath = arg.substr(10);
+        }
+        else if (arg.starts_with("--history=")) {
+            historyPath = arg.substr(10);
+        }
+        else if (arg.starts_with("--loan-limit=")) {
+            loanLimit = static_cast<uint32_t>(stoul(string(arg.substr(13))));
+        }
+        else if (arg.starts_with("--listen=")) {
+            listenAddress = arg.substr(9);
+        }
+        else if (arg.starts_with("--listen-threads=")) {
+            listenThreads = max(stoi(string(arg.substr(17))), 1);
+        }
+        else if (arg.starts_with("--wal=")) {
+            walPath = arg.substr(6);
+        }
+        else if (arg == "--wal-async") {
+            durabilityMode = DurabilityMode::ASYNC;
+        }
+        else if (arg.starts_with("--events=")) {
+            eventsPath = arg.substr(9);
+        }
+        else if (arg.starts_with("--event-level=")) {
+            string_view name = arg.substr(14);
+            for (auto level : { EventLevel::ERROR, EventLevel::WARNING,
+                EventLevel::INFO, EventLevel::DEBUG }) {
+                if (name == getEventLevelName(level)) {
+                    eventLevel = level;
+                }
+            }
+        }
+        else if (arg == "--event-overflow=block") {
+            overflowPolicy = OverflowPolicy::BLOCK;
+        }
+        else if (arg == "--event-overflow=drop") {
+            overflowPolicy = OverflowPolicy::DROP;
+        }
+    }
+
+    ostream batchOutput(cout.rdbuf());
+    if (!batchPath.empty()) {
+        cout.rdbuf(cerr.rdbuf());
+    }
+
+    auto loadStart = chrono::steady_clock::now();
+    shared_ptr<const CatalogSnapshot> snapshot;
+    if (!snapshotPath.empty() && filesystem::exists(snapshotPath)) {
+        snapshot = CatalogSnapshot::open(snapshotPath);
+        if (!snapshot) {
+            cout << "스냅샷을 읽을 수 없음: " << snapshotPath << endl;
+            return 1;
+        }
+    }
+
+    // 제목, 작가, 대여자 이름을 한 곳에 한 번만 저장.
+    // 스냅샷의 문자열은 매핑한 파일에서 바로 씀
+    auto stringPool = make_shared<StringPool>(snapshot);
+    BookManager bookManager(stringPool);
+    RentalManager rentalManager(stringPool);
     BookService bookService(bookManager, rentalManager);
 
-    bookManager.addBook("책1", "이승현");
-    bookManager.addBook("책1", "이승현");
-    bookManager.addBook("책1", "이승현");
-    bookManager.addBook("책2", "이승현");
-    bookManager.addBook("책2", "이승현");
-    bookManager.addBook("책3", "승현");
-    bookManager.addBook("책3", "승현");
-    bookManager.addBook("책3", "승현");
-    bookManager.addBook("책3", "승현");
-    bookManager.addBook("책4", "승현");
-    bookManager.addBook("책4", "승현");
-
-    rentalManager.rentalBookById(
-        1, RentalDTO("철수", "01012345678", DateStruct(2025, 1, 7)),
-        bookManager);
-    rentalManager.rentalBookById(
-        2, RentalDTO("철수", "01012345678", DateStruct(2025, 1, 7)),
-        bookManager);
-    rentalManager.rentalBookById(
-        2, RentalDTO("철수", "01012345678", DateStruct(2025, 1, 7)),
-        bookManager);
-    rentalManager.rentalBookByTitle(
-        "책1", RentalDTO("영희", "01056781234", DateStruct(2025, 1, 6)),
-        bookManager);
-    rentalManager.rentalBookByTitle(
-        "책1", RentalDTO("영희", "01056781234", DateStruct(2025, 1, 6)),
-        bookManager);
-    rentalManager.rentalBookByTitle(
-        "책3", RentalDTO("영희", "01056781234", DateStruct(2025, 1, 6)),
-        bookManager);
-
-    bookService.route();
+    if (!historyPath.empty() && filesystem::exists(historyPath)) {
+        if (!rentalManager.loadHistory(historyPath)) {
+            cout << "대여 기록을 읽을 수 없음: " << historyPath << endl;
+            return 1;
+        }
+        cout << "----대여 기록 적재 완료: "
+            << rentalManager.getHistory().size() << "건----" << endl;
+    }
+
+    bool isRecovered = false;
+    if (snapshot) {
+        if (!bookManager.loadSnapshot(snapshot)
+            || !rentalManager.loadSnapshot(*snapshot, bookManager)) {
+            cout << "스냅샷을 읽을 수 없음: " << snapshotPath << endl;
+            return 1;
+        }
+        chrono::duration<double> elapsed =
+            chrono::steady_clock::now() - loadStart;
+        cout << "----스냅샷 적재 완료----" << endl;
+        cout << "책: " << bookManager.getBookCount() << "권, 대여: "
+            << rentalManager.getRentalCount() << "건, " << elapsed.count()
+            << "초" << endl;
+        isRecovered = true;
+    }
+
+    shared_ptr<MutationLog> mutationLog;
+    if (!walPath.empty()) {
+        ReplayReport report = MutationLog::replay(walPath, bookManager,
+            rentalManager, snapshot ? snapshot->getWalOffset() : 0);
+        cout << "----로그 복구 완료----" << endl;
+        cout << "이벤트: " << report.events << "건, 잘라낸 끝: "
+            << report.truncatedBytes << "바이트, " << report.seconds << "초"
+            << endl;
+        isRecovered = isRecovered || report.events > 0;
+
+        mutationLog = make_shared<MutationLog>(walPath, durabilityMode);
+        if (!mutationLog->isOpen()) {
+            cout << "로그 파일을 열 수 없음: " << walPath << endl;
+            return 1;
+        }
+        bookManager.attachLog(mutationLog);
+        rentalManager.attachLog(mutationLog);
+    }
+
+    // 복구한 책과 대여는 이벤트로 남기지 않음
+    shared_ptr<EventLog> eventLog;
+    if (!eventsPath.empty()) {
+        eventLog = make_shared<EventLog>(eventsPath, eventLevel,
+            overflowPolicy);
+        if (!eventLog->isOpen()) {
+            cout << "이벤트 로그 파일을 열 수 없음: " << eventsPath << endl;
+            return 1;
+        }
+        bookManager.attachEventLog(eventLog);
+        rentalManager.attachEventLog(eventLog);
+        if (mutationLog) {
+            mutationLog->attachEventLog(eventLog);
+        }
+    }
+
+    // 실행 인자: [--snapshot=경로] [--wal=경로] [--wal-async] [--batch=경로]
+    //           [--listen=주소] [--listen-threads=N] [--metrics=경로]
+    //           [--history=경로] [--loan-limit=N] [--events=경로|-]
+    //           [--event-level=수준] [--event-overflow=drop|block]
+    //           [--format=text|tsv|json] [도서 목록 파일(CSV/TSV)]
+    for (int i = 1; i < argc; i++) {
+        string_view arg = argv[i];
+
+        if (arg.starts_with("--snapshot=") || arg.starts_with("--wal")
+            || arg.starts_with("--batch=") || arg.starts_with("--listen")
+            || arg.starts_with("--metrics=") || arg.starts_with("--history=")
+            || arg.starts_with("--loan-limit=")
+            || arg.starts_with("--event")) {
+            continue;
+        }
+        else if (arg == "--format=tsv") {
+            bookService.setRenderFormat(RenderFormat::TSV);
+        }
+        else if (arg == "--format=json") {
+            bookService.setRenderFormat(RenderFormat::JSON);
+        }
+        else if (arg == "--format=text") {
+            bookService.setRenderFormat(RenderFormat::TEXT);
+        }
+        else {
+            // 도서 목록 파일을 주면 먼저 대량 등록
+            ImportReport report = bookManager.importBooks(argv[i]);
+            if (!report.isFileOpened) {
+                cout << "파일을 열 수 없음: " << argv[i] << endl;
+            }
+            cout << "----도서 목록 적재 완료----" << endl;
+            cout << "등록: " << report.rows << "권, 건너뜀: "
+                << report.skipped << "줄, " << report.seconds << "초 ("
+                << static_cast<size_t>(report.getRowsPerSecond())
+                << " rows/s)" << endl;
+        }
+    }
+
+    rentalManager.setLoanLimit(loanLimit);
+
+    optional<MetricsFileWriter> metricsWriter;
+    if (!metricsPath.empty()) {
+        metricsWriter.emplace(metricsPath, bookManager, rentalManager);
+    }
+
+    if (!batchPath.empty()) {
+        ifstream batchFile;
+        if (batchPath != "-") {
+            batchFile.open(batchPath, ios::binary);
+            if (!batchFile) {
+                cout << "명령 파일을 열 수 없음: " << batchPath << endl;
+                return 1;
+            }
+        }
+        BatchRunner batchRunner(bookManager, rentalManager, mutationLog);
+        BatchReport report = batchRunner.run(
+            batchPath == "-" ? cin : batchFile, batchOutput);
+        cout << "----일괄 처리 완료----" << endl;
+        const CommandCounts& counts = report.counts;
+        cout << "명령: " << counts.commands << "건 (성공 " << counts.succeeded
+            << ", 거절 " << counts.rejected << ", 잘못된 줄 " << counts.invalid
+            << "), " << report.seconds << "초 ("
+            << static_cast<size_t>(report.getCommandsPerSecond())
+            << " commands/s)" << endl;
+        if (!report.isDurable) {
+            cout << "로그 기록 실패. 일부 변경이 디스크에 남지 않았을 수 있음"
+                << endl;
+        }
+    }
+    else if (!listenAddress.empty()) {
+        BookServer server(bookManager, rentalManager, mutationLog);
+        string error;
+        if (!server.listen(listenAddress, error)) {
+            cout << error << endl;
+            return 1;
+        }
+        cout << "----서버 시작: " << listenAddress << " (포트 "
+            << server.getPort() << ", 이벤트 루프 " << listenThreads
+            << "개)----" << endl;
+        runningServer = &server;
+        signal(SIGINT, stopRunningServer);
+        signal(SIGTERM, stopRunningServer);
+        server.run(listenThreads);
+        runningServer = nullptr;
+
+        ServerStats stats = server.getStats();
+        cout << "----서버 종료----" << endl;
+        cout << "연결: " << stats.acceptedConnections << "개, 요청: "
+            << stats.requests << "건" << endl;
+    }
+    else {
+        // 복구했으면 예시 데이터는 이미 들어 있음
+        if (!isRecovered) {
+            addSampleData(bookManager, rentalManager);
+        }
+        bookService.route();
+    }
+
+    // 끝낼 때 지금 상태를 스냅샷으로 남김. 로그는 여기까지 반영된 것으로 기록
+    if (!snapshotPath.empty()) {
+        uint64_t walOffset = mutationLog ? mutationLog->checkpoint() : 0;
+        if (CatalogSnapshot::write(snapshotPath, bookManager, rentalManager,
+            walOffset)) {
+            cout << "스냅샷 저장 완료: " << snapshotPath << endl;
+        }
+        else {
+            cout << "스냅샷 저장 실패: " << snapshotPath << endl;
+        }
+    }
+
+    if (!historyPath.empty()) {
+        if (rentalManager.saveHistory(historyPath)) {
+            cout << "대여 기록 저장 완료: " << historyPath << endl;
+        }
+        else {
+            cout << "대여 기록 저장 실패: " << historyPath << endl;
+        }
+    }
 
     return 0;
 }
-